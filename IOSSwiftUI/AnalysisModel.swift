@@ -0,0 +1,179 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+import BackgroundTasks
+import Foundation
+import Observation
+import UIKit
+
+// Long analysis of one position that survives backgrounding. Going to the
+// background stops the search, saves an SFAnalysisCheckpoint, and schedules a
+// BGProcessingTask; the task, or the next return to the foreground, resumes
+// from the checkpoint. Only one analysis exists, so the app and the task
+// handler share it.
+@MainActor
+@Observable
+final class AnalysisModel {
+    static let shared = AnalysisModel()
+    // Also listed under BGTaskSchedulerPermittedIdentifiers in Info.plist.
+    static let processingTaskIdentifier = "com.stockfish.SFEngineTestSwiftUI.analysis"
+
+    // Whether a search is running now.
+    private(set) var isAnalyzing = false
+    // Best line so far, for the UI.
+    private(set) var summary = "No analysis"
+
+    private var engine: SFEngine?
+    private var ticket: UInt64 = 0
+    // Runs once the search has ended and its checkpoint is saved.
+    private var onPaused: (() -> Void)?
+    private var processingTask: BGProcessingTask?
+
+    private let checkpointURL = URL.applicationSupportDirectory.appending(path: "analysis.checkpoint")
+
+    // Registers the task handler; call before the app finishes launching.
+    static func registerProcessingTask() {
+        BGTaskScheduler.shared.register(forTaskWithIdentifier: processingTaskIdentifier, using: .main) { task in
+            MainActor.assumeIsolated {
+                guard let task = task as? BGProcessingTask else { return }
+                AnalysisModel.shared.run(task)
+            }
+        }
+    }
+
+    // Analyses 1. e4 e5, or continues the saved analysis.
+    func start() {
+        guard !isAnalyzing else { return }
+        resume(from: loadCheckpoint() ?? SFAnalysisCheckpoint(fen: nil, moves: ["e2e4", "e7e5"]))
+    }
+
+    // Ends the analysis and discards its checkpoint.
+    func stop() {
+        pause { [weak self] in
+            guard let self else { return }
+            try? FileManager.default.removeItem(at: checkpointURL)
+            summary = "No analysis"
+        }
+    }
+
+    // Scene moved to the background: checkpoint and ask for processing time.
+    func suspend() {
+        guard isAnalyzing, processingTask == nil else { return }
+        let task = UIApplication.shared.beginBackgroundTask(withName: "Analysis checkpoint")
+        pause { [weak self] in
+            self?.scheduleProcessingTask()
+            UIApplication.shared.endBackgroundTask(task)
+        }
+    }
+
+    // Scene is active again. An analysis the processing task was running just
+    // carries on in the foreground.
+    func resumeIfPaused() {
+        if let task = processingTask {
+            processingTask = nil
+            task.setTaskCompleted(success: true)
+        }
+        guard !isAnalyzing, let checkpoint = loadCheckpoint() else { return }
+        resume(from: checkpoint)
+    }
+
+    private func run(_ task: BGProcessingTask) {
+        guard !isAnalyzing, let checkpoint = loadCheckpoint() else {
+            task.setTaskCompleted(success: true)
+            return
+        }
+
+        processingTask = task
+        task.expirationHandler = {
+            Task { @MainActor in
+                AnalysisModel.shared.expireProcessingTask()
+            }
+        }
+        resume(from: checkpoint)
+    }
+
+    private func expireProcessingTask() {
+        guard let task = processingTask else { return }
+        processingTask = nil
+        pause { [weak self] in
+            self?.scheduleProcessingTask()
+            task.setTaskCompleted(success: true)
+        }
+    }
+
+    private func resume(from checkpoint: SFAnalysisCheckpoint) {
+        let engine = SFEngine()
+        engine.start()
+        self.engine = engine
+        isAnalyzing = true
+        if let best = checkpoint.rootMoves.first {
+            show(best)
+        }
+
+        ticket = engine.resumeAnalysis(from: checkpoint, infoHandler: { [weak self] info in
+            DispatchQueue.main.async { [weak self] in
+                self?.show(info)
+            }
+        }, completion: { [weak self] reached, _ in
+            DispatchQueue.main.async { [weak self] in
+                self?.finish(reached)
+            }
+        })
+    }
+
+    // Cancelling the ticket ends the search; finish() then saves and calls `done`.
+    private func pause(then done: @escaping () -> Void) {
+        guard isAnalyzing, let engine else {
+            done()
+            return
+        }
+        onPaused = done
+        engine.cancelSearch(ticket)
+    }
+
+    private func finish(_ reached: SFAnalysisCheckpoint?) {
+        if let reached {
+            try? FileManager.default.createDirectory(
+                at: checkpointURL.deletingLastPathComponent(), withIntermediateDirectories: true)
+            try? reached.dataRepresentation.write(to: checkpointURL, options: .atomic)
+        }
+        isAnalyzing = false
+
+        // Stop the engine off the main thread to avoid blocking UI updates.
+        if let engineToStop = engine {
+            DispatchQueue.global(qos: .userInitiated).async {
+                engineToStop.stop()
+            }
+        }
+        engine = nil
+
+        let done = onPaused
+        onPaused = nil
+        done?()
+    }
+
+    private func scheduleProcessingTask() {
+        let request = BGProcessingTaskRequest(identifier: Self.processingTaskIdentifier)
+        request.requiresExternalPower = false
+        request.requiresNetworkConnectivity = false
+        try? BGTaskScheduler.shared.submit(request)
+    }
+
+    private func loadCheckpoint() -> SFAnalysisCheckpoint? {
+        guard let data = try? Data(contentsOf: checkpointURL) else { return nil }
+        return try? SFAnalysisCheckpoint(data: data)
+    }
+
+    private func show(_ info: SFSearchInfo) {
+        let score = info.scoreType == .mate ? "mate \(info.scoreValue)" : "cp \(info.scoreValue)"
+        let line = info.pv.prefix(8).joined(separator: " ")
+        summary = "depth \(info.depth) \(score) \(line)"
+    }
+}
@@ -14,6 +14,8 @@ import SwiftUI
 struct ContentView: View {
     // Observable model that owns the engine and log output.
     @State private var model = EngineModel()
+    // Long analysis that survives backgrounding.
+    @State private var analysis = AnalysisModel.shared
     // When enabled, the log view scrolls to the newest line as output arrives.
     @State private var autoScroll = true
 
@@ -69,6 +71,33 @@ struct ContentView: View {
                     .accessibilityValue(model.status)
                 }
 
+                // Infinite analysis, checkpointed when the app is backgrounded.
+                HStack(spacing: 12) {
+                    Button {
+                        analysis.start()
+                    } label: {
+                        Text("Analyse")
+                    }
+                    .font(.body)
+                    .buttonStyle(.bordered)
+                    .disabled(analysis.isAnalyzing)
+                    .controlSize(.regular)
+
+                    Button {
+                        analysis.stop()
+                    } label: {
+                        Text("End")
+                    }
+                    .font(.body)
+                    .buttonStyle(.bordered)
+                    .controlSize(.regular)
+
+                    Text(analysis.summary)
+                        .font(.system(.footnote, design: .monospaced))
+                        .foregroundStyle(.secondary)
+                        .lineLimit(2)
+                }
+
                 Toggle("Auto-scroll", isOn: $autoScroll)
                     .toggleStyle(.switch)
 
@@ -10,12 +10,29 @@
 
 import SwiftUI
 
-// App entry point that hosts the smoke test UI.
+// App entry point that hosts the smoke test UI and checkpoints the long
+// analysis when the scene leaves the foreground.
 @main
 struct SFEngineTestSwiftUIApp: App {
+    @Environment(\.scenePhase) private var scenePhase
+
+    init() {
+        AnalysisModel.registerProcessingTask()
+    }
+
     var body: some Scene {
         WindowGroup {
             ContentView()
         }
+        .onChange(of: scenePhase) { _, phase in
+            switch phase {
+            case .background:
+                AnalysisModel.shared.suspend()
+            case .active:
+                AnalysisModel.shared.resumeIfPaused()
+            default:
+                break
+            }
+        }
     }
 }
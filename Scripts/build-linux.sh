@@ -0,0 +1,101 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Builds the embedded engine for Linux hosts: a static library of the vendored
+# Stockfish sources, the EmbeddedUCI wrapper and its C API (SFEngineC.h), plus
+# the C smoke test, which it then runs.
+#
+# - Stockfish's sources are the vendored Makefile's SRCS without main.cpp.
+# - SIMD settings follow the Xcode targets: SSE4.1 with POPCNT on x86_64, NEON
+#   with dot product on aarch64.
+# - The NNUE network is embedded from Resources/NNUE as in the Apple builds.
+#
+# On Linux, Stockfish keeps each network in shared memory (shm_linux.h), one
+# copy per NUMA node, so every engine in the process, and in other processes
+# of the same build, uses the copy local to its threads.
+#
+# Everything is written under build/linux. CXX, CC and JOBS override the
+# compilers and the parallel job count.
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO_ROOT="$(cd "$SCRIPT_DIR/.." && pwd)"
+OUT_DIR="$REPO_ROOT/build/linux"
+SF_SRC="$REPO_ROOT/ThirdParty/Stockfish/src"
+WRAPPER_SRC="$REPO_ROOT/Sources/SFEngine"
+CXX="${CXX:-c++}"
+CC="${CC:-cc}"
+JOBS="${JOBS:-$(nproc)}"
+
+if [[ $# -gt 0 ]]; then
+  echo "Usage: $0" >&2
+  exit 64
+fi
+
+if [[ "$(uname -s)" != Linux ]]; then
+  echo "$0 builds for Linux; use the Xcode project on Apple platforms." >&2
+  exit 1
+fi
+
+cd "$REPO_ROOT"
+Scripts/download-nnue.sh
+
+case "$(uname -m)" in
+  x86_64)
+    ARCH_FLAGS=(-DUSE_POPCNT -DUSE_SSE2 -DUSE_SSSE3 -DUSE_SSE41 -msse4.1 -mpopcnt)
+    ;;
+  aarch64)
+    ARCH_FLAGS=(-DUSE_POPCNT -DUSE_NEON=8 -DUSE_NEON_DOTPROD -march=armv8.2-a+dotprod)
+    ;;
+  *)
+    echo "Unsupported architecture: $(uname -m)" >&2
+    exit 1
+    ;;
+esac
+
+CXXFLAGS=(
+  -std=gnu++17 -O3 -DNDEBUG -DIS_64BIT -DUSE_PTHREADS -fno-exceptions -pthread
+  "${ARCH_FLAGS[@]}"
+  -I"$SF_SRC" -I"$WRAPPER_SRC"
+  -Wa,-I"$REPO_ROOT/Resources/NNUE"
+)
+
+read -r -a SF_SOURCES <<< "$(printf 'sfembedded-sources:\n\t@echo $(SRCS)\n' \
+  | make -s -C "$SF_SRC" -f Makefile -f - sfembedded-sources)"
+
+rm -rf "$OUT_DIR"
+mkdir -p "$OUT_DIR/obj"
+
+sources=()
+for source in "${SF_SOURCES[@]}"; do
+  [[ "$source" == main.cpp ]] || sources+=("$SF_SRC/$source")
+done
+sources+=("$WRAPPER_SRC/EmbeddedUCI.cpp" "$WRAPPER_SRC/SFEngineC.cpp")
+
+# Objects are named after their path, as nnue/ and syzygy/ reuse file names.
+compile() {
+  local source="$1"
+  local object="${source#"$REPO_ROOT"/}"
+  "$CXX" "${CXXFLAGS[@]}" -c "$source" -o "$OUT_DIR/obj/${object//\//_}.o"
+}
+
+for source in "${sources[@]}"; do
+  if (( $(jobs -rp | wc -l) >= JOBS )); then
+    wait -n || true
+  fi
+  { compile "$source" || touch "$OUT_DIR/failed"; } &
+done
+wait
+if [[ -e "$OUT_DIR/failed" ]]; then
+  echo "Compilation failed" >&2
+  exit 1
+fi
+
+ar rcs "$OUT_DIR/libSFEngine-linux.a" "$OUT_DIR"/obj/*.o
+
+"$CC" -std=c11 -O2 -Wall -Wextra -pthread -I"$WRAPPER_SRC" \
+  "$REPO_ROOT/Sources/CLIC/main.c" "$OUT_DIR/libSFEngine-linux.a" \
+  -lstdc++ -lm -o "$OUT_DIR/SFEngineCLITestC"
+"$OUT_DIR/SFEngineCLITestC"
+
+echo "Library: $OUT_DIR/libSFEngine-linux.a"
+echo "Header: $WRAPPER_SRC/SFEngineC.h"
@@ -0,0 +1,81 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Builds the SFEngine static libraries with profile-guided optimization and
+# ThinLTO, like upstream's `make profile-build`, and compares bench NPS
+# against a plain Release build.
+#
+# 1. Release bench (testBenchReportAsJSON) for the baseline NPS.
+# 2. Instrumented Release bench, whose profiles are merged into a .profdata.
+# 3. Release bench with the profile and ThinLTO applied.
+# 4. libSFEngine-macOS.a and libSFEngine-iOS.a built with the same settings.
+#
+# The profile comes from a macOS arm64 run through the wrapper and is applied
+# to both libraries. Everything is written under build/pgo.
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO_ROOT="$(cd "$SCRIPT_DIR/.." && pwd)"
+OUT_DIR="$REPO_ROOT/build/pgo"
+PROFDATA="$OUT_DIR/SFEngine.profdata"
+BENCH_TEST="SFEngineTests/SFEngineBridgeBenchmarkTests/testBenchReportAsJSON"
+
+if [[ $# -gt 0 ]]; then
+  echo "Usage: $0" >&2
+  exit 64
+fi
+
+cd "$REPO_ROOT"
+Scripts/download-nnue.sh
+
+rm -rf "$OUT_DIR"
+mkdir -p "$OUT_DIR/profraw"
+
+# Runs the bench test in Release with extra build settings and writes its
+# JSON report to $1.
+run_bench() {
+  local report="$1"
+  shift
+  TEST_RUNNER_SF_BENCH_JSON="$report" \
+  TEST_RUNNER_LLVM_PROFILE_FILE="$OUT_DIR/profraw/sfengine-%p.profraw" \
+  xcodebuild \
+    -project StockfishEmbedded.xcodeproj \
+    -scheme SFEngineTests \
+    -configuration Release \
+    -destination 'platform=macOS,arch=arm64' \
+    -derivedDataPath "$OUT_DIR/$(basename "$report" .json)" \
+    -only-testing:"$BENCH_TEST" \
+    "$@" \
+    test
+}
+
+PGO_SETTINGS=(
+  CLANG_USE_OPTIMIZATION_PROFILE=YES
+  CLANG_OPTIMIZATION_PROFILE_FILE="$PROFDATA"
+  LLVM_LTO=YES_THIN
+)
+
+run_bench "$OUT_DIR/baseline.json"
+run_bench "$OUT_DIR/instrumented.json" CLANG_INSTRUMENT_FOR_OPTIMIZATION_PROFILING=YES
+xcrun llvm-profdata merge -output="$PROFDATA" "$OUT_DIR"/profraw/*.profraw
+run_bench "$OUT_DIR/optimized.json" "${PGO_SETTINGS[@]}"
+
+for scheme in SFEngine-macOS SFEngine-iOS; do
+  destination='platform=macOS,arch=arm64'
+  [[ "$scheme" == SFEngine-iOS ]] && destination='generic/platform=iOS'
+  xcodebuild \
+    -project StockfishEmbedded.xcodeproj \
+    -scheme "$scheme" \
+    -configuration Release \
+    -destination "$destination" \
+    -derivedDataPath "$OUT_DIR/libraries" \
+    "${PGO_SETTINGS[@]}" \
+    CODE_SIGNING_ALLOWED=NO \
+    build
+done
+
+baseline_nps="$(plutil -extract nps raw "$OUT_DIR/baseline.json")"
+optimized_nps="$(plutil -extract nps raw "$OUT_DIR/optimized.json")"
+echo "Bench NPS: Release $baseline_nps, PGO + ThinLTO $optimized_nps" \
+  "($(( (optimized_nps - baseline_nps) * 100 / baseline_nps ))%)"
+echo "Profile: $PROFDATA"
+echo "Libraries: $OUT_DIR/libraries/Build/Products/Release*/libSFEngine-*.a"
@@ -0,0 +1,125 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "SFEngineC.h"
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t  finished;
+    int             sawUCIOK;
+    int             sawReadyOK;
+    int             sawLegalBestmove;
+    int             sawSearchInfo;
+    int             sawSearchResult;
+    int             searchSucceeded;
+} SmokeState;
+
+static int isLegalBestmove(const char* line) {
+    if (strncmp(line, "bestmove ", 9) != 0)
+        return 0;
+
+    const char* move = line + 9;
+    const size_t length = strcspn(move, " ");
+    if (length != 4 && !(length == 5 && strchr("nbrq", move[4])))
+        return 0;
+    for (int i = 0; i < 4; i += 2)
+        if (move[i] < 'a' || move[i] > 'h' || move[i + 1] < '1' || move[i + 1] > '8')
+            return 0;
+    return 1;
+}
+
+static void handleInfo(void* context, const sf_search_info* info) {
+    SmokeState* state = context;
+    pthread_mutex_lock(&state->mutex);
+    if (info->depth > 0 && info->pv_length > 0)
+        state->sawSearchInfo = 1;
+    pthread_mutex_unlock(&state->mutex);
+}
+
+static void handleSearchResult(void* context, const sf_search_result* result) {
+    SmokeState* state = context;
+    printf("native search: status %d, bestmove %.*s\n", (int)result->status, (int)result->bestmove_length,
+           result->bestmove);
+
+    pthread_mutex_lock(&state->mutex);
+    state->sawSearchResult = 1;
+    state->searchSucceeded = result->status == SF_SEARCH_COMPLETED && result->has_info
+                          && result->info.depth == 6 && result->bestmove_length >= 4;
+    pthread_cond_signal(&state->finished);
+    pthread_mutex_unlock(&state->mutex);
+}
+
+static void handleLine(void* context, const char* line, size_t length) {
+    SmokeState* state = context;
+    printf("%.*s\n", (int)length, line);
+
+    pthread_mutex_lock(&state->mutex);
+    if (strcmp(line, "uciok") == 0)
+        state->sawUCIOK = 1;
+    else if (strcmp(line, "readyok") == 0)
+        state->sawReadyOK = 1;
+    else if (isLegalBestmove(line)) {
+        state->sawLegalBestmove = 1;
+        pthread_cond_signal(&state->finished);
+    }
+    pthread_mutex_unlock(&state->mutex);
+}
+
+int main(void) {
+    SmokeState state = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, 0, 0, 0};
+
+    sf_engine* engine = sf_engine_create(handleLine, &state);
+    if (!engine)
+        return EXIT_FAILURE;
+
+    const sf_callbacks callbacks = {&state, handleLine, handleInfo, NULL};
+    sf_engine_set_callback(engine, &callbacks);
+    sf_engine_start(engine);
+    sf_engine_send(engine, "uci");
+    sf_engine_send(engine, "isready");
+    sf_engine_send(engine, "position startpos moves e2e4");
+    sf_engine_send(engine, "go depth 8");
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 30;
+
+    pthread_mutex_lock(&state.mutex);
+    int timedOut = 0;
+    while (!state.sawLegalBestmove && !timedOut)
+        timedOut = pthread_cond_timedwait(&state.finished, &state.mutex, &deadline) != 0;
+    pthread_mutex_unlock(&state.mutex);
+
+    const char* const      moves[] = {"e2e4", "e7e5"};
+    const sf_search_limits limits  = {.depth = 6};
+    sf_engine_search(engine, NULL, moves, 2, &limits, NULL, handleSearchResult, &state);
+
+    pthread_mutex_lock(&state.mutex);
+    while (!state.sawSearchResult && !timedOut)
+        timedOut = pthread_cond_timedwait(&state.finished, &state.mutex, &deadline) != 0;
+    const int succeeded = state.sawUCIOK && state.sawReadyOK && state.sawLegalBestmove && state.sawSearchInfo
+                       && state.searchSucceeded;
+    pthread_mutex_unlock(&state.mutex);
+
+    sf_engine_destroy(engine);
+
+    if (!succeeded) {
+        fprintf(stderr, "SFEngine C smoke test failed: expected uciok, readyok, a legal bestmove, typed search info, and a completed native search.\n");
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
@@ -32,6 +32,27 @@ import Foundation
 /// # 3) Chess960 positions and verbose engine output
 /// SFEngineCLISoakTestSwift --chess960 --log-output --iterations 50
 /// ```
+///
+/// ```
+/// # 4) Restart the engine every 10 searches and fail if RSS grows by 50 MB
+/// SFEngineCLISoakTestSwift --iterations 5000 --depth 6 --restart-every 10 --memory-sample-every 100 --max-rss-growth-mb 50
+/// ```
+///
+/// ```
+/// # 5) Capacity test: four engines at a target of 20 positions per second
+/// SFEngineCLISoakTestSwift --engines 4 --rate 20 --iterations 2000 --nodes 100000
+/// ```
+///
+/// ```
+/// # 6) Bridge round-trip latency instead of a soak run
+/// SFEngineCLISoakTestSwift --latency-samples 5000
+/// SFEngineCLISoakTestSwift --latency-samples 5000 --latency-threads 4
+/// ```
+///
+/// ```
+/// # 7) 200 self-play games, four at a time, with a changed option on the second engine
+/// SFEngineCLISoakTestSwift --self-play-games 200 --engines 4 --nodes 20000 --second-option "setoption name Threads value 2" --pgn games.pgn --packed-games games.bin
+/// ```
 @main
 @available(macOS 26.0, *)
 struct SFEngineCLISoakTestSwift: AsyncParsableCommand {
@@ -47,12 +68,12 @@ struct SFEngineCLISoakTestSwift: AsyncParsableCommand {
     // input is that at least one position is loaded (from the default files or
     // explicit paths).
 
-    /// One or more position files (one FEN/optional moves sequence per line). Defaults to
-    /// `Resources/Soak/positions.txt` when empty.
+    /// One or more position files (one FEN/optional moves sequence per line, or
+    /// packed positions in a `.bin` file). Defaults to `Resources/Soak/positions.txt` when empty.
     @Option(
         name: .long,
         parsing: .upToNextOption,
-        help: "One or more position files (one FEN with optional moves per line). Defaults to Resources/Soak/positions.txt."
+        help: "One or more position files (one FEN with optional moves per line, or packed .bin records). Defaults to Resources/Soak/positions.txt."
     )
     var positions: [String] = []
 
@@ -110,6 +131,63 @@ struct SFEngineCLISoakTestSwift: AsyncParsableCommand {
     @Flag(name: .customLong("log-output"), help: "Print all engine output lines.")
     var logOutput: Bool = false
 
+    /// If set, stops the engine and starts a new one after every N iterations.
+    @Option(name: .customLong("restart-every"), help: "Stop the engine and start a new one after every N iterations.")
+    var restartEvery: Int?
+
+    /// If set, prints process and engine memory after every N iterations.
+    @Option(name: .customLong("memory-sample-every"), help: "Sample resident and engine memory after every N iterations.")
+    var memorySampleEvery: Int?
+
+    /// If set, fails the run when resident memory grows by more than this many
+    /// megabytes from the first sample. Requires `--memory-sample-every`.
+    @Option(name: .customLong("max-rss-growth-mb"), help: "Fail when resident memory grows by more than this many MB from the first sample. Requires --memory-sample-every.")
+    var maxRSSGrowthMB: Int?
+
+    /// If set, searches on this many engines at once and reports throughput.
+    @Option(name: .long, help: "Search on this many engines at once and report throughput figures.")
+    var engines: Int?
+
+    /// If set, starts searches at this many positions per second (throughput mode).
+    @Option(name: .long, help: "Target positions per second; implies throughput mode.")
+    var rate: Double?
+
+    /// If set, measures bridge round-trip latency with this many samples per
+    /// command and handler load instead of running the soak.
+    @Option(name: .customLong("latency-samples"), help: "Measure isready and go depth 1 round-trip latency instead of soaking, with this many samples each.")
+    var latencySamples: Int?
+
+    /// `Threads` for the latency engines, to compare short-search round trips
+    /// across thread counts.
+    @Option(name: .customLong("latency-threads"), help: "Threads for --latency-samples engines (default 1).")
+    var latencyThreads: Int?
+
+    /// If set, plays this many games between two engines, with the positions
+    /// as openings, instead of running the soak. `--engines` sets how many
+    /// games run at once.
+    @Option(name: .customLong("self-play-games"), help: "Play this many self-play games from the positions as openings instead of soaking.")
+    var selfPlayGames: Int?
+
+    /// UCI commands sent to the second self-play engine only.
+    @Option(name: .customLong("second-option"), help: "UCI command sent only to the second self-play engine. Repeatable.")
+    var secondOptions: [String] = []
+
+    /// Self-play PGN output path.
+    @Option(name: .long, help: "Append self-play games to this PGN file.")
+    var pgn: String?
+
+    /// Self-play packed training record output path.
+    @Option(name: .customLong("packed-games"), help: "Append self-play positions to this file as packed training records.")
+    var packedGames: String?
+
+    /// Syzygy tablebase directory for both self-play engines.
+    @Option(name: .customLong("syzygy-path"), help: "Syzygy tablebase directory for the self-play engines.")
+    var syzygyPath: String?
+
+    /// Adjudicate self-play games from tablebase scores at this many pieces.
+    @Option(name: .customLong("tablebase-pieces"), help: "Adjudicate self-play positions with at most this many pieces from tablebase scores. Requires --syzygy-path.")
+    var tablebasePieces: Int?
+
     // MARK: - Validation
 
     mutating func validate() throws {
@@ -144,11 +222,72 @@ struct SFEngineCLISoakTestSwift: AsyncParsableCommand {
         if let delayMs, delayMs < 0 {
             throw ValidationError("--delay-ms cannot be negative.")
         }
+        if let restartEvery, restartEvery <= 0 {
+            throw ValidationError("--restart-every must be greater than zero.")
+        }
+        if let memorySampleEvery, memorySampleEvery <= 0 {
+            throw ValidationError("--memory-sample-every must be greater than zero.")
+        }
+        if let maxRSSGrowthMB {
+            if maxRSSGrowthMB < 0 {
+                throw ValidationError("--max-rss-growth-mb cannot be negative.")
+            }
+            if memorySampleEvery == nil {
+                throw ValidationError("--max-rss-growth-mb requires --memory-sample-every.")
+            }
+        }
+        if (engines != nil || rate != nil) && (restartEvery != nil || memorySampleEvery != nil) {
+            throw ValidationError("--restart-every and --memory-sample-every do not apply to --engines or --rate.")
+        }
+        if let engines, engines <= 0 {
+            throw ValidationError("--engines must be greater than zero.")
+        }
+        if let rate, !(rate > 0) {
+            throw ValidationError("--rate must be greater than zero.")
+        }
+        if (engines != nil || rate != nil) && (delayMs != nil || readyEach) {
+            throw ValidationError("--delay-ms and --ready-each do not apply to --engines or --rate.")
+        }
+        if let latencySamples, latencySamples <= 0 {
+            throw ValidationError("--latency-samples must be greater than zero.")
+        }
+        if let latencyThreads {
+            if latencySamples == nil {
+                throw ValidationError("--latency-threads requires --latency-samples.")
+            }
+            if latencyThreads <= 0 {
+                throw ValidationError("--latency-threads must be greater than zero.")
+            }
+        }
+        if let selfPlayGames {
+            if selfPlayGames <= 0 {
+                throw ValidationError("--self-play-games must be greater than zero.")
+            }
+            if rate != nil || iterations != nil || restartEvery != nil || memorySampleEvery != nil
+                || delayMs != nil || readyEach {
+                throw ValidationError("--self-play-games only combines with --engines, the search limit and the self-play options.")
+            }
+        } else if !secondOptions.isEmpty || pgn != nil || packedGames != nil || syzygyPath != nil || tablebasePieces != nil {
+            throw ValidationError("--second-option, --pgn, --packed-games, --syzygy-path and --tablebase-pieces require --self-play-games.")
+        }
+        if let tablebasePieces {
+            if tablebasePieces < 3 {
+                throw ValidationError("--tablebase-pieces must be at least 3.")
+            }
+            if syzygyPath == nil {
+                throw ValidationError("--tablebase-pieces requires --syzygy-path.")
+            }
+        }
     }
 
     // MARK: - Run
 
     mutating func run() async throws {
+        if let latencySamples {
+            try await runLatency(samples: latencySamples)
+            return
+        }
+
         // Defaults are relative to the repo root (or current working directory).
         let defaultPositionsPath = "Resources/Soak/positions.txt"
         let defaultChess960Path = "Resources/Soak/positions_chess960.txt"
@@ -185,6 +324,40 @@ struct SFEngineCLISoakTestSwift: AsyncParsableCommand {
             searchLimit = .depth(8)
         }
 
+        if let selfPlayGames {
+            var options: [String] = []
+            if let syzygyPath {
+                options.append("setoption name SyzygyPath value \(resolvePath(syzygyPath))")
+            }
+            try await runSelfPlay(.init(
+                openings: specs,
+                searchLimit: searchLimit,
+                games: selfPlayGames,
+                slots: engines ?? 1,
+                tablebasePieces: tablebasePieces,
+                chess960: chess960,
+                engineOptions: options,
+                secondEngineOptions: secondOptions,
+                perMoveTimeout: .seconds(timeout)
+            ))
+            return
+        }
+
+        if engines != nil || rate != nil {
+            try await runThroughput(.init(
+                positions: specs,
+                searchLimit: searchLimit,
+                totalPositions: iterations,
+                engines: engines ?? 1,
+                targetPositionsPerSecond: rate,
+                perMoveTimeout: .seconds(timeout),
+                stopTimeout: .seconds(stopTimeout),
+                handshakeTimeout: .seconds(handshakeTimeout),
+                engineOptions: engineOptions
+            ))
+            return
+        }
+
         let config = SFEngineSoakRunner.Configuration(
             positions: specs,
             searchLimit: searchLimit,
@@ -194,7 +367,10 @@ struct SFEngineCLISoakTestSwift: AsyncParsableCommand {
             handshakeTimeout: .seconds(handshakeTimeout),
             delayBetweenIterations: delayMs.map { .milliseconds($0) },
             readyCheckEveryIteration: readyEach,
-            engineOptions: engineOptions
+            engineOptions: engineOptions,
+            restartEngineEvery: restartEvery,
+            memorySampleEvery: memorySampleEvery,
+            maxResidentGrowthBytes: maxRSSGrowthMB.map { UInt64($0) * 1_048_576 }
         )
 
         // Run the soak test and emit log lines as events arrive.
@@ -217,6 +393,12 @@ struct SFEngineCLISoakTestSwift: AsyncParsableCommand {
                 fputs("[#\(index + 1)] timeout after \(formatDuration(elapsed))\n", stderr)
             case .error(let message):
                 fputs("error: \(message)\n", stderr)
+            case .engineRestarted(let index):
+                if logOutputEnabled {
+                    print("[#\(index)] engine restarted")
+                }
+            case .memorySample(let index, let sample):
+                print("[#\(index)] memory: " + describe(sample))
             case .stopped:
                 print("Stopped")
             case .finished:
@@ -228,6 +410,14 @@ struct SFEngineCLISoakTestSwift: AsyncParsableCommand {
         print("Completed \(summary.iterationsCompleted)/\(summary.iterationsAttempted) iterations")
         print("Timeouts: \(summary.timeouts), Errors: \(summary.errors)")
         print("Elapsed: \(formatDuration(summary.elapsed))")
+        if summary.engineRestarts > 0 {
+            print("Engine restarts: \(summary.engineRestarts)")
+        }
+        if let first = summary.firstMemorySample, let last = summary.lastMemorySample {
+            let growth = (Double(last.residentBytes) - Double(first.residentBytes)) / 1_048_576
+            print(String(format: "Resident memory: %.1f MB at first sample, %.1f MB at last (%+.1f MB)",
+                         Double(first.residentBytes) / 1_048_576, Double(last.residentBytes) / 1_048_576, growth))
+        }
 
         if summary.errors > 0 || summary.timeouts > 0 {
             throw ExitCode.failure
@@ -235,6 +425,83 @@ struct SFEngineCLISoakTestSwift: AsyncParsableCommand {
     }
 }
 
+@available(macOS 26.0, *)
+extension SFEngineCLISoakTestSwift {
+    /// Prints the capacity figures of a throughput run.
+    func runThroughput(_ configuration: SFEngineSoakRunner.ThroughputConfiguration) async throws {
+        let rateDescription = configuration.targetPositionsPerSecond.map { String(format: ", target %.1f/s", $0) } ?? ""
+        print("Starting throughput test (positions: \(configuration.positions.count), engines: \(configuration.engines)\(rateDescription))")
+        let summary = await SFEngineSoakRunner.runThroughput(configuration)
+
+        print("Completed \(summary.positionsCompleted)/\(summary.positionsAttempted) positions in \(formatDuration(summary.elapsed))")
+        print(String(format: "Positions/second: %.2f", summary.positionsPerSecond))
+        print(String(format: "Timeouts: %d (%.2f%%), Errors: %d", summary.timeouts, summary.timeoutRate * 100, summary.errors))
+        if let nps = summary.nps {
+            print("NPS min/p10/p50/p90/max: \(nps.min)/\(nps.p10)/\(nps.p50)/\(nps.p90)/\(nps.max)")
+        }
+        if let peak = summary.peakResidentBytes {
+            print(String(format: "Peak resident memory: %.1f MB", Double(peak) / 1_048_576))
+        }
+
+        if summary.errors > 0 || summary.timeouts > 0 {
+            throw ExitCode.failure
+        }
+    }
+
+    /// Prints one line per finished game and the score of the first engine,
+    /// appending each game to the `--pgn` and `--packed-games` files.
+    func runSelfPlay(_ configuration: SFEngineSoakRunner.SelfPlayConfiguration) async throws {
+        let pgnFile = try pgn.map { try GameOutputFile(path: resolveOutputPath($0)) }
+        let packedFile = try packedGames.map { try GameOutputFile(path: resolveOutputPath($0)) }
+
+        print("Starting self-play (games: \(configuration.games ?? 0), openings: \(configuration.openings.count), slots: \(configuration.slots))")
+        let summary = await SFEngineSoakRunner.runSelfPlay(configuration) { game in
+            print("[#\(game.index + 1)] \(game.firstEngineIsWhite ? "first-second" : "second-first")"
+                  + " \(game.result) in \(game.positions.count) plies (\(game.termination))")
+            pgnFile?.append(Data(game.pgn.utf8))
+            if let packedFile {
+                if let records = game.packedRecords {
+                    packedFile.append(records)
+                } else {
+                    fputs("[#\(game.index + 1)] error: a position could not be packed\n", stderr)
+                }
+            }
+        }
+
+        let points = Double(summary.firstEngineWins) + Double(summary.draws) / 2
+        let decided = summary.firstEngineWins + summary.secondEngineWins + summary.draws
+        print("Played \(summary.gamesPlayed) games in \(formatDuration(summary.elapsed))"
+              + String(format: " (%.0f games/hour)", summary.gamesPerHour))
+        print("First engine +\(summary.firstEngineWins) -\(summary.secondEngineWins) =\(summary.draws)"
+              + (decided > 0 ? String(format: " (%.1f%%)", points * 100 / Double(decided)) : ""))
+        print("Unfinished: \(summary.unfinished), Errors: \(summary.errors)")
+
+        if summary.errors > 0 {
+            throw ExitCode.failure
+        }
+    }
+
+    /// Prints one line per handler load with p50/p99/p99.9/max round trips.
+    func runLatency(samples: Int) async throws {
+        let configuration = SFEngineSoakRunner.LatencyConfiguration(
+            samples: samples,
+            timeout: .seconds(handshakeTimeout),
+            threads: latencyThreads ?? 1
+        )
+        print("Measuring bridge latency (\(samples) samples per command and handler load,"
+              + " \(configuration.threads) threads)")
+        guard let reports = await SFEngineSoakRunner.measureLatency(configuration) else {
+            fputs("error: a reply did not arrive within \(handshakeTimeout)s\n", stderr)
+            throw ExitCode.failure
+        }
+
+        for report in reports {
+            print("handler load \(formatMicroseconds(report.handlerLoad)):"
+                  + " isready \(describe(report.ready)), go depth 1 \(describe(report.depthOne))")
+        }
+    }
+}
+
 // MARK: - Helpers
 
 /// Resolve paths relative to the current working directory and the repo root.
@@ -264,11 +531,56 @@ private func resolvePath(_ path: String) -> String {
     return cwdPath
 }
 
-/// Load a positions file where each non-empty line is a FEN or `startpos`.
+/// Resolve an output path against the current working directory.
+private func resolveOutputPath(_ path: String) -> String {
+    let expandedPath = (path as NSString).expandingTildeInPath
+    if expandedPath.hasPrefix("/") {
+        return expandedPath
+    }
+    return URL(fileURLWithPath: FileManager.default.currentDirectoryPath)
+        .appendingPathComponent(expandedPath)
+        .path
+}
+
+/// An output file that self-play games from several slots append to.
+private final class GameOutputFile: @unchecked Sendable {
+    private let lock = NSLock()
+    private let handle: FileHandle
+
+    init(path: String) throws {
+        if !FileManager.default.fileExists(atPath: path) {
+            guard FileManager.default.createFile(atPath: path, contents: nil) else {
+                throw ValidationError("Could not create \(path)")
+            }
+        }
+        handle = try FileHandle(forWritingTo: URL(fileURLWithPath: path))
+        try handle.seekToEnd()
+    }
+
+    deinit {
+        try? handle.close()
+    }
+
+    func append(_ data: Data) {
+        lock.lock()
+        defer { lock.unlock() }
+        do {
+            try handle.write(contentsOf: data)
+        } catch {
+            fputs("error: \(error.localizedDescription)\n", stderr)
+        }
+    }
+}
+
+/// Load a positions file where each non-empty line is a FEN or `startpos`,
+/// or a `.bin` file of packed positions.
 private func loadPositions(from path: String) throws -> [SFEngineSoakRunner.PositionSpec] {
     guard FileManager.default.fileExists(atPath: path) else {
         throw ValidationError("Positions file not found: \(path)")
     }
+    if path.hasSuffix(".bin") {
+        return try loadPackedPositions(from: path)
+    }
     let contents = try String(contentsOfFile: path, encoding: .utf8)
     var specs: [SFEngineSoakRunner.PositionSpec] = []
 
@@ -290,6 +602,24 @@ private func loadPositions(from path: String) throws -> [SFEngineSoakRunner.Posi
     return specs
 }
 
+/// Load back-to-back `SFPackedPositionLength`-byte records, as written by
+/// `SFEngine.packedPosition(fen:chess960:)`.
+private func loadPackedPositions(from path: String) throws -> [SFEngineSoakRunner.PositionSpec] {
+    let data = try Data(contentsOf: URL(fileURLWithPath: path))
+    let length = Int(SFPackedPositionLength)
+    guard data.count % length == 0 else {
+        throw ValidationError("Packed positions file \(path) is not a multiple of \(length) bytes")
+    }
+
+    return try stride(from: 0, to: data.count, by: length).map { offset -> SFEngineSoakRunner.PositionSpec in
+        do {
+            return .fen(try SFEngine.fen(packedPosition: data.subdata(in: offset..<offset + length)))
+        } catch {
+            throw ValidationError("Invalid packed position at \(path) record \(offset / length + 1): \(error.localizedDescription)")
+        }
+    }
+}
+
 /// Make long FENs easier to scan in the console output.
 private func describe(_ position: SFEngineSoakRunner.PositionSpec) -> String {
     switch position {
@@ -304,6 +634,31 @@ private func describe(_ position: SFEngineSoakRunner.PositionSpec) -> String {
     }
 }
 
+/// Format a memory sample in megabytes, with the engine's share broken down.
+private func describe(_ sample: SFEngineSoakRunner.MemorySample) -> String {
+    func megabytes(_ bytes: UInt64) -> String {
+        String(format: "%.1f MB", Double(bytes) / 1_048_576)
+    }
+    return "resident \(megabytes(sample.residentBytes)); hash \(megabytes(sample.hashBytes)),"
+        + " network \(megabytes(sample.networkBytes)),"
+        + " \(sample.threads) threads \(megabytes(sample.threadBytes)),"
+        + " callbacks pending \(sample.pendingCallbacks) (peak \(sample.peakPendingCallbacks))"
+}
+
+/// Format latency percentiles as `p50/p99/p99.9/max` in microseconds.
+private func describe(_ percentiles: SFEngineSoakRunner.LatencyPercentiles) -> String {
+    [percentiles.p50, percentiles.p99, percentiles.p999, percentiles.max]
+        .map(formatMicroseconds)
+        .joined(separator: "/")
+}
+
+/// Format a `Duration` as whole microseconds.
+private func formatMicroseconds(_ duration: Duration) -> String {
+    let components = duration.components
+    let microseconds = Double(components.seconds) * 1e6 + Double(components.attoseconds) / 1e12
+    return String(format: "%.0fus", microseconds)
+}
+
 /// Format a `Duration` as a simple seconds string.
 private func formatDuration(_ duration: Duration) -> String {
     let components = duration.components
@@ -16,15 +16,20 @@
 #include <streambuf>
 #include <string>
 
+#include "SPSCQueue.hpp"
+#include "Signposts.hpp"
 #include "ThreadSafeQueue.hpp"
 
 namespace SFEmbedded {
 
-// std::streambuf implementation that exposes a ThreadSafeQueue as an input stream.
+// std::streambuf implementation that exposes a command queue as an input stream.
 // The Stockfish UCI loop reads from this as if it were std::cin.
+// `Queue` is ThreadSafeQueue<std::string> or SPSCQueue<std::string, N>; any type
+// with a blocking `bool pop(std::string&)` works.
+template<typename Queue = ThreadSafeQueue<std::string>>
 class CommandStreambuf: public std::streambuf {
    public:
-    explicit CommandStreambuf(ThreadSafeQueue<std::string>& queue) :
+    explicit CommandStreambuf(Queue& queue) :
         queue_(queue) {
         // setg requires non-null pointers even before data is available.
         setg(buffer_, buffer_, buffer_);
@@ -39,6 +44,7 @@ class CommandStreambuf: public std::streambuf {
         // Block until a command is available or the queue is closed.
         if (!queue_.pop(current_))
             return traits_type::eof();
+        SF_SIGNPOST_EVENT("Command dequeued");
 
         // Ensure each command ends with a newline so UCI parsing works.
         if (current_.empty() || current_.back() != '\n')
@@ -50,10 +56,10 @@ class CommandStreambuf: public std::streambuf {
     }
 
    private:
-    ThreadSafeQueue<std::string>& queue_;
-    std::string                   current_;
+    Queue&      queue_;
+    std::string current_;
     // Placeholder buffer used only to satisfy setg during construction.
-    char                          buffer_[1];
+    char        buffer_[1];
 };
 
 }  // namespace SFEmbedded
@@ -0,0 +1,158 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+// Checks and routing of command lines, shared by SFEngine and the C API.
+
+#pragma once
+
+#include <cctype>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace SFEmbedded {
+
+constexpr std::size_t MaxCommandBytes = 1024 * 1024;
+
+enum class CommandValidation {
+    accepted,
+    ignored,
+    rejected,
+};
+
+// Compares case-insensitively, with whitespace runs counting as one space,
+// without building a normalized copy of the line.
+inline bool startsWithDebugLogOption(const std::string& command) {
+    constexpr std::string_view prefix = "setoption name debug log file";
+
+    std::size_t matched      = 0;
+    bool        pendingSpace = false;
+    for (const unsigned char character : command) {
+        if (std::isspace(character)) {
+            pendingSpace = matched > 0;
+            continue;
+        }
+
+        if (matched == prefix.size())
+            return pendingSpace;
+        if (pendingSpace) {
+            if (prefix[matched] != ' ')
+                return false;
+            ++matched;
+            pendingSpace = false;
+        }
+        if (std::tolower(character) != prefix[matched])
+            return false;
+        ++matched;
+    }
+    return matched == prefix.size();
+}
+
+// Checks one command line from a host: at most MaxCommandBytes, one optional
+// trailing LF or CRLF which is removed, no NUL, CR or LF inside, and not
+// `Debug Log File`, which would write through process-wide streams. An empty
+// line is ignored. SFEngine runs it after UTF-8 conversion, and on lines read
+// from a descriptor as they are.
+inline CommandValidation validateCommandLine(std::string& normalized, std::string& rejectionReason) {
+    if (normalized.size() > MaxCommandBytes) {
+        rejectionReason = "command exceeds 1 MiB";
+        return CommandValidation::rejected;
+    }
+
+    // The public contract accepts one optional trailing LF or CRLF.
+    if (!normalized.empty() && normalized.back() == '\n') {
+        normalized.pop_back();
+        if (!normalized.empty() && normalized.back() == '\r')
+            normalized.pop_back();
+    }
+
+    if (normalized.empty())
+        return CommandValidation::ignored;
+
+    if (normalized.find('\0') != std::string::npos) {
+        rejectionReason = "command contains NUL";
+        return CommandValidation::rejected;
+    }
+    if (normalized.find('\n') != std::string::npos || normalized.find('\r') != std::string::npos) {
+        rejectionReason = "command contains more than one line";
+        return CommandValidation::rejected;
+    }
+    if (startsWithDebugLogOption(normalized)) {
+        rejectionReason = "Debug Log File is unsupported by the embedded stream bridge";
+        return CommandValidation::rejected;
+    }
+
+    return CommandValidation::accepted;
+}
+
+// Checks every LF-separated line of `buffer` as validateCommandLine() does
+// and appends the accepted ones to `lines`; a CR before each LF is dropped
+// and empty lines are skipped. Nothing is appended when any line is rejected,
+// and the reason names the line. Returns `ignored` for a buffer with no
+// commands.
+inline CommandValidation validateCommandBuffer(std::string_view          buffer,
+                                               std::vector<std::string>& lines,
+                                               std::string&              rejectionReason) {
+    const std::size_t first = lines.size();
+    std::size_t       start = 0;
+    for (std::size_t number = 1; start < buffer.size(); ++number) {
+        std::size_t end = buffer.find('\n', start);
+        if (end == std::string_view::npos)
+            end = buffer.size();
+
+        std::string line(buffer.substr(start, end - start));
+        start = end + 1;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        switch (validateCommandLine(line, rejectionReason)) {
+        case CommandValidation::accepted:
+            lines.push_back(std::move(line));
+            break;
+        case CommandValidation::ignored:
+            break;
+        case CommandValidation::rejected:
+            rejectionReason = "line " + std::to_string(number) + ": " + rejectionReason;
+            lines.resize(first);
+            return CommandValidation::rejected;
+        }
+    }
+    return lines.size() > first ? CommandValidation::accepted : CommandValidation::ignored;
+}
+
+// `stop` and `ponderhit` also go to SessionControl, so they reach a running
+// search without waiting behind queued commands.
+enum class PriorityCommand {
+    none,
+    stop,
+    ponderhit,
+};
+
+// Matches the first whitespace-separated token, as Stockfish's UCI loop does.
+inline PriorityCommand priorityCommandFor(const std::string& command) {
+    std::size_t begin = 0;
+    while (begin < command.size() && std::isspace(static_cast<unsigned char>(command[begin])))
+        ++begin;
+
+    std::size_t end = begin;
+    while (end < command.size() && !std::isspace(static_cast<unsigned char>(command[end])))
+        ++end;
+
+    const std::string_view token(command.data() + begin, end - begin);
+    if (token == "stop")
+        return PriorityCommand::stop;
+    if (token == "ponderhit")
+        return PriorityCommand::ponderhit;
+    return PriorityCommand::none;
+}
+
+}  // namespace SFEmbedded
@@ -0,0 +1,278 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+// Named debug counters and histograms kept per thread, for instrumentation
+// that stays on in hot paths.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace SFEmbedded {
+
+enum class DebugCounterKind {
+    hit,        // How often a condition held, as dbg_hit_on
+    mean,       // As dbg_mean_of
+    stdev,      // As dbg_stdev_of
+    histogram,  // Counts per power-of-two bucket
+};
+
+// Totals of one counter across every thread, as DebugCounters::snapshot()
+// returns them. `hits` is the number of true conditions of a hit counter.
+// Histogram bucket 0 counts values below 1 and bucket b values in
+// [2^(b-1), 2^b); the last bucket also takes everything larger.
+struct DebugCounterTotals {
+    static constexpr std::size_t Buckets = 32;
+
+    std::string                       name;
+    DebugCounterKind                  kind         = DebugCounterKind::hit;
+    std::int64_t                      count        = 0;
+    std::int64_t                      hits         = 0;
+    std::int64_t                      sum          = 0;
+    std::int64_t                      sumOfSquares = 0;
+    std::array<std::int64_t, Buckets> buckets{};
+};
+
+// Replaces Stockfish's dbg_* slots, which every thread updates with atomic
+// read-modify-writes on shared cache lines, for code in this wrapper.
+// - Each thread records into a slab of its own, allocated on first use; only
+//   that thread writes it, with plain relaxed stores, so threads never contend.
+// - snapshot() merges the live slabs with those of threads that have exited,
+//   so readers on any thread see totals that lag writers only briefly.
+// - clear() sets a baseline rather than touching other threads' slabs.
+// Counters are registered by name once, usually through a function-local
+// static DebugCounter, and are process-wide like the dbg_* slots.
+class DebugCounters {
+   public:
+    static constexpr std::size_t MaxCounters = 32;
+
+    static DebugCounters& instance() {
+        static auto* counters = new DebugCounters();  // Outlives every thread's slab
+        return *counters;
+    }
+
+    // The slot for `name`, registering it on first use. Returns MaxCounters,
+    // which records nothing, once every slot is taken.
+    std::size_t slot(std::string_view name, DebugCounterKind kind) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::size_t i = 0; i < names_.size(); ++i)
+            if (names_[i] == name)
+                return i;
+        if (names_.size() == MaxCounters)
+            return MaxCounters;
+        names_.emplace_back(name);
+        kinds_.push_back(kind);
+        return names_.size() - 1;
+    }
+
+    void record(std::size_t slot, std::int64_t value, bool hit) {
+        if (slot >= MaxCounters)
+            return;
+
+        Cell& cell = local().cells[slot];
+        bump(cell.count, 1);
+        bump(cell.hits, hit);
+        bump(cell.sum, value);
+        bump(cell.sumOfSquares, value * value);
+        bump(cell.buckets[bucket(value)], 1);
+    }
+
+    // Registered counters in registration order, with their totals since the
+    // last clear(), including counters nothing has recorded yet.
+    std::vector<DebugCounterTotals> snapshot() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<DebugCounterTotals> totals = merged_locked();
+        for (std::size_t i = 0; i < totals.size(); ++i)
+            subtract(totals[i], baseline_[i]);
+        return totals;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const std::vector<DebugCounterTotals> totals = merged_locked();
+        for (std::size_t i = 0; i < totals.size(); ++i)
+            baseline_[i] = totals[i];
+    }
+
+    // Lines in dbg_print's format for every counter that has recorded since
+    // the last clear(), or an empty string when none has.
+    std::string format() {
+        std::ostringstream out;
+        for (const auto& t : snapshot())
+        {
+            const std::int64_t n = t.count;
+            if (!n)
+                continue;
+
+            const auto E = [n](std::int64_t x) { return double(x) / double(n); };
+            switch (t.kind)
+            {
+            case DebugCounterKind::hit :
+                out << "Hit " << t.name << ": Total " << n << " Hits " << t.hits << " Hit Rate (%) "
+                    << 100.0 * E(t.hits) << '\n';
+                break;
+            case DebugCounterKind::mean :
+                out << "Mean " << t.name << ": Total " << n << " Mean " << E(t.sum) << '\n';
+                break;
+            case DebugCounterKind::stdev :
+                out << "Stdev " << t.name << ": Total " << n << " Stdev "
+                    << std::sqrt(std::max(0.0, E(t.sumOfSquares) - E(t.sum) * E(t.sum))) << '\n';
+                break;
+            case DebugCounterKind::histogram :
+                out << "Histogram " << t.name << ": Total " << n;
+                for (std::size_t b = 0; b < t.buckets.size(); ++b)
+                    if (t.buckets[b])
+                        out << ' ' << bucket_label(b) << ": " << t.buckets[b];
+                out << '\n';
+                break;
+            }
+        }
+        return out.str();
+    }
+
+   private:
+    struct Cell {
+        std::atomic<std::int64_t>                                          count{0};
+        std::atomic<std::int64_t>                                          hits{0};
+        std::atomic<std::int64_t>                                          sum{0};
+        std::atomic<std::int64_t>                                          sumOfSquares{0};
+        std::array<std::atomic<std::int64_t>, DebugCounterTotals::Buckets> buckets{};
+    };
+
+    struct Slab {
+        std::array<Cell, MaxCounters> cells;
+    };
+
+    // Registers the calling thread's slab on first use and, when the thread
+    // exits, folds it into retired_.
+    class LocalSlab {
+       public:
+        explicit LocalSlab(DebugCounters& owner) :
+            owner_(owner) {
+            std::lock_guard<std::mutex> lock(owner_.mutex_);
+            owner_.slabs_.push_back(&slab_);
+        }
+
+        ~LocalSlab() {
+            std::lock_guard<std::mutex> lock(owner_.mutex_);
+            for (std::size_t i = 0; i < MaxCounters; ++i)
+                accumulate(owner_.retired_[i], slab_.cells[i]);
+            for (auto it = owner_.slabs_.begin(); it != owner_.slabs_.end(); ++it)
+                if (*it == &slab_)
+                {
+                    owner_.slabs_.erase(it);
+                    break;
+                }
+        }
+
+        Slab slab_;
+
+       private:
+        DebugCounters& owner_;
+    };
+
+    Slab& local() {
+        thread_local LocalSlab slab(*this);
+        return slab.slab_;
+    }
+
+    // Only the owning thread writes a cell, so a load and a store suffice.
+    static void bump(std::atomic<std::int64_t>& value, std::int64_t by) {
+        value.store(value.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    static std::size_t bucket(std::int64_t value) {
+        std::size_t b = 0;
+        for (; value >= 1 && b + 1 < DebugCounterTotals::Buckets; value >>= 1)
+            ++b;
+        return b;
+    }
+
+    // "<1", "1", "2-3", "4-7", ..., and ">=2^30" for the last bucket.
+    static std::string bucket_label(std::size_t b) {
+        if (b == 0)
+            return "<1";
+        const std::int64_t low = std::int64_t(1) << (b - 1);
+        if (b + 1 == DebugCounterTotals::Buckets)
+            return ">=" + std::to_string(low);
+        return b == 1 ? "1" : std::to_string(low) + "-" + std::to_string(2 * low - 1);
+    }
+
+    static void accumulate(DebugCounterTotals& totals, const Cell& cell) {
+        totals.count += cell.count.load(std::memory_order_relaxed);
+        totals.hits += cell.hits.load(std::memory_order_relaxed);
+        totals.sum += cell.sum.load(std::memory_order_relaxed);
+        totals.sumOfSquares += cell.sumOfSquares.load(std::memory_order_relaxed);
+        for (std::size_t b = 0; b < totals.buckets.size(); ++b)
+            totals.buckets[b] += cell.buckets[b].load(std::memory_order_relaxed);
+    }
+
+    static void subtract(DebugCounterTotals& totals, const DebugCounterTotals& baseline) {
+        totals.count -= baseline.count;
+        totals.hits -= baseline.hits;
+        totals.sum -= baseline.sum;
+        totals.sumOfSquares -= baseline.sumOfSquares;
+        for (std::size_t b = 0; b < totals.buckets.size(); ++b)
+            totals.buckets[b] -= baseline.buckets[b];
+    }
+
+    // Requires mutex_.
+    std::vector<DebugCounterTotals> merged_locked() const {
+        std::vector<DebugCounterTotals> totals(names_.size());
+        for (std::size_t i = 0; i < totals.size(); ++i)
+        {
+            totals[i]      = retired_[i];
+            totals[i].name = names_[i];
+            totals[i].kind = kinds_[i];
+            for (const Slab* slab : slabs_)
+                accumulate(totals[i], slab->cells[i]);
+        }
+        return totals;
+    }
+
+    std::mutex                                  mutex_;
+    std::vector<std::string>                    names_;
+    std::vector<DebugCounterKind>               kinds_;
+    std::vector<Slab*>                          slabs_;
+    std::array<DebugCounterTotals, MaxCounters> retired_;
+    std::array<DebugCounterTotals, MaxCounters> baseline_;
+};
+
+// A registered counter. Keep it in a function-local static so the name is
+// looked up once:
+//     static const DebugCounter held("Info updates held", DebugCounterKind::hit);
+//     held.hit_on(time - last < throttle);
+class DebugCounter {
+   public:
+    DebugCounter(std::string_view name, DebugCounterKind kind) :
+        slot_(DebugCounters::instance().slot(name, kind)) {}
+
+    void hit_on(bool cond) const { DebugCounters::instance().record(slot_, 0, cond); }
+    void mean_of(std::int64_t value) const { DebugCounters::instance().record(slot_, value, false); }
+    void stdev_of(std::int64_t value) const { DebugCounters::instance().record(slot_, value, false); }
+    void histogram_of(std::int64_t value) const {
+        DebugCounters::instance().record(slot_, value, false);
+    }
+
+   private:
+    std::size_t slot_;
+};
+
+}  // namespace SFEmbedded
@@ -12,115 +12,3925 @@
 
 #include "EmbeddedUCI.hpp"
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <istream>
 #include <locale>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <set>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+    #include <sys/sysctl.h>
+#endif
+
 #include "attacks.h"
+#include "benchmark.h"
 #include "bitboard.h"
+#include "engine.h"
+#include "evaluate.h"
+#include "history.h"
+#include "incbin/incbin.h"
+#include "memory.h"
 #include "misc.h"
+#include "movegen.h"
+#include "nnue/network.h"
+#include "nnue/nnue_accumulator.h"
+#include "nnue/nnue_misc.h"
+#include "nnue/nnz_helper.h"
+#include "perft.h"
 #include "position.h"
+#include "search.h"
+#include "syzygy/tbprobe.h"
+#include "thread.h"
+#include "timeman.h"
 #include "tune.h"
 #include "uci.h"
+#include "ucioption.h"
+
+#include "DebugCounters.hpp"
+#include "Signposts.hpp"
+
+// The default network, embedded by nnue/network.cpp.
+INCBIN_EXTERN(EmbeddedNNUE);
+
+namespace SFEmbedded {
+namespace {
+
+using namespace Stockfish;
+
+// Serializes output from the UCI loop thread and the Stockfish search thread.
+// Upstream uses the process-wide IO_LOCK around std::cout for the same purpose;
+// each embedded session owns its own stream instead.
+class SessionOutput {
+public:
+    explicit SessionOutput(std::ostream& out) :
+        out_(out) {
+        // Host formatting such as a grouping global locale must not alter UCI text.
+        out_.imbue(std::locale::classic());
+    }
+
+    // Writes `text` plus a trailing newline without interleaving other writers.
+    void write(std::string_view text) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        out_.write(text.data(), static_cast<std::streamsize>(text.size()));
+        out_.put('\n');
+        out_.flush();
+    }
+
+    // Mirrors UCIEngine::print_info_string: one `info string` line per
+    // non-blank input line.
+    void info_string(std::string_view text) {
+        std::string block;
+        for (const auto& line : split(text, "\n"))
+        {
+            if (is_whitespace(line))
+                continue;
+
+            if (!block.empty())
+                block.push_back('\n');
+            block.append("info string ").append(line);
+        }
+
+        if (!block.empty())
+            write(block);
+    }
+
+    void error(std::string_view reason) {
+        write(std::string("info string StockfishEmbedded error: ").append(reason));
+    }
+
+private:
+    std::mutex    mutex_;
+    std::ostream& out_;
+};
+
+// OptionsMap numbers options with a process-wide counter, so only the first
+// Engine constructed in a process can print its option list. The list only
+// shows defaults, which are identical for every session, so render it once.
+const std::string& optionsListing(const OptionsMap& options) {
+    static const std::string listing = [&options] {
+        std::ostringstream ss;
+        ss << options;
+        return ss.str();
+    }();
+    return listing;
+}
+
+// Engine construction touches process-wide state (the option counter above and
+// Tune's options pointer), so concurrent session starts take turns.
+std::mutex& engineConstructionMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+using OptionDefaults = std::map<std::string, std::string, CaseInsensitiveLess>;
+
+// Recovers each option's default from the rendered listing, since Option keeps
+// it private. Buttons have no default and are left out.
+const OptionDefaults& optionDefaults(const OptionsMap& options) {
+    static const OptionDefaults defaults = [&options] {
+        OptionDefaults     result;
+        std::istringstream listing(optionsListing(options));
+        std::string        line;
+        while (std::getline(listing, line))
+        {
+            const auto nameAt    = line.find("option name ");
+            const auto typeAt    = line.find(" type ");
+            const auto defaultAt = line.find(" default ");
+            if (nameAt != 0 || typeAt == std::string::npos || defaultAt == std::string::npos)
+                continue;
+
+            const auto valueAt = defaultAt + 9;
+            auto       valueTo = std::min(line.find(" min ", valueAt), line.find(" var ", valueAt));
+            std::string value  = line.substr(valueAt, valueTo == std::string::npos ? valueTo
+                                                                                   : valueTo - valueAt);
+            if (value == "<empty>")
+                value.clear();
+
+            result.emplace(line.substr(12, typeAt - 12), std::move(value));
+        }
+        return result;
+    }();
+    return defaults;
+}
+
+// Process-wide slot for one idle Engine, so a later session can skip loading
+// the network and building the thread pool. Intentionally leaked: a parked
+// engine's threads must not be joined during static destruction.
+class WarmEngineCache {
+public:
+    static WarmEngineCache& instance() {
+        static auto* cache = new WarmEngineCache();
+        return *cache;
+    }
+
+    void set_enabled(bool enabled) {
+        std::unique_ptr<Engine> released;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            enabled_ = enabled;
+            if (!enabled)
+                released = std::move(engine_);
+        }
+        // `released` is destroyed here, outside the lock.
+    }
+
+    bool enabled() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return enabled_;
+    }
+
+    void set_retains_search_state(bool retains) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retainsSearchState_ = retains;
+    }
+
+    bool retains_search_state() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return retainsSearchState_;
+    }
+
+    void release() {
+        std::unique_ptr<Engine> released;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            released = std::move(engine_);
+        }
+        // `released` is destroyed here, outside the lock.
+    }
+
+    std::unique_ptr<Engine> take() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::move(engine_);
+    }
+
+    // Returns `engine` back if it cannot be kept, for the caller to destroy.
+    std::unique_ptr<Engine> park(std::unique_ptr<Engine> engine) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!enabled_ || engine_)
+            return engine;
+
+        engine_ = std::move(engine);
+        return nullptr;
+    }
+
+private:
+    std::mutex              mutex_;
+    bool                    enabled_            = false;
+    bool                    retainsSearchState_ = false;
+    std::unique_ptr<Engine> engine_;
+};
+
+// Batch-evaluation networks by EvalFile path, shared read-only by every session
+// that evaluates with the same file so concurrent sessions hold one copy. An
+// entry lives as long as some session still uses it.
+class SharedEvalNetworks {
+public:
+    using NetworkPtr = std::shared_ptr<const Eval::NNUE::Network>;
+
+    static SharedEvalNetworks& instance() {
+        static auto* networks = new SharedEvalNetworks();
+        return *networks;
+    }
+
+    // Returns the loaded network for `file`, loading it on first use. Loads are
+    // serialised, so sessions asking for the same file at once load it once.
+    NetworkPtr acquire(const std::string& rootDirectory, const std::string& file) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (NetworkPtr network = networks_[file].lock())
+            return network;
+
+        auto                 network = std::make_shared<Eval::NNUE::Network>();
+        Eval::NNUE::EvalFile loaded{std::nullopt, ""};
+        SF_SIGNPOST_BEGIN("Network load", network.get(), "%{public}s", file.c_str());
+        network->load(rootDirectory, path_from_utf8(file), loaded);
+        SF_SIGNPOST_END("Network load", network.get());
+        if (!loaded.current)
+        {
+            networks_.erase(file);
+            return nullptr;
+        }
+
+        networks_[file] = network;
+        return network;
+    }
+
+private:
+    std::mutex                                                      mutex_;
+    std::map<std::string, std::weak_ptr<const Eval::NNUE::Network>> networks_;
+};
+
+// The layers of the embedded network, held as Network holds them but public,
+// so `nnuebench` can time each NNUE stage on its own. AccumulatorCaches reads
+// `featureTransformer` by name.
+struct StageBenchNetwork {
+    using Transformer = Eval::NNUE::FeatureTransformer;
+    using LayerStack  = Eval::NNUE::NetworkArchitecture;
+
+    Transformer featureTransformer;
+    LayerStack  stacks[Eval::NNUE::LayerStacks];
+
+    // Parses the embedded network the way Network::load_internal does.
+    bool load() {
+        class ReadOnlyBuffer: public std::streambuf {
+        public:
+            ReadOnlyBuffer(const unsigned char* data, std::size_t size) {
+                char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+                setg(begin, begin, begin + size);
+            }
+        };
+
+        ReadOnlyBuffer buffer(gEmbeddedNNUEData, gEmbeddedNNUESize);
+        std::istream   stream(&buffer);
+
+        const auto version     = Eval::NNUE::read_little_endian<u32>(stream);
+        const auto hash        = Eval::NNUE::read_little_endian<u32>(stream);
+        const auto description = Eval::NNUE::read_little_endian<u32>(stream);
+        stream.ignore(description);
+        if (!stream || version != Eval::NNUE::Version
+            || hash != (Transformer::get_hash_value() ^ LayerStack::get_hash_value()))
+            return false;
+
+        if (!read_layer(stream, featureTransformer))
+            return false;
+        for (auto& stack : stacks)
+            if (!read_layer(stream, stack))
+                return false;
+        return true;
+    }
+
+private:
+    template<typename Layer>
+    static bool read_layer(std::istream& stream, Layer& layer) {
+        return Eval::NNUE::read_little_endian<u32>(stream) == Layer::get_hash_value()
+            && layer.read_parameters(stream);
+    }
+};
+
+// Fixed inputs for `nnuebench`, from the opening to the endgame so every
+// layer stack bucket up to 32 pieces is used.
+constexpr const char* StageBenchPositions[] = {
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+  "r2q1rk1/pp2bppp/2n1pn2/3p4/3P4/2NBPN2/PP3PPP/R2Q1RK1 w - - 4 10",
+  "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+  "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+  "r2r1n2/pp2bk2/2p1p2p/3q4/3PN1QP/2P3R1/P4PP1/5RK1 w - - 0 1",
+  "6k1/3b3r/1p1p4/p1n2p2/1PPNpP1q/P3Q1p1/1R1RB1P1/5K2 b - - 0 1",
+  "8/5pk1/6p1/8/3R4/6P1/5PK1/3r4 w - - 0 40",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+  "8/8/1P6/5pr1/8/4R3/7k/2K5 w - - 0 1",
+};
+
+volatile std::int64_t stageBenchSink;
+
+// Nanoseconds per call of `stage` when it is run `iterations` times over
+// `calls` inputs; `stage(i)` folds its output into `sink` so it is not elided.
+template<typename Stage>
+double nanosecondsPerCall(std::size_t calls, int iterations, const Stage& stage) {
+    std::int64_t sink  = 0;
+    const auto   start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; ++n)
+        for (std::size_t i = 0; i < calls; ++i)
+            sink += stage(i);
+    const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+    stageBenchSink = sink;
+    return elapsed.count() / (double(calls) * iterations);
+}
+
+bool sameOptionName(const std::string& a, const std::string& b) {
+    return !CaseInsensitiveLess()(a, b) && !CaseInsensitiveLess()(b, a);
+}
+
+// The commands that read neither an option nor the Syzygy tables, so they may
+// run while a SyzygyPath scan is still writing both.
+bool runsDuringTablebaseScan(const std::string& token) {
+    return token.empty() || token[0] == '#' || token == "quit" || token == "stop"
+        || token == "ponderhit" || token == "isready" || token == "debugcounters"
+        || token == "compiler";
+}
+
+std::uint64_t elapsedMicroseconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()
+                                                                 - since)
+      .count();
+}
+
+// Bitboard, attack, and Zobrist tables are process-wide and identical for
+// every session, so they are built once, by the first session or packing call.
+std::once_flag& tablesInitialized() {
+    static std::once_flag flag;
+    return flag;
+}
+
+// For PrepareTables() and the session-free entry points, which do not time
+// the tables.
+void initialize_tables() {
+    std::call_once(tablesInitialized(), [] {
+        Bitboards::init();
+        Attacks::init();
+        Position::init();
+    });
+}
+
+constexpr std::string_view PieceToChar(" PNBRQK  pnbrqk");
+constexpr std::uint8_t     NoEnPassant = 64;
+
+// In PackedPosition castling order: K, Q, k, q.
+constexpr CastlingRights PackedCastling[] = {WHITE_OO, WHITE_OOO, BLACK_OO, BLACK_OOO};
+
+// Wrapper-added option that fits Threads and Hash into a total footprint.
+constexpr const char*  MemoryBudgetOption = "MemoryBudgetMB";
+constexpr int          MaxMemoryBudgetMB  = Is64Bit ? 33554432 : 2048;  // Same as Hash
+constexpr std::size_t  OneMB              = 1024 * 1024;
+
+// The other wrapper-added options, registered with MemoryBudgetMB when the
+// engine is created.
+constexpr const char*  PerformanceCoresOption = "PerformanceCoresOnly";
+constexpr const char*  SyzygyPrefetchOption   = "SyzygyPrefetch";
+constexpr const char*  BookFileOption         = "BookFile";
+constexpr const char*  BookDepthOption        = "BookDepth";
+constexpr const char*  BookWeightedOption     = "BookWeighted";
+constexpr const char*  ResultCacheOption      = "ResultCacheMB";
+constexpr const char*  ResultCacheFileOption  = "ResultCacheFile";
+constexpr const char*  InfoThrottleOption     = "InfoThrottleMs";
+constexpr const char*  MultiPVDeltaOption     = "MultiPVDelta";
+constexpr const char*  MateFinderOption       = "MateFinder";
+constexpr const char*  SkillEarlyStopOption   = "SkillEarlyStop";
+constexpr const char*  KeepSearchStateOption  = "KeepSearchState";
+
+template<typename>
+struct DynStatsBytes;
+
+template<typename T, int SizeMultiplier>
+struct DynStatsBytes<DynStats<T, SizeMultiplier>> {
+    static constexpr std::size_t perThread = sizeof(T) * SizeMultiplier;
+};
+
+// Heap owned by `threads` search threads on one NUMA node: each Thread and its
+// Search::Worker (histories, accumulator stack and caches), plus the node's
+// SharedHistories, sized by the next power of two as in thread.cpp.
+std::size_t threadPoolBytes(std::size_t threads) {
+    const std::size_t sharedThreads = threads > 1 ? (2ULL << msb(threads - 1)) : 1;
+    const std::size_t shared        = sharedThreads
+                             * (DynStatsBytes<UnifiedCorrectionHistory>::perThread
+                                + DynStatsBytes<PawnHistory>::perThread);
+    return threads * (sizeof(Thread) + sizeof(Search::Worker)) + sizeof(SharedHistories) + shared;
+}
+
+std::string megabytes(std::size_t bytes) {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1) << double(bytes) / OneMB << " MB";
+    return ss.str();
+}
+
+std::string formatUpdateFull(const Engine::InfoFull& info, bool showWDL) {
+    std::ostringstream ss;
+    ss.imbue(std::locale::classic());
+
+    ss << "info";
+    ss << " depth " << info.depth                          //
+       << " seldepth " << info.selDepth                    //
+       << " multipv " << info.multiPV                      //
+       << " score " << UCIEngine::format_score(info.score);  //
+
+    if (!info.bound.empty())
+        ss << " " << info.bound;
+
+    if (showWDL)
+        ss << " wdl " << info.wdl;
+
+    ss << " nodes " << info.nodes        //
+       << " nps " << info.nps            //
+       << " hashfull " << info.hashfull  //
+       << " tbhits " << info.tbHits      //
+       << " time " << info.timeMs        //
+       << " pv " << info.pv;             //
+
+    return ss.str();
+}
+
+// Mirrors UCIEngine::format_score.
+void setScore(SearchInfo& result, const Score& score) {
+    constexpr int TB_CP = 20000;
+
+    if (score.is<Score::Mate>())
+    {
+        const int plies   = score.get<Score::Mate>().plies;
+        result.scoreKind  = SearchInfo::ScoreKind::mate;
+        result.scoreValue = (plies > 0 ? (plies + 1) : plies) / 2;
+    }
+    else if (score.is<Score::Tablebase>())
+    {
+        const auto tb     = score.get<Score::Tablebase>();
+        result.scoreValue = (tb.win ? TB_CP : -TB_CP) - tb.plies;
+    }
+    else
+        result.scoreValue = score.get<Score::InternalUnits>().value;
+}
+
+// Converts a search update without allocating.
+SearchInfo toSearchInfo(const Engine::InfoFull& info) {
+    SearchInfo result;
+    result.depth    = info.depth;
+    result.selDepth = info.selDepth;
+    result.multiPV  = info.multiPV;
+    setScore(result, info.score);
+
+    if (info.bound == "lowerbound")
+        result.bound = SearchInfo::Bound::lower;
+    else if (info.bound == "upperbound")
+        result.bound = SearchInfo::Bound::upper;
+
+    // Stockfish only fills `wdl` ("<win> <draw> <loss>") when UCI_ShowWDL is on.
+    if (!info.wdl.empty())
+    {
+        const char* cursor   = info.wdl.data();
+        const char* end      = cursor + info.wdl.size();
+        int*        fields[] = {&result.wdlWin, &result.wdlDraw, &result.wdlLoss};
+
+        result.hasWDL = true;
+        for (int* field : fields)
+        {
+            while (cursor < end && *cursor == ' ')
+                ++cursor;
+
+            const auto parsed = std::from_chars(cursor, end, *field);
+            if (parsed.ec != std::errc())
+            {
+                result.hasWDL = false;
+                break;
+            }
+            cursor = parsed.ptr;
+        }
+    }
+
+    result.nodes    = info.nodes;
+    result.nps      = info.nps;
+    result.hashfull = info.hashfull;
+    result.tbHits   = info.tbHits;
+    result.timeMs   = info.timeMs;
+    result.pv       = info.pv;
+    return result;
+}
+
+// The legal move `str` names in `pos`, or Move::none(); the same answer as
+// UCIEngine::to_move, which prints every legal move to compare against. Here
+// the squares are read straight from the text, the move type follows from
+// the piece and its destination, and pseudo_legal() plus legal() check it.
+// Only castling, en passant and promotions fall back to a move list, inside
+// pseudo_legal(). Letters are accepted in either case, like to_move.
+Move parse_uci_move(const Position& pos, std::string_view str) {
+    if (str.size() != 4 && str.size() != 5)
+        return Move::none();
+
+    const auto lower  = [&](std::size_t i) { return char(str[i] | 0x20); };
+    const auto square = [&](std::size_t i) {
+        const char file = lower(i), rank = str[i + 1];
+        return file >= 'a' && file <= 'h' && rank >= '1' && rank <= '8'
+               ? make_square(File(file - 'a'), Rank(rank - '1'))
+               : SQ_NONE;
+    };
+
+    const Square from = square(0), to = square(2);
+    if (from == SQ_NONE || to == SQ_NONE || from == to)
+        return Move::none();
+
+    const Piece pc = pos.piece_on(from);
+    if (pc == NO_PIECE || color_of(pc) != pos.side_to_move())
+        return Move::none();
+
+    const auto valid = [&](Move m) { return pos.pseudo_legal(m) && pos.legal(m); };
+
+    if (str.size() == 5)
+    {
+        const char* promotion = std::strchr("nbrq", lower(4));
+        if (!promotion || type_of(pc) != PAWN)
+            return Move::none();
+
+        const Move m = Move::make<PROMOTION>(from, to, PieceType(KNIGHT + (promotion - "nbrq")));
+        return valid(m) ? m : Move::none();
+    }
+
+    if (type_of(pc) == PAWN && to == pos.ep_square() && file_of(from) != file_of(to))
+    {
+        const Move m = Move::make<EN_PASSANT>(from, to);
+        return valid(m) ? m : Move::none();
+    }
+
+    // Chess960 castling is written as the king taking its own rook.
+    if (type_of(pc) == KING && pos.is_chess960() && pos.piece_on(to) == make_piece(color_of(pc), ROOK))
+    {
+        const Move m = Move::make<CASTLING>(from, to);
+        return valid(m) ? m : Move::none();
+    }
+
+    const Move normal(from, to);
+    if (valid(normal))
+        return normal;
+
+    // Standard castling is written as the king's own two-square step, which
+    // to_move only matches after the ordinary king moves.
+    if (type_of(pc) == KING && !pos.is_chess960() && rank_of(from) == rank_of(to)
+        && (file_of(to) == FILE_G || file_of(to) == FILE_C))
+    {
+        const CastlingRights side = color_of(pc) & (to > from ? KING_SIDE : QUEEN_SIDE);
+        if (pos.can_castle(side))
+        {
+            const Move m = Move::make<CASTLING>(from, pos.castling_rook_square(side));
+            return valid(m) ? m : Move::none();
+        }
+    }
+
+    return Move::none();
+}
+
+// Mirror of the position last handed to Engine::set_position, so a rejected
+// command can leave the session's position untouched. GUIs resend the whole
+// game before every `go`; when the new move list extends the previous one only
+// the new moves are checked, when it is a prefix the extra moves are undone,
+// and an identical position need not be set again.
+//
+// No position before the last capture or pawn move can recur, so the engine
+// only needs the game from there on: anchor_fen() plus moves_since_anchor()
+// give the same repetition and 50-move state as the full move list.
+class PositionHistory {
+public:
+    struct Update {
+        std::optional<std::string> error;
+        bool                       changed = false;
+    };
+
+    Update update(const std::string& fen, const std::vector<std::string>& moves, bool isChess960) {
+        if (pos_ && fen == fen_ && isChess960 == isChess960_ && moves.size() >= moves_.size()
+            && std::equal(moves_.begin(), moves_.end(), moves.begin()))
+        {
+            const std::size_t known = moves_.size();
+            for (std::size_t i = known; i < moves.size(); ++i)
+                if (auto err = play(moves[i]))
+                {
+                    rewind(known);
+                    return {err, false};
+                }
+
+            return {std::nullopt, moves.size() > known};
+        }
+
+        // Walking a game backwards only takes moves back.
+        if (pos_ && fen == fen_ && isChess960 == isChess960_ && moves.size() < moves_.size()
+            && std::equal(moves.begin(), moves.end(), moves_.begin()))
+        {
+            rewind(moves.size());
+            return {std::nullopt, true};
+        }
+
+        // Replay on fresh storage, so a failure keeps the current history.
+        PositionHistory replacement;
+        replacement.pos_ = std::make_unique<Position>();
+        replacement.states_.emplace_back();
+        if (auto err = replacement.pos_->set(fen, isChess960, &replacement.states_.back()))
+            return {std::string(err->what()), false};
+
+        for (const auto& move : moves)
+            if (auto err = replacement.play(move))
+                return {err, false};
+
+        replacement.fen_        = fen;
+        replacement.isChess960_ = isChess960;
+        *this                   = std::move(replacement);
+        return {std::nullopt, true};
+    }
+
+    // Plays one more move, as if `position` had been resent with it appended.
+    std::optional<std::string> push(const std::string& move) { return play(move); }
+
+    std::optional<std::string> pop() {
+        if (moves_.empty())
+            return std::string("No move to take back");
+
+        rewind(moves_.size() - 1);
+        return std::nullopt;
+    }
+
+    const std::string& anchor_fen() const { return anchors_.empty() ? fen_ : anchors_.back().fen; }
+
+    // Folds the keys of the positions since the last irreversible move, which
+    // are all a search can find repeated, the current one last.
+    u64 history_key() const {
+        u64 hash = 0;
+        for (auto st = states_.begin() + (anchors_.empty() ? 0 : anchors_.back().ply); st != states_.end(); ++st)
+            hash = (hash ^ st->key) * 0x9E3779B97F4A7C15ULL;
+        return hash;
+    }
+
+    std::vector<std::string> moves_since_anchor() const {
+        const std::size_t ply = anchors_.empty() ? 0 : anchors_.back().ply;
+        return {moves_.begin() + ply, moves_.end()};
+    }
+
+private:
+    struct Anchor {
+        std::size_t ply;
+        std::string fen;
+    };
+
+    std::optional<std::string> play(const std::string& move) {
+        const Move m = parse_uci_move(*pos_, move);
+        if (m == Move::none())
+            return "Illegal move: " + move;
+
+        // std::deque never relocates elements on emplace_back, so the StateInfo
+        // chain Position keeps pointers into stays valid as it grows.
+        states_.emplace_back();
+        pos_->do_move(m, states_.back());
+        played_.push_back(m);
+        moves_.push_back(move);
+        if (pos_->rule50_count() == 0)
+            anchors_.push_back({moves_.size(), pos_->fen()});
+        return std::nullopt;
+    }
+
+    void rewind(std::size_t size) {
+        while (moves_.size() > size)
+        {
+            pos_->undo_move(played_.back());
+            played_.pop_back();
+            moves_.pop_back();
+            states_.pop_back();
+        }
+        while (!anchors_.empty() && anchors_.back().ply > size)
+            anchors_.pop_back();
+    }
+
+    std::unique_ptr<Position> pos_;
+    std::deque<StateInfo>     states_;
+    std::vector<Move>         played_;
+    std::vector<std::string>  moves_;
+    std::vector<Anchor>       anchors_;
+    std::string               fen_;
+    bool                      isChess960_ = false;
+};
+
+// Options of `go perft N` beyond upstream's: `threads T` splits the tree
+// across T workers and `hash MB` caches subtree counts in a table of that size.
+struct PerftOptions {
+    int threads = 1;
+    int hashMB  = 0;
+};
+
+// Subtree node counts keyed by position and remaining depth, shared by every
+// perft worker without locks. A slot keeps its key XORed with its count, so a
+// slot torn by two concurrent writers fails the check and reads as a miss.
+class PerftCache {
+    struct Slot {
+        std::atomic<u64> check{0};
+        std::atomic<u64> nodes{0};
+    };
+
+public:
+    // Null when the table cannot be allocated, which the caller reports
+    // rather than letting a failed allocation end the host process.
+    static std::unique_ptr<PerftCache> create(std::size_t megabytes) {
+        const std::size_t       count = std::max<std::size_t>(megabytes * OneMB / sizeof(Slot), 1);
+        std::unique_ptr<Slot[]> slots(new (std::nothrow) Slot[count]);
+        if (!slots)
+            return nullptr;
+        return std::unique_ptr<PerftCache>(new PerftCache(std::move(slots), count));
+    }
+
+    bool probe(Key key, Depth depth, u64& nodes) const {
+        const Key   tagged = tag(key, depth);
+        const Slot& slot   = slots_[mul_hi64(tagged, count_)];
+        const u64   count  = slot.nodes.load(std::memory_order_relaxed);
+        if ((slot.check.load(std::memory_order_relaxed) ^ count) != tagged)
+            return false;
+        nodes = count;
+        return true;
+    }
+
+    void store(Key key, Depth depth, u64 nodes) {
+        const Key tagged = tag(key, depth);
+        Slot&     slot   = slots_[mul_hi64(tagged, count_)];
+        slot.check.store(tagged ^ nodes, std::memory_order_relaxed);
+        slot.nodes.store(nodes, std::memory_order_relaxed);
+    }
+
+private:
+    PerftCache(std::unique_ptr<Slot[]> slots, std::size_t count) :
+        slots_(std::move(slots)),
+        count_(count) {}
+
+    // The same position is cached once per remaining depth.
+    static Key tag(Key key, Depth depth) { return key ^ (u64(depth) * 0x9E3779B97F4A7C15ULL); }
+
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t             count_;
+};
+
+// WDL and DTZ results of the `tbprobe` extension, kept in front of the
+// tables' block decompression so stepping back and forth through an endgame
+// decodes each position once. Tablebases are process-wide, so the cache is
+// too; slots are checked as in PerftCache, and sessions share it without
+// locks. A miss decodes under one of a few striped mutexes, so sessions
+// probing the same position at once wait for one decode. Searches never reach
+// it: upstream stores each in-search probe in the transposition table already.
+// Intentionally leaked, like WarmEngineCache.
+class TablebaseCache {
+public:
+    struct Result {
+        int wdl = 0;
+        int dtz = 0;
+    };
+
+    struct Stats {
+        u64 hits     = 0;
+        u64 misses   = 0;
+        u64 shared   = 0;  // Misses answered by another session's decode
+        u64 decodeUs = 0;  // Summed over misses
+    };
+
+    static TablebaseCache& instance() {
+        static auto* cache = new TablebaseCache();
+        return *cache;
+    }
+
+    bool probe(Key key, Result& result) {
+        if (!find(key, result))
+        {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Held while decoding `key` after a miss.
+    std::mutex& decode_mutex(Key key) { return decodeMutexes_[key % DecodeStripes]; }
+
+    // Looks again under decode_mutex(), for a result stored while waiting.
+    bool probe_shared(Key key, Result& result) {
+        if (!find(key, result))
+            return false;
+
+        shared_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void store(Key key, const Result& result, u64 decodeUs) {
+        // The flag bit keeps a stored result distinct from an empty slot.
+        const u64 data = (u64(1) << 40) | (u64(result.wdl + 2) << 32) | std::uint32_t(result.dtz);
+        Slot&     slot = slots_[mul_hi64(key, Size)];
+        slot.check.store(key ^ data, std::memory_order_relaxed);
+        slot.data.store(data, std::memory_order_relaxed);
+        decodeUs_.fetch_add(decodeUs, std::memory_order_relaxed);
+    }
+
+    // A new SyzygyPath may load different tables.
+    void clear() {
+        for (std::size_t i = 0; i < Size; ++i)
+            slots_[i].data.store(0, std::memory_order_relaxed);
+        hits_.store(0, std::memory_order_relaxed);
+        misses_.store(0, std::memory_order_relaxed);
+        shared_.store(0, std::memory_order_relaxed);
+        decodeUs_.store(0, std::memory_order_relaxed);
+    }
+
+    Stats stats() const {
+        return {hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed),
+                shared_.load(std::memory_order_relaxed), decodeUs_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    struct Slot {
+        std::atomic<u64> check{0};
+        std::atomic<u64> data{0};
+    };
+
+    static constexpr std::size_t Size          = 1 << 16;  // 1 MB
+    static constexpr std::size_t DecodeStripes = 16;
+
+    TablebaseCache() :
+        slots_(std::make_unique<Slot[]>(Size)) {}
+
+    bool find(Key key, Result& result) const {
+        const Slot& slot = slots_[mul_hi64(key, Size)];
+        const u64   data = slot.data.load(std::memory_order_relaxed);
+        if (!data || (slot.check.load(std::memory_order_relaxed) ^ data) != key)
+            return false;
+
+        result.wdl = int((data >> 32) & 0xFF) - 2;
+        result.dtz = int(std::int32_t(std::uint32_t(data)));
+        return true;
+    }
+
+    std::unique_ptr<Slot[]>               slots_;
+    std::array<std::mutex, DecodeStripes> decodeMutexes_;
+    std::atomic<u64>                      hits_{0};
+    std::atomic<u64>                      misses_{0};
+    std::atomic<u64>                      shared_{0};
+    std::atomic<u64>                      decodeUs_{0};
+};
+
+// King and pawn against king, solved by retrograde analysis the first time a
+// session asks, so KPK endings resolve without Syzygy files. This is the
+// bitbase upstream shipped before its NNUE evaluation made it redundant in
+// search; here it only answers `tbprobe` and the root report. Positions are
+// normalised to a white pawn on files A-D, giving 2 x 24 x 64 x 64 entries
+// in 24 KB. Built once per process and then read without locks.
+class KPKBitbase {
+public:
+    // Sets `wdl` from the side to move's point of view (2 win, 0 draw).
+    static bool probe(const Position& pos, int& wdl) {
+        if (pos.count<ALL_PIECES>() != 3 || pos.count<PAWN>() != 1)
+            return false;
+
+        const Color strong = pos.pieces(WHITE, PAWN) ? WHITE : BLACK;
+        Square      wksq   = pos.square<KING>(strong);
+        Square      bksq   = pos.square<KING>(~strong);
+        Square      psq    = lsb(pos.pieces(PAWN));
+        if (strong == BLACK)
+        {
+            wksq = flip_rank(wksq);
+            bksq = flip_rank(bksq);
+            psq  = flip_rank(psq);
+        }
+        if (file_of(psq) >= FILE_E)
+        {
+            wksq = flip_file(wksq);
+            bksq = flip_file(bksq);
+            psq  = flip_file(psq);
+        }
+
+        const Color stm = pos.side_to_move() == strong ? WHITE : BLACK;
+        const bool  win = instance().wins_[index(stm, bksq, wksq, psq)];
+        wdl             = !win ? 0 : stm == WHITE ? 2 : -2;
+        return true;
+    }
+
+private:
+    enum Result : std::uint8_t {
+        Invalid = 0,
+        Unknown = 1,
+        Draw    = 2,
+        Win     = 4
+    };
+
+    static constexpr unsigned Size = 2 * 24 * 64 * 64;
+
+    // Bits 0-5 white king, 6-11 black king, 12 side to move, 13-14 pawn
+    // file, 15-17 RANK_7 minus pawn rank.
+    static unsigned index(Color stm, Square bksq, Square wksq, Square psq) {
+        return unsigned(wksq) | (bksq << 6) | (stm << 12) | (file_of(psq) << 13)
+             | ((RANK_7 - rank_of(psq)) << 15);
+    }
+
+    static bool adjacent(Square a, Square b) { return Attacks::attacks_bb<KING>(a) & b; }
+
+    static const KPKBitbase& instance() {
+        static const auto* bitbase = new KPKBitbase();
+        return *bitbase;
+    }
+
+    KPKBitbase() {
+        std::vector<Result> db(Size);
+        for (unsigned idx = 0; idx < Size; ++idx)
+            db[idx] = classify_initial(idx);
+
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (unsigned idx = 0; idx < Size; ++idx)
+                if (db[idx] == Unknown && (db[idx] = classify(idx, db)) != Unknown)
+                    changed = true;
+        }
+
+        for (unsigned idx = 0; idx < Size; ++idx)
+            wins_[idx] = db[idx] == Win;
+    }
+
+    struct Squares {
+        Color  stm;
+        Square wksq, bksq, psq;
+    };
+
+    static Squares squares(unsigned idx) {
+        return {Color((idx >> 12) & 1), Square(idx & 0x3F), Square((idx >> 6) & 0x3F),
+                make_square(File((idx >> 13) & 3), Rank(RANK_7 - ((idx >> 15) & 7)))};
+    }
+
+    static Result classify_initial(unsigned idx) {
+        const auto [stm, wksq, bksq, psq] = squares(idx);
+        const Square promotion            = psq + NORTH;
+
+        // Overlapping pieces, or kings that could be captured
+        if (wksq == bksq || adjacent(wksq, bksq) || wksq == psq || bksq == psq
+            || (stm == WHITE && (pawn_attacks_bb<WHITE>(square_bb(psq)) & bksq)))
+            return Invalid;
+
+        // The pawn promotes and the queen cannot be taken
+        if (stm == WHITE && rank_of(psq) == RANK_7 && wksq != promotion && bksq != promotion
+            && (!adjacent(bksq, promotion) || adjacent(wksq, promotion)))
+            return Win;
+
+        // Stalemate, or the pawn is lost
+        const Bitboard whiteKing = Attacks::attacks_bb<KING>(wksq);
+        const Bitboard blackKing = Attacks::attacks_bb<KING>(bksq);
+        const Bitboard guarded   = whiteKing | pawn_attacks_bb<WHITE>(square_bb(psq));
+        if (stm == BLACK && (!(blackKing & ~guarded) || (blackKing & ~whiteKing & psq)))
+            return Draw;
+
+        return Unknown;
+    }
+
+    // A position is won for the side to move when one move reaches a won
+    // one, lost when every move reaches a lost one, and unknown otherwise.
+    static Result classify(unsigned idx, const std::vector<Result>& db) {
+        const auto [stm, wksq, bksq, psq] = squares(idx);
+        const Result good                 = stm == WHITE ? Win : Draw;
+        const Result bad                  = stm == WHITE ? Draw : Win;
+
+        unsigned r = Invalid;
+        for (Bitboard b = Attacks::attacks_bb<KING>(stm == WHITE ? wksq : bksq); b;)
+        {
+            const Square to = pop_lsb(b);
+            r |= stm == WHITE ? db[index(BLACK, bksq, to, psq)] : db[index(WHITE, to, wksq, psq)];
+        }
+
+        if (stm == WHITE)
+        {
+            if (rank_of(psq) < RANK_7)
+                r |= db[index(BLACK, bksq, wksq, psq + NORTH)];
+
+            if (rank_of(psq) == RANK_2 && psq + NORTH != wksq && psq + NORTH != bksq)
+                r |= db[index(BLACK, bksq, wksq, psq + NORTH + NORTH)];
+        }
+
+        return r & good ? good : r & Unknown ? Unknown : bad;
+    }
+
+    std::bitset<Size> wins_;
+};
+
+// Reads the Syzygy files a search is about to probe on a background thread,
+// so that the search threads' first probes into upstream's mapping of them
+// find resident pages instead of stalling on flash reads. Upstream maps the
+// files privately and without access hints; filling the page cache under the
+// mapping is the hint available from outside. Used by one session thread.
+class TablebasePrefetcher {
+public:
+    using Report = std::function<void(const std::string&)>;
+
+    explicit TablebasePrefetcher(Report report) :
+        report_(std::move(report)) {}
+
+    ~TablebasePrefetcher() { reset(); }
+
+    // Reads those of `files` not read before; skipped while a warm-up runs,
+    // so a later search picks up what this one left.
+    void prefetch(std::vector<std::string> files) {
+        if (running_.load())
+            return;
+        if (thread_.joinable())
+            thread_.join();
+
+        files.erase(std::remove_if(files.begin(), files.end(),
+                                   [this](const std::string& file) { return !read_.insert(file).second; }),
+                    files.end());
+        if (files.empty())
+            return;
+
+        running_.store(true);
+        thread_ = std::thread([this, files = std::move(files)] {
+            run(files);
+            running_.store(false);
+        });
+    }
+
+    // For a new SyzygyPath: stops any warm-up and forgets what was read.
+    void reset() {
+        cancelled_.store(true);
+        if (thread_.joinable())
+            thread_.join();
+        cancelled_.store(false);
+        read_.clear();
+    }
+
+private:
+    void run(const std::vector<std::string>& files) {
+        const auto        began = std::chrono::steady_clock::now();
+        std::vector<char> buffer(OneMB);
+        u64               bytes = 0;
+        for (const auto& file : files)
+        {
+            const int fd = ::open(file.c_str(), O_RDONLY);
+            if (fd < 0)
+                continue;
+
+            off_t   offset = 0;
+            ssize_t read;
+            while (!cancelled_.load() && (read = ::pread(fd, buffer.data(), buffer.size(), offset)) > 0)
+            {
+                offset += read;
+                bytes += u64(read);
+            }
+            ::close(fd);
+        }
+
+        if (!cancelled_.load())
+            report_("Syzygy prefetch read " + std::to_string(files.size()) + " files, "
+                    + std::to_string(bytes / OneMB) + " MB in "
+                    + std::to_string(elapsedMicroseconds(began) / 1000) + " ms");
+    }
+
+    Report                report_;
+    std::set<std::string> read_;
+    std::thread           thread_;
+    std::atomic<bool>     running_{false};
+    std::atomic<bool>     cancelled_{false};
+};
+
+// BookEntry::move for `m`.
+std::uint16_t book_move_code(Move m) {
+    const int promotion = m.type_of() == PROMOTION ? m.promotion_type() - KNIGHT + 1 : 0;
+    return std::uint16_t(int(m.to_sq()) | (int(m.from_sq()) << 6) | (promotion << 12));
+}
+
+// A BookEntry file mapped read-only, so a book of any size costs only the
+// pages its probes touch. Used by one session thread.
+class OpeningBook {
+public:
+    OpeningBook(const OpeningBook&)            = delete;
+    OpeningBook& operator=(const OpeningBook&) = delete;
+
+    ~OpeningBook() { ::munmap(map_, bytes_); }
+
+    static std::optional<std::string> open(const std::string& path, std::unique_ptr<OpeningBook>& book) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return "Opening book " + path + " could not be opened";
+
+        struct stat info{};
+        std::optional<std::string> err;
+        void*                      map = MAP_FAILED;
+        if (::fstat(fd, &info) || info.st_size <= 0 || info.st_size % sizeof(BookEntry))
+            err = "Opening book " + path + " is not a whole number of entries";
+        else if ((map = ::mmap(nullptr, std::size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+            err = "Opening book " + path + " could not be mapped";
+        ::close(fd);  // The mapping keeps the file
+        if (err)
+            return err;
+
+        book.reset(new OpeningBook(map, std::size_t(info.st_size)));
+        return std::nullopt;
+    }
+
+    std::size_t size() const { return bytes_ / sizeof(BookEntry); }
+
+    // The legal moves the book gives for `pos` and their weights. Entries
+    // that match no legal move, from a corrupt book or a key collision, are
+    // skipped.
+    std::vector<std::pair<Move, int>> moves(const Position& pos) const {
+        const auto* begin = static_cast<const BookEntry*>(map_);
+        const auto  range = std::equal_range(
+          begin, begin + size(), BookEntry{pos.key()},
+          [](const BookEntry& a, const BookEntry& b) { return a.key < b.key; });
+
+        std::vector<std::pair<Move, int>> result;
+        const MoveList<LEGAL>             legal(pos);
+        for (auto entry = range.first; entry != range.second; ++entry)
+        {
+            const auto m = std::find_if(legal.begin(), legal.end(), [&](Move move) {
+                return book_move_code(move) == entry->move;
+            });
+            if (m != legal.end())
+                result.emplace_back(*m, entry->weight);
+        }
+        return result;
+    }
+
+private:
+    OpeningBook(void* map, std::size_t bytes) :
+        map_(map),
+        bytes_(bytes) {}
+
+    void*       map_;
+    std::size_t bytes_;
+};
+
+// FNV-1a, for result cache keys that must not change between builds.
+u64 stable_hash(std::string_view bytes, u64 hash = 14695981039346656037ULL) {
+    for (const char c : bytes)
+        hash = (hash ^ std::uint8_t(c)) * 1099511628211ULL;
+    return hash;
+}
+
+// Finished native search results by a key of the position, its repetition
+// history, the limits, and the options that change a search, shared by every
+// session. Slots live in one mapping, anonymous or of ResultCacheFile, which
+// then keeps them across runs. A key picks a bucket of four slots, and a
+// store replaces the least recently used slot of its bucket: LRU per bucket,
+// which a fixed-size mapping allows without a separate index. A file is for
+// one process at a time.
+class ResultCache {
+public:
+    // One slot, also its layout in the file. Moves are UCI text, and `pv`
+    // is cut at a move boundary.
+    struct Record {
+        u64           key         = 0;  // Zero for an empty slot
+        u64           lastUse     = 0;
+        u64           nodes       = 0;
+        u64           timeMs      = 0;
+        std::int32_t  scoreValue  = 0;
+        std::uint16_t depth       = 0;
+        std::uint16_t selDepth    = 0;
+        std::uint8_t  scoreKind   = 0;
+        std::uint8_t  bound       = 0;
+        std::uint8_t  hasInfo     = 0;
+        std::uint8_t  hasWDL      = 0;
+        std::uint16_t wdl[3]      = {};
+        char          bestmove[6] = {};
+        char          ponder[6]   = {};
+        char          reserved[2] = {};
+        char          pv[192]     = {};
+    };
+
+    static_assert(sizeof(Record) == 256);
+
+    static ResultCache& instance() {
+        static auto* cache = new ResultCache();
+        return *cache;
+    }
+
+    // Resizes the cache to `megabytes`, zero turning it off, and maps `file`
+    // if given. A file of another size or format is cleared first. Unchanged
+    // settings keep the current entries.
+    std::optional<std::string> configure(int megabytes, const std::string& file) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (megabytes == megabytes_ && file == file_)
+            return std::nullopt;
+
+        unmap();
+        const std::size_t buckets = std::size_t(megabytes) * OneMB / sizeof(Record) / BucketSize;
+        if (!buckets)
+            return std::nullopt;
+
+        const std::size_t bytes = sizeof(Header) + buckets * BucketSize * sizeof(Record);
+        void*             map   = MAP_FAILED;
+        if (file.empty())
+            map = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        else if (const int fd = ::open(file.c_str(), O_RDWR | O_CREAT, 0644); fd >= 0)
+        {
+            if (!::ftruncate(fd, off_t(bytes)))
+                map = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);  // The mapping keeps the file
+        }
+        if (map == MAP_FAILED)
+            return file.empty() ? std::string("Result cache of ") + std::to_string(megabytes) + " MB could not be allocated"
+                                : "Result cache file " + file + " could not be mapped";
+
+        map_       = map;
+        bytes_     = bytes;
+        buckets_   = buckets;
+        megabytes_ = megabytes;
+        file_      = file;
+
+        // A new or resized file has no valid header, so its slots start empty.
+        auto& header = *static_cast<Header*>(map_);
+        if (std::memcmp(header.magic, Magic, sizeof(header.magic)) || header.buckets != buckets)
+        {
+            std::memset(map_, 0, bytes_);
+            std::memcpy(header.magic, Magic, sizeof(header.magic));
+            header.buckets = buckets;
+        }
+        return std::nullopt;
+    }
+
+    bool probe(u64 key, Record& record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!map_)
+            return false;
+
+        for (Record* slot = bucket(key); slot < bucket(key) + BucketSize; ++slot)
+            if (slot->key == key)
+            {
+                slot->lastUse = ++header().clock;
+                record        = *slot;
+                ++hits_;
+                return true;
+            }
+
+        ++misses_;
+        return false;
+    }
+
+    void store(Record record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!map_ || !record.key)
+            return;
+
+        Record* victim = nullptr;
+        for (Record* slot = bucket(record.key); slot < bucket(record.key) + BucketSize; ++slot)
+        {
+            if (slot->key == record.key || !slot->key)
+            {
+                victim = slot;
+                break;
+            }
+            if (!victim || slot->lastUse < victim->lastUse)
+                victim = slot;
+        }
+
+        evictions_ += victim->key && victim->key != record.key;
+        record.lastUse = ++header().clock;
+        *victim        = record;
+        ++stores_;
+    }
+
+    ResultCacheStats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ResultCacheStats stats;
+        stats.hits      = hits_;
+        stats.misses    = misses_;
+        stats.stores    = stores_;
+        stats.evictions = evictions_;
+        stats.capacity  = buckets_ * BucketSize;
+        if (map_)
+            for (std::size_t i = 0; i < buckets_ * BucketSize; ++i)
+                stats.entries += slots()[i].key != 0;
+        return stats;
+    }
+
+private:
+    struct Header {
+        char         magic[16];
+        u64          buckets;
+        u64          clock;  // Last lastUse handed out
+        std::uint8_t reserved[sizeof(Record) - 32];
+    };
+
+    static_assert(sizeof(Header) == sizeof(Record));
+
+    static constexpr std::size_t BucketSize = 4;
+    static constexpr char        Magic[16]  = "SFEResultCache1";
+
+    ResultCache() = default;
+
+    Header& header() { return *static_cast<Header*>(map_); }
+    Record* slots() { return reinterpret_cast<Record*>(static_cast<Header*>(map_) + 1); }
+
+    Record* bucket(u64 key) { return slots() + mul_hi64(key, buckets_) * BucketSize; }
+
+    void unmap() {
+        if (map_)
+            ::munmap(map_, bytes_);
+        map_       = nullptr;
+        bytes_     = 0;
+        buckets_   = 0;
+        megabytes_ = 0;
+        file_.clear();
+    }
+
+    std::mutex  mutex_;
+    void*       map_       = nullptr;
+    std::size_t bytes_     = 0;
+    std::size_t buckets_   = 0;
+    int         megabytes_ = 0;
+    std::string file_;
+    u64         hits_      = 0;
+    u64         misses_    = 0;
+    u64         stores_    = 0;
+    u64         evictions_ = 0;
+};
+
+// Major page faults of the whole process so far, which include those taken
+// on tablebase pages that were not resident.
+long major_page_faults() {
+    rusage usage{};
+    return getrusage(RUSAGE_SELF, &usage) ? 0 : usage.ru_majflt;
+}
+
+// Number of legal moves in `pos`, equal to MoveList<LEGAL>(pos).size() but
+// counted from the checker and pin bitboards: every destination set is
+// already restricted to the squares that answer a check and, for a pinned
+// piece, to its pin line, so only king steps, en passant and castling need a
+// legality test of their own and no move list is built.
+u64 count_legal_moves(const Position& pos) {
+    const Color    us       = pos.side_to_move();
+    const Color    them     = ~us;
+    const Square   ksq      = pos.square<KING>(us);
+    const Bitboard own      = pos.pieces(us);
+    const Bitboard occupied = pos.pieces();
+    const Bitboard checkers = pos.checkers();
+
+    u64 count = 0;
+    for (Bitboard b = Attacks::attacks_bb<KING>(ksq) & ~own; b;)
+        count += !pos.attackers_to_exist(pop_lsb(b), occupied ^ ksq, them);
+    if (more_than_one(checkers))
+        return count;
+
+    const Bitboard target = checkers ? Attacks::between_bb(ksq, lsb(checkers)) : ~own;
+    const Bitboard pinned = pos.blockers_for_king(us) & own;
+    const auto     onPin  = [&](Square from) {
+        return pinned & from ? Attacks::line_bb(ksq, from) : ~Bitboard(0);
+    };
+
+    for (Bitboard b = own & ~pos.pieces(PAWN, KING); b;)
+    {
+        const Square from = pop_lsb(b);
+        count += popcount(Attacks::attacks_bb(type_of(pos.piece_on(from)), from, occupied) & target
+                          & onPin(from));
+    }
+
+    const Direction up        = pawn_push(us);
+    const Bitboard  thirdRank = rank_bb(relative_rank(us, RANK_3));
+    for (Bitboard b = pos.pieces(us, PAWN); b;)
+    {
+        const Square   from   = pop_lsb(b);
+        const Bitboard single = square_bb(from + up) & ~occupied;
+        const Bitboard double_ =
+          (single & thirdRank) ? square_bb(from + up + up) & ~occupied : Bitboard(0);
+        const Bitboard captures = Attacks::attacks_bb<PAWN>(from, us) & pos.pieces(them);
+        const int      moves    = popcount((single | double_ | captures) & target & onPin(from));
+        count += relative_rank(us, from) == RANK_7 ? 4 * moves : moves;
+    }
+
+    if (const Square ep = pos.ep_square(); ep != SQ_NONE)
+    {
+        const Square captured = ep - up;
+        if (!(checkers & ~square_bb(captured) & pos.pieces(KNIGHT, PAWN)))
+            for (Bitboard b = Attacks::attacks_bb<PAWN>(ep, them) & pos.pieces(us, PAWN); b;)
+            {
+                const Bitboard after = (occupied ^ pop_lsb(b) ^ captured) | ep;
+                count += !(Attacks::attacks_bb<ROOK>(ksq, after) & pos.pieces(them, ROOK, QUEEN))
+                      && !(Attacks::attacks_bb<BISHOP>(ksq, after) & pos.pieces(them, BISHOP, QUEEN));
+            }
+    }
+
+    if (!checkers)
+        for (const CastlingRights cr : {us & KING_SIDE, us & QUEEN_SIDE})
+            count += pos.can_castle(cr) && !pos.castling_impeded(cr)
+                  && pos.legal(Move::make<CASTLING>(ksq, pos.castling_rook_square(cr)));
+    return count;
+}
+
+// Leaf count `depth` plies below `pos`, bulk-counting the last ply.
+u64 perft_subtree(Position& pos, Depth depth, PerftCache* cache) {
+    if (depth <= 1)
+        return depth == 1 ? count_legal_moves(pos) : 1;
+
+    u64 nodes = 0;
+    if (cache && cache->probe(pos.key(), depth, nodes))
+        return nodes;
+
+    StateInfo st;
+    for (const auto& m : MoveList<LEGAL>(pos))
+    {
+        pos.do_move(m, st);
+        nodes += perft_subtree(pos, depth - 1, cache);
+        pos.undo_move(m);
+    }
+    if (cache)
+        cache->store(pos.key(), depth, nodes);
+    return nodes;
+}
+
+// Proves a forced mate for the side to move over checking moves only: the
+// attacker tries each check, fewest replies first, and the defender every
+// evasion. That tree is small next to a full search, and most puzzle mates
+// lie in it; one that needs a quiet move is not found. Deepens a move at a
+// time, so the mate found is the shortest by checks, and remembers the depth
+// each attacking position failed at. Stops after MaxNodes moves.
+class MateFinder {
+public:
+    static constexpr u64 MaxNodes = 100000;
+
+    // The mating line of at most `maxMoves` attacking moves, defended by the
+    // evasion that lasts longest, or empty.
+    std::vector<Move> find(Position& pos, int maxMoves) {
+        std::vector<Move> pv;
+        for (int moves = 1; moves <= maxMoves && nodes_ < MaxNodes; ++moves)
+            if (attack(pos, 2 * moves - 1, pv))
+                return pv;
+        return {};
+    }
+
+    u64 nodes() const { return nodes_; }
+
+private:
+    bool attack(Position& pos, int plies, std::vector<Move>& pv) {
+        const auto failed = failedPlies_.find(pos.key());
+        if (failed != failedPlies_.end() && failed->second >= plies)
+            return false;
+
+        StateInfo                         st;
+        std::vector<std::pair<u64, Move>> checks;
+        for (const auto& m : MoveList<LEGAL>(pos))
+        {
+            if (!pos.gives_check(m))
+                continue;
+
+            ++nodes_;
+            pos.do_move(m, st);
+            const u64 replies = count_legal_moves(pos);
+            pos.undo_move(m);
+            if (!replies)
+            {
+                pv = {m};
+                return true;
+            }
+            checks.emplace_back(replies, m);
+        }
+
+        if (plies > 1)
+        {
+            std::stable_sort(checks.begin(), checks.end(),
+                             [](const auto& a, const auto& b) { return a.first < b.first; });
+            for (const auto& [replies, m] : checks)
+            {
+                if (nodes_ >= MaxNodes)
+                    return false;
+
+                pos.do_move(m, st);
+                const bool mates = defend(pos, plies - 1, pv);
+                pos.undo_move(m);
+                if (mates)
+                {
+                    pv.insert(pv.begin(), m);
+                    return true;
+                }
+            }
+        }
+
+        // A node budget cut is not a disproof.
+        if (nodes_ < MaxNodes)
+            failedPlies_[pos.key()] = plies;
+        return false;
+    }
+
+    // The side to move is in check and has a legal move.
+    bool defend(Position& pos, int plies, std::vector<Move>& pv) {
+        StateInfo         st;
+        std::vector<Move> line;
+        pv.clear();
+        for (const auto& m : MoveList<LEGAL>(pos))
+        {
+            ++nodes_;
+            pos.do_move(m, st);
+            const bool mated = attack(pos, plies - 1, line);
+            pos.undo_move(m);
+            if (!mated)
+                return false;
+
+            if (line.size() + 1 > pv.size())
+            {
+                pv = {m};
+                pv.insert(pv.end(), line.begin(), line.end());
+            }
+        }
+        return true;
+    }
+
+    u64                nodes_ = 0;
+    std::map<Key, int> failedPlies_;
+};
+
+struct MateProof {
+    std::vector<std::string> line;  // UCI moves, attacker first
+    Score                    score;
+    u64                      nodes     = 0;
+    TimePoint                elapsedMs = 0;
+};
+
+// Per-session counterpart of Stockfish::UCIEngine. It drives Stockfish::Engine
+// through the same public API, but routes every line to its own SessionOutput
+// and reports command failures instead of terminating the host process.
+class EmbeddedUCIEngine {
+public:
+    EmbeddedUCIEngine(std::istream&   in,
+                      std::ostream&   out,
+                      CommandLine     cli,
+                      SessionHooks    hooks,
+                      SessionControl* control) :
+        in_(in),
+        output_(out),
+        hooks_(std::move(hooks)),
+        control_(control),
+        cli_(std::move(cli)),
+        engine_(WarmEngineCache::instance().take()),
+        warm_(engine_ != nullptr),
+        pristine_(!warm_ || !WarmEngineCache::instance().retains_search_state()) {
+
+        if (warm_)
+            engine_->set_position(StartFEN, {});
+        else
+        {
+            SF_SIGNPOST_BEGIN("Network load", this, "new engine");
+            engine_ = std::make_unique<Engine>(
+              cli_.argc > 0 ? std::optional{path_from_utf8(cli_.argv[0])} : std::nullopt);
+            SF_SIGNPOST_END("Network load", this);
+        }
+        positions_.update(StartFEN, {}, engine_->get_options()["UCI_Chess960"]);
+
+        engine_->get_options().add_info_listener([this](const std::optional<std::string>& str) {
+            if (str.has_value())
+                output_.info_string(*str);
+        });
+
+        // A warm engine already has it from its first session.
+        if (!engine_->get_options().count(MemoryBudgetOption))
+        {
+            engine_->get_options().add(MemoryBudgetOption, Option(0, 0, MaxMemoryBudgetMB));
+            engine_->get_options().add(PerformanceCoresOption, Option(false));
+            engine_->get_options().add(SyzygyPrefetchOption, Option(false));
+            engine_->get_options().add(BookFileOption, Option(""));
+            engine_->get_options().add(BookDepthOption, Option(16, 0, 1024));
+            engine_->get_options().add(BookWeightedOption, Option(false));
+            engine_->get_options().add(ResultCacheOption, Option(0, 0, 65536));
+            engine_->get_options().add(ResultCacheFileOption, Option(""));
+            engine_->get_options().add(InfoThrottleOption, Option(0, 0, 5000));
+            engine_->get_options().add(MultiPVDeltaOption, Option(false));
+            engine_->get_options().add(MateFinderOption, Option(true));
+            engine_->get_options().add(SkillEarlyStopOption, Option(true));
+            engine_->get_options().add(KeepSearchStateOption, Option(false));
+        }
+
+        init_search_update_listeners();
+
+        if (control_)
+            control_->attach([this] { interrupt_stop(); }, [this] { interrupt_ponderhit(); },
+                             [this] { interrupt_background(); },
+                             [this](std::uint64_t ticket) { interrupt_search(ticket); });
+    }
+
+    ~EmbeddedUCIEngine() {
+        if (control_)
+            control_->detach();
+        wait_for_tablebases();
+        park_engine();
+    }
+
+    auto& engine_options() { return engine_->get_options(); }
+
+    bool warm_start() const { return warm_; }
+
+    void report_startup(const StartupTiming& timing) {
+        if (hooks_.onStartup)
+            hooks_.onStartup(timing);
+        report_memory_footprint();
+    }
+
+    // Out-of-band counterparts of the `stop` and `ponderhit` commands, callable
+    // from any thread while loop() runs. Engine::stop() only sets an atomic
+    // flag; set_ponderhit() reads the thread pool, so it must not overlap a
+    // pool rebuild in setoption().
+    void interrupt_stop() {
+        searchStopped_ = true;
+        engine_->stop();
+    }
+
+    void interrupt_ponderhit() {
+        std::lock_guard<std::mutex> lock(threadPoolMutex_);
+        engine_->set_ponderhit(false);
+    }
+
+    // backgroundMutex_ keeps the flag and the running search in step, so a
+    // foreground search that starts just after a background one finishes is
+    // never stopped by mistake.
+    void interrupt_background() {
+        std::lock_guard<std::mutex> lock(backgroundMutex_);
+        if (backgroundRunning_)
+            engine_->stop();
+    }
+
+    // The same lock makes a cancel_search() for a native search that is just
+    // starting either seen as withdrawn or stop the search it started.
+    void interrupt_search(std::uint64_t ticket) {
+        std::lock_guard<std::mutex> lock(backgroundMutex_);
+        if (runningTicket_ == ticket)
+            interrupt_stop();
+    }
+
+    void loop() {
+        set_console_utf8();
+        std::string token, cmd;
+
+        do
+        {
+            if (!std::getline(in_, cmd))  // Wait for an input or an end-of-file (EOF) indication
+                cmd = "quit";
+
+            currentCmd_ = cmd;
+            std::istringstream is(cmd);
+
+            token.clear();  // Avoid a stale if getline() returns nothing or a blank line
+            is >> token;
+
+            if (!runsDuringTablebaseScan(token))
+                wait_for_tablebases();
+
+            if (token == "quit" || token == "stop")
+                interrupt_stop();
+
+            else if (token == "ponderhit")
+                engine_->set_ponderhit(false);
+
+            else if (token == "uci")
+            {
+                output_.write("id name " + engine_info(true) + "\n"
+                              + optionsListing(engine_->get_options()));
+                output_.write("uciok");
+            }
+
+            else if (token == "setoption")
+                setoption(is);
+            else if (token == "go")
+            {
+                // Send info strings after the go command, matching upstream.
+                output_.info_string(engine_->numa_config_information_as_string());
+                output_.info_string(engine_->thread_allocation_information_as_string());
+                if (engine_->get_options()[PerformanceCoresOption])
+                    output_.info_string(core_class_information());
+                go(is);
+            }
+            else if (token == "position")
+                position(is);
+            else if (token == "ucinewgame")
+                new_game();
+            else if (token == "isready")
+                output_.write("readyok");
+
+            // Wrapper extensions for stepping through a game one move at a time.
+            else if (token == "pushmove")
+                push_move(is);
+            else if (token == "popmove")
+                pop_move();
+            else if (token == "tbprobe")
+                tablebase_probe();
+
+            // Custom non-UCI commands, mainly for debugging purposes.
+            else if (token == "flip")
+            {
+                if (auto err = engine_->flip())
+                    report_command_failure(err->what());
+                else
+                    positions_.update(engine_->fen(), {}, engine_->get_options()["UCI_Chess960"]);
+            }
+            else if (token == "bench")
+                bench(is);
+            else if (token == "d")
+                output_.write(engine_->visualize());
+            else if (token == "nnuebench")
+                nnue_stage_benchmark(is);
+            else if (token == "debugcounters")
+            {
+                if (is >> token && token == "clear")
+                    DebugCounters::instance().clear();
+                else
+                    print_debug_counters();
+            }
+            else if (token == "compiler")
+            {
+                output_.write(compiler_info());
+                // The same line speedtest prints, which is not available here.
+                output_.info_string(std::string("Large pages: ") + (has_large_pages() ? "yes" : "no"));
+            }
+
+            // Queued by SFEngine for a search submitted through SessionControl.
+            else if (cmd == NativeSearchCommand())
+                native_search();
+            else if (cmd == NativeEvalCommand())
+                native_eval();
+            else if (cmd == NetworkSwapCommand())
+                network_swap();
+            else if (token == std::string_view("\0hash-limit", 11))
+                limit_hash(is);
+            else if (token == std::string_view("\0thread-limit", 13))
+                limit_threads(is);
+            else if (cmd == RebuildThreadsCommand())
+                rebuild_threads();
+
+            // These upstream commands print through process-wide std::cout or
+            // std::cerr, which embedded sessions deliberately never touch.
+            else if (token == "eval" || token == "export_net" || token == "speedtest")
+                output_.error("'" + token + "' is unsupported by the embedded engine");
+
+            else if (token == "--help" || token == "help" || token == "--license" || token == "license")
+                output_.write(
+                  "\nStockfish is a powerful chess engine for playing and analyzing."
+                  "\nIt is released as free software licensed under the GNU GPLv3 License."
+                  "\nStockfish is normally used with a graphical user interface (GUI) and implements"
+                  "\nthe Universal Chess Interface (UCI) protocol to communicate with a GUI, an API, etc."
+                  "\nFor any further information, visit https://github.com/official-stockfish/Stockfish#readme"
+                  "\nor read the corresponding README.md and Copying.txt files distributed along with this program.\n");
+            else if (!token.empty() && token[0] != '#')
+                output_.write("Unknown command: '" + cmd + "'. Type help for more information.");
+
+            report_memory_footprint();
+        } while (token != "quit");
+    }
+
+private:
+    // Hash is the TT's size, since every resize and limit goes through it; the
+    // network is allocated once per NUMA node, which on Apple devices is one.
+    void report_memory_footprint() {
+        if (!hooks_.onMemoryFootprint)
+            return;
+
+        const auto&     options = engine_->get_options();
+        MemoryFootprint footprint;
+        footprint.hashBytes    = std::uint64_t(int(options["Hash"])) * 1024 * 1024;
+        footprint.networkBytes = sizeof(Eval::NNUE::Network);
+        footprint.threads      = int(options["Threads"]);
+        footprint.threadBytes  = std::uint64_t(footprint.threads) * sizeof(Search::Worker);
+        if (footprint == lastFootprint_)
+            return;
+
+        lastFootprint_ = footprint;
+        hooks_.onMemoryFootprint(footprint);
+    }
+
+    void init_search_update_listeners() {
+        engine_->set_on_iter([this](const Engine::InfoIter& info) {
+            // Superseded by the next one anyway, so a throttled one is dropped.
+            if (infoThrottleMs_ && now() - lastInfoEmit_ < infoThrottleMs_)
+                return;
+
+            std::ostringstream ss;
+            ss.imbue(std::locale::classic());
+            ss << "info depth " << info.depth << " currmove " << info.currmove
+               << " currmovenumber " << info.currmovenumber;
+            output_.write(ss.str());
+        });
+        engine_->set_on_update_no_moves([this](const Engine::InfoShort& info) {
+            if (activeNative_)
+            {
+                activeNative_->result.hasInfo    = true;
+                activeNative_->result.info.depth = info.depth;
+                setScore(activeNative_->result.info, info.score);
+            }
+            output_.write("info depth " + std::to_string(info.depth) + " score "
+                          + UCIEngine::format_score(info.score));
+        });
+        engine_->set_on_update_full([this](const Engine::InfoFull& info) {
+            std::uint32_t lineID  = 0;
+            const bool    changed = track_line(info, lineID);
+
+            record_native_update(info, lineID);
+            if (info.multiPV == 1 && info.bound.empty())
+                SF_SIGNPOST_EVENT("Iteration", "depth %d", info.depth);
+            if (hooks_.onSearchTelemetry && info.multiPV == 1 && info.bound.empty()
+                && info.depth > telemetry_.depth)
+                report_iteration(info);
+            if (changed && !hold_update(info, lineID))
+                emit_update(info, lineID);
+        });
+        engine_->set_on_bestmove(
+          [this](std::string_view bestmove, std::string_view ponder) { finish_search(bestmove, ponder); });
+        engine_->set_on_verify_network([this](std::string_view str) { output_.info_string(str); });
+    }
+
+    // A native search's own result and hints see every update.
+    void record_native_update(const Engine::InfoFull& info, std::uint32_t lineID) {
+        if (!activeNative_ || info.multiPV != 1)
+            return;
+
+        auto& result       = activeNative_->result;
+        result.hasInfo     = true;
+        result.info        = toSearchInfo(info);
+        result.info.lineID = lineID;
+        result.pv.assign(result.info.pv);
+        result.info.pv = result.pv;
+        if (activeNative_->progress)
+            activeNative_->progress(result.info);
+        report_provisional(*activeNative_);
+    }
+
+    // Gives `info` the ID of its root move's line, which keeps it however
+    // the lines reorder. Returns false when MultiPVDelta is set and the line
+    // has the same rank, score, bound and PV as when it was last reported;
+    // multipv 1 always goes out, to carry depth, nodes and time. Runs on the
+    // main search thread.
+    bool track_line(const Engine::InfoFull& info, std::uint32_t& lineID) {
+        if (info.pv.empty())
+            return true;
+
+        const std::string_view rootMove = info.pv.substr(0, info.pv.find(' '));
+        auto                   line     = reportedLines_.find(rootMove);
+        const bool             added    = line == reportedLines_.end();
+        if (added)
+        {
+            line                     = reportedLines_.emplace(std::string(rootMove), ReportedLine{}).first;
+            line->second.info.lineID = std::uint32_t(reportedLines_.size());
+        }
+        lineID = line->second.info.lineID;
+
+        SearchInfo latest = toSearchInfo(info);
+        latest.lineID     = lineID;
+
+        auto&      reported  = line->second;
+        const bool unchanged = !added && reported.info.multiPV == latest.multiPV
+                            && reported.info.scoreKind == latest.scoreKind
+                            && reported.info.scoreValue == latest.scoreValue
+                            && reported.info.bound == latest.bound && reported.pv == info.pv;
+
+        // The root move summary wants the latest depth and nodes even when
+        // MultiPVDelta holds the line back.
+        reported.info = latest;
+        if (!unchanged)
+            reported.pv.assign(info.pv);
+        reported.info.pv = reported.pv;
+        return !(unchanged && multiPVDelta_ && info.multiPV != 1);
+    }
+
+    // The last update of each root move reported this search, `bestmove`
+    // first, then deepest and best ranked.
+    std::vector<SearchInfo> root_moves(std::string_view bestmove) const {
+        std::vector<SearchInfo> moves;
+        moves.reserve(reportedLines_.size());
+        for (const auto& [move, line] : reportedLines_)
+            moves.push_back(line.info);
+
+        std::sort(moves.begin(), moves.end(), [bestmove](const SearchInfo& a, const SearchInfo& b) {
+            const bool aBest = a.pv.substr(0, a.pv.find(' ')) == bestmove;
+            const bool bBest = b.pv.substr(0, b.pv.find(' ')) == bestmove;
+            if (aBest != bBest)
+                return aBest;
+            return a.depth != b.depth ? a.depth > b.depth : a.multiPV < b.multiPV;
+        });
+        return moves;
+    }
+
+    // Text line and typed callback of one update, which InfoThrottleMs may
+    // have held back.
+    void emit_update(const Engine::InfoFull& info, std::uint32_t lineID) {
+        if (hooks_.onSearchInfo)
+        {
+            SearchInfo typed = toSearchInfo(info);
+            typed.lineID     = lineID;
+            hooks_.onSearchInfo(typed);
+        }
+        if (hooks_.emitSearchInfoLines)
+            output_.write(formatUpdateFull(info, engine_->get_options()["UCI_ShowWDL"]));
+    }
+
+    // With InfoThrottleMs set, keeps `info` as the newest update of its
+    // multipv until the interval since the last emission has passed. Then the
+    // held updates of the other lines go out first, in multipv order, and
+    // `info` is emitted by the caller. Runs on the main search thread.
+    bool hold_update(const Engine::InfoFull& info, std::uint32_t lineID) {
+        if (!infoThrottleMs_)
+            return false;
+
+        static const DebugCounter heldUpdates("Info updates held", DebugCounterKind::hit);
+        const TimePoint           time = now();
+        const bool                hold = time - lastInfoEmit_ < infoThrottleMs_;
+        heldUpdates.hit_on(hold);
+        if (hold)
+        {
+            if (heldUpdates_.size() < info.multiPV)
+                heldUpdates_.resize(info.multiPV);
+            auto& held = heldUpdates_[info.multiPV - 1];
+            held.wdl.assign(info.wdl);
+            held.bound.assign(info.bound);
+            held.pv.assign(info.pv);
+            held.lineID     = lineID;
+            held.info       = info;
+            held.info.wdl   = held.wdl;
+            held.info.bound = held.bound;
+            held.info.pv    = held.pv;
+            held.pending    = true;
+            return true;
+        }
+
+        lastInfoEmit_ = time;
+        if (info.multiPV <= heldUpdates_.size())
+            heldUpdates_[info.multiPV - 1].pending = false;  // Superseded
+        flush_held_updates();
+        return false;
+    }
+
+    void flush_held_updates() {
+        for (auto& held : heldUpdates_)
+            if (std::exchange(held.pending, false))
+                emit_update(held.info, held.lineID);
+    }
+
+    // Runs on the search thread as each search ends, or on this one for a
+    // book move, which never starts a search.
+    void finish_search(std::string_view bestmove, std::string_view ponder) {
+        SF_SIGNPOST_END("Search", this);
+        {
+            std::lock_guard<std::mutex> lock(backgroundMutex_);
+            backgroundRunning_ = false;
+            runningTicket_     = 0;
+        }
+
+        // The last iteration always reaches the host before bestmove, and the
+        // next search's first update goes out at once.
+        flush_held_updates();
+        lastInfoEmit_ = 0;
+        if (hooks_.onRootMoves)
+            hooks_.onRootMoves(root_moves(bestmove));
+        reportedLines_.clear();
+
+        if (searchFaults_ >= 0)
+        {
+            output_.info_string("Syzygy search page faults: "
+                                + std::to_string(major_page_faults() - searchFaults_) + " major");
+            searchFaults_ = -1;
+        }
+
+        // Every search thread has stopped writing, so the table is stable.
+        if (hooks_.onHashStats)
+            hooks_.onHashStats(hash_stats());
+
+        if (hooks_.onBestmove)
+            hooks_.onBestmove(bestmove, ponder);
+
+        std::string line = "bestmove ";
+        line.append(bestmove);
+        if (!ponder.empty())
+            line.append(" ponder ").append(ponder);
+        output_.write(line);
+
+        if (activeNative_)
+        {
+            // The search thread is finishing, so nothing else touches the
+            // slot until the next native_search() after wait_for_search_finished().
+            auto native = std::move(*activeNative_);
+            activeNative_.reset();
+            if (native.cacheKey && !searchStopped_)
+                store_result(native.cacheKey, native.result, bestmove, ponder);
+            native.result.info.pv = native.result.pv;  // Re-point after the move
+            native.result.bestmove.assign(bestmove);
+            native.result.ponder.assign(ponder);
+            native.result.searchUs = elapsedMicroseconds(native.started);
+            if (native.deadline != std::chrono::steady_clock::time_point{})
+                finish_deadline(native);
+            native.completion(native.result);
+        }
+    }
+
+    // Fits Threads and Hash into MemoryBudgetMB. The network and thread pool
+    // are fixed costs; threads are dropped only while they leave no room for a
+    // 1 MB table, and the hash takes whatever remains. Returns false when the
+    // budget is off.
+    bool apply_memory_budget() {
+        auto&             options = engine_->get_options();
+        const std::size_t budget  = std::size_t(int(options[MemoryBudgetOption])) * OneMB;
+        if (!budget)
+            return false;
+
+        const std::size_t network = sizeof(Eval::NNUE::Network);
+        std::size_t       threads = int(options["Threads"]);
+        while (threads > 1 && network + threadPoolBytes(threads) + OneMB > budget)
+            --threads;
+
+        const std::size_t fixed  = network + threadPoolBytes(threads);
+        const int         hashMB = int(std::clamp<std::size_t>(
+          budget > fixed ? (budget - fixed) / OneMB : 0, 1, MaxMemoryBudgetMB));
+
+        const auto assign = [&](const std::string& name, std::size_t value) {
+            changedOptions_.insert(name);
+            std::istringstream is("name " + name + " value " + std::to_string(value));
+            options.setoption(is);
+        };
+        if (threads != std::size_t(int(options["Threads"])))
+            assign("Threads", threads);
+        assign("Hash", hashMB);
+
+        report_memory_footprint(budget);
+        return true;
+    }
+
+    // One `info string` with what the TT, network replicas, and thread pools
+    // take. Thread stacks are reserved address space and not counted.
+    void report_memory_footprint(std::size_t budget) {
+        const auto& options = engine_->get_options();
+        std::size_t threads = int(options["Threads"]);
+        std::size_t hash    = std::size_t(int(options["Hash"])) * OneMB;
+
+        std::size_t replicas = 0, pools = 0;
+        for (const auto& [bound, cpus] : engine_->get_bound_thread_count_by_numa_node())
+            if (bound)
+                ++replicas, pools += threadPoolBytes(bound);
+        if (!replicas)
+            replicas = 1, pools = threadPoolBytes(threads);
+
+        const std::size_t network = replicas * sizeof(Eval::NNUE::Network);
+        const std::size_t total   = hash + network + pools;
+
+        output_.info_string("Memory budget " + std::to_string(budget / OneMB) + " MB: hash "
+                            + std::to_string(hash / OneMB) + " MB, network " + std::to_string(replicas) + " x "
+                            + megabytes(sizeof(Eval::NNUE::Network)) + ", "
+                            + std::to_string(threads) + (threads > 1 ? " threads " : " thread ")
+                            + megabytes(pools) + ", total " + megabytes(total)
+                            + (total > budget ? " (over budget at 1 thread)" : ""));
+    }
+
+    // Engine::get_hashfull(maxAge) counts sampled entries at most maxAge
+    // searches old, so consecutive ages difference into a histogram. Stops once
+    // every occupied entry is counted, which is after a few ages between games.
+    HashStats hash_stats() const {
+        HashStats stats;
+        stats.hashMB   = engine_->get_options()["Hash"];
+        stats.occupied = engine_->get_hashfull(HashStats::Ages - 1);
+
+        int counted = 0;
+        for (int age = 0; age < HashStats::Ages && counted < stats.occupied; ++age)
+        {
+            const int upToAge = engine_->get_hashfull(age);
+            stats.byAge[age]  = upToAge - counted;
+            counted           = upToAge;
+        }
+        stats.hashfull = stats.byAge[0];
+        return stats;
+    }
+
+    // Upstream terminates the process here; an embedded host keeps running.
+    void report_command_failure(const std::string& reason) {
+        output_.error("command `" + currentCmd_ + "` failed: " + reason);
+    }
+
+    bool parse_limits(std::istream&       is,
+                      Search::LimitsType& limits,
+                      PerftOptions*       perftOptions = nullptr) {
+        std::string token;
+        std::string perftOption;  // The first `threads` or `hash`, which need `perft`
+
+        limits.startTime = now();  // The search starts as early as possible
+
+        while (is >> token)
+        {
+            if (token == "searchmoves")  // Needs to be the last command on the line
+            {
+                while (is >> token)
+                    limits.searchmoves.push_back(UCIEngine::to_lower(token));
+                break;
+            }
+
+            else if (token == "wtime")
+                is >> limits.time[WHITE];
+            else if (token == "btime")
+                is >> limits.time[BLACK];
+            else if (token == "winc")
+                is >> limits.inc[WHITE];
+            else if (token == "binc")
+                is >> limits.inc[BLACK];
+            else if (token == "movestogo")
+                is >> limits.movestogo;
+            else if (token == "depth")
+                is >> limits.depth;
+            else if (token == "nodes")
+                is >> limits.nodes;
+            else if (token == "movetime")
+                is >> limits.movetime;
+            else if (token == "mate")
+                is >> limits.mate;
+            else if (token == "perft")
+                is >> limits.perft;
+            else if (token == "infinite")
+                limits.infinite = 1;
+            else if (token == "ponder")
+                limits.ponderMode = true;
+            else if (perftOptions && token == "threads")
+            {
+                perftOption = perftOption.empty() ? token : perftOption;
+                if (is >> perftOptions->threads && (perftOptions->threads < 1 || perftOptions->threads > 1024))
+                    is.setstate(std::ios::failbit);
+            }
+            else if (perftOptions && token == "hash")
+            {
+                perftOption = perftOption.empty() ? token : perftOption;
+                if (is >> perftOptions->hashMB && (perftOptions->hashMB < 0 || perftOptions->hashMB > MaxMemoryBudgetMB))
+                    is.setstate(std::ios::failbit);
+            }
+
+            if (is.fail())
+            {
+                report_command_failure("Invalid argument for '" + token + "'");
+                return false;
+            }
+        }
+
+        if (!perftOption.empty() && !limits.perft)
+        {
+            report_command_failure("'" + perftOption + "' only applies to 'go perft'");
+            return false;
+        }
+
+        return true;
+    }
+
+    void go(std::istringstream& is) {
+        Search::LimitsType limits;
+        PerftOptions       perftOptions;
+        if (!parse_limits(is, limits, &perftOptions))
+            return;
+
+        if (limits.perft)
+        {
+            perft(limits, perftOptions);
+            return;
+        }
+
+        // A book move or mate proof is reported from this thread, so the
+        // previous search must have written its bestmove and released the
+        // session's search state first, as in native_search().
+        engine_->wait_for_search_finished();
+
+        if (const auto move = book_move(limits, false))
+            finish_search(*move, {});
+        else if (const auto proof = mate_proof(limits))
+            finish_mate_proof(*proof);
+        else
+            start_search(limits);
+    }
+
+    void start_search(Search::LimitsType& limits) {
+        wait_for_tablebases();
+        pristine_ = false;
+        cap_skill_depth(limits);
+        if (hooks_.onSearchTelemetry)
+            begin_telemetry(limits);
+        if (engine_->get_options()[SyzygyPrefetchOption] && Tablebases::MaxCardinality)
+            prefetch_tablebases();
+        if (Tablebases::MaxCardinality < 3)
+            report_bitbase();
+        SF_SIGNPOST_BEGIN("Search", this);
+        engine_->go(limits);
+    }
+
+    // With Skill Level or UCI_LimitStrength, Search::Skill fixes its weaker
+    // move once the iteration at depth 1 + level completes, and any later
+    // iteration only burns CPU before that move is played. SkillEarlyStop
+    // ends the search there instead, at the same move; a lower depth limit
+    // or the clock can still end it sooner.
+    void cap_skill_depth(Search::LimitsType& limits) {
+        const auto&         options = engine_->get_options();
+        const Search::Skill skill(options["Skill Level"],
+                                  options["UCI_LimitStrength"] ? int(options["UCI_Elo"]) : 0);
+        if (!options[SkillEarlyStopOption] || !skill.enabled())
+            return;
+
+        const Depth pickDepth = 1 + int(skill.level);
+        limits.depth          = limits.depth ? std::min(limits.depth, pickDepth) : pickDepth;
+    }
+
+    // Without tables covering it, a KPK root still gets its exact result
+    // before the search starts.
+    void report_bitbase() {
+        StateInfo st;
+        Position  pos;
+        int       wdl;
+        if (pos.set(engine_->fen(), engine_->get_options()["UCI_Chess960"], &st)
+            || !KPKBitbase::probe(pos, wdl))
+            return;
+
+        const char* result = wdl > 0 ? "win" : wdl < 0 ? "loss" : "draw";
+        output_.info_string(std::string("Bitbase: KPK ") + result + " for the side to move");
+    }
+
+    // The book's move for the current position, when a book is loaded and
+    // `limits` ask for a move to play: analysis (infinite, ponder, mate,
+    // searchmoves, MultiPV) always searches. BookWeighted picks a move at
+    // random in proportion to its weight; otherwise, and always for a
+    // deterministic search, the heaviest move is played.
+    std::optional<std::string> book_move(const Search::LimitsType& limits, bool deterministic) {
+        const auto& options = engine_->get_options();
+        if (!book_ || limits.infinite || limits.ponderMode || limits.mate || !limits.searchmoves.empty()
+            || int(options["MultiPV"]) != 1)
+            return std::nullopt;
+
+        StateInfo st;
+        Position  pos;
+        if (pos.set(engine_->fen(), options["UCI_Chess960"], &st)
+            || pos.game_ply() >= int(options[BookDepthOption]))
+            return std::nullopt;
+
+        const auto moves = book_->moves(pos);
+        if (moves.empty())
+            return std::nullopt;
+
+        int total = 0;
+        for (const auto& [m, weight] : moves)
+            total += weight;
+
+        auto chosen = std::max_element(moves.begin(), moves.end(),
+                                       [](const auto& a, const auto& b) { return a.second < b.second; });
+        if (!deterministic && total > 0 && options[BookWeightedOption])
+        {
+            int pick = int(bookRng_.rand<unsigned>() % unsigned(total));
+            for (chosen = moves.begin(); pick >= chosen->second; ++chosen)
+                pick -= chosen->second;
+        }
+
+        const std::string move = UCIEngine::move(chosen->first, pos.is_chess960());
+        output_.info_string("Book move " + move + ", weight " + std::to_string(chosen->second)
+                            + " of " + std::to_string(total));
+        return move;
+    }
 
-namespace SFEmbedded {
-namespace {
+    // MateFinder's mate for `go mate N`, if it proves one by checks within N
+    // moves; otherwise the caller searches. Only a plain mate limit
+    // qualifies: analysis, ponder, searchmoves and MultiPV always search. The
+    // proof ignores repetitions of positions before the root.
+    std::optional<MateProof> mate_proof(const Search::LimitsType& limits) {
+        const auto& options = engine_->get_options();
+        if (!limits.mate || !options[MateFinderOption] || limits.infinite || limits.ponderMode
+            || !limits.searchmoves.empty() || int(options["MultiPV"]) != 1)
+            return std::nullopt;
 
-// RAII helper to swap std::cin/std::cout rdbuf for the duration of the engine run.
-// Stockfish reads from std::cin and writes to std::cout, so redirecting those
-// buffers lets us feed commands and capture output without modifying upstream code.
-class StreamRedirector {
-public:
-    StreamRedirector(std::istream& in, std::ostream& out) :
-        oldInFlags_(std::cin.flags()),
-        oldOutFlags_(std::cout.flags()),
-        oldInPrecision_(std::cin.precision()),
-        oldOutPrecision_(std::cout.precision()),
-        oldInWidth_(std::cin.width()),
-        oldOutWidth_(std::cout.width()),
-        oldInFill_(std::cin.fill()),
-        oldOutFill_(std::cout.fill()),
-        oldInState_(std::cin.rdstate()),
-        oldOutState_(std::cout.rdstate()),
-        oldInLocale_(std::cin.getloc()),
-        oldOutLocale_(std::cout.getloc()) {
-        oldInTie_  = std::cin.tie(nullptr);
-        oldInBuf_  = std::cin.rdbuf(in.rdbuf());
-        oldOutBuf_ = std::cout.rdbuf(out.rdbuf());
-
-        // Host formatting such as hex or unitbuf must not alter UCI text or
-        // fragment it into partial callback lines.
-        std::cin.flags(std::ios_base::skipws | std::ios_base::dec);
-        std::cout.flags(std::ios_base::skipws | std::ios_base::dec);
-        std::cin.precision(6);
-        std::cout.precision(6);
-        std::cin.width(0);
-        std::cout.width(0);
-        std::cin.fill(' ');
-        std::cout.fill(' ');
-        std::cin.imbue(std::locale::classic());
-        std::cout.imbue(std::locale::classic());
-    }
-    ~StreamRedirector() {
-        std::cout.flush();
-        std::cin.rdbuf(oldInBuf_);
-        std::cout.rdbuf(oldOutBuf_);
-        std::cin.tie(oldInTie_);
-
-        std::cin.flags(oldInFlags_);
-        std::cout.flags(oldOutFlags_);
-        std::cin.precision(oldInPrecision_);
-        std::cout.precision(oldOutPrecision_);
-        std::cin.width(oldInWidth_);
-        std::cout.width(oldOutWidth_);
-        std::cin.fill(oldInFill_);
-        std::cout.fill(oldOutFill_);
-        std::cin.imbue(oldInLocale_);
-        std::cout.imbue(oldOutLocale_);
-
-        // rdbuf() clears stream state. Restore the host's prior state when it
-        // cannot trigger a host-configured iostream exception in this
-        // no-exceptions build.
-        if ((oldInState_ & std::cin.exceptions()) == std::ios_base::goodbit)
-            std::cin.clear(oldInState_);
-        if ((oldOutState_ & std::cout.exceptions()) == std::ios_base::goodbit)
-            std::cout.clear(oldOutState_);
-    }
-    
-private:
-    std::streambuf* oldInBuf_  = nullptr;
-    std::streambuf* oldOutBuf_ = nullptr;
-    std::ostream*   oldInTie_  = nullptr;
-    std::ios_base::fmtflags oldInFlags_;
-    std::ios_base::fmtflags oldOutFlags_;
-    std::streamsize         oldInPrecision_;
-    std::streamsize         oldOutPrecision_;
-    std::streamsize         oldInWidth_;
-    std::streamsize         oldOutWidth_;
-    char                    oldInFill_;
-    char                    oldOutFill_;
-    std::ios_base::iostate  oldInState_;
-    std::ios_base::iostate  oldOutState_;
-    std::locale             oldInLocale_;
-    std::locale             oldOutLocale_;
+        StateInfo st;
+        Position  pos;
+        if (pos.set(engine_->fen(), options["UCI_Chess960"], &st)
+            || pos.rule50_count() + 2 * limits.mate > 100)  // The fifty-move rule could come first
+            return std::nullopt;
+
+        const TimePoint started = now();
+        MateFinder      finder;
+        const auto      line = finder.find(pos, limits.mate);
+        if (line.empty())
+            return std::nullopt;
+
+        MateProof proof;
+        proof.score     = Score(mate_in(int(line.size())), pos);
+        proof.nodes     = finder.nodes();
+        proof.elapsedMs = now() - started;
+        for (const Move m : line)
+            proof.line.push_back(UCIEngine::move(m, pos.is_chess960()));
+        return proof;
+    }
+
+    // Reports a proven mate as one update and the bestmove, as a search
+    // that found it would.
+    void finish_mate_proof(const MateProof& proof) {
+        std::string pv;
+        for (const auto& move : proof.line)
+            pv += (pv.empty() ? "" : " ") + move;
+
+        Engine::InfoFull info{};
+        info.depth    = int(proof.line.size());
+        info.selDepth = int(proof.line.size());
+        info.multiPV  = 1;
+        info.score    = proof.score;
+        info.timeMs   = usize(proof.elapsedMs);
+        info.nodes    = usize(proof.nodes);
+        info.nps      = usize(proof.nodes * 1000 / u64(std::max<TimePoint>(proof.elapsedMs, 1)));
+        info.pv       = pv;
+
+        output_.info_string("Mate finder: mate in " + std::to_string((proof.line.size() + 1) / 2)
+                            + " proven in " + std::to_string(proof.nodes) + " nodes");
+        std::uint32_t lineID = 0;
+        track_line(info, lineID);
+        record_native_update(info, lineID);
+        emit_update(info, lineID);
+        finish_search(proof.line[0], proof.line.size() > 1 ? proof.line[1] : std::string());
+    }
+
+    void load_book() {
+        book_.reset();
+        const std::string path = engine_->get_options()[BookFileOption];
+        if (path.empty())
+            return;
+
+        if (auto err = OpeningBook::open(path, book_))
+            output_.error(*err);
+        else
+            output_.info_string("Opening book: " + std::to_string(book_->size()) + " entries");
+    }
+
+    // Warms the tables for the root's material and for each material one
+    // capture away, the ones a search from here probes first. The fault count
+    // starts here so the bestmove report covers this search.
+    void prefetch_tablebases() {
+        StateInfo  st;
+        Position   pos;
+        const auto& options = engine_->get_options();
+        if (pos.set(engine_->fen(), options["UCI_Chess960"], &st))
+            return;
+
+        std::array<std::string, COLOR_NB> sides;
+        for (Color c : {WHITE, BLACK})
+        {
+            sides[c] = "K";
+            for (PieceType pt : {QUEEN, ROOK, BISHOP, KNIGHT, PAWN})
+                sides[c].append(popcount(pos.pieces(c, pt)), PieceToChar[pt]);
+        }
+
+        std::vector<std::array<std::string, COLOR_NB>> materials;
+        materials.push_back(sides);
+        for (Color c : {WHITE, BLACK})
+            for (std::size_t i = 1; i < sides[c].size(); ++i)
+                if (i == 1 || sides[c][i] != sides[c][i - 1])
+                {
+                    auto captured = sides;
+                    captured[c].erase(i, 1);
+                    materials.push_back(captured);
+                }
+
+        // Files are named with the stronger side first, so try both orders.
+        std::vector<std::string> files;
+        std::istringstream       paths{std::string(options["SyzygyPath"])};
+        std::string              dir;
+        while (std::getline(paths, dir, ':'))
+            for (const auto& material : materials)
+            {
+                if (int(material[WHITE].size() + material[BLACK].size()) > Tablebases::MaxCardinality)
+                    continue;
+                for (const auto& code : {material[WHITE] + "v" + material[BLACK],
+                                         material[BLACK] + "v" + material[WHITE]})
+                    for (const char* extension : {".rtbw", ".rtbz"})
+                    {
+                        const std::string file = dir + "/" + code + extension;
+                        if (!::access(file.c_str(), R_OK))
+                            files.push_back(file);
+                    }
+            }
+
+        prefetcher_.prefetch(std::move(files));
+        searchFaults_ = major_page_faults();
+    }
+
+    // Upstream's start_thinking() waits for the previous search too; waiting
+    // first keeps that search's last updates out of the new counters. The time
+    // budget comes from a TimeManagement initialised as the main thread's
+    // will be, because upstream keeps its own private.
+    void begin_telemetry(const Search::LimitsType& limits) {
+        engine_->wait_for_search_finished();
+        telemetry_ = SearchTelemetry();
+        telemetryBestMove_.clear();
+
+        const auto& options = engine_->get_options();
+        StateInfo   st;
+        Position    pos;
+        if (int(options["nodestime"]) || pos.set(engine_->fen(), options["UCI_Chess960"], &st)
+            || !limits.time[pos.side_to_move()])
+            return;
+
+        Search::LimitsType budgetLimits = limits;
+        TimeManagement     tm;
+        tm.init(budgetLimits, pos.side_to_move(), pos.game_ply(), options, telemetryTimeAdjust_);
+        telemetry_.optimumMs = std::uint64_t(tm.optimum());
+        telemetry_.maximumMs = std::uint64_t(tm.maximum());
+    }
+
+    // Runs on the search thread for the update that completes an iteration.
+    void report_iteration(const Engine::InfoFull& info) {
+        const std::string_view bestMove = info.pv.substr(0, info.pv.find(' '));
+        SearchTelemetry&       t        = telemetry_;
+
+        const std::uint64_t previousIterationNodes = t.iterationNodes;
+        t.iterationNodes  = info.nodes - t.nodes;
+        t.iterationMs     = info.timeMs - t.timeMs;
+        t.branchingFactor = t.depth && previousIterationNodes
+                            ? double(t.iterationNodes) / double(previousIterationNodes)
+                            : 0;
+        t.bestMoveChanged = t.depth && bestMove != telemetryBestMove_;
+        t.bestMoveChanges += t.bestMoveChanged;
+        t.depth    = info.depth;
+        t.selDepth = info.selDepth;
+        t.nodes    = info.nodes;
+        t.timeMs   = info.timeMs;
+        t.hashfull = info.hashfull;
+
+        telemetryBestMove_.assign(bestMove);
+        t.bestMove = telemetryBestMove_;
+        hooks_.onSearchTelemetry(t);
+    }
+
+    // With KeepSearchState the hash and histories carry over to the next game,
+    // as between moves of one game, so games from the same openings start warm
+    // and skip the clear. Engine keeps both private, so they are kept whole
+    // rather than decayed; `Clear Hash` and deterministic searches still clear.
+    void new_game() {
+        if (!engine_->get_options()[KeepSearchStateOption])
+            clear_search_state();
+    }
+
+    // Engine::search_clear() would also rerun Tablebases::init, which remaps
+    // the process-wide tables while other sessions may be probing them. A
+    // fresh thread pool and TT clear the same histories and hash, as
+    // park_engine() does.
+    void clear_search_state(std::string_view reason = "ucinewgame") {
+        engine_->wait_for_search_finished();  // Not while holding the lock
+        const auto began = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(threadPoolMutex_);
+            engine_->resize_threads();
+        }
+        telemetryTimeAdjust_ = -1;  // As ThreadPool::clear() resets the main thread's
+        pristine_ = true;
+        report_hash_reset(reason, began);
+    }
+
+    void report_hash_reset(std::string_view reason, std::chrono::steady_clock::time_point began) {
+        SF_SIGNPOST_EVENT("Hash reset", "%{public}.*s, %llu us", int(reason.size()), reason.data(),
+                          static_cast<unsigned long long>(elapsedMicroseconds(began)));
+        if (hooks_.onHashReset)
+            hooks_.onHashReset(reason, elapsedMicroseconds(began));
+    }
+
+    // Mirrors UCIEngine::bench. Upstream reports progress and totals on
+    // std::cerr; here they are written to the session output instead.
+    void bench(std::istream& args) {
+        std::string token;
+        u64         num, nodes = 0, cnt = 1;
+        u64         nodesSearched = 0;
+        const auto& options       = engine_->get_options();
+
+        engine_->set_on_update_full([&](const Engine::InfoFull& i) {
+            nodesSearched = i.nodes;
+            output_.write(formatUpdateFull(i, options["UCI_ShowWDL"]));
+        });
+
+        std::vector<std::string> list = Benchmark::setup_bench(engine_->fen(), args);
+
+        num = std::count_if(list.begin(), list.end(),
+                            [](const std::string& s) { return s.find("go ") == 0; });
+
+        TimePoint elapsed = now();
+
+        for (const auto& cmd : list)
+        {
+            std::istringstream is(cmd);
+            is >> token;
+
+            if (token == "go")
+            {
+                output_.write("Position: " + std::to_string(cnt++) + '/' + std::to_string(num) + " ("
+                              + engine_->fen() + ")");
+
+                Search::LimitsType limits;
+                if (!parse_limits(is, limits))
+                    break;
+
+                if (limits.perft)
+                    nodesSearched = perft(limits);
+                else
+                {
+                    start_search(limits);
+                    engine_->wait_for_search_finished();
+                }
+
+                nodes += nodesSearched;
+                nodesSearched = 0;
+            }
+            else if (token == "setoption")
+                setoption(is);
+            else if (token == "position")
+                position(is);
+            else if (token == "ucinewgame")
+            {
+                clear_search_state();  // Rebuilding the pool and TT may take a while
+                elapsed = now();
+            }
+        }
+
+        elapsed = now() - elapsed + 1;  // Ensure positivity to avoid a 'divide by zero'
+
+        print_debug_counters();  // Where upstream calls dbg_print()
+
+        output_.write("\n==========================="
+                      "\nTotal time (ms) : "
+                      + std::to_string(elapsed) + "\nNodes searched  : " + std::to_string(nodes)
+                      + "\nNodes/second    : " + std::to_string(1000 * nodes / elapsed));
+
+        // Reset the callback so it does not capture a dangling reference to nodesSearched.
+        init_search_update_listeners();
+    }
+
+    // The wrapper's DebugCounters since the last `debugcounters clear`, in
+    // dbg_print's format. Prints nothing when no counter has recorded.
+    void print_debug_counters() {
+        std::string lines = DebugCounters::instance().format();
+        if (lines.empty())
+            return;
+        lines.pop_back();  // The final newline
+        output_.write(lines);
+    }
+
+    // Times each stage of an NNUE evaluation in isolation on the embedded
+    // network and the fixed StageBenchPositions, so a slowdown after a Stockfish
+    // update can be traced to a layer. Every stage but the first replays the
+    // inputs the previous stage produced for the same positions.
+    void nnue_stage_benchmark(std::istream& args) {
+        using namespace Eval::NNUE;
+        using Stack = StageBenchNetwork::LayerStack;
+
+        // Mirrors the buffers of NetworkArchitecture::propagate.
+        struct alignas(CacheLineSize) Sample {
+            alignas(CacheLineSize) TransformedFeatureType features[FeatureTransformer::BufferSize];
+            NNZInfo<L1> nnz;
+            int         bucket;
+            alignas(CacheLineSize) decltype(Stack::fc_0)::OutputBuffer fc_0_out;
+            alignas(CacheLineSize) decltype(Stack::ac_sqr_0)::OutputType
+              concat[ceil_to_multiple<IndexType>(Stack::FC_0_OUTPUTS * 2 + Stack::FC_1_OUTPUTS * 2, 32)];
+            alignas(CacheLineSize) decltype(Stack::fc_1)::OutputBuffer fc_1_out;
+            alignas(CacheLineSize) decltype(Stack::fc_2)::OutputBuffer fc_2_out;
+        };
+
+        int iterations = 1000;
+        if (args >> iterations; iterations <= 0)
+        {
+            output_.error("nnuebench iterations must be positive");
+            return;
+        }
+
+        engine_->wait_for_search_finished();
+
+        auto network = std::make_unique<StageBenchNetwork>();
+        if (!network->load())
+        {
+            output_.error("nnuebench: the embedded network could not be loaded");
+            return;
+        }
+
+        constexpr std::size_t Count = std::size(StageBenchPositions);
+        auto accumulators = std::make_unique<AccumulatorStack>();
+        auto caches       = std::make_unique<AccumulatorCaches>(*network);
+        auto states       = std::make_unique<StateInfo[]>(Count * 3);
+        auto positions    = std::make_unique<Position[]>(Count);
+        std::vector<Sample> samples(Count);
+        std::vector<std::array<Move, 2>> lines(Count);  // Two plies to replay from each position
+
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            Position& pos = positions[i];
+            pos.set(StageBenchPositions[i], false, &states[i * 3]);
+            lines[i][0] = *MoveList<LEGAL>(pos).begin();
+            pos.do_move(lines[i][0], states[i * 3 + 1]);
+            lines[i][1] = *MoveList<LEGAL>(pos).begin();
+            pos.undo_move(lines[i][0]);
+            samples[i].bucket = (pos.count<ALL_PIECES>() - 1) / 4;
+        }
+
+        const auto& ft     = network->featureTransformer;
+        const auto& stacks = network->stacks;
+        const auto  stack  = [&](std::size_t i) -> const Stack& { return stacks[samples[i].bucket]; };
+        std::vector<std::pair<const char*, double>> stages;
+
+        // A refresh rebuilds both accumulators from the (warm) refresh cache.
+        stages.emplace_back("FeatureTransformer::transform refresh",
+                            nanosecondsPerCall(Count, iterations, [&](std::size_t i) {
+                                Sample& s = samples[i];
+                                accumulators->reset();
+                                return ft.transform(positions[i], *accumulators, *caches,
+                                                    s.features, s.bucket, s.nnz);
+                            }));
+
+        // Incremental updates replay one or two plies on each position's
+        // computed accumulators, kept on a stack of its own, and evaluate only
+        // at the end, as a search does when it cuts a node before evaluating
+        // it. The times include do_move and undo_move.
+        std::vector<std::unique_ptr<AccumulatorStack>> lineStacks;
+        for (std::size_t i = 0; i < Count; ++i)
+        {
+            Sample& s = samples[i];
+            lineStacks.push_back(std::make_unique<AccumulatorStack>());
+            lineStacks.back()->reset();
+            ft.transform(positions[i], *lineStacks.back(), *caches, s.features, s.bucket, s.nnz);
+        }
+        const auto afterPlies = [&](int plies) {
+            return nanosecondsPerCall(Count, iterations, [&](std::size_t i) {
+                alignas(CacheLineSize) TransformedFeatureType out[FeatureTransformer::BufferSize];
+                NNZInfo<L1>       nnz;
+                Position&         pos         = positions[i];
+                AccumulatorStack& accumulated = *lineStacks[i];
+
+                for (int ply = 0; ply < plies; ++ply)
+                {
+                    const Move m = lines[i][ply];
+                    auto [dirtyPiece, dirtyThreats] = accumulated.push();
+                    pos.do_move(m, states[i * 3 + 1 + ply], pos.gives_check(m), dirtyPiece,
+                                dirtyThreats, nullptr, nullptr);
+                }
+                const i32 psqt =
+                  ft.transform(pos, accumulated, *caches, out, (pos.count<ALL_PIECES>() - 1) / 4, nnz);
+                for (int ply = plies; ply-- > 0;)
+                {
+                    pos.undo_move(lines[i][ply]);
+                    accumulated.pop();
+                }
+                return psqt + out[0];
+            });
+        };
+        stages.emplace_back("FeatureTransformer::transform after 1 ply", afterPlies(1));
+        stages.emplace_back("FeatureTransformer::transform after 2 plies", afterPlies(2));
+
+        stages.emplace_back("AffineTransformSparseInput fc_0",
+                            nanosecondsPerCall(Count, iterations, [&](std::size_t i) {
+                                Sample& s = samples[i];
+                                stack(i).fc_0.propagate(s.features, s.fc_0_out, s.nnz);
+                                return s.fc_0_out[0];
+                            }));
+        stages.emplace_back("SqrClippedReLU + ClippedReLU ac_0",
+                            nanosecondsPerCall(Count, iterations, [&](std::size_t i) {
+                                Sample& s = samples[i];
+                                stack(i).ac_sqr_0.propagate(s.fc_0_out, s.concat);
+                                stack(i).ac_0.propagate(s.fc_0_out, s.concat + Stack::FC_0_OUTPUTS);
+                                return s.concat[0];
+                            }));
+        stages.emplace_back("AffineTransform fc_1",
+                            nanosecondsPerCall(Count, iterations, [&](std::size_t i) {
+                                Sample& s = samples[i];
+                                stack(i).fc_1.propagate(s.concat, s.fc_1_out);
+                                return s.fc_1_out[0];
+                            }));
+        stages.emplace_back("SqrClippedReLU + ClippedReLU ac_1",
+                            nanosecondsPerCall(Count, iterations, [&](std::size_t i) {
+                                Sample&   s    = samples[i];
+                                auto*     out  = s.concat + Stack::FC_0_OUTPUTS * 2;
+                                stack(i).ac_sqr_1.propagate(s.fc_1_out, out);
+                                stack(i).ac_1.propagate(s.fc_1_out, out + Stack::FC_1_OUTPUTS);
+                                return out[0];
+                            }));
+        stages.emplace_back("AffineTransform fc_2",
+                            nanosecondsPerCall(Count, iterations, [&](std::size_t i) {
+                                Sample& s = samples[i];
+                                stack(i).fc_2.propagate(s.concat, s.fc_2_out);
+                                return s.fc_2_out[0];
+                            }));
+        stages.emplace_back("NetworkArchitecture::propagate",
+                            nanosecondsPerCall(Count, iterations, [&](std::size_t i) {
+                                return stack(i).propagate(samples[i].features, samples[i].nnz);
+                            }));
+
+        std::ostringstream report;
+        report << "\n==========================="
+               << "\nNNUE stage    : ns/call (" << Count << " positions x " << iterations << ")";
+        for (const auto& [name, ns] : stages)
+            report << "\n" << std::left << std::setw(44) << name << ": " << std::fixed
+                   << std::setprecision(1) << ns;
+        output_.write(report.str());
+    }
+
+    void setoption(std::istringstream& is) {
+        engine_->wait_for_search_finished();
+        wait_for_tablebases();
+
+        // OptionsMap::setoption reports unknown names through std::cout, so
+        // resolve the name here first using the same tokenization.
+        std::istringstream probe(is.str());
+        std::string        token, name, value;
+        probe >> token >> token;  // Consume "setoption" and "name"
+        while (probe >> token && token != "value")
+            name += (name.empty() ? "" : " ") + token;
+        while (probe >> token)
+            value += (value.empty() ? "" : " ") + token;
+
+        if (!engine_->get_options().count(name))
+        {
+            output_.write("No such option: " + name);
+            return;
+        }
+
+        const bool resizes = sameOptionName(name, "Hash") || sameOptionName(name, "Threads");
+
+        // Under a thread limit the host's value is remembered for when the
+        // limit lifts, even when it needs no rebuild now.
+        const int previousCap = thread_cap();
+        if (previousCap && sameOptionName(name, "Threads"))
+            requestedThreads_ = std::clamp(std::atoi(value.c_str()), 1, 1024);
+
+        // Assigning Hash or Threads always reallocates the table and thread
+        // pool. Before any search they are still empty, so re-sending the
+        // current value would only rebuild identical state.
+        if (pristine_ && resizes && value == std::to_string(int(engine_->get_options()[name])))
+            return;
+
+        // Upstream's Clear Hash handler is search_clear().
+        if (sameOptionName(name, "Clear Hash"))
+        {
+            clear_search_state(is.str());
+            return;
+        }
+
+        changedOptions_.insert(name);
+
+        if (sameOptionName(name, "SyzygyPath"))
+        {
+            TablebaseCache::instance().clear();
+            prefetcher_.reset();
+            load_tablebases(is.str());
+            return;
+        }
+
+        std::istringstream* source = &is;
+        std::istringstream  limited;
+        if (previousCap && sameOptionName(name, "Threads") && requestedThreads_ > previousCap)
+        {
+            limited.str("name Threads value " + std::to_string(previousCap));
+            source = &limited;
+        }
+
+        const auto began = std::chrono::steady_clock::now();
+        bool       resetsHash = resizes;
+        {
+            // Options such as Threads rebuild the thread pool. The search is already
+            // finished, so the lock is never held while waiting on a search.
+            std::lock_guard<std::mutex> lock(threadPoolMutex_);
+            engine_->get_options().setoption(*source);
+
+            if (sameOptionName(name, MemoryBudgetOption))
+                resetsHash = apply_memory_budget();
+        }
+
+        if (sameOptionName(name, BookFileOption))
+            load_book();
+
+        if (sameOptionName(name, InfoThrottleOption))
+            infoThrottleMs_ = int(engine_->get_options()[InfoThrottleOption]);
+
+        if (sameOptionName(name, MultiPVDeltaOption))
+            multiPVDelta_ = bool(engine_->get_options()[MultiPVDeltaOption]);
+
+        if (sameOptionName(name, ResultCacheOption) || sameOptionName(name, ResultCacheFileOption))
+            if (auto err = ResultCache::instance().configure(int(engine_->get_options()[ResultCacheOption]),
+                                                             engine_->get_options()[ResultCacheFileOption]))
+                output_.error(*err);
+
+        if (resetsHash)
+        {
+            pristine_ = true;
+            report_hash_reset(is.str(), began);
+        }
+
+        if (sameOptionName(name, PerformanceCoresOption) && thread_cap() != previousCap)
+            apply_thread_cap(previousCap);
+    }
+
+    // Upstream's SyzygyPath handler, Tablebases::init, checks every material
+    // combination for a file in every directory, which takes seconds for a
+    // full set on device storage. It runs here on its own thread, so the loop
+    // keeps reading commands. The scan writes the options and the tables, so
+    // loop() waits for it before every command but runsDuringTablebaseScan()'s,
+    // and searches and setoption() called from bench wait as well.
+    // Upstream maps each table on its first probe anyway, so only this scan
+    // is moved off the loop.
+    void load_tablebases(const std::string& command) {
+        output_.info_string("Loading Syzygy tablebases in the background");
+        tablebaseLoad_ = std::thread([this, command] {
+            const auto         began = std::chrono::steady_clock::now();
+            std::istringstream is(command);
+            std::string        token;
+            is >> token;  // Consume "setoption", as loop() does
+            engine_->get_options().setoption(is);
+            output_.info_string("Syzygy tablebases ready: up to "
+                                + std::to_string(Tablebases::MaxCardinality) + "-man, scanned in "
+                                + std::to_string(elapsedMicroseconds(began) / 1000) + " ms");
+        });
+    }
+
+    void wait_for_tablebases() {
+        if (tablebaseLoad_.joinable())
+            tablebaseLoad_.join();
+    }
+
+    // Probes the current position as upstream's search would, through the
+    // process-wide TablebaseCache. The tables are safe to probe while a
+    // search runs, so this does not wait for one.
+    void tablebase_probe() {
+        wait_for_tablebases();
+
+        StateInfo  st;
+        Position   pos;
+        const bool isChess960 = engine_->get_options()["UCI_Chess960"];
+        if (auto err = pos.set(engine_->fen(), isChess960, &st))
+        {
+            report_command_failure(err->what());
+            return;
+        }
+
+        int wdl;
+        if (Tablebases::MaxCardinality < 3 && KPKBitbase::probe(pos, wdl))
+        {
+            output_.info_string("tbprobe wdl " + std::to_string(wdl) + " bitbase");
+            return;
+        }
+
+        if (pos.count<ALL_PIECES>() > Tablebases::MaxCardinality || pos.can_castle(ANY_CASTLING))
+        {
+            report_command_failure("the position is not covered by the loaded tablebases");
+            return;
+        }
+
+        auto&                  cache = TablebaseCache::instance();
+        TablebaseCache::Result result;
+        const bool             cached = cache.probe(pos.key(), result);
+        bool                   shared = false;
+        if (!cached)
+        {
+            std::lock_guard decoding(cache.decode_mutex(pos.key()));
+            shared = cache.probe_shared(pos.key(), result);
+            if (!shared)
+            {
+                const auto             began = std::chrono::steady_clock::now();
+                Tablebases::ProbeState wdlState, dtzState;
+                result.wdl = Tablebases::probe_wdl(pos, &wdlState);
+                result.dtz = Tablebases::probe_dtz(pos, &dtzState);
+                if (wdlState == Tablebases::FAIL || dtzState == Tablebases::FAIL)
+                {
+                    report_command_failure("a tablebase file for this material is missing");
+                    return;
+                }
+                cache.store(pos.key(), result, elapsedMicroseconds(began));
+            }
+        }
+
+        const auto stats = cache.stats();
+        output_.info_string("tbprobe wdl " + std::to_string(result.wdl) + " dtz "
+                            + std::to_string(result.dtz)
+                            + (cached ? " cached" : shared ? " shared" : " decoded"));
+        output_.info_string("tbprobe cache hits " + std::to_string(stats.hits) + " misses "
+                            + std::to_string(stats.misses) + " shared "
+                            + std::to_string(stats.shared) + " decodeus "
+                            + std::to_string(stats.decodeUs));
+    }
+
+    // Mirrors Benchmark::perft<true>, which prints each root move through
+    // std::cout. With more than one thread the tree is cut into subtrees, each
+    // a line of moves from the root, until there are enough to keep every
+    // worker busy; idle workers then claim the next unclaimed subtree, so one
+    // expensive root move does not leave the others waiting. Each root move's
+    // division line is the sum of its subtrees.
+    u64 perft(const Search::LimitsType& limits, const PerftOptions& options = {}) {
+        engine_->verify_network();
+
+        const std::string fen        = engine_->fen();
+        const bool        isChess960 = engine_->get_options()["UCI_Chess960"];
+        StateInfo         rootState;
+        Position          pos;
+        if (auto err = pos.set(fen, isChess960, &rootState))
+        {
+            report_command_failure(err->what());
+            return 0;
+        }
+
+        struct Subtree {
+            std::vector<Move> line;
+            std::size_t       rootMove;
+            u64               nodes = 0;
+        };
+
+        const Depth           depth = limits.perft;
+        const MoveList<LEGAL> rootMoves(pos);
+        std::vector<Subtree>  subtrees;
+        for (std::size_t i = 0; i < rootMoves.size(); ++i)
+            subtrees.push_back({{rootMoves.begin()[i]}, i});
+
+        // Splitting stops two plies above the leaves, where a subtree is one
+        // bulk-counted list per move and too small to be worth claiming alone.
+        const std::size_t wanted = std::size_t(options.threads) * 8;
+        for (Depth ply = 1; options.threads > 1 && subtrees.size() < wanted && ply < depth - 2; ++ply)
+        {
+            std::vector<Subtree>  deeper;
+            std::deque<StateInfo> states;
+            for (const auto& subtree : subtrees)
+            {
+                for (Move m : subtree.line)
+                    pos.do_move(m, states.emplace_back());
+                for (const auto& m : MoveList<LEGAL>(pos))
+                {
+                    deeper.push_back({subtree.line, subtree.rootMove});
+                    deeper.back().line.push_back(m);
+                }
+                for (auto it = subtree.line.rbegin(); it != subtree.line.rend(); ++it)
+                    pos.undo_move(*it);
+                states.clear();
+            }
+            subtrees = std::move(deeper);
+        }
+
+        std::unique_ptr<PerftCache> cache;
+        if (options.hashMB > 0 && !(cache = PerftCache::create(std::size_t(options.hashMB))))
+        {
+            report_command_failure("Could not allocate " + std::to_string(options.hashMB)
+                                   + " MB for the perft hash");
+            return 0;
+        }
+
+        std::atomic<std::size_t> next{0};
+        const auto               work = [&] {
+            StateInfo              workerRoot;
+            Position               workerPos;
+            std::vector<StateInfo> states(std::max(depth, 1));
+            for (std::size_t i; (i = next.fetch_add(1)) < subtrees.size();)
+            {
+                Subtree& subtree = subtrees[i];
+                workerPos.set(fen, isChess960, &workerRoot);
+                for (std::size_t ply = 0; ply < subtree.line.size(); ++ply)
+                    workerPos.do_move(subtree.line[ply], states[ply]);
+                subtree.nodes = perft_subtree(workerPos, depth - Depth(subtree.line.size()), cache.get());
+            }
+        };
+
+        std::vector<std::thread> helpers;
+        for (int i = 1; i < std::min<int>(options.threads, int(subtrees.size())); ++i)
+            helpers.emplace_back(work);
+        work();
+        for (auto& helper : helpers)
+            helper.join();
+
+        std::vector<u64> division(rootMoves.size(), 0);
+        for (const auto& subtree : subtrees)
+            division[subtree.rootMove] += subtree.nodes;
+
+        u64 nodes = 0;
+        for (std::size_t i = 0; i < rootMoves.size(); ++i)
+        {
+            nodes += division[i];
+            output_.write(UCIEngine::move(rootMoves.begin()[i], pos.is_chess960()) + ": "
+                          + std::to_string(division[i]));
+        }
+
+        output_.write("\nNodes searched: " + std::to_string(nodes) + "\n");
+        return nodes;
+    }
+
+    void rebuild_threads() {
+        engine_->wait_for_search_finished();
+        if (hooks_.onThreadPoolRebuild)
+            hooks_.onThreadPoolRebuild();
+
+        const auto began = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(threadPoolMutex_);
+            engine_->resize_threads();
+        }
+        pristine_ = true;
+        report_hash_reset("rebuild threads", began);
+    }
+
+    void limit_hash(std::istringstream& is) {
+        int megabytes = 0;
+        if (!(is >> megabytes) || megabytes < 1)
+            return;
+
+        const int current = engine_->get_options()["Hash"];
+        if (current <= megabytes)
+            return;
+
+        std::istringstream setHash("setoption name Hash value " + std::to_string(megabytes));
+        std::string        token;
+        setHash >> token;  // Consume "setoption", as loop() does
+        setoption(setHash);
+        output_.info_string("Hash reduced from " + std::to_string(current) + " to "
+                            + std::to_string(megabytes) + " MB");
+    }
+
+    void limit_threads(std::istringstream& is) {
+        int limit = 0;
+        if (!(is >> limit) || limit < 0 || limit == threadLimit_)
+            return;
+
+        const int previousCap = thread_cap();
+        threadLimit_          = limit;
+        apply_thread_cap(previousCap);
+    }
+
+    // The lower of ThreadLimitCommand()'s cap and, with PerformanceCoresOnly,
+    // the performance core count; 0 when neither applies.
+    int thread_cap() const {
+        int cap = threadLimit_;
+        if (engine_->get_options()[PerformanceCoresOption])
+            if (const int cores = DetectCoreClasses().performance)
+                cap = cap ? std::min(cap, cores) : cores;
+        return cap;
+    }
+
+    // Moves Threads to the host's value as far as the cap allows, after the
+    // cap changed from `previousCap`. Without a previous cap the current
+    // Threads is the host's value.
+    void apply_thread_cap(int previousCap) {
+        const int current = engine_->get_options()["Threads"];
+        if (!previousCap)
+            requestedThreads_ = current;
+
+        const int cap       = thread_cap();
+        const int requested = requestedThreads_;
+        const int target    = cap ? std::min(requested, cap) : requested;
+        if (target == current)
+            return;
+
+        std::istringstream setThreads("setoption name Threads value " + std::to_string(target));
+        std::string        token;
+        setThreads >> token;  // Consume "setoption", as loop() does
+        setoption(setThreads);
+        requestedThreads_ = requested;  // setoption() took the target for the host's value
+        output_.info_string("Threads " + std::string(target < current ? "reduced" : "restored")
+                            + " from " + std::to_string(current) + " to " + std::to_string(target));
+    }
+
+    std::string core_class_information() const {
+        const CoreClasses cores = DetectCoreClasses();
+        if (!cores.performance)
+            return "PerformanceCoresOnly has no effect: all cores are of one class";
+
+        const int threads = engine_->get_options()["Threads"];
+        return "Using " + std::to_string(threads) + " threads for "
+             + std::to_string(cores.performance) + " performance cores, leaving "
+             + std::to_string(cores.efficiency) + " efficiency cores unused";
+    }
+
+    // Hands the engine to WarmEngineCache in the state a new Engine starts in.
+    // Options with process-wide side effects cannot be reset without touching
+    // other sessions, so an engine that changed them is destroyed instead.
+    void park_engine() {
+        if (!WarmEngineCache::instance().enabled() || changedOptions_.count("SyzygyPath")
+            || changedOptions_.count("Debug Log File"))
+            return;
+
+        engine_->wait_for_search_finished();
+
+        // Nothing may reach this session's output once the engine is parked.
+        engine_->get_options().add_info_listener([](const std::optional<std::string>&) {});
+        engine_->set_on_iter([](const Engine::InfoIter&) {});
+        engine_->set_on_update_no_moves([](const Engine::InfoShort&) {});
+        engine_->set_on_update_full([](const Engine::InfoFull&) {});
+        engine_->set_on_bestmove([](std::string_view, std::string_view) {});
+        engine_->set_on_verify_network([](std::string_view) {});
+
+        const auto& defaults = optionDefaults(engine_->get_options());
+        for (const auto& name : changedOptions_)
+        {
+            const auto option = defaults.find(name);
+            if (option == defaults.end())
+                continue;
+
+            std::istringstream is("name " + name + " value " + option->second);
+            engine_->get_options().setoption(is);
+        }
+
+        // A fresh thread pool and TT give the next session cleared histories
+        // and hash, as in clear_search_state(). Resetting Threads or Hash
+        // above has already rebuilt them.
+        if (!WarmEngineCache::instance().retains_search_state())
+            engine_->resize_threads();
+
+        engine_ = WarmEngineCache::instance().park(std::move(engine_));
+    }
+
+    // Runs the next search queued on control_, as `position` plus `go` would,
+    // but reports its outcome to the request's completion instead of as text.
+    void native_search() {
+        auto request = control_ ? control_->take_search() : std::nullopt;
+        if (!request || !request->completion)  // None, or one cancel_search() emptied
+            return;
+
+        // The session's own position copy is not used by a running search, so
+        // the next job's FEN and moves are replayed, and validated, while the
+        // previous job finishes; only its hand-off to the engine waits.
+        const std::string fen = request->fen.empty() ? StartFEN : request->fen;
+        const auto update =
+          positions_.update(fen, request->moves, engine_->get_options()["UCI_Chess960"]);
+
+        engine_->wait_for_search_finished();
+
+        const auto started = std::chrono::steady_clock::now();
+        const auto queuedUs =
+          std::chrono::duration_cast<std::chrono::microseconds>(started - request->submitted).count();
+        if (update.error)
+        {
+            NativeSearchResult result;
+            result.status   = NativeSearchResult::Status::rejected;
+            result.error    = *update.error;
+            result.queuedUs = queuedUs;
+            request->completion(result);
+            return;
+        }
+
+        // The mirror already holds the request's position, so the engine
+        // takes it before any of the early returns below; otherwise a later
+        // `go` or request for the same moves would search the old root.
+        if (update.changed)
+            sync_position();
+
+        if (request->deterministic)
+        {
+            if (auto err = deterministic_error(*request))
+            {
+                NativeSearchResult result;
+                result.status   = NativeSearchResult::Status::invalidLimits;
+                result.error    = *err;
+                result.queuedUs = queuedUs;
+                request->completion(result);
+                return;
+            }
+
+            // Nothing searched since the last reset, so there is nothing to clear.
+            if (!pristine_)
+                clear_search_state();
+        }
+
+        Search::LimitsType limits;
+        limits.startTime   = now();
+        limits.depth       = request->depth;
+        limits.nodes       = request->nodes;
+        limits.movetime    = request->movetime;
+        limits.mate        = request->mate;
+        limits.time[WHITE] = request->time[0];
+        limits.time[BLACK] = request->time[1];
+        limits.inc[WHITE]  = request->inc[0];
+        limits.inc[BLACK]  = request->inc[1];
+        limits.movestogo   = request->movestogo;
+
+        // Measured from now, so the wait behind earlier searches is already spent.
+        const bool hasDeadline = request->deadline != std::chrono::steady_clock::time_point{};
+        if (hasDeadline)
+        {
+            const std::int64_t budgetUs =
+              std::chrono::duration_cast<std::chrono::microseconds>(request->deadline
+                                                                    - std::chrono::steady_clock::now())
+                .count()
+              - request->deadlineReserveUs - stopLatency_.peak();
+            const std::int64_t budgetMs = std::max<std::int64_t>(budgetUs / 1000, 1);
+            limits.movetime = limits.movetime ? std::min<std::int64_t>(limits.movetime, budgetMs) : budgetMs;
+        }
+
+        // The previous search has finished, so its bestmove no longer needs
+        // the lock. Checking for withdrawal under it means a cancel_background()
+        // either is seen here or stops the search once it has started.
+        std::unique_lock<std::mutex> lock(backgroundMutex_);
+        if (control_->withdrawn(*request))
+        {
+            lock.unlock();
+            NativeSearchResult result;
+            result.status   = request->background ? NativeSearchResult::Status::cancelled
+                                                  : NativeSearchResult::Status::withdrawn;
+            result.error    = request->background ? "" : "The search was cancelled before it started";
+            result.queuedUs = queuedUs;
+            request->completion(result);
+            return;
+        }
+
+        activeNative_.emplace(ActiveNativeSearch{std::move(request->completion), {}, started,
+                                                 std::move(request->provisional),
+                                                 request->provisionalDepth, request->provisionalMs,
+                                                 std::move(request->progress)});
+        activeNative_->result.queuedUs = queuedUs;
+        activeNative_->deadline        = request->deadline;
+
+        backgroundRunning_ = request->background;
+        runningTicket_     = request->ticket;
+        if (const auto bookMove = request->background ? std::nullopt : book_move(limits, request->deterministic))
+        {
+            lock.unlock();  // finish_search() takes it
+            finish_search(*bookMove, {});
+            return;
+        }
+
+        ResultCache::Record cached;
+        const u64           cacheKey = result_cache_key(*request);
+        if (cacheKey && ResultCache::instance().probe(cacheKey, cached))
+        {
+            lock.unlock();
+            finish_cached_search(cached);
+            return;
+        }
+        if (const auto proof = request->background ? std::nullopt : mate_proof(limits))
+        {
+            lock.unlock();
+            finish_mate_proof(*proof);
+            return;
+        }
+
+        activeNative_->cacheKey = cacheKey;
+        if (hasDeadline)
+            activeNative_->plannedStop =
+              std::chrono::steady_clock::now() + std::chrono::milliseconds(limits.movetime);
+        searchStopped_ = false;
+        start_search(limits);
+    }
+
+    // Zero when the result is not cached: the cache is off, the search is a
+    // pondering slice, or a clock or deadline makes its result depend on the
+    // game or the moment. The
+    // network is told apart by its EvalFile name, which for the embedded
+    // network includes its hash, and a custom file's size and time.
+    u64 result_cache_key(const NativeSearchRequest& request) const {
+        const auto& options = engine_->get_options();
+        if (!int(options[ResultCacheOption]) || request.background || request.time[0] || request.time[1]
+            || request.inc[0] || request.inc[1]
+            || request.deadline != std::chrono::steady_clock::time_point{})
+            return 0;
+
+        std::ostringstream ss;
+        ss << engine_version_info() << ' ' << positions_.history_key() << ' ' << request.depth << ' '
+           << request.nodes << ' ' << request.movetime << ' ' << request.mate << ' '
+           << request.deterministic;
+        for (const char* name : {"Threads", "MultiPV", "Skill Level", "UCI_LimitStrength", "UCI_Elo",
+                                 "UCI_Chess960", "UCI_ShowWDL", "SyzygyProbeDepth", "SyzygyProbeLimit",
+                                 "Syzygy50MoveRule"})
+            ss << ' ' << int(options[name]);
+
+        const std::string evalFile = options["EvalFile"];
+        struct stat       info{};
+        ss << ' ' << std::string(options["SyzygyPath"]) << ' ' << evalFile;
+        if (!::stat(evalFile.c_str(), &info))
+            ss << ' ' << info.st_size << ' ' << info.st_mtime;
+        return stable_hash(ss.str()) | 1;  // Never the empty-slot key
+    }
+
+    // Completes the current native search from a cached result.
+    void finish_cached_search(const ResultCache::Record& record) {
+        auto& result    = activeNative_->result;
+        result.cached   = true;
+        result.hasInfo  = record.hasInfo;
+        result.pv.assign(record.pv);
+        if (record.hasInfo)
+        {
+            SearchInfo& info = result.info;
+            info.depth       = record.depth;
+            info.selDepth    = record.selDepth;
+            info.multiPV     = 1;
+            info.scoreKind   = SearchInfo::ScoreKind(record.scoreKind);
+            info.scoreValue  = record.scoreValue;
+            info.bound       = SearchInfo::Bound(record.bound);
+            info.hasWDL      = record.hasWDL;
+            info.wdlWin      = record.wdl[0];
+            info.wdlDraw     = record.wdl[1];
+            info.wdlLoss     = record.wdl[2];
+            info.nodes       = record.nodes;
+            info.timeMs      = record.timeMs;
+            info.lineID      = result.pv.empty() ? 0 : 1;  // The only line reported
+        }
+
+        output_.info_string("Result cache hit at depth " + std::to_string(record.depth));
+        finish_search(record.bestmove, record.ponder);
+    }
+
+    // Runs on the search thread, from finish_search(), for a native search
+    // that ran to its limits.
+    void store_result(u64                       key,
+                      const NativeSearchResult& result,
+                      std::string_view          bestmove,
+                      std::string_view          ponder) {
+        ResultCache::Record record;
+        record.key = key;
+        if (result.hasInfo)
+        {
+            const SearchInfo& info = result.info;
+            record.hasInfo         = 1;
+            record.depth           = std::uint16_t(info.depth);
+            record.selDepth        = std::uint16_t(info.selDepth);
+            record.scoreKind       = std::uint8_t(info.scoreKind);
+            record.scoreValue      = info.scoreValue;
+            record.bound           = std::uint8_t(info.bound);
+            record.hasWDL          = info.hasWDL;
+            record.wdl[0]          = std::uint16_t(info.wdlWin);
+            record.wdl[1]          = std::uint16_t(info.wdlDraw);
+            record.wdl[2]          = std::uint16_t(info.wdlLoss);
+            record.nodes           = info.nodes;
+            record.timeMs          = info.timeMs;
+        }
+        if (bestmove.size() >= sizeof(record.bestmove) || ponder.size() >= sizeof(record.ponder))
+            return;
+        bestmove.copy(record.bestmove, bestmove.size());
+        ponder.copy(record.ponder, ponder.size());
+
+        std::string_view pv = result.pv;
+        while (pv.size() >= sizeof(record.pv))
+            pv = pv.substr(0, pv.rfind(' '));
+        pv.copy(record.pv, pv.size());
+        ResultCache::instance().store(record);
+    }
+
+    // Lazy SMP helpers race each other, and a clock stops the search at a
+    // time-dependent node, so either would make the result vary between runs.
+    std::optional<std::string> deterministic_error(const NativeSearchRequest& request) const {
+        if (request.movetime || request.time[0] || request.time[1] || request.inc[0] || request.inc[1]
+            || request.deadline != std::chrono::steady_clock::time_point{})
+            return std::string("A deterministic search takes depth, nodes, or mate limits only");
+        if (int(engine_->get_options()["Threads"]) != 1)
+            return std::string("A deterministic search needs Threads 1");
+        return std::nullopt;
+    }
+
+    // Evaluates the next batch queued on control_ without searching. Engine
+    // keeps its network private, so batches use a copy shared between sessions.
+    void native_eval() {
+        auto request = control_ ? control_->take_eval() : std::nullopt;
+        if (!request)
+            return;
+
+        // The batch has its own network copy, positions and accumulators, so
+        // only the CPU is shared with a search that keeps running.
+        const std::size_t workers =
+          request->concurrentWorkers > 0
+            ? std::min<std::size_t>(request->concurrentWorkers,
+                                    std::max(1u, std::thread::hardware_concurrency()))
+            : std::size_t(int(engine_->get_options()["Threads"]));
+        if (request->concurrentWorkers <= 0)
+            engine_->wait_for_search_finished();
+
+        NativeEvalResult result;
+        if (auto err = load_eval_network())
+        {
+            result.status = NativeEvalResult::Status::rejected;
+            result.error  = *err;
+        }
+        else
+        {
+            const std::size_t fens       = request->fens.size();
+            const bool        isChess960 = engine_->get_options()["UCI_Chess960"];
+            result.scores = evaluate_batch(
+              fens + request->packed.size(), workers,
+              [&](std::size_t i, std::string& fen, bool& chess960) {
+                  if (i < fens)
+                  {
+                      fen      = request->fens[i];
+                      chess960 = isChess960;
+                      return true;
+                  }
+                  chess960 = request->packed[i - fens].is_chess960();
+                  return !UnpackPosition(request->packed[i - fens], fen);
+              });
+        }
+
+        request->completion(result);
+    }
+
+    // Validates the requested network by loading it while any running search
+    // continues, and only then, between searches, sets EvalFile to it.
+    // Network::load reads into the engine's network in place, so a file that
+    // fails part way must never reach it. The engine still parses the file
+    // again in setoption(); the validated copy is kept for batch evaluation.
+    // Engine::load_network keeps the thread pool and TT; upstream still clears
+    // the search histories.
+    void network_swap() {
+        auto request = control_ ? control_->take_network_swap() : std::nullopt;
+        if (!request)
+            return;
+
+        NetworkSwapResult result;
+        const auto        began   = std::chrono::steady_clock::now();
+        auto              network = SharedEvalNetworks::instance().acquire(
+          CommandLine::get_binary_directory(cli_.argv[0]), request->file);
+        result.loadUs = elapsedMicroseconds(began);
+        if (!network)
+        {
+            result.status = NetworkSwapResult::Status::rejected;
+            result.error  = "Network " + request->file + " could not be loaded";
+            request->completion(result);
+            return;
+        }
+
+        evalNetwork_     = std::move(network);  // What load_eval_network() would take
+        evalNetworkFile_ = request->file;
+
+        engine_->wait_for_search_finished();
+
+        const auto         swapBegan = std::chrono::steady_clock::now();
+        std::istringstream setEvalFile("setoption name EvalFile value " + request->file);
+        std::string        token;
+        setEvalFile >> token;  // Consume "setoption", as loop() does
+        setoption(setEvalFile);
+        result.swapUs = elapsedMicroseconds(swapBegan);
+
+        request->completion(result);
+    }
+
+    // Takes the network EvalFile names from SharedEvalNetworks, loading it the
+    // way Engine does if no session holds it yet, and keeps it until EvalFile
+    // changes, so only the first batch pays for the load.
+    std::optional<std::string> load_eval_network() {
+        const std::string file = engine_->get_options()["EvalFile"];
+        if (evalNetwork_ && evalNetworkFile_ == file)
+            return std::nullopt;
+
+        evalNetwork_.reset();
+        evalNetwork_ = SharedEvalNetworks::instance().acquire(
+          CommandLine::get_binary_directory(cli_.argv[0]), file);
+        if (!evalNetwork_)
+            return "Network " + file + " could not be loaded";
+
+        evalNetworkFile_ = file;
+        return std::nullopt;
+    }
+
+    // Mirrors the final evaluation of Eval::trace for each of `count` positions,
+    // which `source(i, fen, isChess960)` writes out or rejects by returning
+    // false. Up to `maxWorkers` workers claim chunks of the batch and keep
+    // their accumulator refresh cache across positions, so related positions
+    // refresh cheaply.
+    template<typename Source>
+    std::vector<int> evaluate_batch(std::size_t count, std::size_t maxWorkers, const Source& source) {
+        constexpr std::size_t Chunk = 256;
+
+        std::vector<int>         scores(count, NativeEvalResult::NoScore);
+        const std::size_t        workers =
+          std::clamp<std::size_t>((count + Chunk - 1) / Chunk, 1, std::max<std::size_t>(maxWorkers, 1));
+        std::atomic<std::size_t> next{0};
+
+        static const DebugCounter rejected("Batch eval positions rejected", DebugCounterKind::hit);
+        static const DebugCounter magnitude("Batch eval |score| (cp)", DebugCounterKind::histogram);
+
+        const auto work = [&] {
+            auto        accumulators = std::make_unique<Eval::NNUE::AccumulatorStack>();
+            auto        caches       = std::make_unique<Eval::NNUE::AccumulatorCaches>(*evalNetwork_);
+            Position    pos;
+            StateInfo   st;
+            std::string fen;
+            bool        isChess960 = false;
+
+            for (std::size_t begin; (begin = next.fetch_add(Chunk)) < count;)
+                for (std::size_t i = begin; i < std::min(begin + Chunk, count); ++i)
+                {
+                    const bool skipped = !source(i, fen, isChess960)
+                                      || pos.set(fen, isChess960, &st) || pos.checkers();
+                    rejected.hit_on(skipped);
+                    if (skipped)
+                        continue;
+
+                    accumulators->reset();
+                    Value v = Eval::evaluate(*evalNetwork_, pos, *accumulators, *caches, VALUE_ZERO);
+                    v       = pos.side_to_move() == WHITE ? v : -v;
+                    scores[i] = UCIEngine::to_cp(v, pos);
+                    magnitude.histogram_of(std::abs(scores[i]));
+                }
+        };
+
+        std::vector<std::thread> helpers;
+        for (std::size_t i = 1; i < workers; ++i)
+            helpers.emplace_back(work);
+        work();
+        for (auto& helper : helpers)
+            helper.join();
+
+        return scores;
+    }
+
+    void position(std::istringstream& is) {
+        std::string token, fen;
+
+        is >> token;
+
+        if (token == "startpos")
+        {
+            fen = StartFEN;
+            is >> token;  // Consume the "moves" token, if any
+        }
+        else if (token == "fen")
+            while (is >> token && token != "moves")
+                fen += token + " ";
+        else
+            return;
+
+        std::vector<std::string> moves;
+
+        while (is >> token)
+            moves.push_back(token);
+
+        const auto update = positions_.update(fen, moves, engine_->get_options()["UCI_Chess960"]);
+        if (update.error)
+        {
+            report_command_failure(*update.error + "; keeping the previous position");
+            return;
+        }
+
+        // An unchanged position is still the engine's root; `go` without a
+        // new `position` relies on the same upstream behaviour.
+        if (update.changed)
+            sync_position();
+    }
+
+    void push_move(std::istringstream& is) {
+        std::string move;
+        is >> move;
+        if (auto err = positions_.push(move))
+        {
+            report_command_failure(*err + "; keeping the previous position");
+            return;
+        }
+        sync_position();
+    }
+
+    void pop_move() {
+        if (auto err = positions_.pop())
+        {
+            report_command_failure(*err);
+            return;
+        }
+        sync_position();
+    }
+
+    // Hands the mirrored game to the engine from its last capture or pawn
+    // move, so each change replays at most the moves since then.
+    void sync_position() {
+        engine_->set_position(positions_.anchor_fen(), positions_.moves_since_anchor());
+    }
+
+    // An update InfoThrottleMs holds back, owning the text it points to.
+    struct HeldUpdate {
+        Engine::InfoFull info{};
+        std::string      wdl;
+        std::string      bound;
+        std::string      pv;
+        std::uint32_t    lineID  = 0;
+        bool             pending = false;
+    };
+
+    // The last report of one root move's line, for MultiPVDelta and the root
+    // move summary. `info.pv` views `pv`.
+    struct ReportedLine {
+        SearchInfo  info;
+        std::string pv;
+    };
+
+    struct ActiveNativeSearch {
+        std::function<void(const NativeSearchResult&)>                    completion;
+        NativeSearchResult                                                result;
+        std::chrono::steady_clock::time_point                             started;
+        std::function<void(const SearchInfo&, std::string_view bestmove)> provisional;
+        int                                                               provisionalDepth = 0;
+        std::int64_t                                                      provisionalMs    = 0;
+        std::function<void(const SearchInfo&)>                            progress;
+        u64                                                               cacheKey         = 0;  // Stored when nonzero
+        std::chrono::steady_clock::time_point                             deadline{};
+        std::chrono::steady_clock::time_point                             plannedStop{};  // Unset unless it searched
+    };
+
+    // Runs on the search thread just before a deadline search's completion.
+    // How far bestmove ran past the planned stop, while every thread winds
+    // down, is held back from the next deadline's budget.
+    void finish_deadline(ActiveNativeSearch& native) {
+        static const DebugCounter missed("Deadline missed", DebugCounterKind::hit);
+
+        const auto now = std::chrono::steady_clock::now();
+        if (native.plannedStop != std::chrono::steady_clock::time_point{})
+            stopLatency_.record(
+              std::chrono::duration_cast<std::chrono::microseconds>(now - native.plannedStop).count());
+        native.result.deadlineMissed = now > native.deadline;
+        missed.hit_on(native.result.deadlineMissed);
+    }
+
+    // Runs on the search thread with each multipv-1 update of a native search.
+    void report_provisional(ActiveNativeSearch& native) {
+        const SearchInfo& info = native.result.info;
+        if (!native.provisional || info.pv.empty()
+            || !((native.provisionalDepth && info.depth >= native.provisionalDepth)
+                 || (native.provisionalMs && std::int64_t(info.timeMs) >= native.provisionalMs)))
+            return;
+
+        const auto provisional = std::move(native.provisional);
+        native.provisional     = nullptr;
+        provisional(info, info.pv.substr(0, info.pv.find(' ')));
+    }
+
+    std::istream&   in_;
+    SessionOutput   output_;
+    SessionHooks    hooks_;
+    SessionControl* control_;
+    CommandLine     cli_;
+
+    // Declared before engine_ so it outlives the final bestmove callback,
+    // which ~Engine() waits for.
+    std::optional<ActiveNativeSearch>             activeNative_;
+    SearchTelemetry                               telemetry_;  // Written by the search thread
+    std::string                                   telemetryBestMove_;
+    double                                        telemetryTimeAdjust_ = -1;
+    LatencyPeak                                   stopLatency_;  // Of deadline searches, past their planned stop
+    int                                           threadLimit_      = 0;  // From ThreadLimitCommand()
+    int                                           requestedThreads_ = 1;  // The host's Threads under a limit
+    std::set<std::string, CaseInsensitiveLess>    changedOptions_;
+    PositionHistory                               positions_;
+    std::unique_ptr<Engine>                       engine_;
+    SharedEvalNetworks::NetworkPtr                evalNetwork_;  // Taken by the first native_eval()
+    std::string                                   evalNetworkFile_;
+    bool                                          warm_;
+    bool                                          pristine_;  // No search since the TT was last reset
+    std::mutex                                    threadPoolMutex_;
+    std::mutex                                    backgroundMutex_;
+    bool                                          backgroundRunning_ = false;  // Guarded by backgroundMutex_
+    std::uint64_t                                 runningTicket_     = 0;      // Native search; guarded likewise
+    int                                           infoThrottleMs_    = 0;      // InfoThrottleMs
+    TimePoint                                     lastInfoEmit_      = 0;      // Of a throttled update
+    std::vector<HeldUpdate>                       heldUpdates_;                // By multipv - 1
+    bool                                          multiPVDelta_      = false;  // MultiPVDelta
+    std::map<std::string, ReportedLine, std::less<>> reportedLines_;           // By root move, this search
+    std::string                                   currentCmd_;
+    long                                          searchFaults_ = -1;  // At the last prefetching go
+    std::thread                                   tablebaseLoad_;       // Runs load_tablebases()
+    MemoryFootprint                               lastFootprint_;       // Last sent to onMemoryFootprint
+    std::unique_ptr<OpeningBook>                  book_;                // Loaded from BookFile
+    std::atomic<bool>                             searchStopped_{false};  // By `stop` since the last native search
+    PRNG                                          bookRng_{u64(now()) | 1};
+    TablebasePrefetcher                           prefetcher_{[this](const std::string& line) {
+        output_.info_string(line);
+    }};
 };
 
 }  // namespace
 
-void RunStockfishUCI(std::istream& in, std::ostream& out) {
+void SetWarmEngineRetention(bool enabled) { WarmEngineCache::instance().set_enabled(enabled); }
+
+void ReleaseWarmEngine() { WarmEngineCache::instance().release(); }
+
+void PrepareTables() { initialize_tables(); }
+
+ResultCacheStats GetResultCacheStats() { return ResultCache::instance().stats(); }
+
+void SetWarmSearchStateRetention(bool enabled) {
+    WarmEngineCache::instance().set_retains_search_state(enabled);
+}
+
+CoreClasses DetectCoreClasses() {
+    static const CoreClasses cores = [] {
+        CoreClasses result;
+#if defined(__APPLE__)
+        const auto read = [](const char* name) {
+            int    value = 0;
+            size_t size  = sizeof(value);
+            return sysctlbyname(name, &value, &size, nullptr, 0) == 0 ? value : 0;
+        };
+        if (read("hw.nperflevels") > 1)
+        {
+            result.performance = read("hw.perflevel0.logicalcpu");
+            result.efficiency  = read("hw.perflevel1.logicalcpu");
+        }
+#endif
+        return result;
+    }();
+    return cores;
+}
+
+std::optional<std::string>
+PackPosition(const std::string& fen, bool isChess960, PackedPosition& packed) {
+    initialize_tables();
+
+    StateInfo st;
+    Position  pos;
+    if (auto err = pos.set(fen, isChess960, &st))
+        return std::string(err->what());
+
+    PackedPosition result;
+    auto&          bytes    = result.bytes;
+    const Bitboard occupied = pos.pieces();
+    for (int i = 0; i < 8; ++i)
+        bytes[i] = std::uint8_t(occupied >> (8 * i));
+
+    // Position::set admits at most 32 pieces, which fill the 16 nibble bytes.
+    int n = 0;
+    for (Bitboard b = occupied; b; ++n)
+        bytes[8 + n / 2] |= std::uint8_t(pos.piece_on(pop_lsb(b)) << (4 * (n % 2)));
+
+    unsigned rookFiles = 0;
+    bytes[24]          = (pos.side_to_move() == BLACK) | (isChess960 << 5);
+    for (int i = 0; i < 4; ++i)
+        if (pos.can_castle(PackedCastling[i]))
+        {
+            bytes[24] |= 1 << (i + 1);
+            rookFiles |= unsigned(file_of(pos.castling_rook_square(PackedCastling[i]))) << (3 * i);
+        }
+
+    const int fullmove = 1 + (pos.game_ply() - (pos.side_to_move() == BLACK)) / 2;
+    bytes[25]          = pos.ep_square() == SQ_NONE ? NoEnPassant : std::uint8_t(pos.ep_square());
+    bytes[26]          = std::uint8_t(std::min(pos.rule50_count(), 255));
+    bytes[27]          = std::uint8_t(std::min(fullmove, 0xFFFF));
+    bytes[28]          = std::uint8_t(std::min(fullmove, 0xFFFF) >> 8);
+    bytes[29]          = std::uint8_t(rookFiles);
+    bytes[30]          = std::uint8_t(rookFiles >> 8);
+
+    packed = result;
+    return std::nullopt;
+}
+
+std::optional<std::string> UnpackPosition(const PackedPosition& packed, std::string& fen) {
+    const auto& bytes    = packed.bytes;
+    Bitboard    occupied = 0;
+    for (int i = 0; i < 8; ++i)
+        occupied |= Bitboard(bytes[i]) << (8 * i);
+
+    if (popcount(occupied) > 32)
+        return std::string("Packed position has more than 32 pieces");
+    if (bytes[25] > NoEnPassant)
+        return std::string("Packed position has an invalid en passant square");
+
+    char board[SQUARE_NB] = {};
+    int  n                = 0;
+    for (Bitboard b = occupied; b; ++n)
+    {
+        const int code = (bytes[8 + n / 2] >> (4 * (n % 2))) & 0xF;
+        if (PieceToChar[code] == ' ')
+            return std::string("Packed position has an invalid piece code");
+        board[pop_lsb(b)] = PieceToChar[code];
+    }
+
+    fen.clear();
+    for (int r = RANK_8; r >= RANK_1; --r)
+    {
+        int empty = 0;
+        for (int f = FILE_A; f <= FILE_H; ++f)
+        {
+            const char piece = board[make_square(File(f), Rank(r))];
+            if (!piece)
+            {
+                ++empty;
+                continue;
+            }
+            if (empty)
+                fen.push_back(char('0' + std::exchange(empty, 0)));
+            fen.push_back(piece);
+        }
+        if (empty)
+            fen.push_back(char('0' + empty));
+        if (r > RANK_1)
+            fen.push_back('/');
+    }
+
+    fen.append(bytes[24] & 1 ? " b " : " w ");
+
+    const unsigned rookFiles = bytes[29] | (unsigned(bytes[30]) << 8);
+    const bool     anyRight  = bytes[24] & 0x1E;
+    for (int i = 0; i < 4; ++i)
+        if (bytes[24] & (1 << (i + 1)))
+        {
+            const char file = char('a' + ((rookFiles >> (3 * i)) & 7));
+            const char code = packed.is_chess960() ? file : "kqkq"[i];
+            fen.push_back(i < 2 ? char(code - 'a' + 'A') : code);
+        }
+    if (!anyRight)
+        fen.push_back('-');
+
+    fen.push_back(' ');
+    if (bytes[25] == NoEnPassant)
+        fen.push_back('-');
+    else
+    {
+        fen.push_back(char('a' + bytes[25] % 8));
+        fen.push_back(char('1' + bytes[25] / 8));
+    }
+
+    char       number[16];
+    const auto fullmove = bytes[27] | (unsigned(bytes[28]) << 8);
+    auto       end      = std::to_chars(number, number + sizeof(number), unsigned(bytes[26])).ptr;
+    fen.push_back(' ');
+    fen.append(number, end);
+    end = std::to_chars(number, number + sizeof(number), fullmove).ptr;
+    fen.push_back(' ');
+    fen.append(number, end);
+    return std::nullopt;
+}
+
+std::optional<std::string> QueryPosition(const std::string&              fen,
+                                         const std::vector<std::string>& moves,
+                                         bool                            isChess960,
+                                         PositionQuery&                  query) {
+    initialize_tables();
+
+    // std::deque keeps the StateInfo chain in place as moves are played.
+    std::deque<StateInfo> states(1);
+    Position              pos;
+    if (auto err = pos.set(fen.empty() ? StartFEN : fen, isChess960, &states.back()))
+        return std::string(err->what());
+
+    for (const auto& move : moves)
+    {
+        const Move m = parse_uci_move(pos, move);
+        if (m == Move::none())
+            return "Illegal move: " + move;
+        pos.do_move(m, states.emplace_back());
+    }
+
+    PositionQuery         result;
+    const MoveList<LEGAL> legal(pos);
+    result.legalMoves.reserve(legal.size());
+    for (const auto& m : legal)
+        result.legalMoves.push_back(UCIEngine::move(m, isChess960));
+
+    using Status = PositionQuery::Status;
+    if (legal.size())
+        result.status = pos.checkers() ? Status::check : Status::ongoing;
+    else
+        result.status = pos.checkers() ? Status::checkmate : Status::stalemate;
+    result.fen = pos.fen();
+    result.key = pos.key();
+
+    query = std::move(result);
+    return std::nullopt;
+}
+
+std::optional<std::string> BuildOpeningBook(const std::vector<std::vector<std::string>>& games,
+                                            int                                          maxPly,
+                                            std::vector<BookEntry>&                      entries) {
+    initialize_tables();
+
+    std::map<std::pair<std::uint64_t, std::uint16_t>, unsigned> counts;
+    for (std::size_t game = 0; game < games.size(); ++game)
+    {
+        std::deque<StateInfo> states(1);
+        Position              pos;
+        pos.set(StartFEN, false, &states.back());
+        for (int ply = 0; ply < std::min(maxPly, int(games[game].size())); ++ply)
+        {
+            const Move m = parse_uci_move(pos, games[game][ply]);
+            if (m == Move::none())
+                return "Game " + std::to_string(game + 1) + ": Illegal move: " + games[game][ply];
+            ++counts[{pos.key(), book_move_code(m)}];
+            pos.do_move(m, states.emplace_back());
+        }
+    }
+
+    // std::map already orders the entries by key.
+    std::vector<BookEntry> result;
+    result.reserve(counts.size());
+    for (const auto& [position, count] : counts)
+        result.push_back({position.first, position.second, std::uint16_t(std::min(count, 65535u))});
+
+    entries = std::move(result);
+    return std::nullopt;
+}
+
+void RunStockfishUCI(std::istream&   in,
+                     std::ostream&   out,
+                     SessionHooks    hooks,
+                     SessionControl* control) {
     using namespace Stockfish;
 
-    // Redirect std::cin/std::cout for the duration of the UCI loop.
-    StreamRedirector redirect(in, out);
-    std::cout << engine_info() << std::endl;
+    const auto    startupBegan = std::chrono::steady_clock::now();
+    StartupTiming startup;
+
+    SessionOutput banner(out);
+    banner.write(engine_info());
 
     // Mimic Stockfish's main() setup so evaluation tables and options are ready.
-    Bitboards::init();
-    Attacks::init();
-    Position::init();
+    // Build them once rather than rewriting them under another session's search.
+    // Timed around call_once, so a session that waits for a PrepareTables()
+    // still in progress reports the wait.
+    const auto tablesBegan = std::chrono::steady_clock::now();
+    std::call_once(tablesInitialized(), [] {
+        Bitboards::init();
+        Attacks::init();
+        Position::init();
+    });
+    startup.tablesUs = elapsedMicroseconds(tablesBegan);
 
     // Stockfish expects argc/argv through CommandLine; fake them.
     std::vector<std::string> argvStorage = {"stockfish"};
@@ -132,8 +3942,21 @@ void RunStockfishUCI(std::istream& in, std::ostream& out) {
     // Construct the UCI engine and initialize tuning/options. This mirrors the
     // CommandLine handoff in the vendored Stockfish main.cpp.
     auto cli = CommandLine(static_cast<int>(argv.size()), argv.data());
-    auto uci = std::make_unique<UCIEngine>(std::move(cli));
-    Tune::init(uci->engine_options());
+    std::unique_ptr<EmbeddedUCIEngine> uci;
+    {
+        std::lock_guard<std::mutex> lock(engineConstructionMutex());
+        const auto engineBegan = std::chrono::steady_clock::now();
+        uci = std::make_unique<EmbeddedUCIEngine>(in, out, std::move(cli), std::move(hooks), control);
+        startup.engineUs = elapsedMicroseconds(engineBegan);
+        const auto optionsBegan = std::chrono::steady_clock::now();
+        optionsListing(uci->engine_options());
+        Tune::init(uci->engine_options());
+        startup.optionsUs = elapsedMicroseconds(optionsBegan);
+    }
+
+    startup.warm    = uci->warm_start();
+    startup.totalUs = elapsedMicroseconds(startupBegan);
+    uci->report_startup(startup);
 
     // Blocking UCI loop; returns when "quit" is received or input closes.
     uci->loop();
@@ -12,12 +12,655 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <iosfwd>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace SFEmbedded {
 
-// Runs the Stockfish UCI loop using caller-provided streams by temporarily redirecting
-// process-wide std::cin/std::cout. The SFEngine wrapper enforces exclusive ownership.
-void RunStockfishUCI(std::istream& in, std::ostream& out);
+// One `info ... pv ...` search update in typed form. `pv` is the
+// space-separated UCI move list and only valid for the duration of the callback.
+struct SearchInfo {
+    enum class ScoreKind {
+        centipawns,
+        mate,
+    };
+
+    enum class Bound {
+        exact,
+        lower,
+        upper,
+    };
+
+    int              depth      = 0;
+    int              selDepth   = 0;
+    std::size_t      multiPV    = 0;
+    ScoreKind        scoreKind  = ScoreKind::centipawns;
+    int              scoreValue = 0;
+    Bound            bound      = Bound::exact;
+    bool             hasWDL     = false;
+    int              wdlWin     = 0;
+    int              wdlDraw    = 0;
+    int              wdlLoss    = 0;
+    std::uint64_t    nodes      = 0;
+    std::uint64_t    nps        = 0;
+    int              hashfull   = 0;
+    std::uint64_t    tbHits     = 0;
+    std::uint64_t    timeMs     = 0;
+    std::string_view pv;
+    std::uint32_t    lineID     = 0;  // Stays with the PV's root move for the whole search; 0 without a PV
+};
+
+// Where a session's startup time went, in microseconds.
+struct StartupTiming {
+    bool          warm      = false;  // Reused an engine kept by SetWarmEngineRetention().
+    std::uint64_t tablesUs  = 0;      // Building or waiting for the tables; zero once PrepareTables() ran.
+    std::uint64_t engineUs  = 0;      // Engine construction (network, TT, threads) or warm reuse.
+    std::uint64_t optionsUs = 0;      // Option listing and Tune registration.
+    std::uint64_t totalUs   = 0;      // From RunStockfishUCI entry until the first command is read.
+};
+
+// Transposition-table occupancy when a search finishes, sampled from the
+// first 1000 clusters as `hashfull` is. Occupancy values are per mille.
+struct HashStats {
+    static constexpr int Ages = 32;  // TT generations before the age wraps.
+
+    int                     hashMB   = 0;
+    int                     hashfull = 0;  // Written by the finished search; byAge[0].
+    int                     occupied = 0;  // Entries of any age.
+    std::array<int, Ages>   byAge{};       // Entries last written `index` searches ago.
+};
+
+// What a session has allocated, as of its last command. Thread bytes are the
+// search workers' own state, mostly histories and accumulator caches; the
+// histories a NUMA node's workers share and the thread stacks are not counted.
+struct MemoryFootprint {
+    std::uint64_t hashBytes    = 0;
+    std::uint64_t networkBytes = 0;
+    int           threads      = 0;
+    std::uint64_t threadBytes  = 0;
+
+    bool operator==(const MemoryFootprint& other) const {
+        return hashBytes == other.hashBytes && networkBytes == other.networkBytes
+            && threads == other.threads && threadBytes == other.threadBytes;
+    }
+    bool operator!=(const MemoryFootprint& other) const { return !(*this == other); }
+};
+
+// One completed search iteration, from the multipv-1 update that ends it. The
+// time budget is the time manager's allocation when the search started; the
+// search may stop earlier or, with an unstable best move, later.
+struct SearchTelemetry {
+    int              depth           = 0;
+    int              selDepth        = 0;
+    std::uint64_t    nodes           = 0;  // All threads, since the search started.
+    std::uint64_t    iterationNodes  = 0;  // Since the previous completed iteration.
+    std::uint64_t    timeMs          = 0;
+    std::uint64_t    iterationMs     = 0;
+    double           branchingFactor = 0;  // iterationNodes over the previous one's; 0 at first.
+    bool             bestMoveChanged = false;
+    int              bestMoveChanges = 0;  // Iterations whose best move differed from the one before.
+    int              hashfull        = 0;
+    std::uint64_t    optimumMs       = 0;  // Zero without a clock or in `nodestime` mode.
+    std::uint64_t    maximumMs       = 0;
+    std::string_view bestMove;
+};
+
+// Optional typed listeners for a session. They run on Stockfish's search
+// thread, so keep them short and hand work off elsewhere.
+struct SessionHooks {
+    std::function<void(const SearchInfo&)>                                  onSearchInfo;
+    std::function<void(std::string_view bestmove, std::string_view ponder)> onBestmove;
+    // Runs once on the session thread, before the first command is handled.
+    std::function<void(const StartupTiming&)> onStartup;
+    // Runs after the TT was cleared or reallocated by `ucinewgame` or a Hash,
+    // Threads, or Clear Hash option, with the triggering command and its duration.
+    std::function<void(std::string_view command, std::uint64_t us)> onHashReset;
+    // Runs on the search thread after each search, just before onBestmove.
+    std::function<void(const HashStats&)> onHashStats;
+    // Runs on the search thread after each search, just before onBestmove,
+    // with the last update of every root move reported as a PV line during
+    // it: the best move first, then by depth and MultiPV rank. A move that
+    // dropped out of the lines keeps its score from the depth it was last
+    // reported at. Empty for a book move. `pv` views last only for the call.
+    std::function<void(const std::vector<SearchInfo>&)> onRootMoves;
+    // Runs on the search thread after each completed iteration.
+    std::function<void(const SearchTelemetry&)> onSearchTelemetry;
+    // Runs on the session thread at startup and after each command that
+    // changed the MemoryFootprint.
+    std::function<void(const MemoryFootprint&)> onMemoryFootprint;
+    // Runs on the session thread just before RebuildThreadsCommand() rebuilds
+    // the thread pool, so the new threads inherit whatever it changes there.
+    std::function<void()> onThreadPoolRebuild;
+
+    // Set to false to skip formatting `info ... pv` text lines entirely when the
+    // host only consumes `onSearchInfo`.
+    bool emitSearchInfoLines = true;
+};
+
+// Outcome of a NativeSearchRequest. `info` is the last multipv-1 update (if
+// any) and its `pv` view points into `pv`.
+struct NativeSearchResult {
+    enum class Status {
+        completed,
+        rejected,       // The position was invalid; the search never started.
+        invalidLimits,  // A deterministic search was given a clock or several threads.
+        cancelled,      // The session ended first, or a background search was withdrawn.
+        withdrawn,      // SessionControl::cancel_search() came before the search started.
+    };
+
+    Status      status = Status::completed;
+    std::string error;
+    std::string bestmove;
+    std::string ponder;
+    bool        hasInfo = false;
+    SearchInfo  info;
+    std::string pv;
+
+    // Time from submit_search() until the search started, which includes
+    // waiting for the jobs queued before it, and from then until bestmove.
+    std::uint64_t queuedUs = 0;
+    std::uint64_t searchUs = 0;
+    bool          cached   = false;  // Served by the result cache without searching
+
+    // The request had a deadline and bestmove came after it.
+    bool deadlineMissed = false;
+};
+
+// Peak of the last few latency samples, so one slow sample widens a
+// deadline's margin for the next several searches. One thread records while
+// others read.
+class LatencyPeak {
+   public:
+    static constexpr std::size_t Samples = 16;
+
+    void record(std::int64_t us) {
+        samples_[next_.fetch_add(1, std::memory_order_relaxed) % Samples].store(
+          us > 0 ? us : 0, std::memory_order_relaxed);
+    }
+
+    std::int64_t peak() const {
+        std::int64_t peak = 0;
+        for (const auto& sample : samples_)
+            peak = std::max(peak, sample.load(std::memory_order_relaxed));
+        return peak;
+    }
+
+   private:
+    std::array<std::atomic<std::int64_t>, Samples> samples_{};
+    std::atomic<std::size_t>                       next_{0};
+};
+
+// Counters of the process-wide result cache since the process started.
+struct ResultCacheStats {
+    std::uint64_t hits      = 0;
+    std::uint64_t misses    = 0;
+    std::uint64_t stores    = 0;
+    std::uint64_t evictions = 0;  // Stores that replaced another result
+    std::uint64_t entries   = 0;
+    std::uint64_t capacity  = 0;  // Slots; zero while ResultCacheMB is zero
+};
+
+ResultCacheStats GetResultCacheStats();
+
+// A search submitted without UCI text. Zero limits are unset, as in
+// Search::LimitsType; with no limit at all the search runs until stopped.
+struct NativeSearchRequest {
+    std::string              fen;  // Empty selects the standard start position.
+    std::vector<std::string> moves;
+    int                      depth     = 0;
+    std::uint64_t            nodes     = 0;
+    std::int64_t             movetime  = 0;
+    int                      mate      = 0;
+    std::int64_t             time[2]   = {0, 0};  // White, black remaining ms.
+    std::int64_t             inc[2]    = {0, 0};
+    int                      movestogo = 0;
+
+    // Runs once, on the search thread for finished searches or on the caller
+    // of the failing step otherwise.
+    std::function<void(const NativeSearchResult&)> completion;
+
+    // When set, runs at most once on the search thread with the first
+    // multipv-1 update at `provisionalDepth` or later, or after
+    // `provisionalMs` of searching, whichever comes first; zero disables
+    // either condition. The search keeps going, and `completion` follows.
+    std::function<void(const SearchInfo&, std::string_view bestmove)> provisional;
+    int                                                               provisionalDepth = 0;
+    std::int64_t                                                      provisionalMs    = 0;
+
+    // When set, runs on the search thread with every multipv-1 update.
+    std::function<void(const SearchInfo&)> progress;
+
+    // Background searches, such as pondering on predicted replies, give way
+    // to everything else through SessionControl::cancel_background().
+    bool background = false;
+
+    // Reproducible on every run: the search starts from a cleared hash and
+    // cleared histories, as after `ucinewgame`, and only depth, nodes, and
+    // mate limits with `Threads` 1 are accepted, so nothing depends on timing.
+    bool deterministic = false;
+
+    // When set, bestmove is due by then. The search gets whatever is left
+    // when it starts, after the searches queued before it, less
+    // `deadlineReserveUs` for the host's delivery and the session's own
+    // measured stopping latency, and at least 1 ms. Stopping early still
+    // yields the best root move found so far. Any movetime is capped, other
+    // limits still apply, and the result is never cached.
+    std::chrono::steady_clock::time_point deadline;
+    std::int64_t                          deadlineReserveUs = 0;
+
+    std::chrono::steady_clock::time_point submitted;       // Set by submit_search()
+    std::uint64_t                         generation = 0;  // Set by submit_search()
+    std::uint64_t                         ticket     = 0;  // Set by submit_search(), for cancel_search()
+};
+
+// Fixed-size position for bulk input: 32 bytes against 60 or more for a FEN,
+// with no move list. Little-endian layout:
+//   0-7    occupied squares, bit n for square n (a1 = 0, h8 = 63)
+//   8-23   Stockfish Piece code of each occupied square in ascending order,
+//          low nibble first
+//   24     bit 0 black to move, bits 1-4 castling rights (K, Q, k, q),
+//          bit 5 Chess960
+//   25     en passant square, or 64 for none
+//   26     halfmove clock, saturated at 255
+//   27-28  fullmove number
+//   29-30  castling rook file of each right in bits 3i..3i+2, in byte 24's order
+//   31     zero
+struct PackedPosition {
+    static constexpr std::size_t Size = 32;
+
+    bool is_chess960() const { return bytes[24] & 0x20; }
+
+    std::array<std::uint8_t, Size> bytes{};
+};
+
+// Arrays of packed positions are copied to and from raw bytes.
+static_assert(sizeof(PackedPosition) == PackedPosition::Size);
+
+// Packs `fen` after Position::set has accepted it; otherwise returns its error
+// and leaves `packed` alone.
+std::optional<std::string>
+PackPosition(const std::string& fen, bool isChess960, PackedPosition& packed);
+
+// Writes the FEN `packed` describes into `fen`, reusing its storage. Returns an
+// error for a malformed encoding; Position::set still validates the result.
+std::optional<std::string> UnpackPosition(const PackedPosition& packed, std::string& fen);
+
+// Facts about one position for hosts that validate moves without a session.
+struct PositionQuery {
+    enum class Status {
+        ongoing,
+        check,
+        checkmate,
+        stalemate
+    };
+
+    std::string              fen;         // As Position::fen() writes it
+    std::vector<std::string> legalMoves;  // UCI notation, in generation order
+    Status                   status = Status::ongoing;
+    std::uint64_t            key    = 0;  // Stockfish's Zobrist key
+};
+
+// Sets up `fen` (empty for the start position), plays `moves` in UCI notation,
+// and describes the result in `query`. Needs no running session and may be
+// called from any thread. Returns the FEN's or the first illegal move's error
+// and leaves `query` alone.
+std::optional<std::string> QueryPosition(const std::string&              fen,
+                                         const std::vector<std::string>& moves,
+                                         bool                            isChess960,
+                                         PositionQuery&                  query);
+
+// One record of an opening book file, which is an array of them sorted by key.
+// The layout is Polyglot's, but native-endian and keyed by Stockfish's own
+// Zobrist key, so a book built for one Stockfish version may not match
+// another. `move` has the destination square in bits 0-5, the origin in bits
+// 6-11, and a promotion in bits 12-14 (1 knight to 4 queen); castling is the
+// king taking its own rook, as in Chess960.
+struct BookEntry {
+    std::uint64_t key    = 0;
+    std::uint16_t move   = 0;
+    std::uint16_t weight = 0;  // Relative frequency among the key's moves
+    std::uint32_t learn  = 0;  // Unused, zero
+};
+
+static_assert(sizeof(BookEntry) == 16);
+
+// Builds the sorted entries of a book from the first `maxPly` plies of
+// `games`, each a list of UCI moves from the start position. A move's weight
+// is the number of games that played it in that position, saturated at 65535.
+// Returns the first illegal move's error and leaves `entries` alone.
+std::optional<std::string> BuildOpeningBook(const std::vector<std::vector<std::string>>& games,
+                                            int                                          maxPly,
+                                            std::vector<BookEntry>&                      entries);
+
+// Static evaluations for a NativeEvalRequest, in request order. Scores are
+// centipawns from White's point of view, as in the final line of `eval`.
+struct NativeEvalResult {
+    static constexpr int NoScore = std::numeric_limits<int>::min();
+
+    enum class Status {
+        completed,
+        rejected,   // The EvalFile network could not be loaded.
+        cancelled,  // The session ended first; set by the submitter.
+    };
+
+    Status           status = Status::completed;
+    std::string      error;
+    std::vector<int> scores;  // NoScore for an invalid FEN or a side in check.
+};
+
+// Positions to evaluate without searching, e.g. for book building. Scores
+// cover `fens`, then `packed`; packed positions carry their own Chess960 flag.
+struct NativeEvalRequest {
+    std::vector<std::string>    fens;
+    std::vector<PackedPosition> packed;
+
+    // When positive, the batch starts without waiting for a running search
+    // and splits across this many workers, also capped by the hardware
+    // threads, while the search keeps its own. Zero waits for the search and
+    // uses `Threads` workers. Commands queued after the batch wait for it
+    // either way.
+    int concurrentWorkers = 0;
+
+    // Runs once, on the session thread or on the caller of the failing step.
+    std::function<void(const NativeEvalResult&)> completion;
+};
+
+// Outcome of a NetworkSwapRequest, with the time spent loading the new network
+// to validate it, which overlaps any running search, and the time the engine
+// then took to load it into its own network between searches.
+struct NetworkSwapResult {
+    enum class Status {
+        completed,
+        rejected,   // The file could not be loaded; the engine keeps its network.
+        cancelled,  // The session ended first; set by the submitter.
+    };
+
+    Status        status = Status::completed;
+    std::string   error;
+    std::uint64_t loadUs = 0;
+    std::uint64_t swapUs = 0;
+};
+
+// Points EvalFile at `file` (resolved as EvalFile paths are) once that network
+// has loaded, keeping the thread pool and transposition table.
+struct NetworkSwapRequest {
+    std::string file;
+
+    // Runs once, on the session thread or on the caller of the failing step.
+    std::function<void(const NetworkSwapResult&)> completion;
+};
+
+// Queue token that tells the session loop to run the next submitted native
+// search. It starts with NUL, which SFEngine rejects in text commands.
+inline const std::string& NativeSearchCommand() {
+    static const std::string command("\0native-search", 14);
+    return command;
+}
+
+// Queue token that tells the session loop to run the next submitted
+// NativeEvalRequest.
+inline const std::string& NativeEvalCommand() {
+    static const std::string command("\0native-eval", 12);
+    return command;
+}
+
+// Queue token that tells the session loop to run the next submitted
+// NetworkSwapRequest.
+inline const std::string& NetworkSwapCommand() {
+    static const std::string command("\0network-swap", 13);
+    return command;
+}
+
+// Queue token asking the session to shrink its TT to at most `megabytes` once
+// the current search has finished, e.g. under memory pressure. Shrinking
+// reallocates, and so clears, the table; a smaller or equal Hash is left alone.
+inline std::string HashLimitCommand(int megabytes) {
+    return std::string("\0hash-limit ", 12) + std::to_string(megabytes);
+}
+
+// Queue token asking the session to cap Threads at `threads` once the current
+// search has finished, e.g. while the device is hot; 0 lifts the cap. The
+// host's own Threads value is kept and restored as far as the cap allows.
+// Changing the thread count rebuilds the pool, which clears the TT.
+inline std::string ThreadLimitCommand(int threads) {
+    return std::string("\0thread-limit ", 14) + std::to_string(threads);
+}
+
+// Queue token asking the session to rebuild its thread pool once the current
+// search has finished, as setting Threads does; this also clears the TT.
+inline const std::string& RebuildThreadsCommand() {
+    static const std::string command("\0rebuild-threads", 16);
+    return command;
+}
+
+// Out-of-band path to a running session's search, bypassing its command
+// queue so `stop`/`ponderhit` take effect even behind a burst of queued
+// commands. Calls are no-ops while no session is attached.
+class SessionControl {
+   public:
+    // Same effect as a `stop` command: ask the current search to finish now.
+    void stop() { invoke(stop_); }
+
+    // Same effect as a `ponderhit` command: the ponder search becomes a normal search.
+    void ponderhit() { invoke(ponderhit_); }
+
+    // Withdraws queued background searches, which the caller completes, and
+    // stops the running search if it is a background one; a foreground
+    // search is never interrupted.
+    std::deque<NativeSearchRequest> cancel_background() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::deque<NativeSearchRequest> cancelled, kept;
+        for (auto& request : pendingSearches_)
+            (request.background ? cancelled : kept).push_back(std::move(request));
+        pendingSearches_ = std::move(kept);
+        backgroundGeneration_.fetch_add(1, std::memory_order_release);
+        if (stopBackground_)
+            stopBackground_();
+        return cancelled;
+    }
+
+    // Cancels the search submit_search() returned `ticket` for. A queued
+    // request is withdrawn and handed back for the caller to complete; a
+    // running one is stopped as by `stop`, and one that has finished is left
+    // alone. Cancelling never touches any other search.
+    std::optional<NativeSearchRequest> cancel_search(std::uint64_t ticket) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& pending : pendingSearches_)
+            if (pending.ticket == ticket && pending.completion)
+            {
+                // An empty request keeps the place of the queued token, so
+                // the searches after it still run between the same commands.
+                NativeSearchRequest request = std::exchange(pending, NativeSearchRequest{});
+                return request;
+            }
+
+        // The session may be holding the last request it took until the
+        // search before it finishes; a running one is stopped instead.
+        if (ticket == takenTicket_)
+            cancelledTicket_.store(ticket, std::memory_order_release);
+        if (stopSearch_)
+            stopSearch_(ticket);
+        return std::nullopt;
+    }
+
+    // Used by RunStockfishUCI to bind and unbind the running engine.
+    void attach(std::function<void()>              stop,
+                std::function<void()>              ponderhit,
+                std::function<void()>              stopBackground,
+                std::function<void(std::uint64_t)> stopSearch) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_           = std::move(stop);
+        ponderhit_      = std::move(ponderhit);
+        stopBackground_ = std::move(stopBackground);
+        stopSearch_     = std::move(stopSearch);
+    }
+
+    void detach() { attach(nullptr, nullptr, nullptr, nullptr); }
+
+    // True for a request that cancel_background() or cancel_search()
+    // overtook after take_search() had already handed it to the session loop.
+    bool withdrawn(const NativeSearchRequest& request) const {
+        return (request.background
+                && request.generation != backgroundGeneration_.load(std::memory_order_acquire))
+            || request.ticket == cancelledTicket_.load(std::memory_order_acquire);
+    }
+
+    // Native searches wait here in submission order; the caller pushes one
+    // NativeSearchCommand() into the session's command queue per request.
+    // Returns the request's ticket for cancel_search(), never zero.
+    std::uint64_t submit_search(NativeSearchRequest request) {
+        request.submitted = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        request.generation = backgroundGeneration_.load(std::memory_order_relaxed);
+        request.ticket     = ++lastTicket_;
+        pendingSearches_.push_back(std::move(request));
+        return lastTicket_;
+    }
+
+    std::optional<NativeSearchRequest> take_search() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pendingSearches_.empty())
+            return std::nullopt;
+
+        NativeSearchRequest request = std::move(pendingSearches_.front());
+        pendingSearches_.pop_front();
+        takenTicket_ = request.ticket;
+        return request;
+    }
+
+    // Hands back requests the session never reached, e.g. after it ended.
+    std::deque<NativeSearchRequest> take_all_searches() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::deque<NativeSearchRequest> requests;
+        for (auto& request : pendingSearches_)
+            if (request.completion)
+                requests.push_back(std::move(request));
+        pendingSearches_.clear();
+        return requests;
+    }
+
+    // Evaluations queue the same way, with one NativeEvalCommand() each.
+    void submit_eval(NativeEvalRequest request) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pendingEvals_.push_back(std::move(request));
+    }
+
+    std::optional<NativeEvalRequest> take_eval() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pendingEvals_.empty())
+            return std::nullopt;
+
+        NativeEvalRequest request = std::move(pendingEvals_.front());
+        pendingEvals_.pop_front();
+        return request;
+    }
+
+    std::deque<NativeEvalRequest> take_all_evals() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::exchange(pendingEvals_, {});
+    }
+
+    // And so do network swaps, with one NetworkSwapCommand() each.
+    void submit_network_swap(NetworkSwapRequest request) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pendingSwaps_.push_back(std::move(request));
+    }
+
+    std::optional<NetworkSwapRequest> take_network_swap() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pendingSwaps_.empty())
+            return std::nullopt;
+
+        NetworkSwapRequest request = std::move(pendingSwaps_.front());
+        pendingSwaps_.pop_front();
+        return request;
+    }
+
+    std::deque<NetworkSwapRequest> take_all_network_swaps() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::exchange(pendingSwaps_, {});
+    }
+
+   private:
+    void invoke(const std::function<void()>& action) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (action)
+            action();
+    }
+
+    std::mutex            mutex_;
+    std::function<void()> stop_;
+    std::function<void()> ponderhit_;
+    std::function<void()> stopBackground_;
+
+    std::function<void(std::uint64_t)> stopSearch_;
+
+    // Bumped by cancel_background(), and set by cancel_search(); read without
+    // mutex_ so the session loop can check them while holding its own lock.
+    std::atomic<std::uint64_t> backgroundGeneration_{0};
+    std::atomic<std::uint64_t> cancelledTicket_{0};
+    std::uint64_t              lastTicket_  = 0;
+    std::uint64_t              takenTicket_ = 0;  // Of the last take_search()
+
+    std::deque<NativeSearchRequest> pendingSearches_;
+    std::deque<NativeEvalRequest>   pendingEvals_;
+    std::deque<NetworkSwapRequest>  pendingSwaps_;
+};
+
+// When enabled, a session that ends parks its Stockfish::Engine (loaded
+// network, thread pool, TT allocation) in a process-wide slot with its options
+// reset to defaults, and the next session adopts it instead of constructing a
+// new one. At most one engine is kept. Disabling frees a parked engine.
+// Off by default.
+void SetWarmEngineRetention(bool enabled);
+
+// When enabled as well, a parked engine also keeps its transposition table and
+// search histories, so the next session continues as if `ucinewgame` had not
+// been sent. Restored TT entries age normally through the TT generation that
+// each new search advances. Off by default.
+void SetWarmSearchStateRetention(bool enabled);
+
+// Frees a parked engine now without changing the retention setting.
+void ReleaseWarmEngine();
+
+// Builds Stockfish's process-wide bitboard, attack, and Zobrist tables unless
+// a session or packing call already has, and returns once they are ready.
+// Calling it at launch, off the critical path, keeps their tens of
+// milliseconds out of the first session's startup.
+void PrepareTables();
+
+// Logical CPUs by core class, from the `hw.perflevel0` (fastest) and
+// `hw.perflevel1` sysctls on Apple platforms. Both are 0 where the system
+// does not report more than one performance level.
+struct CoreClasses {
+    int performance = 0;
+    int efficiency  = 0;
+};
+
+CoreClasses DetectCoreClasses();
+
+// Runs a Stockfish UCI session that reads commands from `in` and writes every
+// output line to `out`. Each call owns its own Stockfish::Engine and never
+// touches process-wide std::cin/std::cout, so several sessions may run at once.
+// When `control` is given it is attached for the lifetime of the session and
+// serves the native searches, evaluations, and network swaps queued through it.
+void RunStockfishUCI(std::istream&   in,
+                     std::ostream&   out,
+                     SessionHooks    hooks   = {},
+                     SessionControl* control = nullptr);
 
 }  // namespace SFEmbedded
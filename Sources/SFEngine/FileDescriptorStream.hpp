@@ -0,0 +1,219 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+// UCI output to, and command input from, caller-owned file descriptors.
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace SFEmbedded {
+
+// std::streambuf that writes whole lines to a descriptor without a callback.
+// - Complete lines collect in one buffer that is written when the stream is
+//   flushed, which Stockfish does after each line, or once 64 KiB are pending.
+//   A partial line waits for its newline, so write_line() from another thread
+//   never lands inside one.
+// - Carriage returns are ignored, matching LineBufferStreambuf.
+// - Partial writes, EINTR and EAGAIN are retried. After any other failure,
+//   e.g. a socket whose peer has gone, output is discarded and failed() is
+//   true. SIGPIPE is turned off for the descriptor where the platform allows.
+class FileDescriptorStreambuf: public std::streambuf {
+   public:
+    static constexpr std::size_t MaxPendingBytes = 64 * 1024;
+
+    explicit FileDescriptorStreambuf(int fd) :
+        fd_(fd) {
+#ifdef F_SETNOSIGPIPE
+        ::fcntl(fd_, F_SETNOSIGPIPE, 1);
+#endif
+    }
+
+    ~FileDescriptorStreambuf() override { sync(); }
+
+    // Writes one line now, e.g. a wrapper error raised outside the engine.
+    void write_line(std::string_view line) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.append(line.data(), line.size());
+        pending_.push_back('\n');
+        write_pending();
+    }
+
+    bool failed() const { return failed_.load(std::memory_order_relaxed); }
+
+   protected:
+    int_type overflow(int_type ch) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            const char c = traits_type::to_char_type(ch);
+            append(&c, &c + 1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize count) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        append(s, s + count);
+        if (pending_.size() >= MaxPendingBytes)
+            write_pending();
+        return count;
+    }
+
+    int sync() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        write_pending();
+        return 0;
+    }
+
+   private:
+    void append(const char* begin, const char* end) {
+        for (; begin < end; ++begin)
+        {
+            if (*begin == '\r')
+                continue;
+
+            line_.push_back(*begin);
+            if (*begin == '\n')
+            {
+                pending_ += line_;
+                line_.clear();
+            }
+        }
+    }
+
+    void write_pending() {
+        std::size_t written = 0;
+        while (!failed() && written < pending_.size())
+        {
+            const ssize_t n = ::write(fd_, pending_.data() + written, pending_.size() - written);
+            if (n > 0)
+                written += std::size_t(n);
+            else if (n < 0 && errno == EAGAIN)
+            {
+                pollfd ready{fd_, POLLOUT, 0};
+                ::poll(&ready, 1, -1);
+            }
+            else if (n == 0 || errno != EINTR)
+                failed_.store(true, std::memory_order_relaxed);
+        }
+        pending_.clear();
+    }
+
+    const int         fd_;
+    std::atomic<bool> failed_{false};
+    std::mutex        mutex_;
+    std::string       line_;     // Up to and including its newline
+    std::string       pending_;  // Complete lines not yet written
+};
+
+// Reads newline-separated commands from a descriptor until end of file, a
+// read error, or interrupt() from another thread. LF and CRLF both end a
+// line; a line that grows past MaxLineBytes is passed on at that length (and
+// rejected as oversized downstream) and the rest of it is skipped.
+class FileDescriptorLineReader {
+   public:
+    using LineCallback = std::function<void(std::string&&)>;
+
+    static constexpr std::size_t MaxLineBytes = 1024 * 1024 + 1;
+
+    explicit FileDescriptorLineReader(int fd) :
+        fd_(fd) {
+        if (::pipe(wake_) != 0)
+            wake_[0] = wake_[1] = -1;
+    }
+
+    ~FileDescriptorLineReader() {
+        for (int fd : wake_)
+            if (fd >= 0)
+                ::close(fd);
+    }
+
+    FileDescriptorLineReader(const FileDescriptorLineReader&)            = delete;
+    FileDescriptorLineReader& operator=(const FileDescriptorLineReader&) = delete;
+
+    // Returns true when the input ended, false when interrupted. A final line
+    // without a newline is still delivered at end of file.
+    bool run(const LineCallback& onLine) {
+        std::string line;
+        bool        skipping = false;
+        char        chunk[4096];
+        for (;;)
+        {
+            pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+            if (::poll(fds, wake_[0] >= 0 ? 2 : 1, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (fds[1].revents)
+                return false;
+
+            const ssize_t n = ::read(fd_, chunk, sizeof(chunk));
+            if (n < 0 && (errno == EINTR || errno == EAGAIN))
+                continue;
+            if (n <= 0)
+                break;
+
+            for (const char* cursor = chunk; cursor < chunk + n; ++cursor)
+            {
+                if (*cursor == '\n')
+                {
+                    if (!line.empty() && line.back() == '\r')
+                        line.pop_back();
+                    if (!skipping)
+                        onLine(std::move(line));
+                    line.clear();
+                    skipping = false;
+                }
+                else if (!skipping)
+                {
+                    line.push_back(*cursor);
+                    if (line.size() == MaxLineBytes)
+                    {
+                        onLine(std::move(line));
+                        line.clear();
+                        skipping = true;
+                    }
+                }
+            }
+        }
+
+        if (!line.empty() && !skipping)
+            onLine(std::move(line));
+        return true;
+    }
+
+    // Safe from any thread, before or during run().
+    void interrupt() {
+        const char wake = 0;
+        if (wake_[1] >= 0)
+            while (::write(wake_[1], &wake, 1) < 0 && errno == EINTR) {}
+    }
+
+   private:
+    const int fd_;
+    int       wake_[2];
+};
+
+}  // namespace SFEmbedded
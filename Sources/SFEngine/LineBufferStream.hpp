@@ -12,22 +12,29 @@
 
 #pragma once
 
+#include <cstring>
 #include <functional>
 #include <mutex>
 #include <ostream>
 #include <streambuf>
 #include <string>
 
+#include "LineRing.hpp"
+
 namespace SFEmbedded {
 
 // std::streambuf implementation that collects stdout into lines.
 // Each completed line is forwarded through the provided callback.
+// Bulk writes take the lock once and scan for newlines with memchr; single
+// characters (e.g. std::endl) still go through overflow.
+// With a LineRing, every line is also recorded there before the callback runs.
 class LineBufferStreambuf: public std::streambuf {
    public:
     using LineCallback = std::function<void(const std::string&)>;
 
-    explicit LineBufferStreambuf(LineCallback cb) :
-        callback_(std::move(cb)) {}
+    explicit LineBufferStreambuf(LineCallback cb, LineRing* recent = nullptr) :
+        callback_(std::move(cb)),
+        recent_(recent) {}
 
    protected:
     int_type overflow(int_type ch) override {
@@ -49,6 +56,26 @@ class LineBufferStreambuf: public std::streambuf {
         return traits_type::not_eof(ch);
     }
 
+    std::streamsize xsputn(const char* s, std::streamsize count) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const char* cursor = s;
+        const char* end    = s + count;
+        while (cursor < end) {
+            const auto* newline =
+              static_cast<const char*>(std::memchr(cursor, '\n', static_cast<std::size_t>(end - cursor)));
+            const char* segmentEnd = newline ? newline : end;
+
+            append_without_cr(cursor, segmentEnd);
+            if (!newline)
+                break;
+
+            flush_line();
+            cursor = newline + 1;
+        }
+        return count;
+    }
+
     int sync() override {
         std::lock_guard<std::mutex> lock(mutex_);
 
@@ -58,6 +85,19 @@ class LineBufferStreambuf: public std::streambuf {
     }
 
    private:
+    void append_without_cr(const char* begin, const char* end) {
+        // Carriage returns are ignored, matching overflow().
+        while (begin < end) {
+            const auto* cr =
+              static_cast<const char*>(std::memchr(begin, '\r', static_cast<std::size_t>(end - begin)));
+            const char* runEnd = cr ? cr : end;
+            buffer_.append(begin, runEnd);
+            if (!cr)
+                break;
+            begin = cr + 1;
+        }
+    }
+
     void flush_line() {
         if (buffer_.empty())
             return;
@@ -65,11 +105,14 @@ class LineBufferStreambuf: public std::streambuf {
         // The callback receives the line without the trailing newline.
         std::string line = std::move(buffer_);
         buffer_.clear();
+        if (recent_)
+            recent_->push(line);  // Writes are serialized by mutex_
         if (callback_)
             callback_(line);
     }
 
     LineCallback callback_;
+    LineRing*    recent_;
     std::mutex   mutex_;
     std::string  buffer_;
 };
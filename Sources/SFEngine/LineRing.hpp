@@ -0,0 +1,119 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+// Fixed-size ring of the most recent output lines, for diagnostics.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace SFEmbedded {
+
+// Keeps the last `capacity` lines pushed by one writer, at one slot copy per
+// line and no allocation, while any thread may take a snapshot.
+// - Each slot is a seqlock: the writer marks it odd while copying a line in,
+//   and a reader keeps a copy only if the sequence was even and unchanged
+//   around it. Lines are stored in relaxed atomic words, so a torn read is
+//   detected rather than undefined.
+// - Lines longer than MaxLineBytes are cut to that length.
+// - A snapshot that races the writer skips the oldest lines overwritten
+//   meanwhile; it never blocks the writer.
+class LineRing {
+   public:
+    static constexpr std::size_t MaxLineBytes = 504;
+
+    explicit LineRing(std::size_t capacity) :
+        capacity_(std::max<std::size_t>(capacity, 1)),
+        slots_(std::make_unique<Slot[]>(capacity_)) {}
+
+    std::size_t capacity() const { return capacity_; }
+
+    // Lines pushed since construction, including those overwritten since.
+    std::uint64_t written() const { return written_.load(std::memory_order_acquire); }
+
+    // Single writer only.
+    void push(std::string_view line) {
+        const std::uint64_t n    = written_.load(std::memory_order_relaxed);
+        Slot&               slot = slots_[n % capacity_];
+
+        slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const std::size_t size = std::min(line.size(), MaxLineBytes);
+        slot.size.store(static_cast<std::uint32_t>(size), std::memory_order_relaxed);
+        for (std::size_t i = 0; i * 8 < size; ++i)
+        {
+            std::uint64_t word = 0;
+            std::memcpy(&word, line.data() + i * 8, std::min<std::size_t>(8, size - i * 8));
+            slot.words[i].store(word, std::memory_order_relaxed);
+        }
+
+        slot.sequence.store(2 * n + 2, std::memory_order_release);
+        written_.store(n + 1, std::memory_order_release);
+    }
+
+    // The retained lines, oldest first.
+    std::vector<std::string> snapshot() const {
+        const std::uint64_t end   = written();
+        const std::uint64_t begin = end > capacity_ ? end - capacity_ : 0;
+
+        std::vector<std::string> lines;
+        lines.reserve(static_cast<std::size_t>(end - begin));
+        std::string line;
+        for (std::uint64_t n = begin; n < end; ++n)
+            if (read(n, line))
+                lines.push_back(line);
+        return lines;
+    }
+
+   private:
+    struct Slot {
+        std::atomic<std::uint64_t> sequence{0};  // 2n + 2 once line n is complete
+        std::atomic<std::uint32_t> size{0};
+        std::array<std::atomic<std::uint64_t>, MaxLineBytes / 8> words{};
+    };
+
+    bool read(std::uint64_t n, std::string& line) const {
+        const Slot&         slot   = slots_[n % capacity_];
+        const std::uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before != 2 * n + 2)
+            return false;
+
+        const std::size_t size = std::min<std::size_t>(slot.size.load(std::memory_order_relaxed), MaxLineBytes);
+        std::array<char, MaxLineBytes> bytes;
+        for (std::size_t i = 0; i * 8 < size; ++i)
+        {
+            const std::uint64_t word = slot.words[i].load(std::memory_order_relaxed);
+            std::memcpy(bytes.data() + i * 8, &word, 8);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before)
+            return false;
+
+        line.assign(bytes.data(), size);
+        return true;
+    }
+
+    const std::size_t           capacity_;
+    std::unique_ptr<Slot[]>     slots_;
+    std::atomic<std::uint64_t>  written_{0};
+};
+
+}  // namespace SFEmbedded
@@ -0,0 +1,111 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+import Foundation
+
+// Swift concurrency entry points over `startSearchFEN:moves:limits:infoHandler:completion:`.
+// Cancelling the calling task, or ending iteration of an update stream early,
+// calls `cancelSearch:`, which reaches the engine out of band like `stop`: a
+// running search returns its threads at its next stop poll and a queued one
+// never starts.
+extension SFEngine {
+    /// Searches `fen` (nil for the standard start position) after `moves`, as
+    /// `searchFEN(_:moves:limits:)` does. Throws `CancellationError` once the
+    /// task is cancelled, whether or not the search had started, and the
+    /// `SFEngineErrorDomain` errors of `searchFEN` otherwise.
+    public func search(fen: String? = nil, moves: [String] = [], limits: SFSearchLimits) async throws -> SFSearchResult {
+        let ticket = SFSearchTicket(engine: self)
+        return try await withTaskCancellationHandler {
+            try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<SFSearchResult, Error>) in
+                ticket.start { engine in
+                    engine.startSearch(fen: fen, moves: moves, limits: limits, infoHandler: nil) { result, error in
+                        if ticket.isCancelled {
+                            continuation.resume(throwing: CancellationError())
+                        } else if let result {
+                            continuation.resume(returning: result)
+                        } else {
+                            continuation.resume(throwing: error ?? CancellationError())
+                        }
+                    }
+                }
+            }
+        } onCancel: {
+            ticket.cancel()
+        }
+    }
+
+    /// Streams the multipv-1 updates of one search, in engine order, and
+    /// finishes when it does. The last update is the result's `info`. The
+    /// stream fails with the `SFEngineErrorDomain` errors of `searchFEN`;
+    /// cancelling the consuming task or dropping the stream cancels the search.
+    public func searchUpdates(fen: String? = nil,
+                              moves: [String] = [],
+                              limits: SFSearchLimits) -> AsyncThrowingStream<SFSearchInfo, Error> {
+        AsyncThrowingStream { continuation in
+            let ticket = SFSearchTicket(engine: self)
+            continuation.onTermination = { termination in
+                if case .cancelled = termination {
+                    ticket.cancel()
+                }
+            }
+            ticket.start { engine in
+                engine.startSearch(fen: fen, moves: moves, limits: limits, infoHandler: { info in
+                    continuation.yield(info)
+                }) { result, error in
+                    if result != nil || ticket.isCancelled {
+                        continuation.finish()
+                    } else {
+                        continuation.finish(throwing: error)
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Ties one search's ticket to its cancellation, which may arrive before the
+// search has been submitted.
+private final class SFSearchTicket: @unchecked Sendable {
+    private let lock = NSLock()
+    private let engine: SFEngine
+    private var ticket: UInt64 = 0
+    private var cancelled = false
+
+    init(engine: SFEngine) {
+        self.engine = engine
+    }
+
+    var isCancelled: Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return cancelled
+    }
+
+    func start(_ submit: (SFEngine) -> UInt64) {
+        let submitted = submit(engine)
+        lock.lock()
+        ticket = submitted
+        let cancelNow = cancelled
+        lock.unlock()
+        if cancelNow && submitted != 0 {
+            engine.cancelSearch(submitted)
+        }
+    }
+
+    func cancel() {
+        lock.lock()
+        cancelled = true
+        let submitted = ticket
+        lock.unlock()
+        if submitted != 0 {
+            engine.cancelSearch(submitted)
+        }
+    }
+}
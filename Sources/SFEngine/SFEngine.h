@@ -16,15 +16,596 @@ NS_ASSUME_NONNULL_BEGIN
 
 typedef void (^NS_SWIFT_SENDABLE SFLineHandler)(NSString *line);
 
+typedef void (^NS_SWIFT_SENDABLE SFLineBatchHandler)(NSArray<NSString *> *lines);
+
+/// How `initWithLineBatchHandler:policy:` treats lines while the handler is busy.
+typedef NS_ENUM(NSInteger, SFLineBatchPolicy) {
+    /// Every line is delivered.
+    SFLineBatchPolicyDeliverAll,
+    /// A pending `info ... pv` line is replaced by a newer one for the same
+    /// multipv (and a pending `currmove` line by a newer one) before delivery.
+    /// `bestmove`, `info string`, and all other lines are never dropped.
+    SFLineBatchPolicyDropSupersededInfo,
+};
+
+/// Score reported by an `SFSearchInfo`.
+typedef NS_ENUM(NSInteger, SFScoreType) {
+    /// `scoreValue` is in centipawns from the side to move's point of view.
+    SFScoreTypeCentipawns,
+    /// `scoreValue` is moves to mate; negative when the side to move is mated.
+    SFScoreTypeMate,
+};
+
+/// Whether an `SFSearchInfo` score is exact or an aspiration-window bound.
+typedef NS_ENUM(NSInteger, SFScoreBound) {
+    SFScoreBoundExact,
+    SFScoreBoundLowerbound,
+    SFScoreBoundUpperbound,
+};
+
+/// Typed form of one Stockfish `info ... pv ...` line.
+NS_SWIFT_SENDABLE
+@interface SFSearchInfo : NSObject
+
+@property (nonatomic, readonly) NSInteger depth;
+@property (nonatomic, readonly) NSInteger selectiveDepth;
+@property (nonatomic, readonly) NSInteger multiPV;
+@property (nonatomic, readonly) SFScoreType scoreType;
+@property (nonatomic, readonly) NSInteger scoreValue;
+@property (nonatomic, readonly) SFScoreBound bound;
+/// `YES` when `UCI_ShowWDL` is enabled; the WDL values are per mille.
+@property (nonatomic, readonly) BOOL hasWDL;
+@property (nonatomic, readonly) NSInteger wdlWin;
+@property (nonatomic, readonly) NSInteger wdlDraw;
+@property (nonatomic, readonly) NSInteger wdlLoss;
+@property (nonatomic, readonly) uint64_t nodes;
+@property (nonatomic, readonly) uint64_t nodesPerSecond;
+/// Transposition-table fill in per mille.
+@property (nonatomic, readonly) NSInteger hashfull;
+@property (nonatomic, readonly) uint64_t tablebaseHits;
+@property (nonatomic, readonly) uint64_t timeMilliseconds;
+/// Principal variation as UCI move strings.
+@property (nonatomic, readonly, copy) NSArray<NSString *> *pv;
+/// Identifies the line of the PV's first move for the rest of the search, so
+/// a line keeps its ID when MultiPV ranks change. 0 when `pv` is empty.
+@property (nonatomic, readonly) NSInteger lineID;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+typedef void (^NS_SWIFT_SENDABLE SFSearchInfoHandler)(SFSearchInfo *info);
+typedef void (^NS_SWIFT_SENDABLE SFBestMoveHandler)(NSString *bestMove, NSString *_Nullable ponderMove);
+
+/// Error domain for `searchFEN:moves:limits:completion:`,
+/// `evaluateFENs:completion:`, and `swapNetworkToFile:completion:` failures.
+FOUNDATION_EXPORT NSErrorDomain const SFEngineErrorDomain;
+
+typedef NS_ERROR_ENUM(SFEngineErrorDomain, SFEngineError) {
+    /// The engine was not running when the search was submitted.
+    SFEngineErrorNotRunning = 1,
+    /// The FEN or one of the moves was rejected; the description says why.
+    SFEngineErrorInvalidPosition = 2,
+    /// The engine stopped before the search could start.
+    SFEngineErrorStopped = 3,
+    /// The network named by `EvalFile`, or the one to swap to, could not be loaded.
+    SFEngineErrorNetworkUnavailable = 4,
+    /// The limits cannot be honoured, e.g. a clock for a deterministic search.
+    SFEngineErrorInvalidLimits = 5,
+    /// `cancelSearch:` withdrew the search before it started.
+    SFEngineErrorCancelled = 6,
+    /// Checkpoint data that is damaged or from a newer format.
+    SFEngineErrorInvalidCheckpoint = 7,
+};
+
+/// Limits for `searchFEN:moves:limits:completion:`, matching the `go`
+/// arguments of the same names. Zero leaves a limit unset; with no limit at
+/// all the search runs until it reaches its maximum depth or `stop` is sent.
+@interface SFSearchLimits : NSObject <NSCopying>
+
+@property (nonatomic) NSInteger depth;
+@property (nonatomic) uint64_t nodes;
+@property (nonatomic) NSInteger moveTimeMilliseconds;
+/// Search for a mate in this many moves.
+@property (nonatomic) NSInteger mate;
+@property (nonatomic) NSInteger whiteTimeMilliseconds;
+@property (nonatomic) NSInteger blackTimeMilliseconds;
+@property (nonatomic) NSInteger whiteIncrementMilliseconds;
+@property (nonatomic) NSInteger blackIncrementMilliseconds;
+@property (nonatomic) NSInteger movesToGo;
+/// For `searchFEN:moves:limits:provisionalHandler:completion:`: report a
+/// provisional best move once the search reaches this depth or has run this
+/// long, whichever comes first. Zero disables the condition.
+@property (nonatomic) NSInteger provisionalDepth;
+@property (nonatomic) NSInteger provisionalMilliseconds;
+/// When `YES`, the search gives the same result on every run, for
+/// regression tests and result caches. It starts from a cleared hash and
+/// cleared histories as after `ucinewgame`, which costs the warm start that
+/// consecutive searches otherwise share. Only `depth`, `nodes`, and `mate`
+/// may be set, since a clock stops the search at a time-dependent node, and
+/// the engine must run with `Threads` 1, since Lazy SMP helpers race; anything
+/// else fails with `SFEngineErrorInvalidLimits`. Results also depend on `Hash`,
+/// the network, and the Stockfish version, so include those in a cache key.
+/// Defaults to `NO`.
+@property (nonatomic, getter=isDeterministic) BOOL deterministic;
+/// When set, the completion is due by this moment, as for a service with a
+/// latency target. The search gets the time left once the searches queued
+/// before it have finished, less the measured time to stop every thread and
+/// to deliver a completion through the callback queue, and at least 1 ms;
+/// stopped early, it still completes with the best root move so far. Caps
+/// `moveTimeMilliseconds`, leaves the other limits in force, and bypasses the
+/// result cache. Keep an unlimited search from queueing ahead of it, which
+/// only `cancelSearch:` or `stop` ends. Not allowed with `deterministic`.
+/// Defaults to nil.
+@property (nonatomic, copy, nullable) NSDate *deadline;
+
++ (instancetype)limitsWithDepth:(NSInteger)depth;
++ (instancetype)limitsWithMoveTimeMilliseconds:(NSInteger)moveTime;
++ (instancetype)limitsWithNodes:(uint64_t)nodes;
+
+@end
+
+/// Outcome of a native search.
+NS_SWIFT_SENDABLE
+@interface SFSearchResult : NSObject
+
+/// Best move in UCI notation, or nil when the position has no legal moves.
+@property (nonatomic, readonly, copy, nullable) NSString *bestMove;
+@property (nonatomic, readonly, copy, nullable) NSString *ponderMove;
+/// Last principal-variation update; `info.pv.firstObject` matches `bestMove`.
+/// For a position without legal moves only the depth and score are set.
+@property (nonatomic, readonly, nullable) SFSearchInfo *info;
+/// From `searchFEN:moves:limits:completion:` until the search started,
+/// including the searches queued before it, and from then until the best move.
+/// Their ratio shows how much of a job queue's wall time went to waiting.
+@property (nonatomic, readonly) double queueMilliseconds;
+@property (nonatomic, readonly) double searchMilliseconds;
+/// `YES` when the result came from the `ResultCacheMB` cache without searching.
+@property (nonatomic, readonly, getter=isCached) BOOL cached;
+/// `YES` when the limits had a `deadline` and the completion ran after it.
+@property (nonatomic, readonly) BOOL missedDeadline;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+/// Counters of the process-wide native search result cache since launch.
+NS_SWIFT_SENDABLE
+@interface SFResultCacheStatistics : NSObject
+
+@property (nonatomic, readonly) uint64_t hits;
+@property (nonatomic, readonly) uint64_t misses;
+@property (nonatomic, readonly) uint64_t stores;
+/// Stores that replaced another position's result.
+@property (nonatomic, readonly) uint64_t evictions;
+@property (nonatomic, readonly) uint64_t entries;
+/// Results the cache can hold; zero while it is off.
+@property (nonatomic, readonly) uint64_t capacity;
+/// Hits over lookups, or zero before the first lookup.
+@property (nonatomic, readonly) double hitRate;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+/// Where an engine's startup time went, so startup regressions can be tracked
+/// across Stockfish updates. See `SFEngine.startupTiming`; `description` gives
+/// a one-line summary suitable for logs.
+NS_SWIFT_SENDABLE
+@interface SFStartupTiming : NSObject
+
+/// `YES` when the engine reused one kept by `keepsEngineWarm`.
+@property (nonatomic, readonly, getter=isWarm) BOOL warm;
+/// From `start` until the engine thread begins setting up the session.
+@property (nonatomic, readonly) double launchMilliseconds;
+/// Building, or waiting for, the bitboard, attack, and position tables; zero
+/// once the first engine in a process or `prepareTables` has built them.
+@property (nonatomic, readonly) double tablesMilliseconds;
+/// Stockfish engine construction, or warm reuse. Upstream builds the options,
+/// network, hash, and thread pool in one constructor, so they are not split.
+@property (nonatomic, readonly) double engineMilliseconds;
+/// Rendering the option list and registering tunable options.
+@property (nonatomic, readonly) double optionsMilliseconds;
+/// From session setup on the engine thread until the first command is read;
+/// excludes `launchMilliseconds`.
+@property (nonatomic, readonly) double totalMilliseconds;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+/// Hash occupancy when a search finished, for choosing `Hash` sizes per device
+/// class. Like `hashfull`, it samples the first thousand table clusters and
+/// reports per mille of entries.
+NS_SWIFT_SENDABLE
+@interface SFHashStatistics : NSObject
+
+@property (nonatomic, readonly) NSInteger hashMegabytes;
+/// Entries written by the finished search; equals `occupancyByAge[0]`.
+@property (nonatomic, readonly) NSInteger hashfull;
+/// Entries of any age. Near 1000 with a small `hashfull`, the table is full of
+/// older entries that new searches must overwrite.
+@property (nonatomic, readonly) NSInteger occupied;
+/// Occupancy of entries last written 0, 1, 2, ... searches ago, up to the
+/// oldest age present.
+@property (nonatomic, readonly, copy) NSArray<NSNumber *> *occupancyByAge;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+/// What an engine has allocated, for checking that memory stays flat across
+/// start/stop cycles. Allocation figures are as of the engine's last command;
+/// callback counts are read when the footprint is requested.
+NS_SWIFT_SENDABLE
+@interface SFMemoryFootprint : NSObject
+
+/// Transposition table, as sized by `Hash`.
+@property (nonatomic, readonly) uint64_t hashBytes;
+/// NNUE network weights. A warm engine adopts them instead of allocating.
+@property (nonatomic, readonly) uint64_t networkBytes;
+@property (nonatomic, readonly) NSInteger threads;
+/// The search workers' own state, mostly histories and accumulator caches;
+/// thread stacks and the histories the workers share are not included.
+@property (nonatomic, readonly) uint64_t threadBytes;
+/// Handler callbacks waiting on the callback queue, and the most that have
+/// waited at once since the engine started.
+@property (nonatomic, readonly) NSUInteger pendingCallbacks;
+@property (nonatomic, readonly) NSUInteger peakPendingCallbacks;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+/// How one completed iteration of a search went, for tuning `Threads` and
+/// `Move Overhead` on a device. Nodes and times cover all search threads.
+NS_SWIFT_SENDABLE
+@interface SFSearchTelemetry : NSObject
+
+@property (nonatomic, readonly) NSInteger depth;
+@property (nonatomic, readonly) NSInteger selectiveDepth;
+/// Nodes and time since the search started.
+@property (nonatomic, readonly) uint64_t nodes;
+@property (nonatomic, readonly) uint64_t timeMilliseconds;
+/// Nodes and time spent on this iteration alone.
+@property (nonatomic, readonly) uint64_t iterationNodes;
+@property (nonatomic, readonly) uint64_t iterationMilliseconds;
+/// `iterationNodes` over the previous iteration's; zero for the first.
+@property (nonatomic, readonly) double effectiveBranchingFactor;
+@property (nonatomic, readonly, copy) NSString *bestMove;
+/// Whether `bestMove` differs from the previous iteration's, and how many
+/// iterations of this search so far did so.
+@property (nonatomic, readonly) BOOL bestMoveChanged;
+@property (nonatomic, readonly) NSInteger bestMoveChanges;
+/// Transposition-table fill in per mille.
+@property (nonatomic, readonly) NSInteger hashfull;
+/// The time manager's target and hard limit for this move when the search
+/// started, or zero without a clock (`wtime`/`btime`) or with `nodestime`.
+/// Stockfish stretches or shortens the target as the best move settles.
+@property (nonatomic, readonly) uint64_t optimumTimeMilliseconds;
+@property (nonatomic, readonly) uint64_t maximumTimeMilliseconds;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+typedef void (^NS_SWIFT_SENDABLE SFSearchTelemetryHandler)(SFSearchTelemetry *telemetry);
+
+/// What `ponderFEN:moves:replies:sliceMilliseconds:completion:` searched. The
+/// arrays follow `replies`; a reply that is not legal keeps zeros. Each slice
+/// starts a new search that Stockfish seeds from the hash, so the gap between
+/// `firstDepths` and `depths` at the same slice length shows how much the
+/// earlier slices of that reply had already filled the table.
+NS_SWIFT_SENDABLE
+@interface SFPonderReport : NSObject
+
+@property (nonatomic, readonly, copy) NSArray<NSString *> *replies;
+/// Depth reached by the first and by the latest slice of each reply.
+@property (nonatomic, readonly, copy) NSArray<NSNumber *> *firstDepths;
+@property (nonatomic, readonly, copy) NSArray<NSNumber *> *depths;
+/// Nodes and milliseconds summed over all slices of each reply.
+@property (nonatomic, readonly, copy) NSArray<NSNumber *> *nodes;
+@property (nonatomic, readonly, copy) NSArray<NSNumber *> *milliseconds;
+/// Searches run, across all replies.
+@property (nonatomic, readonly) NSUInteger slices;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+/// Where a long analysis of one position stands, so that it can continue
+/// after the app is suspended or relaunched: the position, the root moves with
+/// their scores and PVs as in `lastRootMoves`, and the work spent so far.
+/// Write `dataRepresentation` to a file and read it back with
+/// `checkpointWithData:error:`. The hash is not included, so a resumed
+/// analysis searches the first depths again (see
+/// `resumeAnalysisFromCheckpoint:infoHandler:completion:`).
+NS_SWIFT_SENDABLE
+@interface SFAnalysisCheckpoint : NSObject
+
+/// Nil for the standard start position.
+@property (nonatomic, readonly, copy, nullable) NSString *fen;
+@property (nonatomic, readonly, copy) NSArray<NSString *> *moves;
+/// The best move first, as in `lastRootMoves`; empty before any analysis.
+@property (nonatomic, readonly, copy) NSArray<SFSearchInfo *> *rootMoves;
+/// Depth of the best move's line, or 0 before any analysis.
+@property (nonatomic, readonly) NSInteger depth;
+/// Nodes and milliseconds searched over every run of this analysis.
+@property (nonatomic, readonly) uint64_t nodes;
+@property (nonatomic, readonly) uint64_t timeMilliseconds;
+
+/// A new analysis of `fen` (nil for the standard start position) after
+/// `moves`, with nothing searched yet.
++ (instancetype)checkpointWithFEN:(nullable NSString *)fen
+                            moves:(NSArray<NSString *> *)moves NS_SWIFT_NAME(init(fen:moves:));
+
+/// Reads `dataRepresentation`. Damaged data, or data from a newer format,
+/// fails with `SFEngineErrorInvalidCheckpoint`.
++ (nullable instancetype)checkpointWithData:(NSData *)data
+                                      error:(NSError **)error NS_SWIFT_NAME(init(data:));
+
+/// A binary property list of everything above.
+@property (nonatomic, readonly, copy) NSData *dataRepresentation;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+typedef void (^NS_SWIFT_SENDABLE SFSearchCompletion)(SFSearchResult *_Nullable result, NSError *_Nullable error);
+
+/// The checkpoint an analysis reached when it ended. It is nil only when the
+/// position was invalid; an analysis that never ran hands back the checkpoint
+/// it was given, with the error.
+typedef void (^NS_SWIFT_SENDABLE SFAnalysisCompletion)(SFAnalysisCheckpoint *_Nullable checkpoint,
+                                                       NSError *_Nullable error);
+
+/// An early best move of a search that is still running, with the update it
+/// came from.
+typedef void (^NS_SWIFT_SENDABLE SFProvisionalBestMoveHandler)(NSString *bestMove, SFSearchInfo *info);
+
+/// One finished search of `searchFENs:limits:concurrency:resultHandler:completion:`,
+/// for the position at `index`; `error` is set as for `searchFEN:` instead.
+typedef void (^NS_SWIFT_SENDABLE SFBatchSearchResultHandler)(NSUInteger index,
+                                                             SFSearchResult *_Nullable result,
+                                                             NSError *_Nullable error);
+
+typedef void (^NS_SWIFT_SENDABLE SFPonderCompletion)(SFPonderReport *_Nullable report, NSError *_Nullable error);
+
+/// One analysed position of `analyzeGameFromFEN:moves:limits:backwards:plyHandler:completion:`,
+/// after the first `ply` moves; `error` is set as for `searchFEN:` instead.
+typedef void (^NS_SWIFT_SENDABLE SFGameAnalysisPlyHandler)(NSUInteger ply,
+                                                           SFSearchResult *_Nullable result,
+                                                           NSError *_Nullable error);
+
+/// Score reported by `evaluateFENs:completion:` for a position without a static
+/// evaluation: its FEN was invalid or the side to move is in check.
+FOUNDATION_EXPORT const NSInteger SFEvaluationNoScore;
+
+/// Size of one packed position from `packedPositionWithFEN:chess960:error:`.
+FOUNDATION_EXPORT const NSUInteger SFPackedPositionLength;
+
+typedef void (^NS_SWIFT_SENDABLE SFEvaluationCompletion)(NSArray<NSNumber *> *_Nullable scores,
+                                                         NSError *_Nullable error);
+
+/// Timings of a network swap: `loadDuration` validated the new network while
+/// any running search continued, and `swapDuration` is how long the engine
+/// then took to load it between searches.
+typedef void (^NS_SWIFT_SENDABLE SFNetworkSwapCompletion)(NSTimeInterval loadDuration,
+                                                          NSTimeInterval swapDuration,
+                                                          NSError *_Nullable error);
+
+typedef NS_ENUM(NSInteger, SFPositionStatus) {
+    SFPositionStatusOngoing,
+    SFPositionStatusCheck,
+    /// No legal moves and in check.
+    SFPositionStatusCheckmate,
+    /// No legal moves and not in check.
+    SFPositionStatusStalemate,
+};
+
+/// A position set up by Stockfish's own `Position` and move generator without
+/// an engine: no thread starts and no network loads, so validating a move or
+/// listing the legal moves takes microseconds rather than a UCI round trip.
+/// Positions are immutable and may be created and used on any thread.
+NS_SWIFT_SENDABLE
+@interface SFPosition : NSObject
+
+/// The position after any moves, as Stockfish writes it.
+@property (nonatomic, readonly, copy) NSString *fen;
+@property (nonatomic, readonly, getter=isChess960) BOOL chess960;
+/// UCI notation, castling as king-takes-rook in Chess960.
+@property (nonatomic, readonly, copy) NSArray<NSString *> *legalMoves;
+@property (nonatomic, readonly) SFPositionStatus status;
+/// Stockfish's Zobrist key, which also covers castling rights, the en passant
+/// square, and the side to move. It is not stable across Stockfish versions.
+@property (nonatomic, readonly) uint64_t zobristKey;
+
+/// Sets up `fen` (nil for the standard start position) and plays `moves` in
+/// UCI notation. A FEN that Stockfish rejects, or an illegal move, fails with
+/// `SFEngineErrorInvalidPosition`.
++ (nullable instancetype)positionWithFEN:(nullable NSString *)fen
+                                   moves:(NSArray<NSString *> *)moves
+                                chess960:(BOOL)chess960
+                                   error:(NSError **)error NS_SWIFT_NAME(init(fen:moves:chess960:));
+
+/// Whether `move` (UCI notation) is one of `legalMoves`.
+- (BOOL)isLegalMove:(NSString *)move;
+
+/// The position after playing `moves` from this one. Repetition history is
+/// not carried over, since `fen` does not record it.
+- (nullable SFPosition *)positionByPlayingMoves:(NSArray<NSString *> *)moves
+                                          error:(NSError **)error NS_SWIFT_NAME(playing(_:));
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
 /// Thin Objective-C wrapper around the embedded Stockfish UCI loop.
 /// - Owns a dedicated engine thread.
 /// - Forwards each UCI output line through `SFLineHandler`.
 /// - `start` is idempotent; `stop` is safe to call multiple times.
 /// - Intended for a single start/stop per instance.
-/// - Only one `SFEngine` may be active in a process at a time because the
-///   embedded UCI shim temporarily redirects process-wide C++ standard streams.
+/// - Each instance owns its own Stockfish engine, so several instances may
+///   run at once. Syzygy tablebases remain process-wide; see README.md.
 @interface SFEngine : NSObject
 
+/// When `YES`, a stopped engine keeps its loaded network, thread pool, and hash
+/// allocation in a process-wide slot, and the next started engine adopts them
+/// instead of loading from scratch. Options are reset to their defaults and the
+/// hash is cleared, so the adopting engine behaves like a new one. At most one
+/// engine is kept; an engine that changed `SyzygyPath` is not. A kept engine is
+/// freed on a system memory-pressure warning, and setting `NO` frees it too.
+/// Defaults to `NO`.
+@property (class, nonatomic) BOOL keepsEngineWarm;
+
+/// When `YES` along with `keepsEngineWarm`, the kept engine also retains its
+/// hash table and search histories, so re-analysing a recent position after a
+/// stop/start cycle starts from a warm table. The next engine then behaves as
+/// if `ucinewgame` had not been sent; send it to start clean. The table lives
+/// in memory only. Defaults to `NO`.
+@property (class, nonatomic) BOOL keepsSearchStateWarm;
+
+/// Builds Stockfish's process-wide bitboard, attack, and position tables now,
+/// so the first engine's startup skips them. It blocks for the tens of
+/// milliseconds the first call takes, so call it off the main thread, for
+/// example from a background queue at launch; later calls return at once.
++ (void)prepareTables;
+
+/// Searches every one of `fens` with `limits` for throughput rather than
+/// latency: `concurrency` engines of one thread each (default options) search
+/// different positions at once, which uses the cores better than one Lazy SMP
+/// search per position, whose speedup grows slower than its thread count. Each
+/// engine has its own hash and loads its own network (about 100 MB), so size
+/// `concurrency` with `recommendedMemoryBudgetMegabytes` in mind; a value below
+/// 1 is treated as 1. `resultHandler` runs once per position as searches finish
+/// and `completion` after the last, all on one serial queue; the engines are
+/// stopped by then. With `limits.deterministic` this is the reproducible batch
+/// mode: every result is the same on each run, whatever the concurrency or
+/// the order in which positions reach the engines.
++ (void)searchFENs:(NSArray<NSString *> *)fens
+            limits:(SFSearchLimits *)limits
+       concurrency:(NSInteger)concurrency
+     resultHandler:(SFBatchSearchResultHandler)resultHandler
+        completion:(dispatch_block_t)completion;
+
+/// A `MemoryBudgetMB` value sized for this device: a quarter of the memory
+/// the process may still use (its remaining jetsam allowance on iOS, physical
+/// memory on macOS), between 128 and 1024 MB. Send it with
+/// `setoption name MemoryBudgetMB value <n>` before the first search. The
+/// network is the same on every device, so the budget mostly sizes the hash.
+@property (class, nonatomic, readonly) NSInteger recommendedMemoryBudgetMegabytes;
+
+/// Counters of the result cache that `setoption name ResultCacheMB` turns on.
+@property (class, nonatomic, readonly) SFResultCacheStatistics *resultCacheStatistics;
+
+/// Logical CPUs of the fastest (`hw.perflevel0`) and the efficiency
+/// (`hw.perflevel1`) core class, or zero when the device reports a single
+/// class. `setoption name PerformanceCoresOnly value true` caps `Threads` at
+/// `performanceCoreCount`. Darwin has no thread affinity, so pair it with a
+/// `searchQualityOfService` of `NSQualityOfServiceUserInitiated` or higher,
+/// which the scheduler keeps on performance cores while they are free.
+@property (class, nonatomic, readonly) NSInteger performanceCoreCount;
+@property (class, nonatomic, readonly) NSInteger efficiencyCoreCount;
+
+/// Quality-of-service class for the engine and search threads, e.g.
+/// `NSQualityOfServiceUserInitiated` for interactive analysis and
+/// `NSQualityOfServiceUtility` for background batch work, which lets the
+/// system favour performance or efficiency cores. Set it before `start` to
+/// apply it from the first search. Changing it while running rebuilds the
+/// thread pool once the current search finishes, which clears the hash like
+/// changing `Threads`. A warm engine adopted through `keepsEngineWarm` keeps
+/// the threads of the engine that parked it until this is changed. Defaults
+/// to `NSQualityOfServiceDefault`.
+@property (nonatomic) NSQualityOfService searchQualityOfService;
+
+/// When `YES`, the engine caps `Threads` while the device is warm or in Low
+/// Power Mode, because a throttled phone searches faster on fewer threads
+/// than on all of them. The cap is three quarters of the cores at the fair
+/// thermal state, half at serious or in Low Power Mode, and one at critical.
+/// The engine restores the host's `Threads` as the device cools. Each change
+/// applies once the current search finishes and rebuilds the thread pool,
+/// which clears the hash like changing `Threads`. Defaults to `NO`.
+@property (nonatomic) BOOL adaptsThreadsToThermalState;
+
+/// When `YES`, the engine times each `bestmove` from Stockfish until a handler
+/// receives it, through the callback queue and whatever work the handlers
+/// before it do, and sets `Move Overhead` to the 99th percentile of the last
+/// 100 such times, rounded up to whole milliseconds (at least 1). The time
+/// manager then keeps a margin that matches the load on the device instead of
+/// a fixed 10 ms. Each change is sent like a `setoption`, so it applies from
+/// the next search, and it replaces any `Move Overhead` the host set. Only the
+/// wrapper's own delivery is measured; a host that relays moves further, e.g.
+/// over a network, should leave this off and set the option itself. Engines
+/// that write to a file descriptor have no handler and are not measured.
+/// Turning it off keeps the last value. Defaults to `NO`.
+@property (nonatomic) BOOL calibratesMoveOverhead;
+
+/// The `Move Overhead` last set by `calibratesMoveOverhead`, in milliseconds;
+/// zero before the first measured `bestmove`.
+@property (nonatomic, readonly) NSInteger calibratedMoveOverheadMilliseconds;
+
+/// Searches with a `deadline` whose completion ran after it, since the
+/// engine was created. Each also reports `missedDeadline`. The `debugcounters`
+/// command's "Deadline missed" counts those whose best move was already late
+/// when the search thread produced it.
+@property (nonatomic, readonly) NSUInteger deadlineMissCount;
+
+/// When positive, `evaluateFENs:completion:` and
+/// `evaluatePackedPositions:completion:` start without waiting for a running
+/// search and split each batch across this many workers, at most one per
+/// hardware thread, while the search keeps its `Threads`. Useful for
+/// offline scoring, such as book building, on an engine that is analysing.
+/// Scores are the same either way; only the time the batch and the search
+/// each take changes. Commands sent after a batch still wait for it. Applies
+/// from the next batch. Defaults to zero: batches wait for the search and use
+/// `Threads` workers.
+@property (nonatomic) NSInteger concurrentEvaluationThreads;
+
+/// When positive, a system memory-pressure warning while this engine runs calls
+/// `limitHashToMegabytes:` with this value. Defaults to zero, which leaves the
+/// hash alone.
+@property (nonatomic) NSInteger memoryPressureHashMegabytes;
+
+/// Hash statistics from the most recently finished search, or nil before the
+/// first. Updated before that search's best move is delivered.
+@property (nonatomic, readonly, nullable) SFHashStatistics *lastHashStatistics;
+
+/// The last update of every root move reported as a PV line in the most
+/// recently finished search: the best move first, then by depth and `multiPV`
+/// rank. Nil before the first search and empty after a book move. A move that
+/// dropped out of the lines keeps the score and PV of the depth it was last
+/// reported at, so with `MultiPV` above 1 a UI can rank alternatives without
+/// searching again. Updated before that search's best move is delivered.
+@property (nonatomic, readonly, copy, nullable) NSArray<SFSearchInfo *> *lastRootMoves;
+
+/// Allocations of this engine and the depth of its callback queue, or nil
+/// until the engine has started.
+@property (nonatomic, readonly, nullable) SFMemoryFootprint *memoryFootprint;
+
+/// Called once per completed search iteration, in order with the other
+/// callbacks on the wrapper-owned queue. Nil by default; it may be set or
+/// cleared at any time and applies from the next iteration.
+@property (nonatomic, copy, nullable) SFSearchTelemetryHandler searchTelemetryHandler;
+
+/// Startup breakdown for this engine, or nil until it has started reading commands.
+@property (nonatomic, readonly, nullable) SFStartupTiming *startupTiming;
+
+/// How long the most recent hash reset (`ucinewgame`, or setting `Hash`,
+/// `Threads`, or `Clear Hash`) blocked the engine thread; zero before the first.
+/// Re-sending the current `Hash` or `Threads` value before any search is
+/// skipped, since the table and thread pool are still empty.
+@property (nonatomic, readonly) double lastHashResetMilliseconds;
+
 /// Creates an engine that discards UCI output. Prefer `initWithLineHandler:`
 /// when the caller needs engine responses.
 - (instancetype)init;
@@ -33,11 +614,61 @@ typedef void (^NS_SWIFT_SENDABLE SFLineHandler)(NSString *line);
 /// The handler is invoked in order on a wrapper-owned serial background queue;
 /// dispatch to the main queue if you need to update UI. It is safe to call
 /// `stop` from the handler.
-- (instancetype)initWithLineHandler:(SFLineHandler)handler NS_DESIGNATED_INITIALIZER;
+- (instancetype)initWithLineHandler:(SFLineHandler)handler;
+
+/// Creates an engine with optional text and typed handlers. All handlers share
+/// the same serial callback queue, so their invocations stay in engine order.
+/// `searchInfoHandler` receives each search update without UCI text parsing;
+/// when `lineHandler` is nil those `info ... pv` lines are not formatted at all.
+/// `bestMoveHandler` fires before the matching `bestmove` line is delivered.
+- (instancetype)initWithLineHandler:(nullable SFLineHandler)lineHandler
+                  searchInfoHandler:(nullable SFSearchInfoHandler)searchInfoHandler
+                    bestMoveHandler:(nullable SFBestMoveHandler)bestMoveHandler NS_DESIGNATED_INITIALIZER;
+
+/// Creates an engine that delivers output lines in batches. Lines produced
+/// while the previous batch is still being handled are coalesced into the
+/// next one, so a slow handler causes larger batches rather than an unbounded
+/// callback backlog. Batches arrive in order on the serial callback queue.
+- (instancetype)initWithLineBatchHandler:(SFLineBatchHandler)handler policy:(SFLineBatchPolicy)policy;
+
+/// Creates an engine that records its output in a fixed ring of the last
+/// `capacity` lines instead of delivering every line, for hosts that only log
+/// recent output when something goes wrong. `handler` still receives
+/// `bestmove` lines and error reports: `info string` lines mentioning an
+/// error, and unknown commands or options. Recording a line is one copy into
+/// a preallocated slot, with no `NSString` or callback dispatch, and lines
+/// longer than 504 bytes are cut. Read the ring with `recentLines`.
+- (instancetype)initWithRecentLineCapacity:(NSUInteger)capacity handler:(nullable SFLineHandler)handler;
+
+/// The lines kept by `initWithRecentLineCapacity:handler:`, oldest first;
+/// empty for other engines. Taking the snapshot never blocks the engine, and
+/// it stays readable after `stop`. Wrapper rejections of `sendCommand:` reach
+/// only the handler.
+@property (nonatomic, readonly, copy) NSArray<NSString *> *recentLines;
+
+/// Creates an engine that writes its UCI output straight to `fileDescriptor`,
+/// e.g. a socket or pipe to a remote GUI, with no per-line callback or
+/// `NSString`. Lines are buffered and written with `write(2)` whenever the
+/// engine flushes, which it does after each line. The descriptor stays owned by
+/// the caller and must stay open until `stop` returns. If a write fails, e.g.
+/// because the peer has gone, output is dropped from then on; `SIGPIPE` is
+/// disabled for the descriptor. Wrapper rejections of `sendCommand:` are
+/// written to the descriptor too.
+- (instancetype)initWithOutputFileDescriptor:(int)fileDescriptor;
 
 /// Starts the engine loop on a background thread.
 - (void)start;
 
+/// Reads newline-separated commands from `fileDescriptor` on a background
+/// thread and sends each as `sendCommand:` would, with the same rejections
+/// except the UTF-8 check, since the bytes are not converted. Pair it with
+/// `initWithOutputFileDescriptor:` for a proxy that never creates
+/// Objective-C objects per line. End of file sends `quit`, as it does for a
+/// UCI engine's stdin. Call after `start`; `stop` ends the reading. The
+/// descriptor stays owned by the caller and must stay open until `stop`
+/// returns.
+- (void)readCommandsFromFileDescriptor:(int)fileDescriptor;
+
 /// Sends a single trusted UCI command line (one trailing newline is optional).
 /// Safe to call from any thread while the engine is running.
 /// Empty commands are ignored. Multiline, NUL-containing, oversized, and
@@ -45,6 +676,203 @@ typedef void (^NS_SWIFT_SENDABLE SFLineHandler)(NSString *line);
 /// handler as an `info string` error.
 - (void)sendCommand:(NSString *)command;
 
+/// Sends several commands as one unit, e.g. `ucinewgame`, a few `setoption`s,
+/// `position`, and `go`. Each is checked as `sendCommand:` checks it before
+/// any is queued; if one is rejected, the error names its 1-based index and
+/// none are sent. The rest are queued together with one wake-up of the
+/// engine thread, so commands from other threads cannot land between them.
+/// Empty commands are skipped. More than 1024 commands, the command queue's
+/// capacity, are rejected as a whole.
+- (void)sendCommands:(NSArray<NSString *> *)commands;
+
+/// Like `sendCommands:` for `length` bytes of LF- or CRLF-separated command
+/// lines, without an `NSString` per line. The bytes need not end in a NUL and
+/// are not checked for UTF-8, as with `readCommandsFromFileDescriptor:`; a
+/// rejection names the 1-based line.
+- (void)sendCommandBytes:(const char *)bytes
+                  length:(NSUInteger)length NS_SWIFT_NAME(sendCommands(bytes:length:));
+
+/// Plays `move` (UCI notation) on the engine's current position, queued like
+/// `sendCommand:`. Same as the wrapper UCI extension `pushmove <move>`; an
+/// illegal move is reported as an `info string` error and ignored. Only the
+/// new move is checked, so stepping through a long game stays cheap.
+- (void)pushMove:(NSString *)move;
+
+/// Takes back the last move played by `position`, `pushMove:`, or a native
+/// search position (`popmove`). Reports an error when there is none.
+- (void)popMove;
+
+/// Searches `fen` (nil for the standard start position) after playing `moves`
+/// (UCI notation) without going through UCI text. Equivalent to `position`
+/// followed by `go`: it runs in order with commands sent before it, replaces
+/// the engine's current position, and its output still reaches the text
+/// handlers. `stop` ends it early with the best move found so far.
+/// `completion` runs exactly once on the serial callback queue, or on a global
+/// queue with `SFEngineErrorNotRunning` when the engine is not running.
+- (void)searchFEN:(nullable NSString *)fen
+            moves:(NSArray<NSString *> *)moves
+           limits:(SFSearchLimits *)limits
+       completion:(SFSearchCompletion)completion;
+
+/// Like `searchFEN:moves:limits:completion:`, for move hints that must appear
+/// at once and then improve. `provisionalHandler` runs at most once, before
+/// `completion` on the same queue. It gets the best move of the first update
+/// at `limits.provisionalDepth` or after `limits.provisionalMilliseconds`.
+/// Updates arrive as iterations complete, so a shallow depth such as 6, or
+/// 20 to 50 ms, gives a plausible move almost immediately while the search
+/// continues to its own limits. Stockfish seeds every iteration from the
+/// hash, so a position searched before reports a deeper move sooner. A search
+/// that ends first skips the provisional move.
+- (void)searchFEN:(nullable NSString *)fen
+                 moves:(NSArray<NSString *> *)moves
+                limits:(SFSearchLimits *)limits
+    provisionalHandler:(SFProvisionalBestMoveHandler)provisionalHandler
+            completion:(SFSearchCompletion)completion;
+
+/// Searches every position of a game, from `fen` (nil for the standard start
+/// position) through each of `moves`, with `limits` per position. Unlike one
+/// `searchFEN:` per ply with `ucinewgame` or a fresh engine in between, the
+/// plies run back to back in this session, so each starts from the hash and
+/// history tables the others left. With `backwards`, the usual order for game
+/// review, the last position is searched first and its deep lines seed the
+/// earlier plies that lead to it. Ply results stream to `plyHandler` as each
+/// search finishes, then `completion` runs once, all on the serial callback
+/// queue. Ply 0 is `fen` itself; scores are from the side to move. Like a
+/// long search, the game runs in order with commands sent before it, and
+/// commands sent after it wait; `stop` ends only the current ply early. A ply
+/// at or after an illegal move fails with `SFEngineErrorInvalidPosition`. When
+/// the engine is not running, every ply fails with `SFEngineErrorNotRunning`
+/// on a global queue.
+- (void)analyzeGameFromFEN:(nullable NSString *)fen
+                     moves:(NSArray<NSString *> *)moves
+                    limits:(SFSearchLimits *)limits
+                 backwards:(BOOL)backwards
+                plyHandler:(SFGameAnalysisPlyHandler)plyHandler
+                completion:(dispatch_block_t)completion;
+
+/// Uses the opponent's thinking time to search the position after each of
+/// `replies`, the opponent's likely answers in UCI notation, after `fen` (nil
+/// for the standard start position) and `moves`. Unlike UCI `go ponder`, which
+/// follows one predicted move, the replies take turns in slices of
+/// `sliceMilliseconds` (at least 1) until `stopPondering`, so the shared hash
+/// holds work for all of them when the real reply arrives. Each slice is a
+/// native search: it replaces the engine's current position and its output
+/// reaches the text handlers. `searchFEN:` and `stop` end pondering first; put
+/// the most likely reply first, since an early stop may reach only it. A new
+/// call ends the previous pondering. `completion` runs exactly once on the
+/// serial callback queue after the last slice, or on a global queue with
+/// `SFEngineErrorNotRunning` when the engine is not running.
+- (void)ponderFEN:(nullable NSString *)fen
+                moves:(NSArray<NSString *> *)moves
+              replies:(NSArray<NSString *> *)replies
+    sliceMilliseconds:(NSInteger)sliceMilliseconds
+           completion:(SFPonderCompletion)completion;
+
+/// Ends pondering at once: a running slice stops with the best move found so
+/// far, and the report is delivered. A foreground search never stops here.
+- (void)stopPondering;
+
+/// Statically evaluates each of `fens` without searching, in centipawns from
+/// White's point of view as in the final line of upstream `eval`. It runs in
+/// order with commands sent before it, after any running search, and splits
+/// the batch across `Threads` workers; the current position is unchanged.
+/// The first call loads a second copy of the network (about 100 MB), which is
+/// kept until the engine stops or `EvalFile` changes. See
+/// `concurrentEvaluationThreads` to score beside a search. `completion` runs exactly
+/// once on the serial callback queue, or on a global queue with
+/// `SFEngineErrorNotRunning` when the engine is not running.
+- (void)evaluateFENs:(NSArray<NSString *> *)fens completion:(SFEvaluationCompletion)completion;
+
+/// Same as `evaluateFENs:completion:` for `positions`, a concatenation of
+/// packed positions, which skips building a FEN string per position on the
+/// caller's side. Each packed position keeps its own Chess960 flag. Data whose
+/// length is not a multiple of `SFPackedPositionLength` fails with
+/// `SFEngineErrorInvalidPosition`.
+- (void)evaluatePackedPositions:(NSData *)positions completion:(SFEvaluationCompletion)completion;
+
+/// Switches `EvalFile` to `path`, validated ahead of time: the network is
+/// loaded and checked while a running search continues, and the engine loads
+/// it once the search has finished, so that second load still blocks the
+/// engine between searches. Batch evaluation reuses the validated copy. The
+/// thread pool and hash are kept;
+/// upstream clears the search histories, as for `setoption name EvalFile`. A
+/// file that cannot be loaded leaves the current network in place and fails
+/// with `SFEngineErrorNetworkUnavailable`. The validated copy stays loaded
+/// while this engine uses the network, as after `evaluateFENs:completion:`. `completion` runs exactly once on the serial callback
+/// queue, or on a global queue with `SFEngineErrorNotRunning` when the engine
+/// is not running.
+- (void)swapNetworkToFile:(NSString *)path
+               completion:(SFNetworkSwapCompletion)completion NS_SWIFT_NAME(swapNetwork(toFile:completion:));
+
+/// Encodes `fen` in the fixed `SFPackedPositionLength`-byte form used by
+/// `evaluatePackedPositions:completion:` and binary soak position files:
+/// piece placement, side to move, castling rights, en passant square, and move
+/// counters. The byte layout is documented on `PackedPosition` in
+/// EmbeddedUCI.hpp. A FEN that Stockfish rejects fails with
+/// `SFEngineErrorInvalidPosition`.
++ (nullable NSData *)packedPositionWithFEN:(NSString *)fen
+                                  chess960:(BOOL)chess960
+                                     error:(NSError **)error NS_SWIFT_NAME(packedPosition(fen:chess960:));
+
+/// Decodes a packed position back to FEN.
++ (nullable NSString *)FENWithPackedPosition:(NSData *)packedPosition
+                                       error:(NSError **)error NS_SWIFT_NAME(fen(packedPosition:));
+
+/// Builds an opening book for the `BookFile` option from the first `maxPly`
+/// plies of `games`, each a list of UCI moves from the standard start
+/// position. Write the data to a file and set `BookFile` to its path; with
+/// `BookDepth` plies or fewer played, `go` then answers from the book without
+/// searching. A move's weight is how many games played it. The format is
+/// documented on `BookEntry` in EmbeddedUCI.hpp and is keyed by Stockfish's
+/// own position key, so rebuild books after a Stockfish update. An illegal
+/// move fails with `SFEngineErrorInvalidPosition`.
++ (nullable NSData *)openingBookWithGames:(NSArray<NSArray<NSString *> *> *)games
+                                   maxPly:(NSInteger)maxPly
+                                    error:(NSError **)error NS_SWIFT_NAME(openingBook(games:maxPly:));
+
+/// Shrinks the hash to `megabytes` if it is currently larger, once the current
+/// search has finished; it is queued like a command. Shrinking reallocates the
+/// table, so its entries are lost, and an `info string` reports the change.
+/// Send `setoption name Hash` to grow it again later.
+- (void)limitHashToMegabytes:(NSInteger)megabytes;
+
+/// Like `searchFEN:moves:limits:completion:`, but returns a ticket for
+/// `cancelSearch:`, and `infoHandler` receives this search's multipv-1
+/// updates on the serial callback queue before `completion`. Returns 0 when
+/// the engine is not running. Swift callers get `search(fen:moves:limits:)`
+/// and `searchUpdates(fen:moves:limits:)` on top of it, which cancel with
+/// their task.
+- (uint64_t)startSearchFEN:(nullable NSString *)fen
+                     moves:(NSArray<NSString *> *)moves
+                    limits:(SFSearchLimits *)limits
+               infoHandler:(nullable SFSearchInfoHandler)infoHandler
+                completion:(SFSearchCompletion)completion
+    NS_SWIFT_NAME(startSearch(fen:moves:limits:infoHandler:completion:));
+
+/// Cancels the search `ticket` names without touching any other. It bypasses
+/// the command queue like `stop`: a running search stops at its next poll of
+/// the stop flag and completes with its best move so far, and a queued one is
+/// withdrawn and fails with `SFEngineErrorCancelled`. Finished searches and
+/// unknown tickets are ignored.
+- (void)cancelSearch:(uint64_t)ticket;
+
+/// Analyses `checkpoint`'s position with no limits, like `go infinite`, until
+/// `cancelSearch:` with the returned ticket or `stop`. `completion` then gets
+/// the checkpoint to save: this run's root moves once it reached the saved
+/// depth, the saved ones otherwise, and the nodes and time of both runs. The
+/// hash cannot be saved, as Stockfish keeps it private to its `Engine`, so
+/// the search starts again from depth 1. Until it is back at the saved
+/// depth, `infoHandler` gets the saved best line at once and then only
+/// updates at that depth or deeper, so a UI never shows a shallower line
+/// than before the suspension. Within one process, prefer cancelling and
+/// resuming on the same engine: the hash is still there and the first depths
+/// take a fraction of the time. Otherwise it behaves as
+/// `startSearchFEN:moves:limits:infoHandler:completion:`.
+- (uint64_t)resumeAnalysisFromCheckpoint:(SFAnalysisCheckpoint *)checkpoint
+                             infoHandler:(nullable SFSearchInfoHandler)infoHandler
+                              completion:(SFAnalysisCompletion)completion
+    NS_SWIFT_NAME(resumeAnalysis(from:infoHandler:completion:));
+
 /// Sends "stop" then "quit" and tears down the engine thread.
 /// This is a terminal transition even when called before `start`.
 - (void)stop;
@@ -12,55 +12,73 @@
 
 #import "SFEngine.h"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cctype>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <vector>
 
 #import <Foundation/Foundation.h>
+#import <TargetConditionals.h>
 #import <dispatch/dispatch.h>
+#include <pthread.h>
+#if TARGET_OS_IPHONE
+#include <os/proc.h>
+#endif
 
 #include "CommandStream.hpp"
+#include "CommandValidation.hpp"
 #include "EmbeddedUCI.hpp"
+#include "FileDescriptorStream.hpp"
 #include "LineBufferStream.hpp"
-#include "ThreadSafeQueue.hpp"
+#include "LineRing.hpp"
+#include "SPSCQueue.hpp"
+#include "Signposts.hpp"
 
 using namespace SFEmbedded;
 
 namespace {
 
-constexpr std::size_t kMaximumCommandBytes = 1024 * 1024;
+// Pushes are serialized by lifecycleMutex_, so the single-producer queue is
+// safe; sendCommand waits only if the engine falls this many commands behind.
+constexpr std::size_t kCommandQueueCapacity = 1024;
+using CommandQueue = SPSCQueue<std::string, kCommandQueueCapacity>;
 char                  kCallbackQueueSpecificKey;
+std::atomic<bool>     warmEngineRetention{false};
+std::atomic<bool>     warmSearchStateRetention{false};
+std::mutex            warmEngineRetentionMutex;
 
-class ActiveEngineRegistry {
-   public:
-    bool claim(const void* owner) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (owner_ != nullptr)
-            return false;
+constexpr uintptr_t kMemoryPressureEvents = DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL;
 
-        owner_ = owner;
-        return true;
-    }
+// Bounds for +recommendedMemoryBudgetMegabytes. The floor leaves room for the
+// roughly 100 MB network plus a small hash; above the cap a larger hash buys
+// little for interactive analysis.
+constexpr NSInteger kMinimumRecommendedBudgetMB = 128;
+constexpr NSInteger kMaximumRecommendedBudgetMB = 1024;
 
-    void release(const void* owner) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (owner_ == owner)
-            owner_ = nullptr;
-    }
+// calibratesMoveOverhead sets Move Overhead to the p99 of the last this many
+// bestmove deliveries, in whole milliseconds within the option's 1-5000 range.
+constexpr std::size_t kMoveOverheadSamples = 100;
+constexpr NSInteger   kMaximumMoveOverheadMs = 5000;
 
-   private:
-    std::mutex  mutex_;
-    const void* owner_ = nullptr;
-};
+// Upper bound of concurrentEvaluationThreads, as of the Threads option.
+constexpr NSInteger kMaximumEvaluationThreads = 1024;
 
-ActiveEngineRegistry& activeEngineRegistry() {
-    static ActiveEngineRegistry registry;
-    return registry;
-}
+// Version of SFAnalysisCheckpoint.dataRepresentation; checkpointWithData:
+// rejects any other.
+constexpr NSInteger kCheckpointFormat = 1;
 
 enum class Lifecycle {
     idle,
@@ -70,39 +88,6 @@ enum class Lifecycle {
     stopped,
 };
 
-enum class CommandValidation {
-    accepted,
-    ignored,
-    rejected,
-};
-
-bool startsWithDebugLogOption(const std::string& command) {
-    std::string normalized;
-    normalized.reserve(command.size());
-
-    bool pendingSpace = false;
-    for (const unsigned char character : command) {
-        if (std::isspace(character)) {
-            pendingSpace = !normalized.empty();
-            continue;
-        }
-
-        if (pendingSpace) {
-            normalized.push_back(' ');
-            pendingSpace = false;
-        }
-        normalized.push_back(static_cast<char>(std::tolower(character)));
-    }
-
-    constexpr char prefix[] = "setoption name debug log file";
-    if (normalized == prefix)
-        return true;
-
-    return normalized.size() > sizeof(prefix) - 1
-        && normalized.compare(0, sizeof(prefix) - 1, prefix) == 0
-        && normalized[sizeof(prefix) - 1] == ' ';
-}
-
 CommandValidation validateCommand(NSString* command,
                                   std::string& normalized,
                                   std::string& rejectionReason) {
@@ -110,8 +95,8 @@ CommandValidation validateCommand(NSString* command,
         return CommandValidation::ignored;
 
     const NSUInteger byteCount = [command lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
-    if (byteCount == 0 || byteCount > kMaximumCommandBytes) {
-        rejectionReason = byteCount > kMaximumCommandBytes ? "command exceeds 1 MiB" : "command is not UTF-8";
+    if (byteCount == 0 || byteCount > MaxCommandBytes) {
+        rejectionReason = byteCount > MaxCommandBytes ? "command exceeds 1 MiB" : "command is not UTF-8";
         return CommandValidation::rejected;
     }
 
@@ -122,37 +107,208 @@ CommandValidation validateCommand(NSString* command,
     }
 
     normalized.assign(static_cast<const char*>(data.bytes), data.length);
+    return validateCommandLine(normalized, rejectionReason);
+}
 
-    // The public contract accepts one optional trailing LF or CRLF.
-    if (!normalized.empty() && normalized.back() == '\n') {
-        normalized.pop_back();
-        if (!normalized.empty() && normalized.back() == '\r')
-            normalized.pop_back();
+NSArray<NSString*>* movesFromPV(std::string_view pv) {
+    NSMutableArray<NSString*>* moves = [NSMutableArray array];
+    std::size_t                start = 0;
+    while (start < pv.size()) {
+        std::size_t end = pv.find(' ', start);
+        if (end == std::string_view::npos)
+            end = pv.size();
+        if (end > start) {
+            NSString* move = [[NSString alloc] initWithBytes:pv.data() + start
+                                                      length:end - start
+                                                    encoding:NSUTF8StringEncoding];
+            if (move)
+                [moves addObject:move];
+        }
+        start = end + 1;
     }
+    return moves;
+}
 
-    if (normalized.empty())
-        return CommandValidation::ignored;
+// Returns the slot a progress `info` line occupies: a newer line for the same
+// slot supersedes it. Returns 0 for lines that must always be delivered, such
+// as `bestmove`, `info string`, and everything that is not search progress.
+int supersededInfoSlot(const std::string& line) {
+    if (line.compare(0, 5, "info ") != 0 || line.compare(0, 12, "info string ") == 0)
+        return 0;
 
-    if (normalized.find('\0') != std::string::npos) {
-        rejectionReason = "command contains NUL";
-        return CommandValidation::rejected;
+    if (line.find(" currmove ") != std::string::npos)
+        return -1;
+
+    if (line.find(" pv ") == std::string::npos)
+        return 0;
+
+    const std::size_t multiPV = line.find(" multipv ");
+    if (multiPV == std::string::npos)
+        return 1;
+
+    const int slot = std::atoi(line.c_str() + multiPV + 9);
+    return slot > 0 ? slot : 1;
+}
+
+SFPositionStatus positionStatusFromQuery(PositionQuery::Status status) {
+    switch (status) {
+    case PositionQuery::Status::check:
+        return SFPositionStatusCheck;
+    case PositionQuery::Status::checkmate:
+        return SFPositionStatusCheckmate;
+    case PositionQuery::Status::stalemate:
+        return SFPositionStatusStalemate;
+    case PositionQuery::Status::ongoing:
+        break;
     }
-    if (normalized.find('\n') != std::string::npos || normalized.find('\r') != std::string::npos) {
-        rejectionReason = "command contains more than one line";
-        return CommandValidation::rejected;
+    return SFPositionStatusOngoing;
+}
+
+SFScoreBound scoreBoundFromInfo(SearchInfo::Bound bound) {
+    switch (bound) {
+    case SearchInfo::Bound::lower:
+        return SFScoreBoundLowerbound;
+    case SearchInfo::Bound::upper:
+        return SFScoreBoundUpperbound;
+    case SearchInfo::Bound::exact:
+        break;
     }
-    if (startsWithDebugLogOption(normalized)) {
-        rejectionReason = "Debug Log File is unsupported by the embedded stream bridge";
-        return CommandValidation::rejected;
+    return SFScoreBoundExact;
+}
+
+qos_class_t qosClassFromQualityOfService(NSQualityOfService qualityOfService) {
+    switch (qualityOfService) {
+    case NSQualityOfServiceUserInteractive:
+        return QOS_CLASS_USER_INTERACTIVE;
+    case NSQualityOfServiceUserInitiated:
+        return QOS_CLASS_USER_INITIATED;
+    case NSQualityOfServiceUtility:
+        return QOS_CLASS_UTILITY;
+    case NSQualityOfServiceBackground:
+        return QOS_CLASS_BACKGROUND;
+    case NSQualityOfServiceDefault:
+        break;
+    }
+    return QOS_CLASS_DEFAULT;
+}
+
+}  // namespace
+
+NSErrorDomain const SFEngineErrorDomain = @"SFEngineErrorDomain";
+const NSInteger SFEvaluationNoScore = NativeEvalResult::NoScore;
+const NSUInteger SFPackedPositionLength = PackedPosition::Size;
+
+@interface SFSearchInfo ()
+- (instancetype)initWithSearchInfo:(const SearchInfo&)info NS_DESIGNATED_INITIALIZER;
+@end
+
+@interface SFStartupTiming ()
+- (instancetype)initWithStartupTiming:(const StartupTiming&)timing
+                   launchMicroseconds:(uint64_t)launchMicroseconds NS_DESIGNATED_INITIALIZER;
+@end
+
+@interface SFHashStatistics ()
+- (instancetype)initWithHashStats:(const HashStats&)stats NS_DESIGNATED_INITIALIZER;
+@end
+
+@interface SFMemoryFootprint ()
+- (instancetype)initWithMemoryFootprint:(const MemoryFootprint&)footprint
+                       pendingCallbacks:(NSUInteger)pendingCallbacks
+                   peakPendingCallbacks:(NSUInteger)peakPendingCallbacks NS_DESIGNATED_INITIALIZER;
+@end
+
+@interface SFResultCacheStatistics ()
+- (instancetype)initWithResultCacheStats:(const ResultCacheStats&)stats NS_DESIGNATED_INITIALIZER;
+@end
+
+@interface SFPosition ()
+- (instancetype)initWithPositionQuery:(PositionQuery&&)query chess960:(BOOL)chess960 NS_DESIGNATED_INITIALIZER;
+@end
+
+@interface SFSearchTelemetry ()
+- (instancetype)initWithSearchTelemetry:(const SearchTelemetry&)telemetry NS_DESIGNATED_INITIALIZER;
+@end
+
+@interface SFSearchResult ()
+- (instancetype)initWithNativeResult:(const NativeSearchResult&)result NS_DESIGNATED_INITIALIZER;
+// Set on the callback queue just before the completion runs.
+@property (nonatomic, readwrite) BOOL missedDeadline;
+@end
+
+@interface SFAnalysisCheckpoint ()
+- (instancetype)initWithFEN:(nullable NSString*)fen
+                      moves:(NSArray<NSString*>*)moves
+                  rootMoves:(NSArray<SFSearchInfo*>*)rootMoves
+                      nodes:(uint64_t)nodes
+           timeMilliseconds:(uint64_t)timeMilliseconds NS_DESIGNATED_INITIALIZER;
+@end
+
+@interface SFPonderReport ()
+- (instancetype)initWithReplies:(NSArray<NSString*>*)replies
+                    firstDepths:(NSArray<NSNumber*>*)firstDepths
+                         depths:(NSArray<NSNumber*>*)depths
+                          nodes:(NSArray<NSNumber*>*)nodes
+                   milliseconds:(NSArray<NSNumber*>*)milliseconds
+                         slices:(NSUInteger)slices NS_DESIGNATED_INITIALIZER;
+@end
+
+namespace {
+
+// Lines a recent-line ring still hands to the line handler: `bestmove`, and
+// reports of failed or rejected commands.
+bool isDiagnosticLine(std::string_view line) {
+    const auto startsWith = [line](std::string_view prefix) { return line.substr(0, prefix.size()) == prefix; };
+    if (startsWith("bestmove") || startsWith("Unknown command") || startsWith("No such option"))
+        return true;
+    if (!startsWith("info string"))
+        return false;
+
+    const auto lower = [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); };
+    constexpr std::string_view error = "error";
+    return std::search(line.begin(), line.end(), error.begin(), error.end(),
+                       [lower](char a, char b) { return lower(a) == b; }) != line.end();
+}
+
+NSString* stringFromBytes(std::string_view bytes) {
+    return [[NSString alloc] initWithBytes:bytes.data() length:bytes.size() encoding:NSUTF8StringEncoding];
+}
+
+NSError* searchError(SFEngineError code, NSString* description) {
+    return [NSError errorWithDomain:SFEngineErrorDomain
+                               code:code
+                           userInfo:@{NSLocalizedDescriptionKey: description ?: @"Search failed"}];
+}
+
+SFEngineError searchErrorCode(NativeSearchResult::Status status) {
+    switch (status) {
+    case NativeSearchResult::Status::rejected:
+        return SFEngineErrorInvalidPosition;
+    case NativeSearchResult::Status::invalidLimits:
+        return SFEngineErrorInvalidLimits;
+    case NativeSearchResult::Status::withdrawn:
+        return SFEngineErrorCancelled;
+    default:
+        return SFEngineErrorStopped;
     }
+}
+
+std::string utf8String(NSString* string) {
+    const char* bytes = string.UTF8String;
+    return bytes ? std::string(bytes) : std::string();
+}
 
-    return CommandValidation::accepted;
+NSInteger nonNegative(NSInteger value) {
+    return std::max<NSInteger>(value, 0);
 }
 
 class EngineState final: public std::enable_shared_from_this<EngineState> {
    public:
-    explicit EngineState(SFLineHandler handler) :
+    EngineState(SFLineHandler handler,
+                SFSearchInfoHandler searchInfoHandler,
+                SFBestMoveHandler bestMoveHandler) :
         handler_([handler copy]),
+        searchInfoHandler_([searchInfoHandler copy]),
+        bestMoveHandler_([bestMoveHandler copy]),
         callbackQueue_(dispatch_queue_create("com.stockfishembedded.SFEngine.callback",
                                              DISPATCH_QUEUE_SERIAL)) {
         dispatch_queue_set_specific(callbackQueue_, &kCallbackQueueSpecificKey, this, nullptr);
@@ -163,30 +319,75 @@ class EngineState final: public std::enable_shared_from_this<EngineState> {
     }
 
     void start() {
-        bool alreadyActive = false;
+        std::lock_guard<std::mutex> lock(lifecycleMutex_);
+        if (lifecycle_ != Lifecycle::idle)
+            return;
 
-        {
-            std::lock_guard<std::mutex> lock(lifecycleMutex_);
-            if (lifecycle_ != Lifecycle::idle)
-                return;
+        lifecycle_ = Lifecycle::running;
 
-            if (!activeEngineRegistry().claim(this)) {
-                alreadyActive = true;
-            } else {
-                ownsActiveLease_.store(true);
-                lifecycle_ = Lifecycle::running;
-
-                auto state = shared_from_this();
-                engineThread_ = std::make_unique<std::thread>([state] {
-                    @autoreleasepool {
-                        state->runEngineLoop();
-                    }
-                });
+        auto state = shared_from_this();
+        const auto startedAt = std::chrono::steady_clock::now();
+        engineThread_ = std::make_unique<std::thread>([state, startedAt] {
+            @autoreleasepool {
+                state->runEngineLoop(startedAt);
             }
-        }
+        });
+
+        std::weak_ptr<EngineState> weakState = state;
+        memoryPressureSource_ = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, kMemoryPressureEvents,
+                                                       dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+        dispatch_source_set_event_handler(memoryPressureSource_, ^{
+            if (auto strongState = weakState.lock())
+                strongState->handleMemoryPressure();
+        });
+        dispatch_resume(memoryPressureSource_);
+
+        NSNotificationCenter* center = NSNotificationCenter.defaultCenter;
+        void (^adaptThreads)(NSNotification*) = ^(NSNotification*) {
+            if (auto strongState = weakState.lock())
+                strongState->applyThermalThreadLimit();
+        };
+        thermalStateObserver_ = [center addObserverForName:NSProcessInfoThermalStateDidChangeNotification
+                                                    object:nil
+                                                     queue:nil
+                                                usingBlock:adaptThreads];
+        powerStateObserver_ = [center addObserverForName:NSProcessInfoPowerStateDidChangeNotification
+                                                  object:nil
+                                                   queue:nil
+                                              usingBlock:adaptThreads];
+        applyThermalThreadLimitLocked();
+    }
+
+    // Switches text delivery to batches. Must be called before `start`.
+    void configureLineBatching(SFLineBatchHandler handler, SFLineBatchPolicy policy) {
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        lineBatchHandler_ = [handler copy];
+        lineBatchPolicy_ = policy;
+    }
+
+    // Records all output in a ring and narrows line delivery to diagnostics.
+    // Must be called before `start`.
+    void configureRecentLines(std::size_t capacity) {
+        recentLines_ = std::make_unique<LineRing>(capacity);
+    }
+
+    // Writes all output to `fd` instead of delivering lines. Must be called
+    // before `start`.
+    void configureOutputDescriptor(int fd) {
+        descriptorOutput_ = std::make_unique<FileDescriptorStreambuf>(fd);
+    }
+
+    NSArray<NSString*>* recentLines() const {
+        if (!recentLines_)
+            return @[];
 
-        if (alreadyActive)
-            deliverWrapperError("another SFEngine instance is already active");
+        const auto lines = recentLines_->snapshot();
+        NSMutableArray<NSString*>* snapshot = [NSMutableArray arrayWithCapacity:lines.size()];
+        for (const auto& line : lines) {
+            if (NSString* nsLine = stringFromBytes(line))
+                [snapshot addObject:nsLine];
+        }
+        return snapshot;
     }
 
     void sendCommand(NSString* command) {
@@ -201,7 +402,7 @@ class EngineState final: public std::enable_shared_from_this<EngineState> {
             const CommandValidation validation =
               validateCommand(command, normalized, rejectionReason);
             if (validation == CommandValidation::accepted) {
-                commandQueue_.push(std::move(normalized));
+                queueCommandLocked(std::move(normalized));
                 return;
             }
             if (validation == CommandValidation::ignored)
@@ -211,161 +412,1926 @@ class EngineState final: public std::enable_shared_from_this<EngineState> {
         deliverWrapperError(rejectionReason);
     }
 
-    void stop() {
-        std::unique_ptr<std::thread> threadToJoin;
+    // sendCommand() for a line read from a descriptor, without an NSString.
+    void sendCommandLine(std::string line) {
+        std::string rejectionReason;
 
         {
-            std::unique_lock<std::mutex> lock(lifecycleMutex_);
-            if (lifecycle_ == Lifecycle::idle) {
-                lifecycle_ = Lifecycle::stopped;
-                lock.unlock();
-                finishCallbackDelivery();
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ != Lifecycle::running)
                 return;
-            }
-            if (lifecycle_ == Lifecycle::stopped) {
-                lock.unlock();
-                finishCallbackDelivery();
+
+            const CommandValidation validation = validateCommandLine(line, rejectionReason);
+            if (validation == CommandValidation::accepted) {
+                queueCommandLocked(std::move(line));
                 return;
             }
-            if (lifecycle_ == Lifecycle::stopping) {
-                lifecycleChanged_.wait(lock, [this] { return lifecycle_ == Lifecycle::stopped; });
-                lock.unlock();
-                finishCallbackDelivery();
+            if (validation == CommandValidation::ignored)
                 return;
-            }
+        }
 
-            const bool loopMayStillBeRunning = lifecycle_ == Lifecycle::running;
-            lifecycle_ = Lifecycle::stopping;
-            if (loopMayStillBeRunning) {
-                commandQueue_.push("stop");
-                commandQueue_.push("quit");
+        deliverWrapperError(rejectionReason);
+    }
+
+    // Checks every command before taking the lock, and queues none if any is
+    // rejected.
+    void sendCommands(NSArray<NSString*>* commands) {
+        std::vector<std::string> lines;
+        lines.reserve(commands.count);
+        std::string rejectionReason;
+        NSUInteger  number = 0;
+        for (NSString* command in commands) {
+            ++number;
+            std::string normalized;
+            switch (validateCommand(command, normalized, rejectionReason)) {
+            case CommandValidation::accepted:
+                lines.push_back(std::move(normalized));
+                break;
+            case CommandValidation::ignored:
+                break;
+            case CommandValidation::rejected:
+                deliverWrapperError("command " + std::to_string(number) + ": " + rejectionReason);
+                return;
             }
-            commandQueue_.close();
-            threadToJoin = std::move(engineThread_);
         }
+        queueCommands(std::move(lines));
+    }
 
-        if (threadToJoin && threadToJoin->joinable()) {
-            if (threadToJoin->get_id() == std::this_thread::get_id())
-                threadToJoin->detach();
-            else
-                threadToJoin->join();
+    void sendCommandBytes(const char* bytes, std::size_t length) {
+        std::vector<std::string> lines;
+        std::string              rejectionReason;
+        if (validateCommandBuffer(std::string_view(bytes, bytes ? length : 0), lines, rejectionReason)
+            == CommandValidation::rejected) {
+            deliverWrapperError(rejectionReason);
+            return;
         }
+        queueCommands(std::move(lines));
+    }
 
-        releaseActiveLease();
+    void queueCommands(std::vector<std::string>&& commands) {
+        if (commands.empty())
+            return;
 
-        {
-            std::lock_guard<std::mutex> lock(lifecycleMutex_);
-            lifecycle_ = Lifecycle::stopped;
+        // A batch the queue cannot hold at once would wait for room while
+        // holding lifecycleMutex_, which the engine thread needs, for example
+        // in ponderSliceFinished(), before it can drain the queue.
+        if (commands.size() > kCommandQueueCapacity) {
+            deliverWrapperError("a batch of " + std::to_string(commands.size())
+                                + " commands exceeds the command queue's "
+                                + std::to_string(kCommandQueueCapacity));
+            return;
         }
-        lifecycleChanged_.notify_all();
 
-        finishCallbackDelivery();
+        std::lock_guard<std::mutex> lock(lifecycleMutex_);
+        if (lifecycle_ == Lifecycle::running)
+            queueCommandsLocked(std::move(commands));
     }
 
-   private:
-    void runEngineLoop() {
-        LineBufferStreambuf::LineCallback callback;
-        if (handler_) {
-            auto state = shared_from_this();
-            callback = [state](const std::string& line) {
-                state->deliverLine(line);
-            };
+    // Reads commands from `fd` on a thread of its own until end of file, which
+    // sends `quit` as the end of stdin does, or until `stop`.
+    void readCommands(int fd) {
+        auto reader = std::make_shared<FileDescriptorLineReader>(fd);
+        auto state = shared_from_this();
+        std::lock_guard<std::mutex> lock(commandReaderMutex_);
+        if (commandReadersStopped_)
+            return;
+
+        commandReaders_.emplace_back(reader, std::thread([state, reader] {
+            if (reader->run([&state](std::string&& line) { state->sendCommandLine(std::move(line)); }))
+                state->sendCommandLine("quit");
+        }));
+    }
+
+    // The queued copy of stop/ponderhit keeps their order relative to a `go`
+    // that has not started yet; the out-of-band one reaches a running search
+    // without waiting behind queued commands. Requires lifecycleMutex_.
+    void queueCommandLocked(std::string&& command) {
+        routePriorityCommandLocked(command);
+        SF_SIGNPOST_EVENT("Command queued");
+        commandQueue_.push(std::move(command));
+    }
+
+    // As queueCommandLocked() for each command, with a single push, so no
+    // other thread's command lands between them. Requires lifecycleMutex_.
+    void queueCommandsLocked(std::vector<std::string>&& commands) {
+        for (const auto& command : commands)
+            routePriorityCommandLocked(command);
+        SF_SIGNPOST_EVENT("Commands queued", "%zu commands", commands.size());
+        commandQueue_.push_all(commands.begin(), commands.end());
+    }
+
+    void routePriorityCommandLocked(const std::string& command) {
+        switch (priorityCommandFor(command)) {
+        case PriorityCommand::stop:
+            sessionControl_.stop();
+            break;
+        case PriorityCommand::ponderhit:
+            sessionControl_.ponderhit();
+            break;
+        case PriorityCommand::none:
+            break;
         }
+    }
 
-        CommandStreambuf    inputBuffer(commandQueue_);
-        LineBufferStreambuf outputBuffer(std::move(callback));
-        std::istream        input(&inputBuffer);
-        std::ostream        output(&outputBuffer);
+    // Hands the search to the session through sessionControl_ and queues the
+    // token that makes the UCI loop run it, so it keeps its place among
+    // commands sent before and after.
+    // Returns the ticket for cancelSearch(), or 0 when the engine is not running.
+    std::uint64_t search(NSString* fen,
+                         NSArray<NSString*>* moves,
+                         SFSearchLimits* limits,
+                         SFProvisionalBestMoveHandler provisionalHandler,
+                         SFSearchInfoHandler infoHandler,
+                         SFSearchCompletion completion) {
+        // A foreground search needs the engine more than any predicted reply.
+        stopPondering();
+
+        SFSearchCompletion handler = [completion copy];
+        NativeSearchRequest request = searchRequest(fen, moves, limits, provisionalHandler, handler);
+        if (infoHandler) {
+            SFSearchInfoHandler progress = [infoHandler copy];
+            std::weak_ptr<EngineState> weakState = shared_from_this();
+            request.progress = [progress, weakState](const SearchInfo& info) {
+                auto state = weakState.lock();
+                if (!state)
+                    return;
 
-        RunStockfishUCI(input, output);
-        commandQueue_.close();
-        releaseActiveLease();
+                SFSearchInfo* searchInfo = [[SFSearchInfo alloc] initWithSearchInfo:info];
+                state->enqueueCallback(^{
+                    progress(searchInfo);
+                });
+            };
+        }
 
         {
             std::lock_guard<std::mutex> lock(lifecycleMutex_);
-            if (lifecycle_ == Lifecycle::running)
-                lifecycle_ = Lifecycle::finished;
+            if (lifecycle_ == Lifecycle::running) {
+                const std::uint64_t ticket = sessionControl_.submit_search(std::move(request));
+                commandQueue_.push(NativeSearchCommand());
+                return ticket;
+            }
         }
-        lifecycleChanged_.notify_all();
-    }
 
-    void deliverWrapperError(const std::string& reason) {
-        deliverLine("info string StockfishEmbedded error: " + reason);
+        NSError* error = searchError(SFEngineErrorNotRunning, @"The engine is not running");
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            handler(nil, error);
+        });
+        return 0;
     }
 
-    void deliverLine(const std::string& line) {
-        SFLineHandler handler;
-        {
-            std::lock_guard<std::mutex> lock(handlerMutex_);
-            handler = [handler_ copy];
+    // A withdrawn request completes here; a running one through the session.
+    void cancelSearch(std::uint64_t ticket) {
+        if (auto request = sessionControl_.cancel_search(ticket)) {
+            NativeSearchResult withdrawn;
+            withdrawn.status = NativeSearchResult::Status::withdrawn;
+            withdrawn.error = "The search was cancelled before it started";
+            request->completion(withdrawn);
         }
-        if (!handler)
-            return;
+    }
 
-        NSString* nsLine = [[NSString alloc] initWithBytes:line.data()
-                                                   length:line.size()
-                                                 encoding:NSUTF8StringEncoding];
-        if (!nsLine)
-            return;
+    // An unlimited native search of the checkpoint's position. The completion
+    // runs on the search thread right after onRootMoves stored this search's
+    // root moves, so it reads them before any later search can replace them.
+    std::uint64_t resumeAnalysis(SFAnalysisCheckpoint* checkpoint,
+                                 SFSearchInfoHandler infoHandler,
+                                 SFAnalysisCompletion completion) {
+        stopPondering();
+
+        SFAnalysisCompletion handler = [completion copy];
+        SFSearchInfo* savedBest = checkpoint.rootMoves.firstObject;
+        const NSInteger savedDepth = checkpoint.depth;
+        NativeSearchRequest request =
+          searchRequest(checkpoint.fen, checkpoint.moves, [[SFSearchLimits alloc] init], nil, nil);
+
+        std::weak_ptr<EngineState> weakState = shared_from_this();
+        SFSearchInfoHandler progress = [infoHandler copy];
+        if (progress) {
+            // Updates arrive one at a time from the search thread.
+            auto caughtUp = std::make_shared<bool>(false);
+            request.progress = [progress, weakState, savedDepth, caughtUp](const SearchInfo& info) {
+                if (!*caughtUp && info.depth < savedDepth)
+                    return;
+                *caughtUp = true;
 
-        std::weak_ptr<EngineState> state = shared_from_this();
-        dispatch_async(callbackQueue_, ^{
-            @autoreleasepool {
-                auto strongState = state.lock();
-                if (!strongState || !strongState->callbacksEnabled_.load())
+                auto state = weakState.lock();
+                if (!state)
                     return;
-                handler(nsLine);
+
+                SFSearchInfo* searchInfo = [[SFSearchInfo alloc] initWithSearchInfo:info];
+                state->enqueueCallback(^{
+                    progress(searchInfo);
+                });
+            };
+        }
+        request.completion = [handler, weakState, checkpoint](const NativeSearchResult& result) {
+            auto state = weakState.lock();
+            if (!state)
+                return;
+
+            if (result.status != NativeSearchResult::Status::completed) {
+                SFAnalysisCheckpoint* kept =
+                  result.status == NativeSearchResult::Status::rejected ? nil : checkpoint;
+                NSError* error = searchError(searchErrorCode(result.status), stringFromBytes(result.error));
+                state->enqueueCallback(^{
+                    handler(kept, error);
+                });
+                return;
             }
+
+            NSArray<SFSearchInfo*>* rootMoves = state->lastRootMoves();
+            if (rootMoves.firstObject.depth < checkpoint.depth)
+                rootMoves = checkpoint.rootMoves;
+            SFAnalysisCheckpoint* reached =
+              [[SFAnalysisCheckpoint alloc] initWithFEN:checkpoint.fen
+                                                  moves:checkpoint.moves
+                                              rootMoves:rootMoves ?: @[]
+                                                  nodes:checkpoint.nodes + (result.hasInfo ? result.info.nodes : 0)
+                                       timeMilliseconds:checkpoint.timeMilliseconds + result.searchUs / 1000];
+            state->enqueueCallback(^{
+                handler(reached, nil);
+            });
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ == Lifecycle::running) {
+                // Ahead of every update of the new search.
+                if (progress && savedBest)
+                    enqueueCallback(^{
+                        progress(savedBest);
+                    });
+                const std::uint64_t ticket = sessionControl_.submit_search(std::move(request));
+                commandQueue_.push(NativeSearchCommand());
+                return ticket;
+            }
+        }
+
+        NSError* error = searchError(SFEngineErrorNotRunning, @"The engine is not running");
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            handler(checkpoint, error);
         });
+        return 0;
     }
 
-    void finishCallbackDelivery() {
-        drainCallbacks();
-        callbacksEnabled_.store(false);
-        std::lock_guard<std::mutex> lock(handlerMutex_);
-        handler_ = nil;
+    // Queues one search per ply under a single lock, so the whole game runs
+    // back to back in this session, each ply reusing the hash and histories
+    // the plies before it left. The handlers run on the serial callback
+    // queue, so the count needs no lock.
+    void analyzeGame(NSString* fen,
+                     NSArray<NSString*>* moves,
+                     SFSearchLimits* limits,
+                     BOOL backwards,
+                     SFGameAnalysisPlyHandler plyHandler,
+                     dispatch_block_t completion) {
+        stopPondering();
+
+        SFGameAnalysisPlyHandler handler = [plyHandler copy];
+        dispatch_block_t done = [completion copy];
+        const NSUInteger plies = moves.count + 1;
+        __block NSUInteger remaining = plies;
+
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ == Lifecycle::running) {
+                for (NSUInteger i = 0; i < plies; ++i) {
+                    const NSUInteger ply = backwards ? plies - 1 - i : i;
+                    NSArray<NSString*>* played = [moves subarrayWithRange:NSMakeRange(0, ply)];
+                    SFSearchCompletion plyDone = [^(SFSearchResult* result, NSError* error) {
+                        handler(ply, result, error);
+                        if (--remaining == 0)
+                            done();
+                    } copy];
+                    sessionControl_.submit_search(searchRequest(fen, played, limits, nil, plyDone));
+                    commandQueue_.push(NativeSearchCommand());
+                }
+                return;
+            }
+        }
+
+        NSError* error = searchError(SFEngineErrorNotRunning, @"The engine is not running");
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            for (NSUInteger i = 0; i < plies; ++i)
+                handler(backwards ? plies - 1 - i : i, nil, error);
+            done();
+        });
     }
 
-    void drainCallbacks() {
-        if (dispatch_get_specific(&kCallbackQueueSpecificKey) == this)
+    // Searches each legal reply in turn, one background native search per
+    // slice, until stopPondering(). Slices of a reply after its first start
+    // from the hash entries its earlier slices left.
+    void ponder(NSString* fen,
+                NSArray<NSString*>* moves,
+                NSArray<NSString*>* replies,
+                NSInteger sliceMilliseconds,
+                SFPonderCompletion completion) {
+        auto job = std::make_shared<PonderJob>();
+        job->fen = fen ? utf8String(fen) : std::string();
+        for (NSString* move in moves)
+            job->moves.push_back(utf8String(move));
+        for (NSString* reply in replies)
+            job->replies.push_back(utf8String(reply));
+        job->legal.assign(job->replies.size(), true);
+        job->firstDepth.assign(job->replies.size(), 0);
+        job->depth.assign(job->replies.size(), 0);
+        job->nodes.assign(job->replies.size(), 0);
+        job->searchUs.assign(job->replies.size(), 0);
+        job->sliceMs = std::max<NSInteger>(sliceMilliseconds, 1);
+        job->completion = [completion copy];
+
+        stopPondering();
+
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ != Lifecycle::running)
+                job->finished = true;
+        }
+        if (job->finished) {
+            SFPonderCompletion handler = job->completion;
+            NSError* error = searchError(SFEngineErrorNotRunning, @"The engine is not running");
+            dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+                handler(nil, error);
+            });
             return;
+        }
 
-        dispatch_sync(callbackQueue_, ^{});
+        std::lock_guard<std::mutex> lock(ponderMutex_);
+        ponder_ = job;
+        submitPonderSliceLocked(job);
     }
 
-    void releaseActiveLease() {
-        if (ownsActiveLease_.exchange(false))
-            activeEngineRegistry().release(this);
-    }
+    // Withdraws the queued slice and stops the running one; either way its
+    // completion finishes the job, since `stopping` is set first.
+    void stopPondering() {
+        {
+            std::lock_guard<std::mutex> lock(ponderMutex_);
+            if (!ponder_)
+                return;
+            ponder_->stopping = true;
+        }
 
-    SFLineHandler                       handler_;
-    std::mutex                          handlerMutex_;
-    dispatch_queue_t                    callbackQueue_;
-    ThreadSafeQueue<std::string>        commandQueue_;
-    std::unique_ptr<std::thread>        engineThread_;
-    std::mutex                          lifecycleMutex_;
-    std::condition_variable             lifecycleChanged_;
-    Lifecycle                          lifecycle_ = Lifecycle::idle;
-    std::atomic<bool>                   ownsActiveLease_{false};
-    std::atomic<bool>                   callbacksEnabled_{true};
-};
+        NativeSearchResult cancelled;
+        cancelled.status = NativeSearchResult::Status::cancelled;
+        for (const auto& request : sessionControl_.cancel_background())
+            request.completion(cancelled);
+    }
 
-}  // namespace
+    // Queued like search(), so the batch runs between the commands around it.
+    void evaluate(NativeEvalRequest request, SFEvaluationCompletion completion) {
+        request.concurrentWorkers = static_cast<int>(concurrentEvaluationThreads_.load());
+        SFEvaluationCompletion handler = [completion copy];
+        std::weak_ptr<EngineState> weakState = shared_from_this();
+        request.completion = [handler, weakState](const NativeEvalResult& result) {
+            auto state = weakState.lock();
+            if (!state)
+                return;
 
-@implementation SFEngine {
-    std::shared_ptr<EngineState> _state;
-}
+            if (result.status != NativeEvalResult::Status::completed) {
+                const SFEngineError code = result.status == NativeEvalResult::Status::rejected
+                    ? SFEngineErrorNetworkUnavailable
+                    : SFEngineErrorStopped;
+                NSError* error = searchError(code, stringFromBytes(result.error));
+                state->enqueueCallback(^{
+                    handler(nil, error);
+                });
+                return;
+            }
 
-- (instancetype)init {
-    return [self initWithLineHandler:^(NSString* line) {
-        (void) line;
-    }];
-}
+            NSMutableArray<NSNumber*>* scores = [NSMutableArray arrayWithCapacity:result.scores.size()];
+            for (int score : result.scores)
+                [scores addObject:@(score)];
+            state->enqueueCallback(^{
+                handler(scores, nil);
+            });
+        };
 
-- (instancetype)initWithLineHandler:(SFLineHandler)handler {
-    self = [super init];
-    if (self)
-        _state = std::make_shared<EngineState>(handler);
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ == Lifecycle::running) {
+                sessionControl_.submit_eval(std::move(request));
+                commandQueue_.push(NativeEvalCommand());
+                return;
+            }
+        }
+
+        NSError* error = searchError(SFEngineErrorNotRunning, @"The engine is not running");
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            handler(nil, error);
+        });
+    }
+
+    // Queued like search(); the session loads the file before waiting for the
+    // running search, then swaps.
+    void swapNetwork(NetworkSwapRequest request, SFNetworkSwapCompletion completion) {
+        SFNetworkSwapCompletion handler = [completion copy];
+        std::weak_ptr<EngineState> weakState = shared_from_this();
+        request.completion = [handler, weakState](const NetworkSwapResult& result) {
+            auto state = weakState.lock();
+            if (!state)
+                return;
+
+            const NSTimeInterval load = result.loadUs / 1e6;
+            const NSTimeInterval swap = result.swapUs / 1e6;
+            NSError* error = nil;
+            if (result.status != NetworkSwapResult::Status::completed) {
+                const SFEngineError code = result.status == NetworkSwapResult::Status::rejected
+                    ? SFEngineErrorNetworkUnavailable
+                    : SFEngineErrorStopped;
+                error = searchError(code, stringFromBytes(result.error));
+            }
+            state->enqueueCallback(^{
+                handler(load, swap, error);
+            });
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ == Lifecycle::running) {
+                sessionControl_.submit_network_swap(std::move(request));
+                commandQueue_.push(NetworkSwapCommand());
+                return;
+            }
+        }
+
+        NSError* error = searchError(SFEngineErrorNotRunning, @"The engine is not running");
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            handler(0, 0, error);
+        });
+    }
+
+    // Queued like any command, so the table shrinks only between searches.
+    void limitHash(NSInteger megabytes) {
+        if (megabytes < 1)
+            return;
+
+        const int limit = static_cast<int>(std::min<NSInteger>(megabytes, std::numeric_limits<int>::max()));
+        std::lock_guard<std::mutex> lock(lifecycleMutex_);
+        if (lifecycle_ == Lifecycle::running)
+            commandQueue_.push(HashLimitCommand(limit));
+    }
+
+    // Stockfish creates its search threads from the engine thread, and Darwin
+    // starts a pthread in its creator's QoS class. Changing the class therefore
+    // means rebuilding the pool from an engine thread that already has it.
+    void setQualityOfService(NSQualityOfService qualityOfService) {
+        std::lock_guard<std::mutex> lock(lifecycleMutex_);
+        if (qualityOfService_.exchange(qualityOfService) == qualityOfService)
+            return;
+        if (lifecycle_ == Lifecycle::running)
+            commandQueue_.push(RebuildThreadsCommand());
+    }
+
+    void setAdaptsThreadsToThermalState(bool adapts) {
+        adaptsThreadsToThermalState_.store(adapts);
+        applyThermalThreadLimit();
+    }
+
+    bool adaptsThreadsToThermalState() const {
+        return adaptsThreadsToThermalState_.load();
+    }
+
+    void setCalibratesMoveOverhead(bool calibrates) {
+        calibratesMoveOverhead_.store(calibrates);
+    }
+
+    bool calibratesMoveOverhead() const {
+        return calibratesMoveOverhead_.load();
+    }
+
+    NSInteger calibratedMoveOverheadMilliseconds() const {
+        return calibratedMoveOverheadMs_.load();
+    }
+
+    NSUInteger deadlineMissCount() const {
+        return deadlineMissCount_.load();
+    }
+
+    void setConcurrentEvaluationThreads(NSInteger threads) {
+        concurrentEvaluationThreads_.store(std::clamp<NSInteger>(threads, 0, kMaximumEvaluationThreads));
+    }
+
+    NSInteger concurrentEvaluationThreads() const {
+        return concurrentEvaluationThreads_.load();
+    }
+
+    void applyThermalThreadLimit() {
+        std::lock_guard<std::mutex> lock(lifecycleMutex_);
+        applyThermalThreadLimitLocked();
+    }
+
+    NSQualityOfService qualityOfService() const {
+        return static_cast<NSQualityOfService>(qualityOfService_.load());
+    }
+
+    void setMemoryPressureHashMegabytes(NSInteger megabytes) {
+        memoryPressureHashMegabytes_.store(megabytes);
+    }
+
+    NSInteger memoryPressureHashMegabytes() const {
+        return memoryPressureHashMegabytes_.load();
+    }
+
+    SFSearchTelemetryHandler searchTelemetryHandler() {
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        return searchTelemetryHandler_;
+    }
+
+    void setSearchTelemetryHandler(SFSearchTelemetryHandler handler) {
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        searchTelemetryHandler_ = [handler copy];
+    }
+
+    SFHashStatistics* lastHashStatistics() {
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        return lastHashStatistics_;
+    }
+
+    NSArray<SFSearchInfo*>* lastRootMoves() {
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        return lastRootMoves_;
+    }
+
+    SFStartupTiming* startupTiming() {
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        return startupTiming_;
+    }
+
+    SFMemoryFootprint* memoryFootprint() {
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        if (!hasMemoryFootprint_)
+            return nil;
+        return [[SFMemoryFootprint alloc] initWithMemoryFootprint:memoryFootprint_
+                                                 pendingCallbacks:pendingCallbacks_.load()
+                                             peakPendingCallbacks:peakPendingCallbacks_.load()];
+    }
+
+    double lastHashResetMilliseconds() const {
+        return lastHashResetMicroseconds_.load() / 1000.0;
+    }
+
+    void stop() {
+        std::unique_ptr<std::thread> threadToJoin;
+
+        stopPondering();
+        stopCommandReaders();
+
+        {
+            std::unique_lock<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ == Lifecycle::idle) {
+                lifecycle_ = Lifecycle::stopped;
+                lock.unlock();
+                finishCallbackDelivery();
+                return;
+            }
+            if (lifecycle_ == Lifecycle::stopped) {
+                lock.unlock();
+                finishCallbackDelivery();
+                return;
+            }
+            if (lifecycle_ == Lifecycle::stopping) {
+                lifecycleChanged_.wait(lock, [this] { return lifecycle_ == Lifecycle::stopped; });
+                lock.unlock();
+                finishCallbackDelivery();
+                return;
+            }
+
+            const bool loopMayStillBeRunning = lifecycle_ == Lifecycle::running;
+            lifecycle_ = Lifecycle::stopping;
+            if (memoryPressureSource_) {
+                dispatch_source_cancel(memoryPressureSource_);
+                memoryPressureSource_ = nil;
+            }
+            if (thermalStateObserver_) {
+                [NSNotificationCenter.defaultCenter removeObserver:thermalStateObserver_];
+                [NSNotificationCenter.defaultCenter removeObserver:powerStateObserver_];
+                thermalStateObserver_ = nil;
+                powerStateObserver_ = nil;
+            }
+            if (loopMayStillBeRunning) {
+                sessionControl_.stop();
+                commandQueue_.push("stop");
+                commandQueue_.push("quit");
+            }
+            commandQueue_.close();
+            threadToJoin = std::move(engineThread_);
+        }
+
+        if (threadToJoin && threadToJoin->joinable()) {
+            if (threadToJoin->get_id() == std::this_thread::get_id())
+                threadToJoin->detach();
+            else
+                threadToJoin->join();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            lifecycle_ = Lifecycle::stopped;
+        }
+        lifecycleChanged_.notify_all();
+
+        failPendingSearches();
+        finishCallbackDelivery();
+    }
+
+   private:
+    // Readers hold the state, so they are joined before it can go away. None
+    // start afterwards.
+    void stopCommandReaders() {
+        std::vector<std::pair<std::shared_ptr<FileDescriptorLineReader>, std::thread>> readers;
+        {
+            std::lock_guard<std::mutex> lock(commandReaderMutex_);
+            commandReadersStopped_ = true;
+            readers.swap(commandReaders_);
+        }
+        for (auto& [reader, thread] : readers) {
+            reader->interrupt();
+            if (thread.get_id() == std::this_thread::get_id())
+                thread.detach();
+            else
+                thread.join();
+        }
+    }
+
+    // Converts limits and wraps the handlers; shared by search() and analyzeGame().
+    NativeSearchRequest searchRequest(NSString* fen,
+                                      NSArray<NSString*>* moves,
+                                      SFSearchLimits* limits,
+                                      SFProvisionalBestMoveHandler provisionalHandler,
+                                      SFSearchCompletion handler) {
+        NativeSearchRequest request;
+        request.fen = fen ? utf8String(fen) : std::string();
+        for (NSString* move in moves)
+            request.moves.push_back(utf8String(move));
+        request.depth = static_cast<int>(nonNegative(limits.depth));
+        request.nodes = limits.nodes;
+        request.movetime = nonNegative(limits.moveTimeMilliseconds);
+        request.mate = static_cast<int>(nonNegative(limits.mate));
+        request.time[0] = nonNegative(limits.whiteTimeMilliseconds);
+        request.time[1] = nonNegative(limits.blackTimeMilliseconds);
+        request.inc[0] = nonNegative(limits.whiteIncrementMilliseconds);
+        request.inc[1] = nonNegative(limits.blackIncrementMilliseconds);
+        request.movestogo = static_cast<int>(nonNegative(limits.movesToGo));
+        request.deterministic = limits.deterministic;
+        if (limits.deadline) {
+            request.deadline = std::chrono::steady_clock::now()
+                             + std::chrono::microseconds(static_cast<std::int64_t>(
+                                 limits.deadline.timeIntervalSinceNow * 1e6));
+            request.deadlineReserveUs = deadlineDeliveryUs_.peak();
+        }
+
+        std::weak_ptr<EngineState> weakState = shared_from_this();
+        if (provisionalHandler) {
+            SFProvisionalBestMoveHandler provisional = [provisionalHandler copy];
+            request.provisionalDepth = static_cast<int>(nonNegative(limits.provisionalDepth));
+            request.provisionalMs = nonNegative(limits.provisionalMilliseconds);
+            request.provisional = [provisional, weakState](const SearchInfo& info, std::string_view bestmove) {
+                auto state = weakState.lock();
+                if (!state)
+                    return;
+
+                NSString* bestMove = stringFromBytes(bestmove);
+                SFSearchInfo* searchInfo = [[SFSearchInfo alloc] initWithSearchInfo:info];
+                state->enqueueCallback(^{
+                    provisional(bestMove, searchInfo);
+                });
+            };
+        }
+        request.completion = [handler, weakState, deadline = request.deadline](const NativeSearchResult& result) {
+            auto state = weakState.lock();
+            if (!state)
+                return;
+
+            if (result.status != NativeSearchResult::Status::completed) {
+                NSError* error = searchError(searchErrorCode(result.status), stringFromBytes(result.error));
+                state->enqueueCallback(^{
+                    handler(nil, error);
+                });
+                return;
+            }
+
+            SFSearchResult* searchResult = [[SFSearchResult alloc] initWithNativeResult:result];
+            if (deadline == std::chrono::steady_clock::time_point{}) {
+                state->enqueueCallback(^{
+                    handler(searchResult, nil);
+                });
+                return;
+            }
+
+            const auto enqueued = std::chrono::steady_clock::now();
+            EngineState* rawState = state.get();  // enqueueCallback() keeps it alive
+            state->enqueueCallback(^{
+                const auto delivered = std::chrono::steady_clock::now();
+                rawState->deadlineDeliveryUs_.record(
+                  std::chrono::duration_cast<std::chrono::microseconds>(delivered - enqueued).count());
+                searchResult.missedDeadline = delivered > deadline;
+                if (searchResult.missedDeadline)
+                    rawState->deadlineMissCount_.fetch_add(1);
+                handler(searchResult, nil);
+            });
+        };
+        return request;
+    }
+
+    struct PonderJob {
+        std::string                fen;
+        std::vector<std::string>   moves;
+        std::vector<std::string>   replies;
+        std::vector<bool>          legal;
+        std::vector<int>           firstDepth;
+        std::vector<int>           depth;
+        std::vector<std::uint64_t> nodes;
+        std::vector<std::int64_t>  searchUs;
+        std::int64_t               sliceMs = 0;
+        std::size_t                next = 0;  // Reply for the next slice
+        NSUInteger                 slices = 0;
+        bool                       stopping = false;
+        bool                       finished = false;
+        SFPonderCompletion         completion;
+    };
+
+    // Called with ponderMutex_ held. Lock order is ponderMutex_, then
+    // lifecycleMutex_.
+    void submitPonderSliceLocked(const std::shared_ptr<PonderJob>& job) {
+        std::size_t reply = job->next;
+        std::size_t tried = 0;
+        while (tried < job->replies.size() && !job->legal[reply]) {
+            reply = (reply + 1) % job->replies.size();
+            ++tried;
+        }
+        if (job->stopping || tried == job->replies.size()) {
+            finishPonderLocked(job);
+            return;
+        }
+        job->next = (reply + 1) % job->replies.size();
+
+        NativeSearchRequest request;
+        request.fen = job->fen;
+        request.moves = job->moves;
+        request.moves.push_back(job->replies[reply]);
+        request.movetime = job->sliceMs;
+        request.background = true;
+        std::weak_ptr<EngineState> weakState = shared_from_this();
+        request.completion = [weakState, job, reply](const NativeSearchResult& result) {
+            if (auto state = weakState.lock())
+                state->ponderSliceFinished(job, reply, result);
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ == Lifecycle::running) {
+                sessionControl_.submit_search(std::move(request));
+                commandQueue_.push(NativeSearchCommand());
+                return;
+            }
+        }
+        finishPonderLocked(job);
+    }
+
+    void ponderSliceFinished(const std::shared_ptr<PonderJob>& job,
+                             std::size_t reply,
+                             const NativeSearchResult& result) {
+        std::lock_guard<std::mutex> lock(ponderMutex_);
+        switch (result.status) {
+        case NativeSearchResult::Status::completed:
+            if (result.hasInfo) {
+                if (job->firstDepth[reply] == 0)
+                    job->firstDepth[reply] = result.info.depth;
+                job->depth[reply] = result.info.depth;
+                job->nodes[reply] += result.info.nodes;
+            }
+            job->searchUs[reply] += result.searchUs;
+            ++job->slices;
+            break;
+        case NativeSearchResult::Status::rejected:
+        case NativeSearchResult::Status::invalidLimits:
+            // The reply is illegal in this position; leave it out from now on.
+            job->legal[reply] = false;
+            break;
+        case NativeSearchResult::Status::cancelled:
+        case NativeSearchResult::Status::withdrawn:
+            job->stopping = true;
+            break;
+        }
+        submitPonderSliceLocked(job);
+    }
+
+    void finishPonderLocked(const std::shared_ptr<PonderJob>& job) {
+        if (job->finished)
+            return;
+        job->finished = true;
+        if (ponder_ == job)
+            ponder_.reset();
+
+        NSMutableArray<NSString*>* replies = [NSMutableArray arrayWithCapacity:job->replies.size()];
+        NSMutableArray<NSNumber*>* firstDepths = [NSMutableArray arrayWithCapacity:job->replies.size()];
+        NSMutableArray<NSNumber*>* depths = [NSMutableArray arrayWithCapacity:job->replies.size()];
+        NSMutableArray<NSNumber*>* nodes = [NSMutableArray arrayWithCapacity:job->replies.size()];
+        NSMutableArray<NSNumber*>* milliseconds = [NSMutableArray arrayWithCapacity:job->replies.size()];
+        for (std::size_t i = 0; i < job->replies.size(); ++i) {
+            [replies addObject:stringFromBytes(job->replies[i])];
+            [firstDepths addObject:@(job->firstDepth[i])];
+            [depths addObject:@(job->depth[i])];
+            [nodes addObject:@(job->nodes[i])];
+            [milliseconds addObject:@(job->searchUs[i] / 1000.0)];
+        }
+        SFPonderReport* report = [[SFPonderReport alloc] initWithReplies:replies
+                                                             firstDepths:firstDepths
+                                                                  depths:depths
+                                                                   nodes:nodes
+                                                            milliseconds:milliseconds
+                                                                  slices:job->slices];
+        SFPonderCompletion handler = job->completion;
+        enqueueCallback(^{
+            handler(report, nil);
+        });
+    }
+
+    void handleMemoryPressure() {
+        limitHash(memoryPressureHashMegabytes_.load());
+    }
+
+    // Fewer threads keep a hot or power-saving device at a higher sustained
+    // speed than all cores would after throttling. Zero means no cap.
+    static int thermalThreadLimit() {
+        NSProcessInfo* processInfo = NSProcessInfo.processInfo;
+        const int      cores = static_cast<int>(processInfo.activeProcessorCount);
+        int            limit = 0;
+        switch (processInfo.thermalState) {
+        case NSProcessInfoThermalStateNominal:
+            break;
+        case NSProcessInfoThermalStateFair:
+            limit = cores * 3 / 4;
+            break;
+        case NSProcessInfoThermalStateSerious:
+            limit = cores / 2;
+            break;
+        case NSProcessInfoThermalStateCritical:
+            limit = 1;
+            break;
+        }
+        if (processInfo.lowPowerModeEnabled)
+            limit = limit ? std::min(limit, cores / 2) : cores / 2;
+        return limit ? std::max(limit, 1) : 0;
+    }
+
+    // Requires lifecycleMutex_. Queued like any command, so the thread count
+    // changes only between searches.
+    void applyThermalThreadLimitLocked() {
+        if (lifecycle_ != Lifecycle::running)
+            return;
+        const int limit = adaptsThreadsToThermalState_.load() ? thermalThreadLimit() : 0;
+        if (threadLimit_.exchange(limit) != limit)
+            commandQueue_.push(ThreadLimitCommand(limit));
+    }
+
+    void applyQualityOfService() {
+        pthread_set_qos_class_self_np(qosClassFromQualityOfService(qualityOfService()), 0);
+    }
+
+    void runEngineLoop(std::chrono::steady_clock::time_point startedAt) {
+        const auto launchMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - startedAt).count();
+        if (qualityOfService() != NSQualityOfServiceDefault)
+            applyQualityOfService();
+
+        LineBufferStreambuf::LineCallback callback;
+        if (handler_ || lineBatchHandler_) {
+            auto state = shared_from_this();
+            const bool diagnosticsOnly = recentLines_ != nullptr;
+            callback = [state, diagnosticsOnly](const std::string& line) {
+                if (!diagnosticsOnly || isDiagnosticLine(line))
+                    state->deliverLine(line);
+            };
+        }
+
+        SessionHooks hooks;
+        hooks.emitSearchInfoLines =
+          handler_ != nil || lineBatchHandler_ != nil || recentLines_ || descriptorOutput_;
+        {
+            auto state = shared_from_this();
+            hooks.onStartup = [state, launchMicroseconds](const StartupTiming& timing) {
+                SFStartupTiming* startupTiming =
+                  [[SFStartupTiming alloc] initWithStartupTiming:timing
+                                              launchMicroseconds:static_cast<uint64_t>(launchMicroseconds)];
+                std::lock_guard<std::mutex> lock(state->handlerMutex_);
+                state->startupTiming_ = startupTiming;
+            };
+            hooks.onHashReset = [state](std::string_view, std::uint64_t us) {
+                state->lastHashResetMicroseconds_.store(us);
+            };
+            hooks.onSearchTelemetry = [state](const SearchTelemetry& telemetry) {
+                state->deliverSearchTelemetry(telemetry);
+            };
+            hooks.onThreadPoolRebuild = [state] {
+                state->applyQualityOfService();
+            };
+            hooks.onMemoryFootprint = [state](const MemoryFootprint& footprint) {
+                std::lock_guard<std::mutex> lock(state->handlerMutex_);
+                state->memoryFootprint_ = footprint;
+                state->hasMemoryFootprint_ = true;
+            };
+            hooks.onHashStats = [state](const HashStats& stats) {
+                SFHashStatistics* statistics = [[SFHashStatistics alloc] initWithHashStats:stats];
+                std::lock_guard<std::mutex> lock(state->handlerMutex_);
+                state->lastHashStatistics_ = statistics;
+            };
+            hooks.onRootMoves = [state](const std::vector<SearchInfo>& moves) {
+                NSMutableArray<SFSearchInfo*>* rootMoves = [NSMutableArray arrayWithCapacity:moves.size()];
+                for (const SearchInfo& info : moves)
+                    [rootMoves addObject:[[SFSearchInfo alloc] initWithSearchInfo:info]];
+                std::lock_guard<std::mutex> lock(state->handlerMutex_);
+                state->lastRootMoves_ = [rootMoves copy];
+            };
+        }
+        if (searchInfoHandler_) {
+            auto state = shared_from_this();
+            hooks.onSearchInfo = [state](const SearchInfo& info) {
+                state->deliverSearchInfo(info);
+            };
+        }
+        if (bestMoveHandler_) {
+            auto state = shared_from_this();
+            hooks.onBestmove = [state](std::string_view bestmove, std::string_view ponder) {
+                state->deliverBestMove(bestmove, ponder);
+            };
+        }
+
+        CommandStreambuf    inputBuffer(commandQueue_);
+        LineBufferStreambuf outputBuffer(std::move(callback), recentLines_.get());
+        std::istream        input(&inputBuffer);
+        std::ostream        output(descriptorOutput_ ? static_cast<std::streambuf*>(descriptorOutput_.get())
+                                                     : &outputBuffer);
+
+        RunStockfishUCI(input, output, std::move(hooks), &sessionControl_);
+        output.flush();
+        commandQueue_.close();
+
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ == Lifecycle::running)
+                lifecycle_ = Lifecycle::finished;
+        }
+        lifecycleChanged_.notify_all();
+
+        // No search can be submitted once the lifecycle has left `running`.
+        failPendingSearches();
+    }
+
+    // Completes searches, evaluations, and network swaps the session never
+    // reached, e.g. after a `quit`.
+    void failPendingSearches() {
+        NativeSearchResult cancelled;
+        cancelled.status = NativeSearchResult::Status::cancelled;
+        cancelled.error = "The engine stopped before the search started";
+        for (const auto& request : sessionControl_.take_all_searches())
+            request.completion(cancelled);
+
+        NativeEvalResult cancelledEval;
+        cancelledEval.status = NativeEvalResult::Status::cancelled;
+        cancelledEval.error = "The engine stopped before the evaluation started";
+        for (const auto& request : sessionControl_.take_all_evals())
+            request.completion(cancelledEval);
+
+        NetworkSwapResult cancelledSwap;
+        cancelledSwap.status = NetworkSwapResult::Status::cancelled;
+        cancelledSwap.error = "The engine stopped before the network swap started";
+        for (const auto& request : sessionControl_.take_all_network_swaps())
+            request.completion(cancelledSwap);
+    }
+
+    void deliverWrapperError(const std::string& reason) {
+        deliverLine("info string StockfishEmbedded error: " + reason);
+    }
+
+    void deliverLine(const std::string& line) {
+        SF_SIGNPOST_EVENT("Line", "%zu bytes", line.size());
+        if (descriptorOutput_) {
+            descriptorOutput_->write_line(line);
+            return;
+        }
+
+        SFLineHandler handler;
+        bool          batched = false;
+        {
+            std::lock_guard<std::mutex> lock(handlerMutex_);
+            handler = [handler_ copy];
+            batched = lineBatchHandler_ != nil;
+        }
+        if (batched) {
+            deliverBatchedLine(line);
+            return;
+        }
+        if (!handler)
+            return;
+
+        NSString* nsLine = [[NSString alloc] initWithBytes:line.data()
+                                                   length:line.size()
+                                                 encoding:NSUTF8StringEncoding];
+        if (!nsLine)
+            return;
+
+        if (isBestMoveLine(line) && noteBestMoveEmitted()) {
+            enqueueCallback(^{
+                recordBestMoveDelivery();
+                handler(nsLine);
+            });
+            return;
+        }
+        enqueueCallback(^{
+            handler(nsLine);
+        });
+    }
+
+    // Appends to the pending batch. At most one flush is queued at a time, so a
+    // slow handler receives larger batches instead of a growing queue.
+    void deliverBatchedLine(const std::string& line) {
+        bool scheduleFlush = false;
+        {
+            std::lock_guard<std::mutex> lock(batchMutex_);
+            if (lineBatchPolicy_ == SFLineBatchPolicyDropSupersededInfo)
+                dropSupersededLine(line);
+
+            pendingLines_.push_back(line);
+            if (isBestMoveLine(line))
+                noteBestMoveEmitted();
+            scheduleFlush = !batchFlushScheduled_;
+            batchFlushScheduled_ = true;
+        }
+
+        if (scheduleFlush) {
+            enqueueCallback(^{
+                flushLineBatch();
+            });
+        }
+    }
+
+    // Only looks at the trailing run of progress lines, so an `info` line never
+    // replaces one from before a `bestmove` or other barrier line.
+    void dropSupersededLine(const std::string& line) {
+        const int slot = supersededInfoSlot(line);
+        if (slot == 0)
+            return;
+
+        for (auto it = pendingLines_.rbegin(); it != pendingLines_.rend(); ++it) {
+            const int pendingSlot = supersededInfoSlot(*it);
+            if (pendingSlot == 0)
+                return;
+            if (pendingSlot == slot) {
+                pendingLines_.erase(std::next(it).base());
+                return;
+            }
+        }
+    }
+
+    void flushLineBatch() {
+        std::vector<std::string> lines;
+        {
+            std::lock_guard<std::mutex> lock(batchMutex_);
+            lines.swap(pendingLines_);
+            batchFlushScheduled_ = false;
+        }
+
+        SFLineBatchHandler handler;
+        {
+            std::lock_guard<std::mutex> lock(handlerMutex_);
+            handler = [lineBatchHandler_ copy];
+        }
+        if (!handler || lines.empty())
+            return;
+
+        if (std::any_of(lines.begin(), lines.end(), isBestMoveLine))
+            recordBestMoveDelivery();
+        NSMutableArray<NSString*>* batch = [NSMutableArray arrayWithCapacity:lines.size()];
+        for (const auto& line : lines) {
+            NSString* nsLine = [[NSString alloc] initWithBytes:line.data()
+                                                       length:line.size()
+                                                     encoding:NSUTF8StringEncoding];
+            if (nsLine)
+                [batch addObject:nsLine];
+        }
+        if (batch.count > 0)
+            handler(batch);
+    }
+
+    void deliverSearchInfo(const SearchInfo& info) {
+        SFSearchInfoHandler handler;
+        {
+            std::lock_guard<std::mutex> lock(handlerMutex_);
+            handler = [searchInfoHandler_ copy];
+        }
+        if (!handler)
+            return;
+
+        SFSearchInfo* searchInfo = [[SFSearchInfo alloc] initWithSearchInfo:info];
+        enqueueCallback(^{
+            handler(searchInfo);
+        });
+    }
+
+    void deliverSearchTelemetry(const SearchTelemetry& telemetry) {
+        SFSearchTelemetryHandler handler = searchTelemetryHandler();
+        if (!handler)
+            return;
+
+        SFSearchTelemetry* searchTelemetry = [[SFSearchTelemetry alloc] initWithSearchTelemetry:telemetry];
+        enqueueCallback(^{
+            handler(searchTelemetry);
+        });
+    }
+
+    void deliverBestMove(std::string_view bestmove, std::string_view ponder) {
+        SFBestMoveHandler handler;
+        {
+            std::lock_guard<std::mutex> lock(handlerMutex_);
+            handler = [bestMoveHandler_ copy];
+        }
+        if (!handler)
+            return;
+
+        NSString* bestMove = [[NSString alloc] initWithBytes:bestmove.data()
+                                                      length:bestmove.size()
+                                                    encoding:NSUTF8StringEncoding];
+        NSString* ponderMove = ponder.empty() ? nil
+                                              : [[NSString alloc] initWithBytes:ponder.data()
+                                                                         length:ponder.size()
+                                                                       encoding:NSUTF8StringEncoding];
+        if (!bestMove)
+            return;
+
+        noteBestMoveEmitted();
+        enqueueCallback(^{
+            recordBestMoveDelivery();
+            handler(bestMove, ponderMove);
+        });
+    }
+
+    static bool isBestMoveLine(const std::string& line) {
+        return line.compare(0, 9, "bestmove ") == 0;
+    }
+
+    // Stamps a bestmove on its way to the callback queue. The text line and
+    // the typed callback of one bestmove are stamped once, and the first of
+    // them to reach its handler records the sample. Returns whether
+    // calibration is on.
+    bool noteBestMoveEmitted() {
+        if (!calibratesMoveOverhead_.load())
+            return false;
+
+        std::int64_t none = 0;
+        bestMoveEmittedAtUs_.compare_exchange_strong(none, steadyMicroseconds());
+        return true;
+    }
+
+    // Runs on the callback queue just before a handler receives a bestmove.
+    void recordBestMoveDelivery() {
+        const std::int64_t emittedAt = bestMoveEmittedAtUs_.exchange(0);
+        if (emittedAt == 0)
+            return;
+
+        deliverySamplesUs_[deliverySampleCount_++ % kMoveOverheadSamples] =
+          std::max<std::int64_t>(steadyMicroseconds() - emittedAt, 0);
+        const std::size_t count = std::min(deliverySampleCount_, kMoveOverheadSamples);
+        std::array<std::int64_t, kMoveOverheadSamples> sorted = deliverySamplesUs_;
+        const std::size_t rank = (count * 99 + 99) / 100 - 1;  // Nearest-rank p99
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.begin() + count);
+
+        const NSInteger overheadMs =
+          std::clamp<NSInteger>((sorted[rank] + 999) / 1000, 1, kMaximumMoveOverheadMs);
+        if (calibratedMoveOverheadMs_.exchange(overheadMs) == overheadMs)
+            return;
+
+        std::lock_guard<std::mutex> lock(lifecycleMutex_);
+        if (lifecycle_ == Lifecycle::running)
+            commandQueue_.push("setoption name Move Overhead value " + std::to_string(overheadMs));
+    }
+
+    static std::int64_t steadyMicroseconds() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+    }
+
+    // Runs `block` on the serial callback queue unless delivery has been shut down.
+    // Counts the blocks waiting so memoryFootprint can report the backlog.
+    void enqueueCallback(dispatch_block_t block) {
+        std::weak_ptr<EngineState> state = shared_from_this();
+        const std::size_t pending = pendingCallbacks_.fetch_add(1) + 1;
+        std::size_t peak = peakPendingCallbacks_.load();
+        while (pending > peak && !peakPendingCallbacks_.compare_exchange_weak(peak, pending)) {}
+        dispatch_async(callbackQueue_, ^{
+            @autoreleasepool {
+                auto strongState = state.lock();
+                if (!strongState)
+                    return;
+                strongState->pendingCallbacks_.fetch_sub(1);
+                if (!strongState->callbacksEnabled_.load())
+                    return;
+                SF_SIGNPOST_BEGIN("Callback", strongState.get());
+                block();
+                SF_SIGNPOST_END("Callback", strongState.get());
+            }
+        });
+    }
+
+    void finishCallbackDelivery() {
+        drainCallbacks();
+        callbacksEnabled_.store(false);
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        handler_ = nil;
+        searchInfoHandler_ = nil;
+        bestMoveHandler_ = nil;
+        lineBatchHandler_ = nil;
+    }
+
+    void drainCallbacks() {
+        if (dispatch_get_specific(&kCallbackQueueSpecificKey) == this)
+            return;
+
+        dispatch_sync(callbackQueue_, ^{});
+    }
+
+    SFLineHandler                       handler_;
+    SFSearchInfoHandler                 searchInfoHandler_;
+    SFBestMoveHandler                   bestMoveHandler_;
+    SFSearchTelemetryHandler            searchTelemetryHandler_;
+    SFLineBatchHandler                  lineBatchHandler_;
+    SFLineBatchPolicy                   lineBatchPolicy_ = SFLineBatchPolicyDeliverAll;
+    std::mutex                          handlerMutex_;
+    SFStartupTiming*                    startupTiming_ = nil;
+    SFHashStatistics*                   lastHashStatistics_ = nil;
+    NSArray<SFSearchInfo*>*             lastRootMoves_ = nil;
+    MemoryFootprint                     memoryFootprint_;
+    bool                                hasMemoryFootprint_ = false;
+    std::atomic<std::size_t>            pendingCallbacks_{0};
+    std::atomic<std::size_t>            peakPendingCallbacks_{0};
+    std::atomic<std::uint64_t>          lastHashResetMicroseconds_{0};
+    std::atomic<NSInteger>              memoryPressureHashMegabytes_{0};
+    std::atomic<NSInteger>              qualityOfService_{NSQualityOfServiceDefault};
+    dispatch_source_t                   memoryPressureSource_ = nil;
+    id                                  thermalStateObserver_ = nil;
+    id                                  powerStateObserver_ = nil;
+    std::atomic<bool>                   adaptsThreadsToThermalState_{false};
+    std::atomic<int>                    threadLimit_{0};
+    std::atomic<bool>                   calibratesMoveOverhead_{false};
+    std::atomic<std::int64_t>           bestMoveEmittedAtUs_{0};  // Zero while no bestmove is in flight
+    std::array<std::int64_t, kMoveOverheadSamples> deliverySamplesUs_{};  // Callback queue only
+    std::size_t                         deliverySampleCount_ = 0;         // Callback queue only
+    std::atomic<NSInteger>              calibratedMoveOverheadMs_{0};
+    LatencyPeak                         deadlineDeliveryUs_;  // Enqueue to run of deadline completions
+    std::atomic<NSUInteger>             deadlineMissCount_{0};
+    std::atomic<NSInteger>              concurrentEvaluationThreads_{0};
+    std::mutex                          ponderMutex_;
+    std::shared_ptr<PonderJob>          ponder_;  // Guarded by ponderMutex_
+    std::unique_ptr<LineRing>           recentLines_;  // Set before start
+    std::unique_ptr<FileDescriptorStreambuf> descriptorOutput_;  // Set before start
+    std::mutex                          commandReaderMutex_;
+    std::vector<std::pair<std::shared_ptr<FileDescriptorLineReader>, std::thread>> commandReaders_;
+    bool                                commandReadersStopped_ = false;  // Guarded by commandReaderMutex_
+    std::mutex                          batchMutex_;
+    std::vector<std::string>            pendingLines_;
+    bool                                batchFlushScheduled_ = false;
+    dispatch_queue_t                    callbackQueue_;
+    CommandQueue                        commandQueue_;
+    SessionControl                      sessionControl_;
+    std::unique_ptr<std::thread>        engineThread_;
+    std::mutex                          lifecycleMutex_;
+    std::condition_variable             lifecycleChanged_;
+    Lifecycle                          lifecycle_ = Lifecycle::idle;
+    std::atomic<bool>                   callbacksEnabled_{true};
+};
+
+// A parked engine is pure cache, so memory pressure frees it whether or not
+// any engine is running. Installed once, the first time retention is enabled.
+void releaseWarmEngineUnderMemoryPressure() {
+    static dispatch_source_t source;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        source = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, kMemoryPressureEvents,
+                                        dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+        dispatch_source_set_event_handler(source, ^{
+            ReleaseWarmEngine();
+        });
+        dispatch_resume(source);
+    });
+}
+
+// Runs a list of searches on several one-thread engines. Each engine takes the
+// next unclaimed position when its search completes; results and the final
+// completion are delivered in completion order on one serial queue.
+class SearchBatch : public std::enable_shared_from_this<SearchBatch> {
+public:
+    SearchBatch(NSArray<NSString*>* fens,
+                SFSearchLimits* limits,
+                SFBatchSearchResultHandler resultHandler,
+                dispatch_block_t completion)
+        : fens_([fens copy]),
+          limits_(limits),
+          resultHandler_([resultHandler copy]),
+          completion_([completion copy]),
+          queue_(dispatch_queue_create("com.stockfish.embedded.searchbatch", DISPATCH_QUEUE_SERIAL)) {}
+
+    void start(NSInteger concurrency) {
+        const NSUInteger workers =
+          std::min<NSUInteger>(std::max<NSInteger>(concurrency, 1), std::max<NSUInteger>(fens_.count, 1));
+        remainingWorkers_ = workers;
+        for (NSUInteger i = 0; i < workers; ++i) {
+            SFEngine* engine = [[SFEngine alloc] init];
+            [engine start];
+            engines_.push_back(engine);
+        }
+
+        auto batch = shared_from_this();
+        dispatch_async(queue_, ^{
+            for (NSUInteger i = 0; i < workers; ++i)
+                batch->runNext(i);
+        });
+    }
+
+private:
+    // Runs on queue_.
+    void runNext(NSUInteger worker) {
+        if (nextIndex_ >= fens_.count) {
+            [engines_[worker] stop];
+            engines_[worker] = nil;
+            if (--remainingWorkers_ == 0)
+                completion_();
+            return;
+        }
+
+        const NSUInteger index = nextIndex_++;
+        auto batch = shared_from_this();
+        [engines_[worker] searchFEN:fens_[index]
+                              moves:@[]
+                             limits:limits_
+                         completion:^(SFSearchResult* result, NSError* error) {
+            dispatch_async(batch->queue_, ^{
+                batch->resultHandler_(index, result, error);
+                batch->runNext(worker);
+            });
+        }];
+    }
+
+    NSArray<NSString*>*        fens_;
+    SFSearchLimits*            limits_;
+    SFBatchSearchResultHandler resultHandler_;
+    dispatch_block_t           completion_;
+    dispatch_queue_t           queue_;
+    std::vector<SFEngine*>     engines_;
+    NSUInteger                 nextIndex_ = 0;
+    NSUInteger                 remainingWorkers_ = 0;
+};
+
+}  // namespace
+
+@implementation SFSearchInfo
+
+- (instancetype)initWithSearchInfo:(const SearchInfo&)info {
+    self = [super init];
+    if (self) {
+        _depth = info.depth;
+        _selectiveDepth = info.selDepth;
+        _multiPV = static_cast<NSInteger>(info.multiPV);
+        _scoreType = info.scoreKind == SearchInfo::ScoreKind::mate ? SFScoreTypeMate : SFScoreTypeCentipawns;
+        _scoreValue = info.scoreValue;
+        _bound = scoreBoundFromInfo(info.bound);
+        _hasWDL = info.hasWDL;
+        _wdlWin = info.wdlWin;
+        _wdlDraw = info.wdlDraw;
+        _wdlLoss = info.wdlLoss;
+        _nodes = info.nodes;
+        _nodesPerSecond = info.nps;
+        _hashfull = info.hashfull;
+        _tablebaseHits = info.tbHits;
+        _timeMilliseconds = info.timeMs;
+        _pv = [movesFromPV(info.pv) copy];
+        _lineID = static_cast<NSInteger>(info.lineID);
+    }
+    return self;
+}
+
+@end
+
+@implementation SFSearchLimits
+
++ (instancetype)limitsWithDepth:(NSInteger)depth {
+    SFSearchLimits* limits = [[self alloc] init];
+    limits.depth = depth;
+    return limits;
+}
+
++ (instancetype)limitsWithMoveTimeMilliseconds:(NSInteger)moveTime {
+    SFSearchLimits* limits = [[self alloc] init];
+    limits.moveTimeMilliseconds = moveTime;
+    return limits;
+}
+
++ (instancetype)limitsWithNodes:(uint64_t)nodes {
+    SFSearchLimits* limits = [[self alloc] init];
+    limits.nodes = nodes;
+    return limits;
+}
+
+- (id)copyWithZone:(NSZone*)zone {
+    SFSearchLimits* copy = [[[self class] allocWithZone:zone] init];
+    copy.depth = self.depth;
+    copy.nodes = self.nodes;
+    copy.moveTimeMilliseconds = self.moveTimeMilliseconds;
+    copy.mate = self.mate;
+    copy.whiteTimeMilliseconds = self.whiteTimeMilliseconds;
+    copy.blackTimeMilliseconds = self.blackTimeMilliseconds;
+    copy.whiteIncrementMilliseconds = self.whiteIncrementMilliseconds;
+    copy.blackIncrementMilliseconds = self.blackIncrementMilliseconds;
+    copy.movesToGo = self.movesToGo;
+    copy.provisionalDepth = self.provisionalDepth;
+    copy.provisionalMilliseconds = self.provisionalMilliseconds;
+    copy.deterministic = self.deterministic;
+    copy.deadline = self.deadline;
+    return copy;
+}
+
+@end
+
+@implementation SFStartupTiming
+
+- (instancetype)initWithStartupTiming:(const StartupTiming&)timing
+                   launchMicroseconds:(uint64_t)launchMicroseconds {
+    self = [super init];
+    if (self) {
+        _warm = timing.warm;
+        _launchMilliseconds = launchMicroseconds / 1000.0;
+        _tablesMilliseconds = timing.tablesUs / 1000.0;
+        _engineMilliseconds = timing.engineUs / 1000.0;
+        _optionsMilliseconds = timing.optionsUs / 1000.0;
+        _totalMilliseconds = timing.totalUs / 1000.0;
+    }
+    return self;
+}
+
+- (NSString*)description {
+    return [NSString stringWithFormat:@"<%@: %@ launch %.3f ms, tables %.3f ms, engine %.3f ms, "
+                                      @"options %.3f ms, total %.3f ms>",
+                                      NSStringFromClass([self class]),
+                                      self.warm ? @"warm" : @"cold",
+                                      self.launchMilliseconds,
+                                      self.tablesMilliseconds,
+                                      self.engineMilliseconds,
+                                      self.optionsMilliseconds,
+                                      self.totalMilliseconds];
+}
+
+@end
+
+@implementation SFHashStatistics
+
+- (instancetype)initWithHashStats:(const HashStats&)stats {
+    self = [super init];
+    if (self) {
+        _hashMegabytes = stats.hashMB;
+        _hashfull = stats.hashfull;
+        _occupied = stats.occupied;
+
+        std::size_t ages = stats.byAge.size();
+        while (ages > 1 && stats.byAge[ages - 1] == 0)
+            --ages;
+        NSMutableArray<NSNumber*>* occupancyByAge = [NSMutableArray arrayWithCapacity:ages];
+        for (std::size_t age = 0; age < ages; ++age)
+            [occupancyByAge addObject:@(stats.byAge[age])];
+        _occupancyByAge = [occupancyByAge copy];
+    }
+    return self;
+}
+
+@end
+
+@implementation SFMemoryFootprint
+
+- (instancetype)initWithMemoryFootprint:(const MemoryFootprint&)footprint
+                       pendingCallbacks:(NSUInteger)pendingCallbacks
+                   peakPendingCallbacks:(NSUInteger)peakPendingCallbacks {
+    self = [super init];
+    if (self) {
+        _hashBytes = footprint.hashBytes;
+        _networkBytes = footprint.networkBytes;
+        _threads = footprint.threads;
+        _threadBytes = footprint.threadBytes;
+        _pendingCallbacks = pendingCallbacks;
+        _peakPendingCallbacks = peakPendingCallbacks;
+    }
+    return self;
+}
+
+@end
+
+@implementation SFSearchTelemetry
+
+- (instancetype)initWithSearchTelemetry:(const SearchTelemetry&)telemetry {
+    self = [super init];
+    if (self) {
+        _depth = telemetry.depth;
+        _selectiveDepth = telemetry.selDepth;
+        _nodes = telemetry.nodes;
+        _timeMilliseconds = telemetry.timeMs;
+        _iterationNodes = telemetry.iterationNodes;
+        _iterationMilliseconds = telemetry.iterationMs;
+        _effectiveBranchingFactor = telemetry.branchingFactor;
+        _bestMove = stringFromBytes(telemetry.bestMove);
+        _bestMoveChanged = telemetry.bestMoveChanged;
+        _bestMoveChanges = telemetry.bestMoveChanges;
+        _hashfull = telemetry.hashfull;
+        _optimumTimeMilliseconds = telemetry.optimumMs;
+        _maximumTimeMilliseconds = telemetry.maximumMs;
+    }
+    return self;
+}
+
+@end
+
+@implementation SFSearchResult
+
+- (instancetype)initWithNativeResult:(const NativeSearchResult&)result {
+    self = [super init];
+    if (self) {
+        // Stockfish reports "(none)" when the root position has no legal moves.
+        if (result.bestmove != "(none)")
+            _bestMove = stringFromBytes(result.bestmove);
+        if (!result.ponder.empty())
+            _ponderMove = stringFromBytes(result.ponder);
+        if (result.hasInfo)
+            _info = [[SFSearchInfo alloc] initWithSearchInfo:result.info];
+        _queueMilliseconds = result.queuedUs / 1000.0;
+        _searchMilliseconds = result.searchUs / 1000.0;
+        _cached = result.cached;
+    }
+    return self;
+}
+
+@end
+
+@implementation SFResultCacheStatistics
+
+- (instancetype)initWithResultCacheStats:(const ResultCacheStats&)stats {
+    self = [super init];
+    if (self) {
+        _hits = stats.hits;
+        _misses = stats.misses;
+        _stores = stats.stores;
+        _evictions = stats.evictions;
+        _entries = stats.entries;
+        _capacity = stats.capacity;
+        _hitRate = stats.hits + stats.misses ? double(stats.hits) / double(stats.hits + stats.misses) : 0;
+    }
+    return self;
+}
+
+@end
+
+namespace {
+
+NSNumber* numberForKey(NSDictionary* dictionary, NSString* key) {
+    id value = dictionary[key];
+    return [value isKindOfClass:[NSNumber class]] ? value : nil;
+}
+
+NSArray<NSString*>* stringsForKey(NSDictionary* dictionary, NSString* key) {
+    id value = dictionary[key];
+    if (![value isKindOfClass:[NSArray class]])
+        return nil;
+    for (id item in value)
+        if (![item isKindOfClass:[NSString class]])
+            return nil;
+    return value;
+}
+
+NSDictionary* propertyListFromSearchInfo(SFSearchInfo* info) {
+    NSMutableDictionary* entry = [@{
+        @"depth": @(info.depth),
+        @"selectiveDepth": @(info.selectiveDepth),
+        @"multiPV": @(info.multiPV),
+        @"mate": @(info.scoreType == SFScoreTypeMate),
+        @"score": @(info.scoreValue),
+        @"bound": @(info.bound),
+        @"nodes": @(info.nodes),
+        @"nodesPerSecond": @(info.nodesPerSecond),
+        @"hashfull": @(info.hashfull),
+        @"tablebaseHits": @(info.tablebaseHits),
+        @"timeMilliseconds": @(info.timeMilliseconds),
+        @"pv": info.pv,
+        @"lineID": @(info.lineID),
+    } mutableCopy];
+    if (info.hasWDL)
+        entry[@"wdl"] = @[@(info.wdlWin), @(info.wdlDraw), @(info.wdlLoss)];
+    return entry;
+}
+
+// Nil unless `object` is an entry propertyListFromSearchInfo() wrote.
+SFSearchInfo* searchInfoFromPropertyList(id object) {
+    if (![object isKindOfClass:[NSDictionary class]])
+        return nil;
+
+    NSDictionary* entry = object;
+    for (NSString* key in @[@"depth", @"selectiveDepth", @"multiPV", @"mate", @"score", @"bound", @"nodes",
+                            @"nodesPerSecond", @"hashfull", @"tablebaseHits", @"timeMilliseconds", @"lineID"])
+        if (!numberForKey(entry, key))
+            return nil;
+    NSArray<NSString*>* pv = stringsForKey(entry, @"pv");
+    if (!pv)
+        return nil;
+
+    SearchInfo info;
+    info.depth = numberForKey(entry, @"depth").intValue;
+    info.selDepth = numberForKey(entry, @"selectiveDepth").intValue;
+    info.multiPV = numberForKey(entry, @"multiPV").unsignedLongValue;
+    info.scoreKind = numberForKey(entry, @"mate").boolValue ? SearchInfo::ScoreKind::mate : SearchInfo::ScoreKind::centipawns;
+    info.scoreValue = numberForKey(entry, @"score").intValue;
+    switch (numberForKey(entry, @"bound").integerValue) {
+    case SFScoreBoundLowerbound:
+        info.bound = SearchInfo::Bound::lower;
+        break;
+    case SFScoreBoundUpperbound:
+        info.bound = SearchInfo::Bound::upper;
+        break;
+    default:
+        info.bound = SearchInfo::Bound::exact;
+        break;
+    }
+    id wdl = entry[@"wdl"];
+    if (wdl) {
+        if (![wdl isKindOfClass:[NSArray class]] || [wdl count] != 3)
+            return nil;
+        for (id value in wdl)
+            if (![value isKindOfClass:[NSNumber class]])
+                return nil;
+        info.hasWDL = true;
+        info.wdlWin = [wdl[0] intValue];
+        info.wdlDraw = [wdl[1] intValue];
+        info.wdlLoss = [wdl[2] intValue];
+    }
+    info.nodes = numberForKey(entry, @"nodes").unsignedLongLongValue;
+    info.nps = numberForKey(entry, @"nodesPerSecond").unsignedLongLongValue;
+    info.hashfull = numberForKey(entry, @"hashfull").intValue;
+    info.tbHits = numberForKey(entry, @"tablebaseHits").unsignedLongLongValue;
+    info.timeMs = numberForKey(entry, @"timeMilliseconds").unsignedLongLongValue;
+    info.lineID = numberForKey(entry, @"lineID").unsignedIntValue;
+
+    const std::string text = utf8String([pv componentsJoinedByString:@" "]);
+    info.pv = text;
+    return [[SFSearchInfo alloc] initWithSearchInfo:info];
+}
+
+}  // namespace
+
+@implementation SFAnalysisCheckpoint
+
+- (instancetype)initWithFEN:(NSString*)fen
+                      moves:(NSArray<NSString*>*)moves
+                  rootMoves:(NSArray<SFSearchInfo*>*)rootMoves
+                      nodes:(uint64_t)nodes
+           timeMilliseconds:(uint64_t)timeMilliseconds {
+    self = [super init];
+    if (self) {
+        _fen = [fen copy];
+        _moves = [moves copy];
+        _rootMoves = [rootMoves copy];
+        _nodes = nodes;
+        _timeMilliseconds = timeMilliseconds;
+    }
+    return self;
+}
+
++ (instancetype)checkpointWithFEN:(NSString*)fen moves:(NSArray<NSString*>*)moves {
+    return [[self alloc] initWithFEN:fen moves:moves rootMoves:@[] nodes:0 timeMilliseconds:0];
+}
+
++ (instancetype)checkpointWithData:(NSData*)data error:(NSError**)error {
+    NSError* invalid = searchError(SFEngineErrorInvalidCheckpoint, @"The analysis checkpoint is damaged");
+    id plist = [NSPropertyListSerialization propertyListWithData:data
+                                                          options:NSPropertyListImmutable
+                                                           format:nil
+                                                            error:nil];
+    NSDictionary* dictionary = [plist isKindOfClass:[NSDictionary class]] ? plist : nil;
+    NSNumber* format = numberForKey(dictionary, @"format");
+    if (format && format.integerValue != kCheckpointFormat)
+        invalid = searchError(SFEngineErrorInvalidCheckpoint,
+                              [NSString stringWithFormat:@"Unsupported analysis checkpoint format %@", format]);
+
+    id fen = dictionary[@"fen"];
+    NSArray<NSString*>* moves = stringsForKey(dictionary, @"moves");
+    NSNumber* nodes = numberForKey(dictionary, @"nodes");
+    NSNumber* milliseconds = numberForKey(dictionary, @"timeMilliseconds");
+    id entries = dictionary[@"rootMoves"];
+    NSMutableArray<SFSearchInfo*>* rootMoves = [NSMutableArray array];
+    bool valid = format.integerValue == kCheckpointFormat && (!fen || [fen isKindOfClass:[NSString class]]) && moves
+              && nodes && milliseconds && [entries isKindOfClass:[NSArray class]];
+    for (id entry in valid ? entries : @[]) {
+        SFSearchInfo* info = searchInfoFromPropertyList(entry);
+        if (!info) {
+            valid = false;
+            break;
+        }
+        [rootMoves addObject:info];
+    }
+    if (!valid) {
+        if (error)
+            *error = invalid;
+        return nil;
+    }
+
+    return [[self alloc] initWithFEN:fen
+                               moves:moves
+                           rootMoves:rootMoves
+                               nodes:nodes.unsignedLongLongValue
+                    timeMilliseconds:milliseconds.unsignedLongLongValue];
+}
+
+- (NSInteger)depth {
+    return self.rootMoves.firstObject.depth;
+}
+
+- (NSData*)dataRepresentation {
+    NSMutableArray* rootMoves = [NSMutableArray arrayWithCapacity:self.rootMoves.count];
+    for (SFSearchInfo* info in self.rootMoves)
+        [rootMoves addObject:propertyListFromSearchInfo(info)];
+
+    NSMutableDictionary* plist = [@{
+        @"format": @(kCheckpointFormat),
+        @"moves": self.moves,
+        @"rootMoves": rootMoves,
+        @"nodes": @(self.nodes),
+        @"timeMilliseconds": @(self.timeMilliseconds),
+    } mutableCopy];
+    if (self.fen)
+        plist[@"fen"] = self.fen;
+    return [NSPropertyListSerialization dataWithPropertyList:plist
+                                                      format:NSPropertyListBinaryFormat_v1_0
+                                                     options:0
+                                                       error:nil];
+}
+
+@end
+
+@implementation SFPonderReport
+
+- (instancetype)initWithReplies:(NSArray<NSString*>*)replies
+                    firstDepths:(NSArray<NSNumber*>*)firstDepths
+                         depths:(NSArray<NSNumber*>*)depths
+                          nodes:(NSArray<NSNumber*>*)nodes
+                   milliseconds:(NSArray<NSNumber*>*)milliseconds
+                         slices:(NSUInteger)slices {
+    self = [super init];
+    if (self) {
+        _replies = [replies copy];
+        _firstDepths = [firstDepths copy];
+        _depths = [depths copy];
+        _nodes = [nodes copy];
+        _milliseconds = [milliseconds copy];
+        _slices = slices;
+    }
+    return self;
+}
+
+@end
+
+@implementation SFPosition
+
++ (instancetype)positionWithFEN:(NSString*)fen moves:(NSArray<NSString*>*)moves chess960:(BOOL)chess960 error:(NSError**)error {
+    std::vector<std::string> uciMoves;
+    uciMoves.reserve(moves.count);
+    for (NSString* move in moves)
+        uciMoves.push_back(utf8String(move));
+
+    PositionQuery query;
+    if (auto err = QueryPosition(fen ? utf8String(fen) : std::string(), uciMoves, chess960, query)) {
+        if (error)
+            *error = searchError(SFEngineErrorInvalidPosition, stringFromBytes(*err));
+        return nil;
+    }
+    return [[self alloc] initWithPositionQuery:std::move(query) chess960:chess960];
+}
+
+- (instancetype)initWithPositionQuery:(PositionQuery&&)query chess960:(BOOL)chess960 {
+    self = [super init];
+    if (self) {
+        _fen = stringFromBytes(query.fen);
+        _chess960 = chess960;
+        NSMutableArray<NSString*>* legalMoves = [NSMutableArray arrayWithCapacity:query.legalMoves.size()];
+        for (const auto& move : query.legalMoves)
+            [legalMoves addObject:stringFromBytes(move)];
+        _legalMoves = [legalMoves copy];
+        _status = positionStatusFromQuery(query.status);
+        _zobristKey = query.key;
+    }
+    return self;
+}
+
+- (BOOL)isLegalMove:(NSString*)move {
+    // Stockfish accepts an uppercase promotion piece, as in `position`.
+    return [_legalMoves containsObject:move.lowercaseString];
+}
+
+- (SFPosition*)positionByPlayingMoves:(NSArray<NSString*>*)moves error:(NSError**)error {
+    return [SFPosition positionWithFEN:_fen moves:moves chess960:_chess960 error:error];
+}
+
+@end
+
+@implementation SFEngine {
+    std::shared_ptr<EngineState> _state;
+}
+
++ (BOOL)keepsEngineWarm {
+    return warmEngineRetention.load();
+}
+
++ (void)setKeepsEngineWarm:(BOOL)keepsEngineWarm {
+    std::lock_guard<std::mutex> lock(warmEngineRetentionMutex);
+    warmEngineRetention.store(keepsEngineWarm);
+    SetWarmEngineRetention(keepsEngineWarm);
+    if (keepsEngineWarm)
+        releaseWarmEngineUnderMemoryPressure();
+}
+
++ (BOOL)keepsSearchStateWarm {
+    return warmSearchStateRetention.load();
+}
+
++ (void)setKeepsSearchStateWarm:(BOOL)keepsSearchStateWarm {
+    std::lock_guard<std::mutex> lock(warmEngineRetentionMutex);
+    warmSearchStateRetention.store(keepsSearchStateWarm);
+    SetWarmSearchStateRetention(keepsSearchStateWarm);
+}
+
++ (void)prepareTables {
+    PrepareTables();
+}
+
++ (void)searchFENs:(NSArray<NSString*>*)fens
+            limits:(SFSearchLimits*)limits
+       concurrency:(NSInteger)concurrency
+     resultHandler:(SFBatchSearchResultHandler)resultHandler
+        completion:(dispatch_block_t)completion {
+    std::make_shared<SearchBatch>(fens, limits, resultHandler, completion)->start(concurrency);
+}
+
++ (NSInteger)recommendedMemoryBudgetMegabytes {
+    uint64_t available = 0;
+#if TARGET_OS_IPHONE
+    // The remaining jetsam allowance, which is far below physical memory in
+    // app extensions; zero when the process has no limit.
+    available = os_proc_available_memory();
+#endif
+    if (available == 0)
+        available = NSProcessInfo.processInfo.physicalMemory;
+
+    const NSInteger quarterMB = static_cast<NSInteger>(available / 4 / (1024 * 1024));
+    return std::clamp(quarterMB, kMinimumRecommendedBudgetMB, kMaximumRecommendedBudgetMB);
+}
+
++ (SFResultCacheStatistics*)resultCacheStatistics {
+    return [[SFResultCacheStatistics alloc] initWithResultCacheStats:GetResultCacheStats()];
+}
+
++ (NSInteger)performanceCoreCount {
+    return DetectCoreClasses().performance;
+}
+
++ (NSInteger)efficiencyCoreCount {
+    return DetectCoreClasses().efficiency;
+}
+
+- (instancetype)init {
+    return [self initWithLineHandler:nil searchInfoHandler:nil bestMoveHandler:nil];
+}
+
+- (instancetype)initWithLineHandler:(SFLineHandler)handler {
+    return [self initWithLineHandler:handler searchInfoHandler:nil bestMoveHandler:nil];
+}
+
+- (instancetype)initWithLineBatchHandler:(SFLineBatchHandler)handler policy:(SFLineBatchPolicy)policy {
+    self = [self initWithLineHandler:nil searchInfoHandler:nil bestMoveHandler:nil];
+    if (self)
+        _state->configureLineBatching(handler, policy);
+    return self;
+}
+
+- (instancetype)initWithRecentLineCapacity:(NSUInteger)capacity handler:(SFLineHandler)handler {
+    self = [self initWithLineHandler:handler searchInfoHandler:nil bestMoveHandler:nil];
+    if (self)
+        _state->configureRecentLines(capacity);
+    return self;
+}
+
+- (instancetype)initWithOutputFileDescriptor:(int)fileDescriptor {
+    self = [self initWithLineHandler:nil searchInfoHandler:nil bestMoveHandler:nil];
+    if (self)
+        _state->configureOutputDescriptor(fileDescriptor);
+    return self;
+}
+
+- (instancetype)initWithLineHandler:(SFLineHandler)lineHandler
+                  searchInfoHandler:(SFSearchInfoHandler)searchInfoHandler
+                    bestMoveHandler:(SFBestMoveHandler)bestMoveHandler {
+    self = [super init];
+    if (self)
+        _state = std::make_shared<EngineState>(lineHandler, searchInfoHandler, bestMoveHandler);
     return self;
 }
 
@@ -383,6 +2349,264 @@ class EngineState final: public std::enable_shared_from_this<EngineState> {
         _state->sendCommand(command);
 }
 
+- (void)readCommandsFromFileDescriptor:(int)fileDescriptor {
+    if (_state)
+        _state->readCommands(fileDescriptor);
+}
+
+- (void)sendCommands:(NSArray<NSString*>*)commands {
+    if (_state)
+        _state->sendCommands(commands);
+}
+
+- (void)sendCommandBytes:(const char*)bytes length:(NSUInteger)length {
+    if (_state)
+        _state->sendCommandBytes(bytes, length);
+}
+
+- (void)pushMove:(NSString*)move {
+    [self sendCommand:[@"pushmove " stringByAppendingString:move]];
+}
+
+- (void)popMove {
+    [self sendCommand:@"popmove"];
+}
+
+- (void)searchFEN:(NSString*)fen
+            moves:(NSArray<NSString*>*)moves
+           limits:(SFSearchLimits*)limits
+       completion:(SFSearchCompletion)completion {
+    if (_state)
+        _state->search(fen, moves, limits, nil, nil, completion);
+}
+
+- (void)searchFEN:(NSString*)fen
+                 moves:(NSArray<NSString*>*)moves
+                limits:(SFSearchLimits*)limits
+    provisionalHandler:(SFProvisionalBestMoveHandler)provisionalHandler
+            completion:(SFSearchCompletion)completion {
+    if (_state)
+        _state->search(fen, moves, limits, provisionalHandler, nil, completion);
+}
+
+- (uint64_t)startSearchFEN:(NSString*)fen
+                     moves:(NSArray<NSString*>*)moves
+                    limits:(SFSearchLimits*)limits
+               infoHandler:(SFSearchInfoHandler)infoHandler
+                completion:(SFSearchCompletion)completion {
+    return _state ? _state->search(fen, moves, limits, nil, infoHandler, completion) : 0;
+}
+
+- (void)cancelSearch:(uint64_t)ticket {
+    if (_state)
+        _state->cancelSearch(ticket);
+}
+
+- (uint64_t)resumeAnalysisFromCheckpoint:(SFAnalysisCheckpoint*)checkpoint
+                             infoHandler:(SFSearchInfoHandler)infoHandler
+                              completion:(SFAnalysisCompletion)completion {
+    return _state ? _state->resumeAnalysis(checkpoint, infoHandler, completion) : 0;
+}
+
+- (void)analyzeGameFromFEN:(NSString*)fen
+                     moves:(NSArray<NSString*>*)moves
+                    limits:(SFSearchLimits*)limits
+                 backwards:(BOOL)backwards
+                plyHandler:(SFGameAnalysisPlyHandler)plyHandler
+                completion:(dispatch_block_t)completion {
+    if (_state)
+        _state->analyzeGame(fen, moves, limits, backwards, plyHandler, completion);
+}
+
+- (void)ponderFEN:(NSString*)fen
+                moves:(NSArray<NSString*>*)moves
+              replies:(NSArray<NSString*>*)replies
+    sliceMilliseconds:(NSInteger)sliceMilliseconds
+           completion:(SFPonderCompletion)completion {
+    if (_state)
+        _state->ponder(fen, moves, replies, sliceMilliseconds, completion);
+}
+
+- (void)stopPondering {
+    if (_state)
+        _state->stopPondering();
+}
+
++ (NSData*)packedPositionWithFEN:(NSString*)fen chess960:(BOOL)chess960 error:(NSError**)error {
+    PackedPosition packed;
+    if (auto err = PackPosition(utf8String(fen), chess960, packed)) {
+        if (error)
+            *error = searchError(SFEngineErrorInvalidPosition, stringFromBytes(*err));
+        return nil;
+    }
+    return [NSData dataWithBytes:packed.bytes.data() length:packed.bytes.size()];
+}
+
++ (NSString*)FENWithPackedPosition:(NSData*)packedPosition error:(NSError**)error {
+    PackedPosition packed;
+    std::string fen;
+    std::optional<std::string> err = std::string("A packed position is exactly 32 bytes");
+    if (packedPosition.length == PackedPosition::Size) {
+        [packedPosition getBytes:packed.bytes.data() length:packed.bytes.size()];
+        err = UnpackPosition(packed, fen);
+    }
+    if (err) {
+        if (error)
+            *error = searchError(SFEngineErrorInvalidPosition, stringFromBytes(*err));
+        return nil;
+    }
+    return stringFromBytes(fen);
+}
+
++ (NSData*)openingBookWithGames:(NSArray<NSArray<NSString*>*>*)games maxPly:(NSInteger)maxPly error:(NSError**)error {
+    std::vector<std::vector<std::string>> lines;
+    lines.reserve(games.count);
+    for (NSArray<NSString*>* game in games) {
+        auto& line = lines.emplace_back();
+        for (NSString* move in game)
+            line.push_back(utf8String(move));
+    }
+
+    std::vector<BookEntry> entries;
+    if (auto err = BuildOpeningBook(lines, int(std::clamp<NSInteger>(maxPly, 0, 1024)), entries)) {
+        if (error)
+            *error = searchError(SFEngineErrorInvalidPosition, stringFromBytes(*err));
+        return nil;
+    }
+    return [NSData dataWithBytes:entries.data() length:entries.size() * sizeof(BookEntry)];
+}
+
+- (void)evaluateFENs:(NSArray<NSString*>*)fens completion:(SFEvaluationCompletion)completion {
+    if (!_state)
+        return;
+
+    NativeEvalRequest request;
+    request.fens.reserve(fens.count);
+    for (NSString* fen in fens)
+        request.fens.push_back(utf8String(fen));
+    _state->evaluate(std::move(request), completion);
+}
+
+- (void)evaluatePackedPositions:(NSData*)positions completion:(SFEvaluationCompletion)completion {
+    if (!_state)
+        return;
+
+    if (positions.length % PackedPosition::Size) {
+        NSError* error = searchError(SFEngineErrorInvalidPosition,
+                                     @"Packed positions must be a multiple of 32 bytes");
+        SFEvaluationCompletion handler = [completion copy];
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            handler(nil, error);
+        });
+        return;
+    }
+
+    NativeEvalRequest request;
+    request.packed.resize(positions.length / PackedPosition::Size);
+    [positions getBytes:request.packed.data() length:positions.length];
+    _state->evaluate(std::move(request), completion);
+}
+
+- (void)swapNetworkToFile:(NSString*)path completion:(SFNetworkSwapCompletion)completion {
+    if (!_state)
+        return;
+
+    NetworkSwapRequest request;
+    request.file = utf8String(path);
+    _state->swapNetwork(std::move(request), completion);
+}
+
+- (SFSearchTelemetryHandler)searchTelemetryHandler {
+    return _state ? _state->searchTelemetryHandler() : nil;
+}
+
+- (void)setSearchTelemetryHandler:(SFSearchTelemetryHandler)searchTelemetryHandler {
+    if (_state)
+        _state->setSearchTelemetryHandler(searchTelemetryHandler);
+}
+
+- (NSInteger)memoryPressureHashMegabytes {
+    return _state ? _state->memoryPressureHashMegabytes() : 0;
+}
+
+- (void)setMemoryPressureHashMegabytes:(NSInteger)memoryPressureHashMegabytes {
+    if (_state)
+        _state->setMemoryPressureHashMegabytes(memoryPressureHashMegabytes);
+}
+
+- (BOOL)adaptsThreadsToThermalState {
+    return _state ? _state->adaptsThreadsToThermalState() : NO;
+}
+
+- (void)setAdaptsThreadsToThermalState:(BOOL)adaptsThreadsToThermalState {
+    if (_state)
+        _state->setAdaptsThreadsToThermalState(adaptsThreadsToThermalState);
+}
+
+- (BOOL)calibratesMoveOverhead {
+    return _state ? _state->calibratesMoveOverhead() : NO;
+}
+
+- (void)setCalibratesMoveOverhead:(BOOL)calibratesMoveOverhead {
+    if (_state)
+        _state->setCalibratesMoveOverhead(calibratesMoveOverhead);
+}
+
+- (NSInteger)calibratedMoveOverheadMilliseconds {
+    return _state ? _state->calibratedMoveOverheadMilliseconds() : 0;
+}
+
+- (NSUInteger)deadlineMissCount {
+    return _state ? _state->deadlineMissCount() : 0;
+}
+
+- (NSInteger)concurrentEvaluationThreads {
+    return _state ? _state->concurrentEvaluationThreads() : 0;
+}
+
+- (void)setConcurrentEvaluationThreads:(NSInteger)concurrentEvaluationThreads {
+    if (_state)
+        _state->setConcurrentEvaluationThreads(concurrentEvaluationThreads);
+}
+
+- (NSQualityOfService)searchQualityOfService {
+    return _state ? _state->qualityOfService() : NSQualityOfServiceDefault;
+}
+
+- (void)setSearchQualityOfService:(NSQualityOfService)searchQualityOfService {
+    if (_state)
+        _state->setQualityOfService(searchQualityOfService);
+}
+
+- (void)limitHashToMegabytes:(NSInteger)megabytes {
+    if (_state)
+        _state->limitHash(megabytes);
+}
+
+- (SFHashStatistics*)lastHashStatistics {
+    return _state ? _state->lastHashStatistics() : nil;
+}
+
+- (NSArray<SFSearchInfo*>*)lastRootMoves {
+    return _state ? _state->lastRootMoves() : nil;
+}
+
+- (SFStartupTiming*)startupTiming {
+    return _state ? _state->startupTiming() : nil;
+}
+
+- (NSArray<NSString*>*)recentLines {
+    return _state ? _state->recentLines() : @[];
+}
+
+- (SFMemoryFootprint*)memoryFootprint {
+    return _state ? _state->memoryFootprint() : nil;
+}
+
+- (double)lastHashResetMilliseconds {
+    return _state ? _state->lastHashResetMilliseconds() : 0;
+}
+
 - (void)stop {
     if (_state)
         _state->stop();
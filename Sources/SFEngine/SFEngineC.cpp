@@ -0,0 +1,450 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+#include "SFEngineC.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "CommandStream.hpp"
+#include "CommandValidation.hpp"
+#include "EmbeddedUCI.hpp"
+#include "FileDescriptorStream.hpp"
+#include "LineBufferStream.hpp"
+#include "SPSCQueue.hpp"
+
+using namespace SFEmbedded;
+
+namespace {
+
+// Pushes are serialized by lifecycleMutex_, as in SFEngine.
+constexpr std::size_t CommandQueueCapacity = 1024;
+using CommandQueue                         = SPSCQueue<std::string, CommandQueueCapacity>;
+
+enum class Lifecycle {
+    idle,
+    running,
+    stopped,
+};
+
+template<typename T>
+T non_negative(T value) {
+    return std::max(value, T(0));
+}
+
+sf_search_info to_c_info(const SearchInfo& info) {
+    sf_search_info out{};
+    out.depth       = info.depth;
+    out.sel_depth   = info.selDepth;
+    out.multipv     = info.multiPV;
+    out.score_kind  = info.scoreKind == SearchInfo::ScoreKind::mate ? SF_SCORE_MATE : SF_SCORE_CENTIPAWNS;
+    out.score_value = info.scoreValue;
+    out.bound       = info.bound == SearchInfo::Bound::lower ? SF_BOUND_LOWER
+                    : info.bound == SearchInfo::Bound::upper ? SF_BOUND_UPPER
+                                                             : SF_BOUND_EXACT;
+    out.has_wdl     = info.hasWDL;
+    out.wdl_win     = info.wdlWin;
+    out.wdl_draw    = info.wdlDraw;
+    out.wdl_loss    = info.wdlLoss;
+    out.nodes       = info.nodes;
+    out.nps         = info.nps;
+    out.hashfull    = info.hashfull;
+    out.tb_hits     = info.tbHits;
+    out.time_ms     = info.timeMs;
+    out.pv          = info.pv.data();
+    out.pv_length   = info.pv.size();
+    out.line_id     = info.lineID;
+    return out;
+}
+
+// Same mapping as SFEngine's search errors.
+sf_search_status to_c_status(NativeSearchResult::Status status) {
+    switch (status)
+    {
+    case NativeSearchResult::Status::completed :
+        return SF_SEARCH_COMPLETED;
+    case NativeSearchResult::Status::rejected :
+        return SF_SEARCH_INVALID_POSITION;
+    case NativeSearchResult::Status::invalidLimits :
+        return SF_SEARCH_INVALID_LIMITS;
+    case NativeSearchResult::Status::cancelled :
+        return SF_SEARCH_STOPPED;
+    case NativeSearchResult::Status::withdrawn :
+        return SF_SEARCH_CANCELLED;
+    }
+    return SF_SEARCH_STOPPED;
+}
+
+}  // namespace
+
+// The C counterpart of SFEngine's EngineState, without its callback queue,
+// batch and ponder searches, and Apple power or memory-pressure handling.
+struct sf_engine {
+    sf_engine(sf_line_handler handler, void* context) :
+        callbacks_{context, handler, nullptr, nullptr} {}
+
+    explicit sf_engine(int fd) :
+        descriptorOutput_(std::make_unique<FileDescriptorStreambuf>(fd)) {}
+
+    ~sf_engine() { stop(); }
+
+    void start() {
+        std::lock_guard<std::mutex> lock(lifecycleMutex_);
+        if (lifecycle_ != Lifecycle::idle)
+            return;
+
+        lifecycle_    = Lifecycle::running;
+        engineThread_ = std::thread([this] { run(); });
+    }
+
+    void set_callbacks(const sf_callbacks* callbacks) {
+        std::lock_guard<std::recursive_mutex> lock(handlerMutex_);
+        callbacks_ = callbacks ? *callbacks : sf_callbacks{};
+    }
+
+    sf_send_status send_commands(const char* buffer, std::size_t length) {
+        std::vector<std::string> lines;
+        std::string              rejectionReason;
+        auto                     validation =
+          validateCommandBuffer(std::string_view(buffer, buffer ? length : 0), lines, rejectionReason);
+
+        // A batch the queue cannot hold at once would wait for room while
+        // holding lifecycleMutex_, which a line handler calling sf_engine_send
+        // on the engine thread needs before that thread can drain the queue.
+        if (validation == CommandValidation::accepted && lines.size() > CommandQueueCapacity)
+        {
+            validation      = CommandValidation::rejected;
+            rejectionReason = "a batch of " + std::to_string(lines.size())
+                            + " commands exceeds the command queue's "
+                            + std::to_string(CommandQueueCapacity);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ != Lifecycle::running)
+                return SF_SEND_NOT_RUNNING;
+
+            switch (validation)
+            {
+            case CommandValidation::accepted :
+                for (const auto& line : lines)
+                    route_priority_command_locked(line);
+                commandQueue_.push_all(lines.begin(), lines.end());
+                return SF_SEND_QUEUED;
+            case CommandValidation::ignored :
+                return SF_SEND_IGNORED;
+            case CommandValidation::rejected :
+                break;
+            }
+        }
+
+        deliver("info string StockfishEmbedded error: " + rejectionReason);
+        return SF_SEND_REJECTED;
+    }
+
+    sf_send_status send(const char* command) {
+        std::string line(command ? command : "");
+        std::string rejectionReason;
+
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ != Lifecycle::running)
+                return SF_SEND_NOT_RUNNING;
+
+            switch (validateCommandLine(line, rejectionReason))
+            {
+            case CommandValidation::accepted :
+                queue_command_locked(std::move(line));
+                return SF_SEND_QUEUED;
+            case CommandValidation::ignored :
+                return SF_SEND_IGNORED;
+            case CommandValidation::rejected :
+                break;
+            }
+        }
+
+        deliver("info string StockfishEmbedded error: " + rejectionReason);
+        return SF_SEND_REJECTED;
+    }
+
+    std::uint64_t search(const char*             fen,
+                         const char* const*      moves,
+                         std::size_t             moveCount,
+                         const sf_search_limits* limits,
+                         sf_info_handler         progress,
+                         sf_search_completion    completion,
+                         void*                   context) {
+        NativeSearchRequest request;
+        request.fen = fen ? fen : "";
+        for (std::size_t i = 0; i < moveCount; ++i)
+            request.moves.emplace_back(moves[i] ? moves[i] : "");
+        if (limits)
+        {
+            request.depth         = non_negative(limits->depth);
+            request.nodes         = limits->nodes;
+            request.movetime      = non_negative(limits->movetime_ms);
+            request.mate          = non_negative(limits->mate);
+            request.time[0]       = non_negative(limits->time_ms[0]);
+            request.time[1]       = non_negative(limits->time_ms[1]);
+            request.inc[0]        = non_negative(limits->inc_ms[0]);
+            request.inc[1]        = non_negative(limits->inc_ms[1]);
+            request.movestogo     = non_negative(limits->movestogo);
+            request.deterministic = limits->deterministic != 0;
+            if (limits->deadline_us)
+            {
+                request.deadline          = std::chrono::steady_clock::time_point(
+                  std::chrono::microseconds(limits->deadline_us));
+                request.deadlineReserveUs = deliveryLatency_.peak();
+            }
+        }
+        if (progress)
+            request.progress = [this, progress, context](const SearchInfo& info) {
+                const sf_search_info cInfo = to_c_info(info);
+                std::lock_guard<std::recursive_mutex> lock(handlerMutex_);
+                progress(context, &cInfo);
+            };
+        request.completion = [this, completion, context,
+                              deadline = request.deadline](const NativeSearchResult& result) {
+            sf_search_result cResult{};
+            cResult.status          = to_c_status(result.status);
+            cResult.error           = result.error.data();
+            cResult.error_length    = result.error.size();
+            cResult.bestmove        = result.bestmove.data();
+            cResult.bestmove_length = result.bestmove.size();
+            cResult.ponder          = result.ponder.data();
+            cResult.ponder_length   = result.ponder.size();
+            cResult.has_info        = result.hasInfo;
+            if (result.hasInfo)
+                cResult.info = to_c_info(result.info);
+            cResult.queued_us = result.queuedUs;
+            cResult.search_us = result.searchUs;
+            cResult.cached    = result.cached;
+
+            const auto                            waiting = std::chrono::steady_clock::now();
+            std::lock_guard<std::recursive_mutex> lock(handlerMutex_);
+            if (result.status == NativeSearchResult::Status::completed
+                && deadline != std::chrono::steady_clock::time_point{})
+            {
+                const auto delivered = std::chrono::steady_clock::now();
+                deliveryLatency_.record(
+                  std::chrono::duration_cast<std::chrono::microseconds>(delivered - waiting).count());
+                cResult.deadline_missed = result.deadlineMissed || delivered > deadline;
+            }
+            if (completion)
+                completion(context, &cResult);
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ == Lifecycle::running)
+            {
+                const std::uint64_t ticket = sessionControl_.submit_search(std::move(request));
+                commandQueue_.push(NativeSearchCommand());
+                return ticket;
+            }
+        }
+
+        static constexpr std::string_view notRunning = "The engine is not running";
+        sf_search_result                  cResult{};
+        cResult.status       = SF_SEARCH_NOT_RUNNING;
+        cResult.error        = notRunning.data();
+        cResult.error_length = notRunning.size();
+        std::lock_guard<std::recursive_mutex> lock(handlerMutex_);
+        if (completion)
+            completion(context, &cResult);
+        return 0;
+    }
+
+    // A withdrawn request completes here; a running one through the session.
+    void cancel_search(std::uint64_t ticket) {
+        if (ticket == 0)
+            return;
+
+        if (auto request = sessionControl_.cancel_search(ticket))
+        {
+            NativeSearchResult withdrawn;
+            withdrawn.status = NativeSearchResult::Status::withdrawn;
+            withdrawn.error  = "The search was cancelled before it started";
+            request->completion(withdrawn);
+        }
+    }
+
+    // Searches still queued are withdrawn first: each one would wait for the
+    // search before it, and so keep the queued `stop` from reaching a search
+    // that started after sessionControl_.stop().
+    void stop() {
+        std::deque<NativeSearchRequest> pending;
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            if (lifecycle_ == Lifecycle::running)
+            {
+                pending = sessionControl_.take_all_searches();
+                sessionControl_.stop();
+                commandQueue_.push("stop");
+                commandQueue_.push("quit");
+            }
+            lifecycle_ = Lifecycle::stopped;
+            commandQueue_.close();
+        }
+
+        complete_cancelled(pending);
+        if (engineThread_.joinable())
+            engineThread_.join();
+    }
+
+   private:
+    void run() {
+        LineBufferStreambuf lineOutput([this](const std::string& line) { deliver(line); });
+        CommandStreambuf    inputBuffer(commandQueue_);
+        std::istream        input(&inputBuffer);
+        std::ostream        output(descriptorOutput_ ? static_cast<std::streambuf*>(descriptorOutput_.get())
+                                                     : &lineOutput);
+
+        SessionHooks hooks;
+        hooks.onSearchInfo = [this](const SearchInfo& info) {
+            std::lock_guard<std::recursive_mutex> lock(handlerMutex_);
+            if (callbacks_.info)
+            {
+                const sf_search_info cInfo = to_c_info(info);
+                callbacks_.info(callbacks_.context, &cInfo);
+            }
+        };
+        hooks.onBestmove = [this](std::string_view bestmove, std::string_view ponder) {
+            std::lock_guard<std::recursive_mutex> lock(handlerMutex_);
+            if (callbacks_.bestmove)
+                callbacks_.bestmove(callbacks_.context, bestmove.data(), bestmove.size(), ponder.data(),
+                                    ponder.size());
+        };
+
+        RunStockfishUCI(input, output, std::move(hooks), &sessionControl_);
+        output.flush();
+
+        // After `quit`, sends report SF_SEND_NOT_RUNNING and searches
+        // SF_SEARCH_NOT_RUNNING, so the pending ones below are the last.
+        {
+            std::lock_guard<std::mutex> lock(lifecycleMutex_);
+            lifecycle_ = Lifecycle::stopped;
+            commandQueue_.close();
+        }
+
+        complete_cancelled(sessionControl_.take_all_searches());
+    }
+
+    static void complete_cancelled(const std::deque<NativeSearchRequest>& requests) {
+        NativeSearchResult cancelled;
+        cancelled.status = NativeSearchResult::Status::cancelled;
+        cancelled.error  = "The engine stopped before the search started";
+        for (const auto& request : requests)
+            request.completion(cancelled);
+    }
+
+    // The queued copy of stop/ponderhit keeps their order relative to a `go`
+    // that has not started yet; the out-of-band one reaches a running search.
+    void queue_command_locked(std::string&& command) {
+        route_priority_command_locked(command);
+        commandQueue_.push(std::move(command));
+    }
+
+    void route_priority_command_locked(const std::string& command) {
+        switch (priorityCommandFor(command))
+        {
+        case PriorityCommand::stop :
+            sessionControl_.stop();
+            break;
+        case PriorityCommand::ponderhit :
+            sessionControl_.ponderhit();
+            break;
+        case PriorityCommand::none :
+            break;
+        }
+    }
+
+    // Engine output, typed updates, search results and rejected-command
+    // reports from sending threads go through one lock, so the listeners see
+    // one at a time. It is recursive for a listener that sends a rejected
+    // command or a search itself.
+    void deliver(const std::string& line) {
+        if (descriptorOutput_)
+        {
+            descriptorOutput_->write_line(line);
+            return;
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(handlerMutex_);
+        if (callbacks_.line)
+            callbacks_.line(callbacks_.context, line.c_str(), line.size());
+    }
+
+    sf_callbacks                             callbacks_{};  // Guarded by handlerMutex_
+    std::unique_ptr<FileDescriptorStreambuf> descriptorOutput_;
+    std::recursive_mutex                     handlerMutex_;
+    LatencyPeak                              deliveryLatency_;  // Waits for handlerMutex_ before deadline completions
+    std::mutex                               lifecycleMutex_;
+    Lifecycle                                lifecycle_ = Lifecycle::idle;
+    CommandQueue                             commandQueue_;
+    SessionControl                           sessionControl_;
+    std::thread                              engineThread_;
+};
+
+extern "C" {
+
+void sf_prepare_tables(void) { PrepareTables(); }
+
+uint64_t sf_monotonic_us(void) {
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch())
+                           .count());
+}
+
+sf_engine* sf_engine_create(sf_line_handler handler, void* context) {
+    return new (std::nothrow) sf_engine(handler, context);
+}
+
+sf_engine* sf_engine_create_with_output_fd(int fd) { return new (std::nothrow) sf_engine(fd); }
+
+void sf_engine_set_callback(sf_engine* engine, const sf_callbacks* callbacks) { engine->set_callbacks(callbacks); }
+
+void sf_engine_start(sf_engine* engine) { engine->start(); }
+
+sf_send_status sf_engine_send(sf_engine* engine, const char* command) { return engine->send(command); }
+
+sf_send_status sf_engine_send_commands(sf_engine* engine, const char* buffer, size_t length) {
+    return engine->send_commands(buffer, length);
+}
+
+uint64_t sf_engine_search(sf_engine*              engine,
+                          const char*             fen,
+                          const char* const*      moves,
+                          size_t                  move_count,
+                          const sf_search_limits* limits,
+                          sf_info_handler         progress,
+                          sf_search_completion    completion,
+                          void*                   context) {
+    return engine->search(fen, moves, move_count, limits, progress, completion, context);
+}
+
+void sf_engine_cancel_search(sf_engine* engine, uint64_t ticket) { engine->cancel_search(ticket); }
+
+void sf_engine_stop(sf_engine* engine) { engine->stop(); }
+
+void sf_engine_destroy(sf_engine* engine) { delete engine; }
+
+}  // extern "C"
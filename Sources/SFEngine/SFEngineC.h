@@ -0,0 +1,235 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+// C API for the embedded engine, for hosts without Objective-C such as the
+// Linux build (Scripts/build-linux.sh) or FFI callers of the Apple static
+// libraries. It covers SFEngine's line interface (start, UCI commands in,
+// output lines out, stop), its typed search updates, and native searches.
+// Strings cross as pointer and length, structs as plain C structs.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sf_engine sf_engine;
+
+/// Receives one output line without its newline; `line` is NUL-terminated and
+/// only valid during the call. Lines arrive one at a time and in order, on
+/// the engine's own threads, so keep the handler short. It may call
+/// `sf_engine_send`, but not `sf_engine_stop` or `sf_engine_destroy`.
+typedef void (*sf_line_handler)(void *context, const char *line, size_t length);
+
+typedef enum sf_score_kind {
+    SF_SCORE_CENTIPAWNS = 0,
+    SF_SCORE_MATE       = 1,
+} sf_score_kind;
+
+typedef enum sf_score_bound {
+    SF_BOUND_EXACT = 0,
+    SF_BOUND_LOWER = 1,
+    SF_BOUND_UPPER = 2,
+} sf_score_bound;
+
+/// One `info ... pv ...` update, as in SFSearchInfo. `pv` is the
+/// space-separated UCI move list. It is not NUL-terminated and is only valid
+/// during the call.
+typedef struct sf_search_info {
+    int            depth;
+    int            sel_depth;
+    size_t         multipv;
+    sf_score_kind  score_kind;
+    int            score_value;
+    sf_score_bound bound;
+    int            has_wdl;
+    int            wdl_win;
+    int            wdl_draw;
+    int            wdl_loss;
+    uint64_t       nodes;
+    uint64_t       nps;
+    int            hashfull;
+    uint64_t       tb_hits;
+    uint64_t       time_ms;
+    const char    *pv;
+    size_t         pv_length;
+    /// Stays with the PV's root move for the whole search; 0 without a PV.
+    uint32_t line_id;
+} sf_search_info;
+
+typedef void (*sf_info_handler)(void *context, const sf_search_info *info);
+
+/// `ponder` is empty, with `ponder_length` 0, when the engine has none.
+/// Neither string is NUL-terminated.
+typedef void (*sf_bestmove_handler)(void *context,
+                                    const char *bestmove,
+                                    size_t      bestmove_length,
+                                    const char *ponder,
+                                    size_t      ponder_length);
+
+/// The listeners of an engine. Any of them may be NULL. They all run under
+/// one lock, one at a time and in output order, with the same rules as
+/// `sf_line_handler`.
+typedef struct sf_callbacks {
+    void               *context;
+    sf_line_handler     line;
+    sf_info_handler     info;
+    sf_bestmove_handler bestmove;
+} sf_callbacks;
+
+typedef enum sf_send_status {
+    /// The command was queued for the engine.
+    SF_SEND_QUEUED = 0,
+    /// An empty command, which is dropped.
+    SF_SEND_IGNORED = 1,
+    /// Longer than 1 MiB, more than one line, a NUL byte, or `Debug Log File`.
+    /// The reason is also delivered as an
+    /// `info string StockfishEmbedded error: ...` line.
+    SF_SEND_REJECTED = 2,
+    /// The engine has not started, or has stopped or quit.
+    SF_SEND_NOT_RUNNING = 3,
+} sf_send_status;
+
+/// Builds the process-wide bitboard, attack, and position tables unless an
+/// engine already has, as `+[SFEngine prepareTables]` does. Blocks until
+/// they are ready; call it early on a thread of your own.
+void sf_prepare_tables(void);
+
+/// Microseconds on the steady clock that `sf_search_limits.deadline_us`
+/// uses, e.g. `sf_monotonic_us() + 250000` for 250 ms from now.
+uint64_t sf_monotonic_us(void);
+
+/// A new engine that delivers its output to `handler`. Returns NULL only if
+/// allocation fails.
+sf_engine *sf_engine_create(sf_line_handler handler, void *context);
+
+/// A new engine that writes its output, one line at a time, to `fd`, which
+/// stays owned by the caller and must stay open until `sf_engine_stop`.
+sf_engine *sf_engine_create_with_output_fd(int fd);
+
+/// Replaces all listeners at once; NULL removes them. Takes effect from the
+/// next line. With an output descriptor, lines keep going to the descriptor
+/// and `line` is not called.
+void sf_engine_set_callback(sf_engine *engine, const sf_callbacks *callbacks);
+
+/// Starts the engine on a thread of its own. Like SFEngine, an engine starts
+/// at most once; later calls do nothing.
+void sf_engine_start(sf_engine *engine);
+
+/// Queues one UCI command, with or without a trailing LF or CRLF. Safe from
+/// any thread. `stop` and `ponderhit` also reach a running search at once,
+/// ahead of commands still queued.
+sf_send_status sf_engine_send(sf_engine *engine, const char *command);
+
+/// Queues every LF- or CRLF-separated line of `buffer`, which need not end
+/// in a NUL, as one unit: all lines are checked as `sf_engine_send` checks
+/// one before any is queued, and they are queued together, so no other
+/// thread's command lands between them. Empty lines are skipped. Returns
+/// SF_SEND_REJECTED, queueing nothing, if any line is rejected or there are
+/// more than 1024, the command queue's capacity; the error line names the
+/// 1-based line. SF_SEND_IGNORED means no commands.
+sf_send_status sf_engine_send_commands(sf_engine *engine, const char *buffer, size_t length);
+
+/// Limits of a native search, as in SFSearchLimits. Zero leaves a limit
+/// unset, negative values count as zero, and with no limit at all the search
+/// runs until stopped. Index 0 of `time_ms` and `inc_ms` is white's.
+typedef struct sf_search_limits {
+    int      depth;
+    uint64_t nodes;
+    int64_t  movetime_ms;
+    int      mate;
+    int64_t  time_ms[2];
+    int64_t  inc_ms[2];
+    int      movestogo;
+    /// Starts from a cleared hash and histories and accepts only depth,
+    /// nodes, and mate limits with `Threads` 1, as `deterministic` does.
+    int deterministic;
+    /// When nonzero, the `sf_monotonic_us` time by which `completion` should
+    /// run. The search gets what is left once the searches ahead of it are
+    /// done, less the measured latency of stopping and of taking the
+    /// listeners' lock, and always completes with a move, the best found so
+    /// far. Caps `movetime_ms`; other limits still apply.
+    uint64_t deadline_us;
+} sf_search_limits;
+
+typedef enum sf_search_status {
+    SF_SEARCH_COMPLETED = 0,
+    /// The FEN or a move was invalid; the search never started.
+    SF_SEARCH_INVALID_POSITION = 1,
+    /// A deterministic search was given a clock or several threads.
+    SF_SEARCH_INVALID_LIMITS = 2,
+    /// The session ended before the search could finish.
+    SF_SEARCH_STOPPED = 3,
+    /// `sf_engine_cancel_search` withdrew the search before it started.
+    SF_SEARCH_CANCELLED = 4,
+    /// The engine has not started, or has stopped or quit.
+    SF_SEARCH_NOT_RUNNING = 5,
+} sf_search_status;
+
+/// Outcome of `sf_engine_search`, as in SFSearchResult. The strings are not
+/// NUL-terminated and, like `info.pv`, are only valid during the call.
+/// `error` is empty for a completed search and `bestmove` for any other.
+typedef struct sf_search_result {
+    sf_search_status status;
+    const char      *error;
+    size_t           error_length;
+    const char      *bestmove;
+    size_t           bestmove_length;
+    const char      *ponder;
+    size_t           ponder_length;
+    /// The last multipv-1 update, when the search made one.
+    int            has_info;
+    sf_search_info info;
+    /// From submission until the search started, and from then until bestmove.
+    uint64_t queued_us;
+    uint64_t search_us;
+    /// Served by the result cache without searching.
+    int cached;
+    /// The search had a deadline and `completion` runs after it.
+    int deadline_missed;
+} sf_search_result;
+
+typedef void (*sf_search_completion)(void *context, const sf_search_result *result);
+
+/// Searches `fen` (NULL or empty for the start position) after `moves`
+/// without UCI text. The search keeps its place among the commands sent
+/// before and after it. `progress`, which may be NULL, gets every multipv-1
+/// update, and `completion` runs exactly once; both run under the listeners'
+/// lock and receive `context`. Returns the ticket for
+/// `sf_engine_cancel_search`, or 0 when the engine is not running, in which
+/// case `completion` has already run, with SF_SEARCH_NOT_RUNNING, on the
+/// calling thread.
+uint64_t sf_engine_search(sf_engine              *engine,
+                          const char             *fen,
+                          const char *const      *moves,
+                          size_t                  move_count,
+                          const sf_search_limits *limits,
+                          sf_info_handler         progress,
+                          sf_search_completion    completion,
+                          void                   *context);
+
+/// Withdraws a queued search, which completes with SF_SEARCH_CANCELLED, or
+/// stops a running one, which completes with the move found so far. Does
+/// nothing for a finished search or a ticket of 0.
+void sf_engine_cancel_search(sf_engine *engine, uint64_t ticket);
+
+/// Stops the search, ends the session and waits for its threads. Terminal:
+/// the engine cannot be started again. Safe to call more than once.
+void sf_engine_stop(sf_engine *engine);
+
+/// Stops the engine if needed and frees it.
+void sf_engine_destroy(sf_engine *engine);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,154 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+// Bounded single-producer/single-consumer ring buffer for passing commands between threads.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace SFEmbedded {
+
+// Drop-in alternative to ThreadSafeQueue for exactly one pushing thread (or
+// pushes serialized by the caller) and one popping thread.
+// - push()/pop() hand slots over with acquire/release indices; no per-item
+//   allocation and no lock while both sides keep up.
+// - A side that finds the ring empty (pop) or full (push) spins briefly, then
+//   falls back to a condition-variable wait, so idle engines do not burn CPU.
+// - close() unblocks waiters and prevents future pushes; pop() returns false
+//   when closed and empty (used as an EOF signal).
+template<typename T, std::size_t Capacity>
+class SPSCQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SPSCQueue capacity must be a power of two");
+
+   public:
+    // Enqueue a value, waiting while the ring is full. No-op after close().
+    void push(T value) {
+        if (closed_.load(std::memory_order_acquire))
+            return;
+
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+
+        if (!wait_until([&] { return tail - head_.load(std::memory_order_acquire) < Capacity; },
+                        producerWaiting_))
+            return;
+
+        slots_[tail & (Capacity - 1)] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        wake(consumerWaiting_);
+    }
+
+    // Enqueues [first, last) in order, publishing each run of free slots with
+    // one index update and at most one wake-up. Waits while the ring is full,
+    // so a range larger than Capacity goes out in several runs. No-op after
+    // close(), including for the rest of a range that was waiting for room.
+    template<typename It>
+    void push_all(It first, It last) {
+        while (first != last) {
+            if (closed_.load(std::memory_order_acquire))
+                return;
+
+            std::size_t tail = tail_.load(std::memory_order_relaxed);
+            std::size_t room = 0;
+            const auto free = [&] {
+                room = Capacity - (tail - head_.load(std::memory_order_acquire));
+                return room > 0;
+            };
+            if (!wait_until(free, producerWaiting_))
+                return;
+
+            for (; room > 0 && first != last; --room, ++first, ++tail)
+                slots_[tail & (Capacity - 1)] = std::move(*first);
+            tail_.store(tail, std::memory_order_release);
+            wake(consumerWaiting_);
+        }
+    }
+
+    // Blocks until an item is available or the queue is closed.
+    // Returns false if the queue is closed and empty.
+    bool pop(T& out) {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+
+        const auto available = [&] { return tail_.load(std::memory_order_acquire) != head; };
+        wait_until(available, consumerWaiting_);
+        if (!available())
+            return false;
+
+        out = std::move(slots_[head & (Capacity - 1)]);
+        head_.store(head + 1, std::memory_order_release);
+        wake(producerWaiting_);
+        return true;
+    }
+
+    // Close the queue: future pops will return false once drained.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_.store(true, std::memory_order_seq_cst);
+        }
+        cv_.notify_all();
+    }
+
+    // Query closed state (thread-safe).
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+   private:
+    static constexpr int kSpinIterations = 64;
+
+    // Waits for `ready` or close(). Returns false if the queue closed first.
+    template<typename Ready>
+    bool wait_until(const Ready& ready, std::atomic<bool>& waiting) {
+        for (int spin = 0; spin < kSpinIterations; ++spin) {
+            if (ready())
+                return true;
+            if (closed_.load(std::memory_order_acquire))
+                return false;
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        // Publishing `waiting` before re-checking pairs with the fence in wake():
+        // either this thread sees the other side's update, or it sees `waiting`.
+        waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv_.wait(lock, [&] { return ready() || closed_.load(std::memory_order_seq_cst); });
+        waiting.store(false, std::memory_order_relaxed);
+        return ready();
+    }
+
+    void wake(std::atomic<bool>& waiting) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!waiting.load(std::memory_order_relaxed))
+            return;
+
+        // Taking the mutex orders the notification after the waiter's predicate check.
+        { std::lock_guard<std::mutex> lock(mutex_); }
+        cv_.notify_all();
+    }
+
+    // Producer- and consumer-owned indices live on separate cache lines.
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    alignas(64) std::atomic<bool> consumerWaiting_{false};
+    std::atomic<bool>             producerWaiting_{false};
+    std::atomic<bool>             closed_{false};
+    std::mutex                    mutex_;
+    std::condition_variable       cv_;
+    std::array<T, Capacity>       slots_;
+};
+
+}  // namespace SFEmbedded
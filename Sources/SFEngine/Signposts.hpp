@@ -0,0 +1,58 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+// os_signpost points of interest for Instruments, off unless the build
+// defines SFENGINE_SIGNPOSTS=1. Disabled, or on other platforms, every macro
+// expands to nothing and its arguments are never evaluated.
+//
+// Names must be string literals, as must the optional os_log format that
+// follows them. An interval's `key` is any pointer that tells concurrent
+// intervals of the same name apart, usually the session or engine.
+
+#pragma once
+
+#ifndef SFENGINE_SIGNPOSTS
+    #define SFENGINE_SIGNPOSTS 0
+#endif
+
+#if SFENGINE_SIGNPOSTS && defined(__APPLE__)
+
+    #include <os/signpost.h>
+
+namespace SFEmbedded {
+
+// Points of Interest shows next to the Time Profiler and SwiftUI tracks, so
+// engine activity lines up with the host's own hitches.
+inline os_log_t signpost_log() {
+    static const os_log_t log =
+      os_log_create("com.stockfishembedded.SFEngine", OS_LOG_CATEGORY_POINTS_OF_INTEREST);
+    return log;
+}
+
+}  // namespace SFEmbedded
+
+    #define SF_SIGNPOST_EVENT(name, ...) \
+        os_signpost_event_emit(SFEmbedded::signpost_log(), OS_SIGNPOST_ID_EXCLUSIVE, name, ##__VA_ARGS__)
+    #define SF_SIGNPOST_BEGIN(name, key, ...) \
+        os_signpost_interval_begin(SFEmbedded::signpost_log(), \
+                                   os_signpost_id_make_with_pointer(SFEmbedded::signpost_log(), key), \
+                                   name, ##__VA_ARGS__)
+    #define SF_SIGNPOST_END(name, key, ...) \
+        os_signpost_interval_end(SFEmbedded::signpost_log(), \
+                                 os_signpost_id_make_with_pointer(SFEmbedded::signpost_log(), key), \
+                                 name, ##__VA_ARGS__)
+
+#else
+
+    #define SF_SIGNPOST_EVENT(name, ...) ((void) 0)
+    #define SF_SIGNPOST_BEGIN(name, key, ...) ((void) 0)
+    #define SF_SIGNPOST_END(name, key, ...) ((void) 0)
+
+#endif
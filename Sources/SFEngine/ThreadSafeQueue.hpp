@@ -37,6 +37,20 @@ class ThreadSafeQueue {
         cv_.notify_one();
     }
 
+    // Enqueues [first, last) in order with one lock and one notification.
+    // No-op after close().
+    template<typename It>
+    void push_all(It first, It last) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_)
+                return;
+            for (; first != last; ++first)
+                queue_.push_back(std::move(*first));
+        }
+        cv_.notify_one();
+    }
+
     // Blocks until an item is available or the queue is closed.
     // Returns false if the queue is closed and empty.
     bool pop(T& out) {
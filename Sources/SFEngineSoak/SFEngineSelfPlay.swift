@@ -0,0 +1,604 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+import Foundation
+
+// MARK: - Self-play
+
+extension SFEngineSoakRunner {
+    /// Configuration for `runSelfPlay(_:gameHandler:)`.
+    ///
+    /// Required:
+    /// - `openings`: non-empty list of start positions. Consecutive games share
+    ///   an opening with colours swapped, so each opening is played by both
+    ///   engines as White.
+    ///
+    /// Optional (defaults shown):
+    /// - `searchLimit`: `.nodes(10_000)` per move
+    /// - `games`: `nil` (two per opening)
+    /// - `slots`: 2 (games played at once, each on its own pair of `SFEngine`s)
+    /// - `maxPlies`: 400 (a longer game ends unfinished, `*`)
+    /// - `resignScore`, `resignPlies`: 1000 cp for 6 plies in a row, both
+    ///   engines agreeing on the side that is winning
+    /// - `drawScore`, `drawPlies`, `drawMinPly`: within 10 cp for 12 plies in a
+    ///   row, once 80 plies have been played
+    /// - `tablebasePieces`: `nil` (no tablebase adjudication; otherwise a
+    ///   position with at most this many pieces is adjudicated from the
+    ///   engine's tablebase score once it reports tablebase hits, which needs
+    ///   `SyzygyPath` in `engineOptions`)
+    /// - `chess960`: `false`
+    /// - `engineOptions`: `[]` (UCI commands sent to both engines)
+    /// - `secondEngineOptions`: `[]` (sent to the second engine after
+    ///   `engineOptions`, e.g. to measure an option change)
+    /// - `perMoveTimeout`: 30s
+    public struct SelfPlayConfiguration: Equatable, Sendable {
+        public var openings: [PositionSpec]
+        public var searchLimit: SearchLimit
+        public var games: Int?
+        public var slots: Int
+        public var maxPlies: Int
+        public var resignScore: Int
+        public var resignPlies: Int
+        public var drawScore: Int
+        public var drawPlies: Int
+        public var drawMinPly: Int
+        public var tablebasePieces: Int?
+        public var chess960: Bool
+        public var engineOptions: [String]
+        public var secondEngineOptions: [String]
+        public var perMoveTimeout: Duration
+
+        public init(
+            openings: [PositionSpec],
+            searchLimit: SearchLimit = .nodes(10_000),
+            games: Int? = nil,
+            slots: Int = 2,
+            maxPlies: Int = 400,
+            resignScore: Int = 1000,
+            resignPlies: Int = 6,
+            drawScore: Int = 10,
+            drawPlies: Int = 12,
+            drawMinPly: Int = 80,
+            tablebasePieces: Int? = nil,
+            chess960: Bool = false,
+            engineOptions: [String] = [],
+            secondEngineOptions: [String] = [],
+            perMoveTimeout: Duration = .seconds(30)
+        ) {
+            self.openings = openings
+            self.searchLimit = searchLimit
+            self.games = games
+            self.slots = slots
+            self.maxPlies = maxPlies
+            self.resignScore = resignScore
+            self.resignPlies = resignPlies
+            self.drawScore = drawScore
+            self.drawPlies = drawPlies
+            self.drawMinPly = drawMinPly
+            self.tablebasePieces = tablebasePieces
+            self.chess960 = chess960
+            self.engineOptions = engineOptions
+            self.secondEngineOptions = secondEngineOptions
+            self.perMoveTimeout = perMoveTimeout
+        }
+
+        var validationError: String? {
+            guard !openings.isEmpty else { return "No openings configured" }
+            guard openings.allSatisfy({ $0.isValid }) else { return "Invalid opening position" }
+            guard slots > 0 else { return "Slot count must be greater than zero" }
+            guard maxPlies > 0 else { return "Maximum plies must be greater than zero" }
+            guard resignPlies > 0, drawPlies > 0 else { return "Adjudication plies must be greater than zero" }
+            if let games, games <= 0 {
+                return "Game count must be greater than zero"
+            }
+            if let tablebasePieces, tablebasePieces < 3 {
+                return "Tablebase adjudication needs at least 3 pieces"
+            }
+            switch searchLimit {
+            case .depth(let value), .nodes(let value), .moveTimeMillis(let value):
+                return value > 0 ? nil : "Search limit must be greater than zero"
+            }
+        }
+    }
+
+    /// How a self-play game ended.
+    public enum SelfPlayTermination: Equatable, Sendable {
+        case checkmate
+        case stalemate
+        case repetition
+        case fiftyMoves
+        case insufficientMaterial
+        case tablebase
+        case resignation
+        case drawAdjudication
+        case maxPlies
+        case error(String)
+
+        var pgnTermination: String {
+            switch self {
+            case .checkmate, .stalemate, .repetition, .fiftyMoves, .insufficientMaterial:
+                return "normal"
+            case .tablebase, .resignation, .drawAdjudication:
+                return "adjudication"
+            case .maxPlies:
+                return "unterminated"
+            case .error:
+                return "emergency"
+            }
+        }
+    }
+
+    /// One searched position of a game.
+    public struct SelfPlayPosition: Equatable, Sendable {
+        public var fen: String
+        public var move: String
+        /// Centipawns for the side to move; mate scores are `±(32000 - plies to mate)`.
+        public var score: Int
+    }
+
+    /// A finished game, with its moves in UCI notation.
+    public struct SelfPlayGame: Equatable, Sendable {
+        public var index: Int
+        public var startFEN: String
+        public var firstEngineIsWhite: Bool
+        public var positions: [SelfPlayPosition]
+        /// `1-0`, `0-1`, `1/2-1/2`, or `*` when the game was cut off.
+        public var result: String
+        public var termination: SelfPlayTermination
+        var chess960: Bool
+
+        public var moves: [String] { positions.map(\.move) }
+
+        /// The game as PGN with SAN moves; the engines are named `first` and
+        /// `second`, and `FEN`/`SetUp` tags give the opening.
+        public var pgn: String {
+            var tags = [
+                ("Event", "SFEngine self-play"),
+                ("Site", "?"),
+                ("Date", pgnDate()),
+                ("Round", String(index + 1)),
+                ("White", firstEngineIsWhite ? "first" : "second"),
+                ("Black", firstEngineIsWhite ? "second" : "first"),
+                ("Result", result),
+                ("Termination", termination.pgnTermination),
+            ]
+            if chess960 {
+                tags.append(("Variant", "Chess960"))
+            }
+            tags.append(("SetUp", "1"))
+            tags.append(("FEN", startFEN))
+
+            var text = tags.map { "[\($0.0) \"\($0.1)\"]\n" }.joined() + "\n"
+            var line = ""
+            for (ply, position) in positions.enumerated() {
+                let fields = position.fen.split(separator: " ")
+                let whiteToMove = fields.count > 1 && fields[1] == "w"
+                var token = ""
+                if whiteToMove || ply == 0 {
+                    let moveNumber = fields.count > 5 ? String(fields[5]) : "1"
+                    token = whiteToMove ? "\(moveNumber). " : "\(moveNumber)... "
+                }
+                token += sanMove(position.move, fen: position.fen, chess960: chess960)
+                if line.count + token.count + 1 > 79 {
+                    text += line + "\n"
+                    line = ""
+                }
+                line += line.isEmpty ? token : " " + token
+            }
+            let resultToken = line.isEmpty ? result : " " + result
+            return text + line + resultToken + "\n\n"
+        }
+
+        /// One record per searched position: the `SFPackedPositionLength`-byte
+        /// packed position, the score for the side to move as a little-endian
+        /// Int16, the game result for the side to move as an Int8 (1, 0, -1;
+        /// 0 for an unfinished game), and a zero byte. `nil` if a position
+        /// cannot be packed.
+        public var packedRecords: Data? {
+            var data = Data()
+            for position in positions {
+                guard let packed = try? SFEngine.packedPosition(fen: position.fen, chess960: chess960) else {
+                    return nil
+                }
+                data.append(packed)
+                let score = Int16(clamping: position.score).littleEndian
+                withUnsafeBytes(of: score) { data.append(contentsOf: $0) }
+                let whiteToMove = position.fen.split(separator: " ").dropFirst().first == "w"
+                let whiteResult: Int8 = result == "1-0" ? 1 : result == "0-1" ? -1 : 0
+                data.append(UInt8(bitPattern: whiteToMove ? whiteResult : -whiteResult))
+                data.append(0)
+            }
+            return data
+        }
+    }
+
+    /// Results of a self-play run, from the first engine's point of view.
+    public struct SelfPlaySummary: Equatable, Sendable {
+        public var gamesPlayed: Int
+        public var firstEngineWins: Int
+        public var secondEngineWins: Int
+        public var draws: Int
+        public var unfinished: Int
+        public var errors: Int
+        public var elapsed: Duration
+        public var gamesPerHour: Double
+    }
+
+    /// Plays games between two engine configurations on `slots` pairs of
+    /// engines at once and hands each finished game to `gameHandler`, from
+    /// the slot's task and in completion order. Every move is a native search
+    /// (`search(fen:moves:limits:)`) on the full game, so the engines see the
+    /// repetition history; the rules and adjudication are checked here with
+    /// `SFPosition`. A slot whose engine fails or misses `perMoveTimeout`
+    /// reports that game as an error and goes on with new engines. Cancel the
+    /// calling task to end the run early.
+    public static func runSelfPlay(_ configuration: SelfPlayConfiguration,
+                                   gameHandler: @escaping @Sendable (SelfPlayGame) -> Void) async -> SelfPlaySummary {
+        let clock = ContinuousClock()
+        let start = clock.now
+        var tally = SelfPlayTally()
+
+        if configuration.validationError == nil {
+            let total = configuration.games ?? configuration.openings.count * 2
+            let scheduler = ThroughputScheduler(total: total, interval: nil, start: start)
+            await withTaskGroup(of: SelfPlayTally.self) { group in
+                for _ in 0..<configuration.slots {
+                    group.addTask { await selfPlayWorker(configuration, scheduler: scheduler, gameHandler: gameHandler) }
+                }
+                for await slotTally in group {
+                    tally.merge(slotTally)
+                }
+            }
+        } else {
+            tally.errors = 1
+        }
+
+        let elapsed = clock.now - start
+        let components = elapsed.components
+        let seconds = max(Double(components.seconds) + Double(components.attoseconds) / 1e18, 1e-9)
+        return SelfPlaySummary(gamesPlayed: tally.played,
+                               firstEngineWins: tally.firstWins,
+                               secondEngineWins: tally.secondWins,
+                               draws: tally.draws,
+                               unfinished: tally.unfinished,
+                               errors: tally.errors,
+                               elapsed: elapsed,
+                               gamesPerHour: Double(tally.played) * 3600 / seconds)
+    }
+
+    // One slot's share of a self-play run.
+    private static func selfPlayWorker(_ configuration: SelfPlayConfiguration,
+                                       scheduler: ThroughputScheduler,
+                                       gameHandler: @escaping @Sendable (SelfPlayGame) -> Void) async -> SelfPlayTally {
+        var tally = SelfPlayTally()
+        var players: [SelfPlayPlayer] = []
+        defer { players.forEach { $0.engine.stop() } }
+
+        while !Task.isCancelled, let slot = await scheduler.next() {
+            if players.isEmpty {
+                players = startSelfPlayPlayers(configuration)
+            } else {
+                players.forEach { $0.engine.sendCommand("ucinewgame") }
+            }
+
+            let opening = configuration.openings[(slot.index / 2) % configuration.openings.count]
+            let game = await playGame(index: slot.index,
+                                      opening: opening,
+                                      firstEngineIsWhite: slot.index % 2 == 0,
+                                      players: players,
+                                      configuration: configuration)
+            if Task.isCancelled { break }
+
+            tally.record(game)
+            gameHandler(game)
+            if case .error = game.termination {
+                players.forEach { $0.engine.stop() }
+                players = []
+            }
+        }
+        return tally
+    }
+
+    private static func startSelfPlayPlayers(_ configuration: SelfPlayConfiguration) -> [SelfPlayPlayer] {
+        var options = configuration.engineOptions
+        if configuration.chess960 {
+            options.insert("setoption name UCI_Chess960 value true", at: 0)
+        }
+        return [options, options + configuration.secondEngineOptions].map { commands in
+            SelfPlayPlayer(commands: commands, searchLimit: configuration.searchLimit)
+        }
+    }
+
+    private static func playGame(index: Int,
+                                 opening: PositionSpec,
+                                 firstEngineIsWhite: Bool,
+                                 players: [SelfPlayPlayer],
+                                 configuration: SelfPlayConfiguration) async -> SelfPlayGame {
+        var game = SelfPlayGame(index: index,
+                                startFEN: "",
+                                firstEngineIsWhite: firstEngineIsWhite,
+                                positions: [],
+                                result: "*",
+                                termination: .maxPlies,
+                                chess960: configuration.chess960)
+        func finish(_ result: String, _ termination: SelfPlayTermination) -> SelfPlayGame {
+            game.result = result
+            game.termination = termination
+            return game
+        }
+
+        let (openingFEN, openingMoves) = opening.fenAndMoves
+        guard var position = try? SFPosition(fen: openingFEN, moves: openingMoves, chess960: configuration.chess960) else {
+            return finish("*", .error("The opening could not be set up"))
+        }
+        game.startFEN = position.fen
+
+        var keys: [UInt64: Int] = [position.zobristKey: 1]
+        var moves: [String] = []
+        var resignStreak = 0
+        var drawStreak = 0
+
+        while moves.count < configuration.maxPlies {
+            let whiteToMove = position.fen.split(separator: " ").dropFirst().first == "w"
+            switch position.status {
+            case .checkmate:
+                return finish(whiteToMove ? "0-1" : "1-0", .checkmate)
+            case .stalemate:
+                return finish("1/2-1/2", .stalemate)
+            default:
+                break
+            }
+            if keys[position.zobristKey, default: 0] >= 3 {
+                return finish("1/2-1/2", .repetition)
+            }
+            let fields = position.fen.split(separator: " ")
+            if fields.count > 4, let halfmoves = Int(fields[4]), halfmoves >= 100 {
+                return finish("1/2-1/2", .fiftyMoves)
+            }
+            if hasInsufficientMaterial(String(fields[0])) {
+                return finish("1/2-1/2", .insufficientMaterial)
+            }
+
+            let player = players[whiteToMove == firstEngineIsWhite ? 0 : 1]
+            let result = await player.search(fen: game.startFEN, moves: moves, timeout: configuration.perMoveTimeout)
+            if Task.isCancelled {
+                return finish("*", .error("Cancelled"))
+            }
+            guard let result, let move = result.bestMove, position.isLegalMove(move) else {
+                return finish("*", .error(result == nil ? "No move within the timeout" : "The engine returned no legal move"))
+            }
+
+            let score = result.info.map(sideToMoveScore) ?? 0
+            game.positions.append(SelfPlayPosition(fen: position.fen, move: move, score: score))
+
+            // Adjudication looks at the score before the move is played.
+            let whiteScore = whiteToMove ? score : -score
+            if let pieces = configuration.tablebasePieces, let info = result.info, info.tablebaseHits > 0,
+               pieceCount(String(fields[0])) <= pieces {
+                if abs(whiteScore) >= tablebaseWinScore {
+                    return finish(whiteScore > 0 ? "1-0" : "0-1", .tablebase)
+                }
+                if whiteScore == 0 {
+                    return finish("1/2-1/2", .tablebase)
+                }
+            }
+            // Positive while White keeps winning, negative while Black does.
+            if abs(whiteScore) >= configuration.resignScore {
+                let sign = whiteScore > 0 ? 1 : -1
+                resignStreak = resignStreak * sign > 0 ? resignStreak + sign : sign
+            } else {
+                resignStreak = 0
+            }
+            if abs(resignStreak) >= configuration.resignPlies {
+                return finish(resignStreak > 0 ? "1-0" : "0-1", .resignation)
+            }
+            drawStreak = moves.count + 1 >= configuration.drawMinPly && abs(whiteScore) <= configuration.drawScore
+                ? drawStreak + 1
+                : 0
+            if drawStreak >= configuration.drawPlies {
+                return finish("1/2-1/2", .drawAdjudication)
+            }
+
+            guard let next = try? position.playing([move]) else {
+                return finish("*", .error("Could not play \(move)"))
+            }
+            moves.append(move)
+            position = next
+            keys[position.zobristKey, default: 0] += 1
+        }
+        return finish("*", .maxPlies)
+    }
+}
+
+/// One side of a self-play slot: an engine with its options applied, and the
+/// limits of its searches.
+private final class SelfPlayPlayer: @unchecked Sendable {
+    let engine = SFEngine()
+    private let limits = SFSearchLimits()
+
+    init(commands: [String], searchLimit: SFEngineSoakRunner.SearchLimit) {
+        switch searchLimit {
+        case .depth(let depth):
+            limits.depth = depth
+        case .nodes(let nodes):
+            limits.nodes = UInt64(nodes)
+        case .moveTimeMillis(let milliseconds):
+            limits.moveTimeMilliseconds = milliseconds
+        }
+        engine.start()
+        for command in commands where !command.isEmpty {
+            engine.sendCommand(command)
+        }
+    }
+
+    // `nil` on an engine error or timeout; a timed-out search is cancelled.
+    func search(fen: String, moves: [String], timeout: Duration) async -> SFSearchResult? {
+        await withTimeout(timeout) {
+            try? await self.engine.search(fen: fen, moves: moves, limits: self.limits)
+        }
+    }
+}
+
+private struct SelfPlayTally: Sendable {
+    var played = 0
+    var firstWins = 0
+    var secondWins = 0
+    var draws = 0
+    var unfinished = 0
+    var errors = 0
+
+    mutating func record(_ game: SFEngineSoakRunner.SelfPlayGame) {
+        played += 1
+        if case .error = game.termination {
+            errors += 1
+            return
+        }
+        switch game.result {
+        case "1-0":
+            if game.firstEngineIsWhite { firstWins += 1 } else { secondWins += 1 }
+        case "0-1":
+            if game.firstEngineIsWhite { secondWins += 1 } else { firstWins += 1 }
+        case "1/2-1/2":
+            draws += 1
+        default:
+            unfinished += 1
+        }
+    }
+
+    mutating func merge(_ other: SelfPlayTally) {
+        played += other.played
+        firstWins += other.firstWins
+        secondWins += other.secondWins
+        draws += other.draws
+        unfinished += other.unfinished
+        errors += other.errors
+    }
+}
+
+// A tablebase win is reported as 20000 cp minus the plies to reach it.
+private let tablebaseWinScore = 19_000
+
+// Today as a PGN `Date` tag value.
+private func pgnDate() -> String {
+    let today = Calendar(identifier: .gregorian).dateComponents([.year, .month, .day], from: Date())
+    return String(format: "%04d.%02d.%02d", today.year ?? 0, today.month ?? 0, today.day ?? 0)
+}
+
+private func sideToMoveScore(_ info: SFSearchInfo) -> Int {
+    guard info.scoreType == .mate else { return info.scoreValue }
+    let plies = abs(info.scoreValue) * 2 - (info.scoreValue > 0 ? 1 : 0)
+    return info.scoreValue > 0 ? 32000 - plies : -(32000 - plies)
+}
+
+private func pieceCount(_ placement: String) -> Int {
+    placement.filter { $0.isLetter }.count
+}
+
+// Kings alone, or with a single knight or bishop.
+private func hasInsufficientMaterial(_ placement: String) -> Bool {
+    let pieces = placement.filter { $0.isLetter && $0 != "k" && $0 != "K" }
+    return pieces.isEmpty || (pieces.count == 1 && "nNbB".contains(pieces))
+}
+
+// Standard algebraic notation for a legal UCI move, from the FEN's board and
+// the position's legal moves for disambiguation.
+private func sanMove(_ move: String, fen: String, chess960: Bool) -> String {
+    let characters = Array(move)
+    guard characters.count >= 4,
+          let position = try? SFPosition(fen: fen, moves: [], chess960: chess960) else {
+        return move
+    }
+
+    var board = [Character?](repeating: nil, count: 64)
+    var rank = 7
+    var file = 0
+    for character in fen.prefix(while: { $0 != " " }) {
+        if character == "/" {
+            rank -= 1
+            file = 0
+        } else if let skip = character.wholeNumberValue {
+            file += skip
+        } else if (0..<8).contains(file), (0..<8).contains(rank) {
+            board[rank * 8 + file] = character
+            file += 1
+        }
+    }
+
+    func square(_ fileCharacter: Character, _ rankCharacter: Character) -> Int {
+        let file = Int(fileCharacter.asciiValue ?? 97) - 97
+        let rank = Int(rankCharacter.asciiValue ?? 49) - 49
+        return rank * 8 + file
+    }
+    let from = square(characters[0], characters[1])
+    let to = square(characters[2], characters[3])
+    guard let piece = board[from] else { return move }
+
+    let kind = Character(piece.uppercased())
+    let target = board[to]
+    let ownPiece = target.map { $0.isUppercase == piece.isUppercase } ?? false
+    var san: String
+    if kind == "K" && (ownPiece || (!chess960 && abs(to % 8 - from % 8) == 2)) {
+        san = to % 8 > from % 8 ? "O-O" : "O-O-O"
+    } else if kind == "P" {
+        let capture = from % 8 != to % 8
+        san = capture ? "\(characters[0])x\(characters[2])\(characters[3])" : "\(characters[2])\(characters[3])"
+        if characters.count > 4 {
+            san += "=" + characters[4].uppercased()
+        }
+    } else {
+        let rivals = position.legalMoves.filter { other in
+            let otherCharacters = Array(other)
+            guard other != move, otherCharacters.count >= 4,
+                  square(otherCharacters[2], otherCharacters[3]) == to else { return false }
+            return board[square(otherCharacters[0], otherCharacters[1])] == piece
+        }
+        san = String(kind)
+        if !rivals.isEmpty {
+            let sameFile = rivals.contains { $0.first == characters[0] }
+            let sameRank = rivals.contains { Array($0)[1] == characters[1] }
+            if !sameFile {
+                san.append(characters[0])
+            } else if !sameRank {
+                san.append(characters[1])
+            } else {
+                san += "\(characters[0])\(characters[1])"
+            }
+        }
+        if target != nil {
+            san += "x"
+        }
+        san += "\(characters[2])\(characters[3])"
+    }
+
+    switch (try? position.playing([move]))?.status {
+    case .checkmate:
+        san += "#"
+    case .check:
+        san += "+"
+    default:
+        break
+    }
+    return san
+}
+
+private extension SFEngineSoakRunner.PositionSpec {
+    // The FEN (nil for the start position) and the moves after it.
+    var fenAndMoves: (String?, [String]) {
+        switch self {
+        case .startpos:
+            return (nil, [])
+        case .fen(let value):
+            let tokens = value.split(whereSeparator: \Character.isWhitespace).map(String.init)
+            let movesIndex = tokens.firstIndex(of: "moves") ?? tokens.endIndex
+            let moves = movesIndex < tokens.endIndex ? Array(tokens[(movesIndex + 1)...]) : []
+            return (tokens[..<movesIndex].joined(separator: " "), moves)
+        }
+    }
+}
@@ -96,6 +96,15 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
             }
         }
 
+        // Swaps in a restarted engine; fails once a stop has been requested.
+        func replace(engine: SFEngine) -> Bool {
+            queue.sync {
+                guard !stopRequested else { return false }
+                self.engine = engine
+                return true
+            }
+        }
+
         func clearEngine() {
             queue.sync {
                 engine = nil
@@ -160,6 +169,13 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
     /// - `delayBetweenIterations`: `nil` (no delay)
     /// - `readyCheckEveryIteration`: `false` (skip per-iteration `isready`)
     /// - `engineOptions`: `[]` (UCI commands like `setoption name ...`)
+    /// - `restartEngineEvery`: `nil` (keep one engine; otherwise stop it and
+    ///   start a new one after every N iterations)
+    /// - `memorySampleEvery`: `nil` (no sampling; otherwise sample memory
+    ///   after every N iterations)
+    /// - `maxResidentGrowthBytes`: `nil` (no limit; otherwise end the run with
+    ///   an error when resident memory grows by more than this from the first
+    ///   sample, which is taken after the first N iterations have warmed up)
     public struct Configuration: Equatable, Sendable {
         public var positions: [PositionSpec]
         public var searchLimit: SearchLimit
@@ -170,6 +186,9 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
         public var delayBetweenIterations: Duration?
         public var readyCheckEveryIteration: Bool
         public var engineOptions: [String]
+        public var restartEngineEvery: Int?
+        public var memorySampleEvery: Int?
+        public var maxResidentGrowthBytes: UInt64?
 
         /// Creates a configuration. `positions` must be non-empty.
         ///
@@ -184,7 +203,10 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
             handshakeTimeout: Duration = .seconds(10),
             delayBetweenIterations: Duration? = nil,
             readyCheckEveryIteration: Bool = false,
-            engineOptions: [String] = []
+            engineOptions: [String] = [],
+            restartEngineEvery: Int? = nil,
+            memorySampleEvery: Int? = nil,
+            maxResidentGrowthBytes: UInt64? = nil
         ) {
             self.positions = positions
             self.searchLimit = searchLimit
@@ -195,6 +217,9 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
             self.delayBetweenIterations = delayBetweenIterations
             self.readyCheckEveryIteration = readyCheckEveryIteration
             self.engineOptions = engineOptions
+            self.restartEngineEvery = restartEngineEvery
+            self.memorySampleEvery = memorySampleEvery
+            self.maxResidentGrowthBytes = maxResidentGrowthBytes
         }
 
         var validationError: String? {
@@ -223,17 +248,44 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
             if let delayBetweenIterations, delayBetweenIterations < .zero {
                 return "Delay between iterations cannot be negative"
             }
+            if let restartEngineEvery, restartEngineEvery <= 0 {
+                return "Engine restart interval must be greater than zero"
+            }
+            if let memorySampleEvery, memorySampleEvery <= 0 {
+                return "Memory sample interval must be greater than zero"
+            }
+            if maxResidentGrowthBytes != nil && memorySampleEvery == nil {
+                return "A resident memory growth limit needs a memory sample interval"
+            }
             return nil
         }
     }
 
+    /// Memory after one sampling interval. `residentBytes` is the process's
+    /// resident size from `task_info`; the other fields are the current
+    /// engine's `SFMemoryFootprint`, or zero before it has reported one.
+    public struct MemorySample: Equatable, Sendable {
+        public var residentBytes: UInt64
+        public var hashBytes: UInt64
+        public var networkBytes: UInt64
+        public var threads: Int
+        public var threadBytes: UInt64
+        public var pendingCallbacks: Int
+        public var peakPendingCallbacks: Int
+    }
+
     /// Summary counters for the run. `elapsed` is set when the run finishes.
+    /// The memory fields are the first and last samples, or nil without
+    /// `memorySampleEvery`.
     public struct Summary: Equatable, Sendable {
         public var iterationsAttempted: Int
         public var iterationsCompleted: Int
         public var timeouts: Int
         public var errors: Int
         public var elapsed: Duration
+        public var engineRestarts: Int = 0
+        public var firstMemorySample: MemorySample?
+        public var lastMemorySample: MemorySample?
     }
 
     /// Emitted events in the order they occur during a run.
@@ -246,6 +298,8 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
         case iterationStarted(index: Int, position: PositionSpec)
         case iterationCompleted(index: Int, bestmove: String, elapsed: Duration)
         case timeout(index: Int, position: PositionSpec, elapsed: Duration)
+        case engineRestarted(afterIteration: Int)
+        case memorySample(afterIteration: Int, sample: MemorySample)
         case stopped
         case error(String)
         case finished(Summary)
@@ -291,10 +345,14 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
         // Marshal the engine's line callback into an async stream.
         let lineQueue = LineQueue()
 
-        // Create the engine and enqueue each output line.
-        let engine = SFEngine(lineHandler: { line in
-            lineQueue.push(line)
-        })
+        // Create the engine and enqueue each output line. Restarted engines
+        // share the queue, since each is stopped only after its last reply.
+        func makeEngine() -> SFEngine {
+            SFEngine(lineHandler: { line in
+                lineQueue.push(line)
+            })
+        }
+        var engine = makeEngine()
 
         guard state.start(engine: engine, lineQueue: lineQueue) else {
             let summary = Summary(iterationsAttempted: 0,
@@ -362,29 +420,36 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
         }
 
         // Handshake: `uci` -> `uciok`, then apply options, then `isready`.
-        engine.sendCommand("uci")
-        guard await waitForPrefix("uciok", timeout: configuration.handshakeTimeout) != nil else {
-            if shouldStop() {
-                eventHandler(.stopped)
-                return finalizeSummary()
+        // Returns false after reporting a timeout, or when stopping.
+        func handshake() async -> Bool {
+            engine.sendCommand("uci")
+            guard await waitForPrefix("uciok", timeout: configuration.handshakeTimeout) != nil else {
+                if !shouldStop() {
+                    summary.errors += 1
+                    eventHandler(.error("Timed out waiting for uciok"))
+                }
+                return false
             }
-            summary.errors += 1
-            eventHandler(.error("Timed out waiting for uciok"))
-            return finalizeSummary()
-        }
 
-        for option in configuration.engineOptions where !option.isEmpty {
-            engine.sendCommand(option)
+            for option in configuration.engineOptions where !option.isEmpty {
+                engine.sendCommand(option)
+            }
+
+            engine.sendCommand("isready")
+            guard await waitForPrefix("readyok", timeout: configuration.handshakeTimeout) != nil else {
+                if !shouldStop() {
+                    summary.errors += 1
+                    eventHandler(.error("Timed out waiting for readyok"))
+                }
+                return false
+            }
+            return true
         }
 
-        engine.sendCommand("isready")
-        guard await waitForPrefix("readyok", timeout: configuration.handshakeTimeout) != nil else {
+        guard await handshake() else {
             if shouldStop() {
                 eventHandler(.stopped)
-                return finalizeSummary()
             }
-            summary.errors += 1
-            eventHandler(.error("Timed out waiting for readyok"))
             return finalizeSummary()
         }
 
@@ -455,6 +520,33 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
 
             index += 1
 
+            if let interval = configuration.memorySampleEvery, index % interval == 0 {
+                let sample = memorySample(of: engine)
+                let first = summary.firstMemorySample ?? sample
+                summary.firstMemorySample = first
+                summary.lastMemorySample = sample
+                eventHandler(.memorySample(afterIteration: index, sample: sample))
+
+                let growth = sample.residentBytes > first.residentBytes ? sample.residentBytes - first.residentBytes : 0
+                if let limit = configuration.maxResidentGrowthBytes, growth > limit {
+                    summary.errors += 1
+                    eventHandler(.error(String(format: "Resident memory grew by %.1f MB over %d iterations",
+                                               Double(growth) / 1_048_576, index - interval)))
+                    break
+                }
+            }
+
+            let finished = configuration.maxIterations.map { index >= $0 } ?? false
+            if let interval = configuration.restartEngineEvery, index % interval == 0, !finished {
+                engine.stop()
+                engine = makeEngine()
+                guard state.replace(engine: engine) else { break }
+                engine.start()
+                summary.engineRestarts += 1
+                eventHandler(.engineRestarted(afterIteration: index))
+                guard await handshake() else { break }
+            }
+
             if let delay = configuration.delayBetweenIterations {
                 let deadline = clock.now.advanced(by: delay)
                 while !shouldStop() {
@@ -473,6 +565,487 @@ public final class SFEngineSoakRunner: @unchecked Sendable {
     }
 }
 
+// MARK: - Throughput
+
+extension SFEngineSoakRunner {
+    /// Configuration for `runThroughput(_:)`.
+    ///
+    /// Required:
+    /// - `positions`: non-empty list of positions to loop over.
+    ///
+    /// Optional (defaults shown):
+    /// - `searchLimit`: `.depth(8)`
+    /// - `totalPositions`: `nil` (each position once)
+    /// - `engines`: 2 (engines searching at the same time, each on its own
+    ///   `SFEngine`)
+    /// - `targetPositionsPerSecond`: `nil` (start each search as soon as an
+    ///   engine is free)
+    /// - `perMoveTimeout`, `stopTimeout`, `handshakeTimeout`, `engineOptions`:
+    ///   as in `Configuration`
+    public struct ThroughputConfiguration: Equatable, Sendable {
+        public var positions: [PositionSpec]
+        public var searchLimit: SearchLimit
+        public var totalPositions: Int?
+        public var engines: Int
+        public var targetPositionsPerSecond: Double?
+        public var perMoveTimeout: Duration
+        public var stopTimeout: Duration
+        public var handshakeTimeout: Duration
+        public var engineOptions: [String]
+
+        public init(
+            positions: [PositionSpec],
+            searchLimit: SearchLimit = .depth(8),
+            totalPositions: Int? = nil,
+            engines: Int = 2,
+            targetPositionsPerSecond: Double? = nil,
+            perMoveTimeout: Duration = .seconds(30),
+            stopTimeout: Duration = .seconds(5),
+            handshakeTimeout: Duration = .seconds(10),
+            engineOptions: [String] = []
+        ) {
+            self.positions = positions
+            self.searchLimit = searchLimit
+            self.totalPositions = totalPositions
+            self.engines = engines
+            self.targetPositionsPerSecond = targetPositionsPerSecond
+            self.perMoveTimeout = perMoveTimeout
+            self.stopTimeout = stopTimeout
+            self.handshakeTimeout = handshakeTimeout
+            self.engineOptions = engineOptions
+        }
+
+        var soakConfiguration: Configuration {
+            Configuration(positions: positions,
+                          searchLimit: searchLimit,
+                          maxIterations: totalPositions,
+                          perMoveTimeout: perMoveTimeout,
+                          stopTimeout: stopTimeout,
+                          handshakeTimeout: handshakeTimeout,
+                          engineOptions: engineOptions)
+        }
+
+        var validationError: String? {
+            if let error = soakConfiguration.validationError {
+                return error
+            }
+            guard engines > 0 else { return "Engine count must be greater than zero" }
+            if let targetPositionsPerSecond, !(targetPositionsPerSecond > 0) {
+                return "Target rate must be greater than zero"
+            }
+            return nil
+        }
+    }
+
+    /// Nodes per second over completed searches, from each search's last `info` line.
+    public struct NPSDistribution: Equatable, Sendable {
+        public var min: Int
+        public var p10: Int
+        public var p50: Int
+        public var p90: Int
+        public var max: Int
+
+        init?(_ samples: [Int]) {
+            guard !samples.isEmpty else { return nil }
+            let sorted = samples.sorted()
+            func percentile(_ fraction: Double) -> Int {
+                sorted[Swift.min(sorted.count - 1, Int(Double(sorted.count) * fraction))]
+            }
+            min = sorted[0]
+            p10 = percentile(0.1)
+            p50 = percentile(0.5)
+            p90 = percentile(0.9)
+            max = sorted[sorted.count - 1]
+        }
+    }
+
+    /// Results of a throughput run.
+    ///
+    /// `peakResidentBytes` is the process's resident-size high-water mark from
+    /// `task_info`, so it includes everything else the process has mapped.
+    public struct ThroughputSummary: Equatable, Sendable {
+        public var positionsAttempted: Int
+        public var positionsCompleted: Int
+        public var timeouts: Int
+        public var errors: Int
+        public var elapsed: Duration
+        public var positionsPerSecond: Double
+        public var timeoutRate: Double
+        public var nps: NPSDistribution?
+        public var peakResidentBytes: UInt64?
+    }
+
+    /// Searches `positions` on `engines` engines at once and reports capacity
+    /// figures. Each engine takes the next position as soon as it is free, or
+    /// at its slot in the schedule when a target rate is set; a rate the
+    /// engines cannot keep up with shows as `positionsPerSecond` below it.
+    /// A timed-out search is stopped and its engine moves on, as in `run`.
+    /// Cancel the calling task to end the run early.
+    public static func runThroughput(_ configuration: ThroughputConfiguration) async -> ThroughputSummary {
+        let clock = ContinuousClock()
+        let start = clock.now
+        var tally = ThroughputTally()
+
+        if configuration.validationError == nil {
+            let total = configuration.totalPositions ?? configuration.positions.count
+            let interval = configuration.targetPositionsPerSecond.map { Duration.seconds(1 / $0) }
+            let scheduler = ThroughputScheduler(total: total, interval: interval, start: start)
+            await withTaskGroup(of: ThroughputTally.self) { group in
+                for _ in 0..<configuration.engines {
+                    group.addTask { await throughputWorker(configuration, scheduler: scheduler) }
+                }
+                for await workerTally in group {
+                    tally.merge(workerTally)
+                }
+            }
+        } else {
+            tally.errors = 1
+        }
+
+        let elapsed = clock.now - start
+        let components = elapsed.components
+        let seconds = max(Double(components.seconds) + Double(components.attoseconds) / 1e18, 1e-9)
+        return ThroughputSummary(positionsAttempted: tally.attempted,
+                                 positionsCompleted: tally.completed,
+                                 timeouts: tally.timeouts,
+                                 errors: tally.errors,
+                                 elapsed: elapsed,
+                                 positionsPerSecond: Double(tally.completed) / seconds,
+                                 timeoutRate: tally.attempted > 0 ? Double(tally.timeouts) / Double(tally.attempted) : 0,
+                                 nps: NPSDistribution(tally.nps),
+                                 peakResidentBytes: residentSizeHighWaterMark())
+    }
+
+    // One engine's share of a throughput run.
+    private static func throughputWorker(_ configuration: ThroughputConfiguration,
+                                         scheduler: ThroughputScheduler) async -> ThroughputTally {
+        var tally = ThroughputTally()
+        let lineQueue = LineQueue()
+        let engine = SFEngine(lineHandler: { line in
+            lineQueue.push(line)
+        })
+        engine.start()
+        defer {
+            engine.stop()
+            lineQueue.finish()
+        }
+
+        // Waits for a line starting with `prefix`, noting the last reported NPS.
+        func waitFor(_ prefix: String, timeout: Duration) async -> ThroughputReply? {
+            await withTimeout(timeout) {
+                var nps: Int?
+                while let line = await lineQueue.next() {
+                    if line.hasPrefix(prefix) {
+                        return ThroughputReply(line: line, nps: nps)
+                    }
+                    let fields = line.split(separator: " ")
+                    if fields.first == "info", let index = fields.firstIndex(of: "nps"), index + 1 < fields.count {
+                        nps = Int(fields[index + 1]) ?? nps
+                    }
+                }
+                return nil
+            }
+        }
+
+        engine.sendCommand("uci")
+        guard await waitFor("uciok", timeout: configuration.handshakeTimeout) != nil else {
+            tally.errors += 1
+            return tally
+        }
+        for option in configuration.engineOptions where !option.isEmpty {
+            engine.sendCommand(option)
+        }
+        engine.sendCommand("isready")
+        guard await waitFor("readyok", timeout: configuration.handshakeTimeout) != nil else {
+            tally.errors += 1
+            return tally
+        }
+
+        while !Task.isCancelled, let slot = await scheduler.next() {
+            if let startAt = slot.startAt {
+                try? await Task.sleep(until: startAt, clock: .continuous)
+            }
+            if Task.isCancelled { break }
+
+            let position = configuration.positions[slot.index % configuration.positions.count]
+            engine.sendCommand(position.uciCommand)
+            engine.sendCommand(configuration.searchLimit.uciCommand)
+            tally.attempted += 1
+
+            if let reply = await waitFor("bestmove", timeout: configuration.perMoveTimeout) {
+                guard parseBestmove(reply.line) != nil else {
+                    tally.errors += 1
+                    break
+                }
+                tally.completed += 1
+                if let nps = reply.nps {
+                    tally.nps.append(nps)
+                }
+            } else if Task.isCancelled {
+                break
+            } else {
+                tally.timeouts += 1
+                engine.sendCommand("stop")
+                guard let stopped = await waitFor("bestmove", timeout: configuration.stopTimeout),
+                      parseBestmove(stopped.line) != nil else {
+                    tally.errors += 1
+                    break
+                }
+            }
+        }
+        return tally
+    }
+}
+
+private struct ThroughputReply: Sendable {
+    let line: String
+    let nps: Int?
+}
+
+private struct ThroughputTally: Sendable {
+    var attempted = 0
+    var completed = 0
+    var timeouts = 0
+    var errors = 0
+    var nps: [Int] = []
+
+    mutating func merge(_ other: ThroughputTally) {
+        attempted += other.attempted
+        completed += other.completed
+        timeouts += other.timeouts
+        errors += other.errors
+        nps += other.nps
+    }
+}
+
+/// Hands out position (or game) indices to workers, with start times when
+/// the run has a target rate.
+actor ThroughputScheduler {
+    private let total: Int
+    private let interval: Duration?
+    private let start: ContinuousClock.Instant
+    private var issued = 0
+
+    init(total: Int, interval: Duration?, start: ContinuousClock.Instant) {
+        self.total = total
+        self.interval = interval
+        self.start = start
+    }
+
+    func next() -> (index: Int, startAt: ContinuousClock.Instant?)? {
+        guard issued < total else { return nil }
+        defer { issued += 1 }
+        return (issued, interval.map { start.advanced(by: $0 * issued) })
+    }
+}
+
+/// The process's `task_info` basic counters, or `nil` if unavailable.
+private func taskBasicInfo() -> mach_task_basic_info? {
+    var info = mach_task_basic_info()
+    var count = mach_msg_type_number_t(MemoryLayout<mach_task_basic_info>.size / MemoryLayout<natural_t>.size)
+    let result = withUnsafeMutablePointer(to: &info) {
+        $0.withMemoryRebound(to: integer_t.self, capacity: Int(count)) {
+            task_info(mach_task_self_, task_flavor_t(MACH_TASK_BASIC_INFO), $0, &count)
+        }
+    }
+    return result == KERN_SUCCESS ? info : nil
+}
+
+/// The process's peak resident size, or `nil` if unavailable.
+private func residentSizeHighWaterMark() -> UInt64? {
+    taskBasicInfo()?.resident_size_max
+}
+
+private func memorySample(of engine: SFEngine) -> SFEngineSoakRunner.MemorySample {
+    let footprint = engine.memoryFootprint
+    return SFEngineSoakRunner.MemorySample(
+        residentBytes: taskBasicInfo()?.resident_size ?? 0,
+        hashBytes: footprint?.hashBytes ?? 0,
+        networkBytes: footprint?.networkBytes ?? 0,
+        threads: footprint?.threads ?? 0,
+        threadBytes: footprint?.threadBytes ?? 0,
+        pendingCallbacks: Int(footprint?.pendingCallbacks ?? 0),
+        peakPendingCallbacks: Int(footprint?.peakPendingCallbacks ?? 0)
+    )
+}
+
+// MARK: - Bridge latency
+
+extension SFEngineSoakRunner {
+    /// Configuration for `measureLatency(_:)`.
+    ///
+    /// Optional (defaults shown):
+    /// - `samples`: 1000 (round trips timed per command and handler load)
+    /// - `handlerLoads`: 0, 20, and 200 µs (time the line handler spends on
+    ///   every line, standing in for an app's own work on the callback queue)
+    /// - `timeout`: 10s (wait for one reply)
+    /// - `threads`: 1 (`Threads` of each engine; upstream wakes every search
+    ///   thread for each `go`, however short, so comparing counts shows what
+    ///   that costs a `go depth 1`)
+    public struct LatencyConfiguration: Equatable, Sendable {
+        public var samples: Int
+        public var handlerLoads: [Duration]
+        public var timeout: Duration
+        public var threads: Int
+
+        public init(
+            samples: Int = 1_000,
+            handlerLoads: [Duration] = [.zero, .microseconds(20), .microseconds(200)],
+            timeout: Duration = .seconds(10),
+            threads: Int = 1
+        ) {
+            self.samples = samples
+            self.handlerLoads = handlerLoads
+            self.timeout = timeout
+            self.threads = threads
+        }
+    }
+
+    /// Percentiles of one kind of round trip.
+    public struct LatencyPercentiles: Equatable, Sendable {
+        public var p50: Duration
+        public var p99: Duration
+        public var p999: Duration
+        public var max: Duration
+
+        init(_ samples: [Duration]) {
+            let sorted = samples.sorted()
+            func percentile(_ fraction: Double) -> Duration {
+                let rank = Int((Double(sorted.count) * fraction).rounded(.up))
+                return sorted[Swift.max(0, Swift.min(sorted.count, rank) - 1)]
+            }
+            p50 = percentile(0.5)
+            p99 = percentile(0.99)
+            p999 = percentile(0.999)
+            max = sorted.last ?? .zero
+        }
+    }
+
+    /// Round trips measured with one handler load.
+    ///
+    /// `ready` times `isready` to `readyok` and `depthOne` times `go depth 1`
+    /// to `bestmove`, each from `sendCommand` until the reply reaches the line
+    /// handler.
+    public struct LatencyReport: Equatable, Sendable {
+        public var handlerLoad: Duration
+        public var ready: LatencyPercentiles
+        public var depthOne: LatencyPercentiles
+    }
+
+    /// Times the wrapper's round trip with each handler load in turn, on a fresh
+    /// engine per load: `sendCommand`, the command queue, the UCI loop, the line
+    /// buffer, and the callback queue to the handler. `go depth 1` adds a
+    /// minimal search and its `info` lines, each of which costs the handler load.
+    ///
+    /// Samples run one at a time on a dedicated thread so the caller's executor
+    /// does not add to them. Returns `nil` for an invalid configuration or when
+    /// a reply does not arrive within `timeout`.
+    public static func measureLatency(_ configuration: LatencyConfiguration) async -> [LatencyReport]? {
+        guard configuration.samples > 0,
+              configuration.timeout > .zero,
+              configuration.threads > 0,
+              configuration.handlerLoads.allSatisfy({ $0 >= .zero }) else {
+            return nil
+        }
+
+        return await withCheckedContinuation { continuation in
+            Thread.detachNewThread {
+                continuation.resume(returning: measureLatencySynchronously(configuration))
+            }
+        }
+    }
+
+    private static func measureLatencySynchronously(_ configuration: LatencyConfiguration) -> [LatencyReport]? {
+        var reports: [LatencyReport] = []
+        for load in configuration.handlerLoads {
+            let probe = LatencyProbe(load: load, timeout: configuration.timeout)
+            let engine = SFEngine(lineHandler: { probe.handle($0) })
+            engine.start()
+            defer { engine.stop() }
+
+            guard probe.roundTrip(engine, command: "uci", reply: "uciok") != nil else {
+                return nil
+            }
+            if configuration.threads != 1 {
+                engine.sendCommand("setoption name Threads value \(configuration.threads)")
+            }
+            guard probe.roundTrip(engine, command: "isready", reply: "readyok") != nil else {
+                return nil
+            }
+            engine.sendCommand("position startpos")
+
+            var ready: [Duration] = []
+            var depthOne: [Duration] = []
+            for _ in 0..<configuration.samples {
+                guard let sample = probe.roundTrip(engine, command: "isready", reply: "readyok") else { return nil }
+                ready.append(sample)
+            }
+            for _ in 0..<configuration.samples {
+                guard let sample = probe.roundTrip(engine, command: "go depth 1", reply: "bestmove") else { return nil }
+                depthOne.append(sample)
+            }
+
+            reports.append(LatencyReport(handlerLoad: load,
+                                         ready: LatencyPercentiles(ready),
+                                         depthOne: LatencyPercentiles(depthOne)))
+        }
+        return reports
+    }
+}
+
+/// Line handler for `measureLatency(_:)`: notes when the awaited reply arrives,
+/// then spins for the handler load on every line.
+private final class LatencyProbe: @unchecked Sendable {
+    private let lock = NSLock()
+    private let arrived = DispatchSemaphore(value: 0)
+    private let clock = ContinuousClock()
+    private let load: Duration
+    private let timeout: Duration
+    private var awaitedPrefix: String?
+    private var arrival: ContinuousClock.Instant?
+
+    init(load: Duration, timeout: Duration) {
+        self.load = load
+        self.timeout = timeout
+    }
+
+    func handle(_ line: String) {
+        let now = clock.now
+        lock.lock()
+        let matched = awaitedPrefix.map { line.hasPrefix($0) } ?? false
+        if matched {
+            awaitedPrefix = nil
+            arrival = now
+        }
+        lock.unlock()
+
+        let deadline = now.advanced(by: load)
+        while clock.now < deadline {}
+        if matched {
+            arrived.signal()
+        }
+    }
+
+    func roundTrip(_ engine: SFEngine, command: String, reply: String) -> Duration? {
+        lock.lock()
+        awaitedPrefix = reply
+        arrival = nil
+        lock.unlock()
+
+        let sent = clock.now
+        engine.sendCommand(command)
+        let components = timeout.components
+        let seconds = Double(components.seconds) + Double(components.attoseconds) / 1e18
+        guard arrived.wait(timeout: .now() + seconds) == .success else {
+            return nil
+        }
+
+        lock.lock()
+        defer { lock.unlock() }
+        return arrival.map { sent.duration(to: $0) }
+    }
+}
+
 /// Lock-backed ordered line buffer to bridge the serial engine callback to async consumers.
 private final class LineQueue: @unchecked Sendable {
     private struct Waiter {
@@ -566,7 +1139,7 @@ private final class LineQueue: @unchecked Sendable {
 }
 
 // Runs an async operation with a timeout; returns `nil` on timeout.
-private func withTimeout<T: Sendable>(
+func withTimeout<T: Sendable>(
     _ timeout: Duration,
     operation: @escaping @Sendable () async -> T?
 ) async -> T? {
@@ -654,7 +1227,7 @@ func isValidFENWithOptionalMoves(_ value: String) -> Bool {
     return true
 }
 
-private extension SFEngineSoakRunner.PositionSpec {
+extension SFEngineSoakRunner.PositionSpec {
     var isValid: Bool {
         switch self {
         case .startpos:
@@ -0,0 +1,27 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+// Test-only micro-benchmark comparing the wrapper's command queue implementations.
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Commands per second moved through `CommandStreambuf` by each queue type.
+typedef struct {
+    double threadSafeQueueCommandsPerSecond;
+    double spscQueueCommandsPerSecond;
+} SFCommandQueueBenchmarkResult;
+
+/// Pushes `commandCount` UCI-sized commands from one thread and reads them back
+/// with `std::getline` on another, once per queue implementation.
+FOUNDATION_EXPORT SFCommandQueueBenchmarkResult SFRunCommandQueueBenchmark(NSInteger commandCount);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,71 @@
+//
+// StockfishEmbedded embeds Stockfish as an in-process engine for Apple platforms.
+//
+// See README.md and ThirdParty/Stockfish/Copying.txt for upstream attribution and license details.
+//
+// Licensed under the GNU General Public License v3.0.
+// You may obtain a copy of the License at: https://www.gnu.org/licenses/gpl-3.0.html
+// See the LICENSE file for more information.
+//
+
+// Test-only micro-benchmark comparing the wrapper's command queue implementations.
+
+#import "SFCommandQueueBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <istream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "CommandStream.hpp"
+#include "SPSCQueue.hpp"
+#include "ThreadSafeQueue.hpp"
+
+using namespace SFEmbedded;
+
+namespace {
+
+template<typename Queue>
+double commandsPerSecond(Queue& queue, NSInteger commandCount) {
+    static const char* const commands[] = {
+        "position startpos moves e2e4 e7e5 g1f3",
+        "go ponder wtime 60000 btime 60000",
+        "ponderhit",
+        "stop",
+    };
+
+    CommandStreambuf<Queue> buffer(queue);
+    std::istream            input(&buffer);
+
+    const auto  start = std::chrono::steady_clock::now();
+    std::thread producer([&queue, commandCount] {
+        for (NSInteger i = 0; i < commandCount; ++i)
+            queue.push(commands[i % 4]);
+        queue.close();
+    });
+
+    std::string line;
+    NSInteger   received = 0;
+    while (std::getline(input, line))
+        ++received;
+    producer.join();
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return received == commandCount ? received / std::max(elapsed.count(), 1e-9) : 0.0;
+}
+
+}  // namespace
+
+SFCommandQueueBenchmarkResult SFRunCommandQueueBenchmark(NSInteger commandCount) {
+    SFCommandQueueBenchmarkResult result{};
+
+    ThreadSafeQueue<std::string> lockedQueue;
+    result.threadSafeQueueCommandsPerSecond = commandsPerSecond(lockedQueue, commandCount);
+
+    auto ringQueue = std::make_unique<SPSCQueue<std::string, 1024>>();
+    result.spscQueueCommandsPerSecond = commandsPerSecond(*ringQueue, commandCount);
+
+    return result;
+}
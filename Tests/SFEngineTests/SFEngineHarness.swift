@@ -9,6 +9,7 @@
 //
 
 import Foundation
+import XCTest
 
 final class SFLineMailbox: @unchecked Sendable {
     private let lock = NSLock()
@@ -134,6 +135,43 @@ final class SFEngineHarness: @unchecked Sendable {
         engine?.sendCommand(command)
     }
 
+    var searchQualityOfService: QualityOfService {
+        get { engine?.searchQualityOfService ?? .default }
+        set { engine?.searchQualityOfService = newValue }
+    }
+
+    func pushMove(_ move: String) {
+        engine?.pushMove(move)
+    }
+
+    func popMove() {
+        engine?.popMove()
+    }
+
+    func limitHash(toMegabytes megabytes: Int) {
+        engine?.limitHash(toMegabytes: megabytes)
+    }
+
+    func swapNetwork(toFile path: String) async throws -> (TimeInterval, TimeInterval)? {
+        try await engine?.swapNetwork(toFile: path)
+    }
+
+    var lastHashStatistics: SFHashStatistics? {
+        engine?.lastHashStatistics
+    }
+
+    var lastRootMoves: [SFSearchInfo]? {
+        engine?.lastRootMoves
+    }
+
+    var startupTiming: SFStartupTiming? {
+        engine?.startupTiming
+    }
+
+    var lastHashResetMilliseconds: Double {
+        engine?.lastHashResetMilliseconds ?? 0
+    }
+
     @discardableResult
     func waitForLine(
         timeout: TimeInterval,
@@ -190,10 +228,11 @@ final class SFEngineHarness: @unchecked Sendable {
     func runPerft(
         positionCommand: String,
         depth: Int,
+        options: String = "",
         timeout: TimeInterval
     ) async -> Int? {
         send(positionCommand)
-        send("go perft \(depth)")
+        send(options.isEmpty ? "go perft \(depth)" : "go perft \(depth) \(options)")
 
         guard let nodesLine = await waitForLine(
             timeout: timeout,
@@ -209,6 +248,22 @@ final class SFEngineHarness: @unchecked Sendable {
         return Self.parseNodesSearched(nodesLine)
     }
 
+    // The downloaded .nnue in Resources/NNUE; tests that load it by path skip without one.
+    static func networkFile() throws -> URL {
+        let networkDirectory = URL(fileURLWithPath: #filePath)
+            .deletingLastPathComponent()
+            .deletingLastPathComponent()
+            .deletingLastPathComponent()
+            .appendingPathComponent("Resources/NNUE")
+        let network = try FileManager.default
+            .contentsOfDirectory(at: networkDirectory, includingPropertiesForKeys: nil)
+            .first { $0.pathExtension == "nnue" }
+        guard let network else {
+            throw XCTSkip("No .nnue file in \(networkDirectory.path)")
+        }
+        return network
+    }
+
     static func parseBestmove(_ line: String) -> String? {
         let parts = line.split(separator: " ")
         guard parts.count >= 2, parts[0] == "bestmove" else {
@@ -8,4 +8,5 @@
 // See the LICENSE file for more information.
 //
 
+#import "SFCommandQueueBenchmark.h"
 #import "SFEngine.h"
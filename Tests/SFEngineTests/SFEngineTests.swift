@@ -34,6 +34,12 @@ private final class SFEngineHolder: @unchecked Sendable {
         lock.unlock()
         engine?.start()
     }
+
+    func current() -> SFEngine? {
+        lock.lock()
+        defer { lock.unlock() }
+        return engine
+    }
 }
 
 private final class CallbackCounter: @unchecked Sendable {
@@ -54,6 +60,110 @@ private final class CallbackCounter: @unchecked Sendable {
     }
 }
 
+private final class SearchInfoRecorder: @unchecked Sendable {
+    private let lock = NSLock()
+    private var storage: [SFSearchInfo] = []
+    private var lines: [String] = []
+
+    func append(_ info: SFSearchInfo) {
+        lock.lock()
+        storage.append(info)
+        lock.unlock()
+    }
+
+    func appendLine(_ line: String) {
+        lock.lock()
+        lines.append(line)
+        lock.unlock()
+    }
+
+    var infos: [SFSearchInfo] {
+        lock.lock()
+        defer { lock.unlock() }
+        return storage
+    }
+
+    var textLines: [String] {
+        lock.lock()
+        defer { lock.unlock() }
+        return lines
+    }
+}
+
+private final class SearchTelemetryRecorder: @unchecked Sendable {
+    private let lock = NSLock()
+    private var storage: [SFSearchTelemetry] = []
+
+    func append(_ telemetry: SFSearchTelemetry) {
+        lock.lock()
+        storage.append(telemetry)
+        lock.unlock()
+    }
+
+    func removeAll() -> [SFSearchTelemetry] {
+        lock.lock()
+        defer { lock.unlock() }
+        let iterations = storage
+        storage.removeAll()
+        return iterations
+    }
+}
+
+private final class AnalysisCheckpointRecorder: @unchecked Sendable {
+    private let lock = NSLock()
+    private var checkpoints: [SFAnalysisCheckpoint] = []
+
+    func append(_ checkpoint: SFAnalysisCheckpoint?) {
+        guard let checkpoint else { return }
+        lock.lock()
+        checkpoints.append(checkpoint)
+        lock.unlock()
+    }
+
+    var last: SFAnalysisCheckpoint? {
+        lock.lock()
+        defer { lock.unlock() }
+        return checkpoints.last
+    }
+}
+
+private final class BatchSearchRecorder: @unchecked Sendable {
+    private let lock = NSLock()
+    private var storage: [Int: Result<SFSearchResult, Error>] = [:]
+    private var calls = 0
+    private var indices: [Int] = []
+
+    func record(_ index: Int, _ result: SFSearchResult?, _ error: Error?) {
+        lock.lock()
+        calls += 1
+        indices.append(index)
+        if let result {
+            storage[index] = .success(result)
+        } else if let error {
+            storage[index] = .failure(error)
+        }
+        lock.unlock()
+    }
+
+    var results: [Int: Result<SFSearchResult, Error>] {
+        lock.lock()
+        defer { lock.unlock() }
+        return storage
+    }
+
+    var callCount: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return calls
+    }
+
+    var order: [Int] {
+        lock.lock()
+        defer { lock.unlock() }
+        return indices
+    }
+}
+
 final class SFEngineTests: XCTestCase {
     private struct PerftCase {
         let name: String
@@ -239,29 +349,606 @@ final class SFEngineTests: XCTestCase {
         engine.stop()
     }
 
-    func testContractConcurrentInstanceIsRejectedAndCanRetryLater() async {
-        let rejected = expectation(description: "second_instance_rejected")
-        let retryStarted = expectation(description: "second_instance_retry_started")
-        let contender = SFEngine(lineHandler: { line in
-            if line == "info string StockfishEmbedded error: another SFEngine instance is already active" {
-                rejected.fulfill()
-            } else if line == "uciok" {
-                retryStarted.fulfill()
-            }
-        })
+    func testContractConcurrentInstancesSearchIndependently() async throws {
+        let second = SFEngineHarness()
+        defer { second.stop() }
+        try await second.startAndBootstrap(timeout: 10.0)
+
+        second.send("uci")
+        var secondOptions: [String] = []
+        let secondUCIOK = await second.waitForLine(
+            timeout: 5.0,
+            collecting: { secondOptions.append($0) },
+            matching: { $0 == "uciok" }
+        )
+        XCTAssertEqual(secondUCIOK, "uciok")
+        XCTAssertTrue(
+            secondOptions.contains { $0.hasPrefix("option name Hash ") },
+            "Second instance should list options. Lines: \(secondOptions)"
+        )
+
+        harness.send("position startpos moves e2e4")
+        second.send("position fen 4k3/8/8/8/8/8/4P3/4K3 w - - 0 1")
+        harness.send("go movetime 300")
+        second.send("go movetime 300")
+
+        let firstBestmove = await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+        let secondBestmove = await second.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+
+        guard let firstMove = firstBestmove.flatMap(SFEngineHarness.parseBestmove),
+              let secondMove = secondBestmove.flatMap(SFEngineHarness.parseBestmove) else {
+            XCTFail("Expected bestmove from both instances")
+            return
+        }
+
+        // Each bestmove must belong to its own instance's position: a black
+        // reply after 1.e4, and a king or e-pawn move in the pawn ending.
+        let firstFromRank = firstMove.dropFirst().first
+        XCTAssertTrue(
+            firstFromRank == "7" || firstFromRank == "8",
+            "Unexpected first-instance bestmove \(firstMove)"
+        )
+        XCTAssertTrue(
+            secondMove.hasPrefix("e1") || secondMove.hasPrefix("e2"),
+            "Unexpected second-instance bestmove \(secondMove)"
+        )
+    }
+
+    func testContractStartupTimingBreaksDownPhases() throws {
+        let timing = try XCTUnwrap(harness.startupTiming)
+        XCTAssertGreaterThan(timing.engineMilliseconds, 0)
+        XCTAssertGreaterThanOrEqual(timing.launchMilliseconds, 0)
+        XCTAssertLessThanOrEqual(
+            timing.tablesMilliseconds + timing.engineMilliseconds + timing.optionsMilliseconds,
+            timing.totalMilliseconds
+        )
+        XCTAssertTrue(timing.description.contains(timing.isWarm ? " warm " : " cold "))
+    }
+
+    func testContractPreparedTablesAreNotRebuiltAtStartup() async throws {
+        SFEngine.prepareTables()
+
+        let engine = SFEngineHarness()
+        defer { engine.stop() }
+        try await engine.startAndBootstrap(timeout: 10.0)
+
+        let timing = try XCTUnwrap(engine.startupTiming)
+        XCTAssertLessThan(timing.tablesMilliseconds, 1)
+    }
+
+    func testContractHashResetTimeIsReported() async {
+        // The bootstrap's `Clear Hash` already reset the table once.
+        XCTAssertGreaterThan(harness.lastHashResetMilliseconds, 0)
+
+        harness.send("position startpos")
+        harness.send("go depth 4")
+        await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+        harness.send("ucinewgame")
+        harness.send("isready")
+        let ready = await harness.waitForLine(timeout: 10.0, matching: { $0 == "readyok" })
+        XCTAssertEqual(ready, "readyok")
+        XCTAssertGreaterThan(harness.lastHashResetMilliseconds, 0)
+    }
+
+    func testContractHashStatisticsDescribeOccupancyByAge() async throws {
+        XCTAssertNil(harness.lastHashStatistics)
+
+        let first = await harness.runSearch(positionCommand: "position startpos", goCommand: "go depth 10", timeout: 10.0)
+        XCTAssertNotNil(first)
+        let afterFirst = try XCTUnwrap(harness.lastHashStatistics)
+        XCTAssertEqual(afterFirst.hashMegabytes, 16)
+        XCTAssertGreaterThan(afterFirst.hashfull, 0)
+        XCTAssertEqual(afterFirst.occupancyByAge.first?.intValue, afterFirst.hashfull)
 
-        contender.start()
-        await fulfillment(of: [rejected], timeout: 2.0)
+        let second = await harness.runSearch(
+            positionCommand: "position startpos moves e2e4 e7e5",
+            goCommand: "go depth 10",
+            timeout: 10.0
+        )
+        XCTAssertNotNil(second)
+        let afterSecond = try XCTUnwrap(harness.lastHashStatistics)
+        XCTAssertGreaterThanOrEqual(afterSecond.occupancyByAge.count, 2)
+        XCTAssertEqual(afterSecond.occupancyByAge.reduce(0) { $0 + $1.intValue }, afterSecond.occupied)
+    }
+
+    func testContractRootMovesRankTheFinishedSearchsLines() async throws {
+        XCTAssertNil(harness.lastRootMoves)
+
+        harness.send("setoption name MultiPV value 3")
+        let result = await harness.runSearch(
+            positionCommand: "position startpos moves e2e4 e7e5",
+            goCommand: "go depth 12",
+            timeout: 20.0
+        )
+        let bestmove = try XCTUnwrap(result?.bestmove)
+        let rootMoves = try XCTUnwrap(harness.lastRootMoves)
+
+        XCTAssertGreaterThanOrEqual(rootMoves.count, 3)
+        XCTAssertEqual(rootMoves.first?.pv.first, bestmove)
+        XCTAssertEqual(rootMoves.prefix(3).map(\.depth), [12, 12, 12])
+        XCTAssertEqual(rootMoves.prefix(3).map(\.multiPV), [1, 2, 3])
+        XCTAssertEqual(Set(rootMoves.compactMap { $0.pv.first }).count, rootMoves.count)
+        XCTAssertEqual(Set(rootMoves.map(\.lineID)).count, rootMoves.count)
+        XCTAssertTrue(rootMoves.dropFirst().allSatisfy { $0.depth <= 12 })
+    }
+
+    func testContractMemoryBudgetSizesHashAndReportsBreakdown() async throws {
+        harness.send("setoption name MemoryBudgetMB value 300")
+        harness.send("isready")
+
+        var transcript: [String] = []
+        let ready = await harness.waitForLine(
+            timeout: 10.0,
+            collecting: { transcript.append($0) },
+            matching: { $0 == "readyok" }
+        )
+        XCTAssertEqual(ready, "readyok")
+
+        let report = try XCTUnwrap(transcript.first { $0.hasPrefix("info string Memory budget 300 MB: hash ") })
+        XCTAssertFalse(report.contains("over budget"))
+        let hashField = report.dropFirst("info string Memory budget 300 MB: hash ".count).prefix { $0.isNumber }
+        let hashMegabytes = try XCTUnwrap(Int(hashField))
+        XCTAssertGreaterThan(hashMegabytes, 16)
+        XCTAssertLessThan(hashMegabytes, 300)
+    }
+
+    func testContractRecommendedMemoryBudgetFitsNetworkAndHash() async throws {
+        let budget = SFEngine.recommendedMemoryBudgetMegabytes
+        XCTAssertGreaterThanOrEqual(budget, 128)
+        XCTAssertLessThanOrEqual(budget, 1024)
+
+        harness.send("setoption name MemoryBudgetMB value \(budget)")
+        let report = await harness.waitForLine(timeout: 5.0, matching: { $0.contains("Memory budget") })
+        XCTAssertNotNil(report)
+        XCTAssertFalse(report?.contains("over budget") ?? true)
+    }
+
+    func testContractPerformanceCoresOnlyCapsThreads() async throws {
+        let performanceCores = SFEngine.performanceCoreCount
+        harness.send("setoption name Threads value 64")
+        harness.send("setoption name PerformanceCoresOnly value true")
+        harness.send("go depth 1")
 
+        let report = try XCTUnwrap(await harness.waitForLine(
+            timeout: 10.0,
+            matching: { $0.contains("performance cores") || $0.contains("PerformanceCoresOnly") }
+        ))
+        if performanceCores > 0 {
+            XCTAssertEqual(
+                report,
+                "info string Using \(performanceCores) threads for \(performanceCores) performance cores, "
+                    + "leaving \(SFEngine.efficiencyCoreCount) efficiency cores unused"
+            )
+        } else {
+            XCTAssertEqual(report, "info string PerformanceCoresOnly has no effect: all cores are of one class")
+        }
+        _ = await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+    }
+
+    func testContractCompilerReportsLargePageStatus() async {
+        harness.send("compiler")
+        let line = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("info string Large pages: ") })
+        // The vendored allocator has no large-page path on Apple platforms.
+        XCTAssertEqual(line, "info string Large pages: no")
+    }
+
+    func testContractCompilerReportsSIMDSettings() async {
+        harness.send("compiler")
+        let line = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("Compilation settings") })
+        XCTAssertNotNil(line)
+        guard let settings = line else { return }
+        XCTAssertTrue(settings.contains("64bit"), settings)
+        XCTAssertTrue(settings.contains("POPCNT"), settings)
+        #if arch(arm64)
+        XCTAssertTrue(settings.contains("NEON_DOTPROD"), settings)
+        #elseif arch(x86_64)
+        XCTAssertTrue(settings.contains("SSE41"), settings)
+        #endif
+    }
+
+    func testContractChangingQualityOfServiceRebuildsThreadsBetweenSearches() async {
+        harness.send("position startpos")
+        harness.send("go depth 8")
+        harness.searchQualityOfService = .utility
+        XCTAssertEqual(harness.searchQualityOfService, .utility)
+
+        // The rebuild waits for the running search, which still completes.
+        let bestmove = await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+        XCTAssertNotNil(bestmove)
+
+        harness.searchQualityOfService = .userInitiated
+        let result = await harness.runSearch(positionCommand: "position startpos", goCommand: "go depth 6", timeout: 10.0)
+        XCTAssertNotNil(result)
+    }
+
+    func testContractHashLimitShrinksOnlyLargerTables() async {
+        harness.send("setoption name Hash value 64")
+        harness.limitHash(toMegabytes: 128)
+        harness.limitHash(toMegabytes: 16)
+        harness.limitHash(toMegabytes: 16)
         harness.send("isready")
-        let originalReady = await harness.waitForLine(timeout: 5.0, matching: { $0 == "readyok" })
-        XCTAssertEqual(originalReady, "readyok")
 
+        var transcript: [String] = []
+        let ready = await harness.waitForLine(
+            timeout: 10.0,
+            collecting: { transcript.append($0) },
+            matching: { $0 == "readyok" }
+        )
+        XCTAssertEqual(ready, "readyok")
+        XCTAssertEqual(transcript.filter { $0.hasPrefix("info string Hash reduced") },
+                       ["info string Hash reduced from 64 to 16 MB"])
+        XCTAssertGreaterThan(harness.lastHashResetMilliseconds, 0)
+    }
+
+    func testContractWarmStartReusesEngineWithDefaultOptions() async throws {
+        let cold = try XCTUnwrap(harness.startupTiming)
+        XCTAssertFalse(cold.isWarm)
+        harness.stop()
+
+        SFEngine.keepsEngineWarm = true
+        defer { SFEngine.keepsEngineWarm = false }
+
+        let first = SFEngineHarness()
+        try await first.startAndBootstrap(timeout: 10.0)
+        first.send("setoption name UCI_ShowWDL value true")
+        first.send("isready")
+        await first.waitForLine(timeout: 5.0, matching: { $0 == "readyok" })
+        first.stop()
+
+        let second = SFEngineHarness()
+        defer { second.stop() }
+        try await second.startAndBootstrap(timeout: 10.0)
+
+        let warm = try XCTUnwrap(second.startupTiming)
+        XCTAssertTrue(warm.isWarm)
+        XCTAssertLessThan(warm.engineMilliseconds, cold.engineMilliseconds)
+
+        // UCI_ShowWDL was reset to its default before the engine was kept.
+        var transcript: [String] = []
+        second.send("position startpos")
+        second.send("go depth 6")
+        await second.waitForLine(
+            timeout: 10.0,
+            collecting: { transcript.append($0) },
+            matching: { $0.hasPrefix("bestmove ") }
+        )
+        XCTAssertTrue(transcript.contains { $0.contains(" pv ") })
+        XCTAssertFalse(transcript.contains { $0.contains(" wdl ") })
+    }
+
+    func testContractWarmSearchStateReusesHashAcrossEngines() async throws {
         harness.stop()
-        contender.start()
-        contender.sendCommand("uci")
-        await fulfillment(of: [retryStarted], timeout: 5.0)
-        contender.stop()
+        SFEngine.keepsEngineWarm = true
+        SFEngine.keepsSearchStateWarm = true
+        defer {
+            SFEngine.keepsSearchStateWarm = false
+            SFEngine.keepsEngineWarm = false
+        }
+
+        // Option assignments such as Hash or Clear Hash rebuild the table, so
+        // these engines search with defaults and no setup commands.
+        func searchNodes() async -> Int? {
+            let recorder = SearchInfoRecorder()
+            let bestmoveReceived = expectation(description: "bestmove")
+            let engine = SFEngine { line in
+                recorder.appendLine(line)
+                if line.hasPrefix("bestmove ") {
+                    bestmoveReceived.fulfill()
+                }
+            }
+            engine.start()
+            engine.sendCommand("position startpos moves e2e4")
+            engine.sendCommand("go depth 10")
+            await fulfillment(of: [bestmoveReceived], timeout: 20.0)
+            engine.stop()
+
+            let fields = recorder.textLines.last { $0.hasPrefix("info depth 10 ") }?.split(separator: " ") ?? []
+            return fields.firstIndex(of: "nodes").flatMap { Int(fields[$0 + 1]) }
+        }
+
+        let coldNodes = try XCTUnwrap(await searchNodes())
+        let warmNodes = try XCTUnwrap(await searchNodes())
+        XCTAssertLessThan(warmNodes, coldNodes, "A retained hash should shorten the repeated search")
+    }
+
+    func testContractEvalFileLoadsNetworkFromAbsolutePath() async throws {
+        let network = try SFEngineHarness.networkFile()
+
+        harness.send("setoption name EvalFile value \(network.path)")
+        harness.send("position startpos")
+        harness.send("go depth 1")
+        let loaded = await harness.waitForLine(
+            timeout: 10.0,
+            matching: { $0.hasPrefix("info string NNUE evaluation using ") }
+        )
+        XCTAssertEqual(loaded?.hasPrefix("info string NNUE evaluation using \(network.path) "), true)
+        await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+    }
+
+    func testContractNetworkSwapValidatesDuringSearchAndKeepsNetworkOnFailure() async throws {
+        let network = try SFEngineHarness.networkFile()
+
+        do {
+            _ = try await harness.swapNetwork(toFile: network.appendingPathExtension("missing").path)
+            XCTFail("Expected a missing network file to be rejected")
+        } catch let error as NSError {
+            XCTAssertEqual(error.code, SFEngineError.networkUnavailable.rawValue)
+        }
+
+        harness.send("position startpos")
+        harness.send("go movetime 500")
+        let timings = try await XCTUnwrap(harness.swapNetwork(toFile: network.path))
+        XCTAssertGreaterThan(timings.0, 0)
+        XCTAssertGreaterThanOrEqual(timings.1, 0)
+        XCTAssertNotNil(await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") }))
+
+        harness.send("go depth 1")
+        let loaded = await harness.waitForLine(
+            timeout: 10.0,
+            matching: { $0.hasPrefix("info string NNUE evaluation using ") }
+        )
+        XCTAssertEqual(loaded?.hasPrefix("info string NNUE evaluation using \(network.path) "), true)
+        await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+    }
+
+    func testContractIllegalPositionIsReportedAndKeepsPreviousPosition() async {
+        harness.send("position startpos moves e2e4")
+        harness.send("position startpos moves e2e5")
+
+        let error = await harness.waitForLine(
+            timeout: 5.0,
+            matching: { $0.hasPrefix("info string StockfishEmbedded error: ") }
+        )
+        XCTAssertEqual(
+            error,
+            "info string StockfishEmbedded error: command `position startpos moves e2e5` failed: "
+                + "Illegal move: e2e5; keeping the previous position"
+        )
+
+        harness.send("d")
+        let fen = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("Fen: ") })
+        XCTAssertEqual(fen, "Fen: rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1")
+
+        harness.send("isready")
+        let ready = await harness.waitForLine(timeout: 5.0, matching: { $0 == "readyok" })
+        XCTAssertEqual(ready, "readyok")
+    }
+
+    func testContractResentGameExtendsPositionAndRejectsBadTail() async {
+        harness.send("position startpos moves e2e4 e7e5")
+        harness.send("position startpos moves e2e4 e7e5 g1f3 b8c6")
+        harness.send("position startpos moves e2e4 e7e5 g1f3 b8c6 f1c4 e8e6")
+
+        let error = await harness.waitForLine(
+            timeout: 5.0,
+            matching: { $0.hasPrefix("info string StockfishEmbedded error: ") }
+        )
+        XCTAssertEqual(error?.hasSuffix("Illegal move: e8e6; keeping the previous position"), true)
+
+        // The rejected tail was rolled back, so resending the same game is valid again.
+        harness.send("position startpos moves e2e4 e7e5 g1f3 b8c6")
+        harness.send("d")
+        let fen = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("Fen: ") })
+        XCTAssertEqual(fen, "Fen: r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3")
+
+        harness.send("position startpos moves e2e4 e7e5 g1f3 b8c6 f1c4")
+        harness.send("d")
+        let extended = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("Fen: ") })
+        XCTAssertEqual(extended, "Fen: r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 3 3")
+    }
+
+    func testContractPushAndPopMoveStepThroughGame() async {
+        harness.send("position startpos moves e2e4 e7e5")
+        harness.pushMove("g1f3")
+        harness.pushMove("b8c6")
+        harness.pushMove("f3g1")
+        harness.pushMove("e1e8")
+
+        let error = await harness.waitForLine(
+            timeout: 5.0,
+            matching: { $0.hasPrefix("info string StockfishEmbedded error: ") }
+        )
+        XCTAssertEqual(error?.hasSuffix("Illegal move: e1e8; keeping the previous position"), true)
+
+        harness.popMove()
+        harness.send("d")
+        let fen = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("Fen: ") })
+        XCTAssertEqual(fen, "Fen: r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3")
+
+        for _ in 0..<5 {
+            harness.popMove()
+        }
+        let empty = await harness.waitForLine(
+            timeout: 5.0,
+            matching: { $0.hasPrefix("info string StockfishEmbedded error: ") }
+        )
+        XCTAssertEqual(empty?.hasSuffix("failed: No move to take back"), true)
+
+        harness.send("d")
+        let start = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("Fen: ") })
+        XCTAssertEqual(start, "Fen: rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1")
+    }
+
+    func testContractTablebaseProbeWithoutTablesReportsAnError() async {
+        harness.send("position fen 8/8/8/8/8/8/k7/2R1K3 w - - 0 1")
+        harness.send("tbprobe")
+
+        let error = await harness.waitForLine(
+            timeout: 5.0,
+            matching: { $0.hasPrefix("info string StockfishEmbedded error: ") }
+        )
+        XCTAssertEqual(error?.hasSuffix("failed: the position is not covered by the loaded tablebases"), true)
+
+        harness.send("isready")
+        let ready = await harness.waitForLine(timeout: 5.0, matching: { $0 == "readyok" })
+        XCTAssertEqual(ready, "readyok")
+    }
+
+    func testContractKPKBitbaseAnswersWithoutTablebases() async {
+        // King in front of its pawn on the sixth rank wins with either side to move.
+        harness.send("position fen 4k3/8/4K3/4P3/8/8/8/8 b - - 0 1")
+        harness.send("tbprobe")
+        let loss = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("info string tbprobe ") })
+        XCTAssertEqual(loss, "info string tbprobe wdl -2 bitbase")
+
+        // A rook pawn with the defending king ahead of it is a draw.
+        harness.send("position fen 8/8/8/8/8/k7/P7/K7 w - - 0 1")
+        harness.send("go depth 4")
+        let report = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("info string Bitbase: ") })
+        XCTAssertEqual(report, "info string Bitbase: KPK draw for the side to move")
+        let bestMove = await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+        XCTAssertNotNil(bestMove)
+    }
+
+    func testContractSyzygyPathLoadsInTheBackground() async throws {
+        let directory = FileManager.default.temporaryDirectory.appendingPathComponent(UUID().uuidString)
+        try FileManager.default.createDirectory(at: directory, withIntermediateDirectories: true)
+        defer { try? FileManager.default.removeItem(at: directory) }
+
+        var transcript: [String] = []
+        harness.send("setoption name SyzygyPath value \(directory.path)")
+        harness.send("go depth 2")
+        let bestMove = await harness.waitForLine(
+            timeout: 10.0,
+            collecting: { transcript.append($0) },
+            matching: { $0.hasPrefix("bestmove ") }
+        )
+        XCTAssertNotNil(bestMove)
+
+        let loading = try XCTUnwrap(transcript.firstIndex(of: "info string Loading Syzygy tablebases in the background"))
+        let ready = try XCTUnwrap(transcript.firstIndex { $0.hasPrefix("info string Syzygy tablebases ready: up to 0-man") })
+        XCTAssertLessThan(loading, ready)
+        // The search waits for the scan, so its output follows the report.
+        let firstInfo = try XCTUnwrap(transcript.firstIndex { $0.hasPrefix("info depth ") })
+        XCTAssertLessThan(ready, firstInfo)
+        harness.send("setoption name SyzygyPath value <empty>")
+    }
+
+    func testContractSyzygyPrefetchIsIdleWithoutTablebases() async {
+        harness.send("uci")
+        let option = await harness.waitForLine(timeout: 5.0, matching: { $0.contains("name SyzygyPrefetch ") })
+        XCTAssertEqual(option, "option name SyzygyPrefetch type check default false")
+
+        var transcript: [String] = []
+        harness.send("setoption name SyzygyPrefetch value true")
+        harness.send("go depth 4")
+        let bestMove = await harness.waitForLine(
+            timeout: 10.0,
+            collecting: { transcript.append($0) },
+            matching: { $0.hasPrefix("bestmove ") }
+        )
+        XCTAssertNotNil(bestMove)
+        XCTAssertFalse(transcript.contains { $0.contains("Syzygy") })
+    }
+
+    func testContractOpeningBookAnswersWithoutSearching() async throws {
+        let book = try SFEngine.openingBook(
+            games: [["e2e4", "e7e5", "g1f3"], ["e2e4", "c7c5"], ["d2d4", "d7d5"]],
+            maxPly: 2
+        )
+        XCTAssertEqual(book.count, 5 * 16)
+        XCTAssertThrowsError(try SFEngine.openingBook(games: [["e2e4", "e2e4"]], maxPly: 2))
+
+        let file = FileManager.default.temporaryDirectory.appendingPathComponent(UUID().uuidString + ".book")
+        try book.write(to: file)
+        defer { try? FileManager.default.removeItem(at: file) }
+
+        harness.send("setoption name BookFile value \(file.path)")
+        XCTAssertNotNil(await harness.waitForLine(timeout: 5.0, matching: { $0 == "info string Opening book: 5 entries" }))
+
+        var transcript: [String] = []
+        harness.send("position startpos")
+        harness.send("go movetime 10000")
+        let bookMove = await harness.waitForLine(
+            timeout: 2.0,
+            collecting: { transcript.append($0) },
+            matching: { $0.hasPrefix("bestmove ") }
+        )
+        XCTAssertEqual(bookMove, "bestmove e2e4")
+        XCTAssertTrue(transcript.contains("info string Book move e2e4, weight 2 of 3"))
+        XCTAssertFalse(transcript.contains { $0.hasPrefix("info depth ") })
+
+        // Past the book's plies, and for analysis, the engine searches as usual.
+        harness.send("position startpos moves e2e4 e7e5")
+        harness.send("go depth 2")
+        let searched = await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+        XCTAssertNotNil(searched)
+        harness.send("position startpos")
+        harness.send("go depth 2 searchmoves d2d4")
+        let analysed = await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+        XCTAssertEqual(analysed, "bestmove d2d4")
+
+        harness.send("setoption name BookFile value <empty>")
+    }
+
+    func testContractBookMoveAfterStopFollowsThePreviousBestmove() async throws {
+        let book = try SFEngine.openingBook(games: [["e2e4", "e7e5"]], maxPly: 1)
+        let file = FileManager.default.temporaryDirectory.appendingPathComponent(UUID().uuidString + ".book")
+        try book.write(to: file)
+        defer { try? FileManager.default.removeItem(at: file) }
+
+        harness.send("setoption name BookFile value \(file.path)")
+        XCTAssertNotNil(await harness.waitForLine(timeout: 5.0, matching: { $0 == "info string Opening book: 1 entries" }))
+
+        // Each round stops an off-book search and immediately asks for a book
+        // move, which must not be reported before the stopped search's bestmove.
+        var bestmoves: [String] = []
+        for _ in 0..<5 {
+            harness.send("position startpos moves e2e4 e7e5")
+            harness.send("go infinite")
+            XCTAssertNotNil(await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("info depth ") }))
+            harness.send("stop")
+            harness.send("position startpos")
+            harness.send("go movetime 10000")
+            for _ in 0..<2 {
+                if let line = await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") }) {
+                    bestmoves.append(line)
+                }
+            }
+        }
+        XCTAssertEqual(bestmoves.count, 10)
+        for (index, line) in bestmoves.enumerated() {
+            if index % 2 == 0 {
+                XCTAssertNotEqual(line, "bestmove e2e4")
+            } else {
+                XCTAssertEqual(line, "bestmove e2e4")
+            }
+        }
+        harness.send("isready")
+        XCTAssertNotNil(await harness.waitForLine(timeout: 5.0, matching: { $0 == "readyok" }))
+        XCTAssertNil(await harness.waitForLine(timeout: 0.5, matching: { $0.hasPrefix("bestmove ") }))
+
+        harness.send("setoption name BookFile value <empty>")
+    }
+
+    func testContractMateProofAfterStopFollowsThePreviousBestmove() async {
+        // As with book moves, a proven mate is reported from the UCI thread
+        // and must not overtake the stopped search's bestmove.
+        var bestmoves: [String] = []
+        for _ in 0..<5 {
+            harness.send("position startpos moves e2e4 e7e5")
+            harness.send("go infinite")
+            XCTAssertNotNil(await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("info depth ") }))
+            harness.send("stop")
+            harness.send("position startpos moves f2f3 e7e5 g2g4")
+            harness.send("go mate 1")
+            for _ in 0..<2 {
+                if let line = await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") }) {
+                    bestmoves.append(line)
+                }
+            }
+        }
+        XCTAssertEqual(bestmoves.count, 10)
+        for (index, line) in bestmoves.enumerated() {
+            if index % 2 == 0 {
+                XCTAssertNotEqual(line, "bestmove d8h4")
+            } else {
+                XCTAssertEqual(line, "bestmove d8h4")
+            }
+        }
+        harness.send("isready")
+        XCTAssertNotNil(await harness.waitForLine(timeout: 5.0, matching: { $0 == "readyok" }))
+        XCTAssertNil(await harness.waitForLine(timeout: 0.5, matching: { $0.hasPrefix("bestmove ") }))
     }
 
     func testContractRejectsUnsafeCommandShapesWithoutBreakingUCI() async {
@@ -287,31 +974,1102 @@ final class SFEngineTests: XCTestCase {
         })
 
         engine.start()
-        engine.sendCommand("uci\nisready")
-        engine.sendCommand("\0uci")
-        engine.sendCommand("setoption name Debug Log File value /tmp/stockfish.log")
-        engine.sendCommand("uci\r\n")
+        engine.sendCommand("uci\nisready")
+        engine.sendCommand("\0uci")
+        engine.sendCommand("setoption name Debug Log File value /tmp/stockfish.log")
+        engine.sendCommand("uci\r\n")
+
+        await fulfillment(
+            of: [multilineRejected, nulRejected, debugLogRejected, uciAccepted],
+            timeout: 5.0
+        )
+        engine.stop()
+    }
+
+    func testContractCommandBatchesAreQueuedWholeOrNotAtAll() async {
+        harness.stop()
+        let batchRejected = expectation(description: "batch_rejected")
+        let bytesRejected = expectation(description: "bytes_rejected")
+        let oversizedRejected = expectation(description: "oversized_rejected")
+        let ready = expectation(description: "readyok")
+        let uciCount = CallbackCounter()
+
+        let engine = SFEngine(lineHandler: { line in
+            switch line {
+            case "info string StockfishEmbedded error: command 2: command contains NUL":
+                batchRejected.fulfill()
+            case "info string StockfishEmbedded error: line 3: Debug Log File is unsupported by the embedded stream bridge":
+                bytesRejected.fulfill()
+            case "info string StockfishEmbedded error: a batch of 1025 commands exceeds the command queue's 1024":
+                oversizedRejected.fulfill()
+            case "uciok":
+                _ = uciCount.increment()
+            case "readyok":
+                ready.fulfill()
+            default:
+                break
+            }
+        })
+        defer { engine.stop() }
+
+        engine.start()
+        engine.sendCommands(["uci", "\0isready"])
+        let rejected = Array("uci\n\nsetoption name Debug Log File value /tmp/stockfish.log".utf8CString)
+        rejected.withUnsafeBufferPointer { engine.sendCommands(bytes: $0.baseAddress!, length: UInt(rejected.count - 1)) }
+        let accepted = Array("uci\r\nisready".utf8CString)
+        engine.sendCommands(["uci"] + Array(repeating: "isready", count: 1024))
+        accepted.withUnsafeBufferPointer { engine.sendCommands(bytes: $0.baseAddress!, length: UInt(accepted.count - 1)) }
+
+        await fulfillment(of: [batchRejected, bytesRejected, oversizedRejected, ready], timeout: 5.0)
+        XCTAssertEqual(uciCount.value, 1, "Only the accepted batch reaches the engine")
+    }
+
+    func testContractConcurrentStartAndStopCallsDoNotRaceLifecycle() {
+        harness.stop()
+        let engine = SFEngine(lineHandler: { _ in })
+        let engineHolder = SFEngineHolder()
+        engineHolder.store(engine)
+
+        DispatchQueue.concurrentPerform(iterations: 100) { index in
+            if index.isMultiple(of: 2) {
+                engineHolder.start()
+            } else {
+                engineHolder.stop()
+            }
+        }
+        engine.stop()
+    }
+
+    func testContractStructuredSearchInfoMatchesTextOutput() async {
+        harness.stop()
+        let recorder = SearchInfoRecorder()
+        let bestMoveReceived = expectation(description: "structured_bestmove")
+        let bestmoveLineReceived = expectation(description: "text_bestmove")
+        let bestMoveHolder = SearchInfoRecorder()
+
+        let engine = SFEngine(
+            lineHandler: { line in
+                recorder.appendLine(line)
+                if line.hasPrefix("bestmove ") {
+                    bestmoveLineReceived.fulfill()
+                }
+            },
+            searchInfoHandler: { info in
+                recorder.append(info)
+            },
+            bestMoveHandler: { bestMove, ponderMove in
+                bestMoveHolder.appendLine(bestMove)
+                if let ponderMove {
+                    bestMoveHolder.appendLine(ponderMove)
+                }
+                bestMoveReceived.fulfill()
+            }
+        )
+        defer { engine.stop() }
+
+        engine.start()
+        engine.sendCommand("setoption name Threads value 1")
+        engine.sendCommand("setoption name UCI_ShowWDL value true")
+        engine.sendCommand("position startpos")
+        engine.sendCommand("go depth 8")
+        await fulfillment(of: [bestMoveReceived, bestmoveLineReceived], timeout: 10.0, enforceOrder: true)
+
+        let infos = recorder.infos
+        let infoLines = recorder.textLines.filter { $0.hasPrefix("info depth ") && $0.contains(" pv ") }
+        XCTAssertFalse(infos.isEmpty, "Expected structured search info")
+        XCTAssertEqual(infos.count, infoLines.count, "Each info pv line should have a typed twin")
+
+        guard let last = infos.last, let lastLine = infoLines.last else {
+            return
+        }
+        XCTAssertEqual(last.depth, 8)
+        XCTAssertEqual(last.multiPV, 1)
+        XCTAssertTrue(last.hasWDL)
+        XCTAssertEqual(last.wdlWin + last.wdlDraw + last.wdlLoss, 1000)
+        XCTAssertGreaterThan(last.nodes, 0)
+        XCTAssertTrue(lastLine.hasSuffix(" pv " + last.pv.joined(separator: " ")))
+        XCTAssertEqual(last.scoreType, .centipawns)
+        XCTAssertTrue(lastLine.contains(" score cp \(last.scoreValue)"))
+        XCTAssertEqual(bestMoveHolder.textLines.first, last.pv.first)
+    }
+
+    func testContractAnalysisCheckpointResumesAtTheSavedDepth() async throws {
+        harness.stop()
+        let recorder = AnalysisCheckpointRecorder()
+
+        let first = SFEngine()
+        first.start()
+        let paused = expectation(description: "first_checkpoint")
+        let ticket = first.resumeAnalysis(from: SFAnalysisCheckpoint(fen: nil, moves: ["e2e4"]), infoHandler: nil) {
+            checkpoint, error in
+            XCTAssertNil(error)
+            recorder.append(checkpoint)
+            paused.fulfill()
+        }
+        try await Task.sleep(for: .seconds(1))
+        first.cancelSearch(ticket)
+        await fulfillment(of: [paused], timeout: 10.0)
+        first.stop()
+
+        // It survives the round trip through its data, as after a relaunch.
+        let reached = try XCTUnwrap(recorder.last)
+        XCTAssertGreaterThan(reached.depth, 5)
+        XCTAssertGreaterThan(reached.nodes, 0)
+        let saved = try SFAnalysisCheckpoint(data: reached.dataRepresentation)
+        XCTAssertNil(saved.fen)
+        XCTAssertEqual(saved.moves, ["e2e4"])
+        XCTAssertEqual(saved.depth, reached.depth)
+        XCTAssertEqual(saved.nodes, reached.nodes)
+        XCTAssertEqual(saved.rootMoves.map(\.pv), reached.rootMoves.map(\.pv))
+        XCTAssertEqual(saved.rootMoves.first?.scoreValue, reached.rootMoves.first?.scoreValue)
+
+        // A fresh engine shows the saved line first, then nothing shallower.
+        let infos = SearchInfoRecorder()
+        let second = SFEngine()
+        defer { second.stop() }
+        second.start()
+        let resumed = expectation(description: "second_checkpoint")
+        let resumedTicket = second.resumeAnalysis(from: saved, infoHandler: { infos.append($0) }) {
+            checkpoint, error in
+            XCTAssertNil(error)
+            recorder.append(checkpoint)
+            resumed.fulfill()
+        }
+        try await Task.sleep(for: .seconds(2))
+        second.cancelSearch(resumedTicket)
+        await fulfillment(of: [resumed], timeout: 10.0)
+
+        let updates = infos.infos
+        XCTAssertEqual(updates.first?.pv, saved.rootMoves.first?.pv)
+        XCTAssertTrue(updates.dropFirst().allSatisfy { $0.depth >= saved.depth }, "\(updates.map(\.depth))")
+        let continued = try XCTUnwrap(recorder.last)
+        XCTAssertGreaterThanOrEqual(continued.depth, saved.depth)
+        XCTAssertGreaterThan(continued.nodes, saved.nodes)
+        XCTAssertGreaterThan(continued.timeMilliseconds, saved.timeMilliseconds)
+
+        XCTAssertThrowsError(try SFAnalysisCheckpoint(data: Data("not a checkpoint".utf8))) { error in
+            XCTAssertEqual((error as NSError).code, SFEngineError.invalidCheckpoint.rawValue)
+        }
+    }
+
+    func testContractNativeSearchReturnsTypedResultWithoutUCIText() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+
+        engine.start()
+        engine.sendCommand("setoption name Threads value 1")
+
+        let result = try await engine.searchFEN(nil, moves: ["e2e4", "e7e5"], limits: SFSearchLimits(depth: 8))
+        let bestMove = try XCTUnwrap(result.bestMove)
+        XCTAssertNotNil(
+            Self.validBestmoveRegex.firstMatch(
+                in: bestMove,
+                range: NSRange(bestMove.startIndex..., in: bestMove)
+            )
+        )
+        let info = try XCTUnwrap(result.info)
+        XCTAssertEqual(info.depth, 8)
+        XCTAssertEqual(info.pv.first, bestMove)
+
+        let mate = try await engine.searchFEN(
+            "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1",
+            moves: [],
+            limits: SFSearchLimits(depth: 6)
+        )
+        XCTAssertEqual(mate.bestMove, "a1a8")
+        XCTAssertEqual(mate.info?.scoreType, .mate)
+        XCTAssertEqual(mate.info?.scoreValue, 1)
+
+        let stalemate = try await engine.searchFEN(
+            "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1",
+            moves: [],
+            limits: SFSearchLimits(depth: 3)
+        )
+        XCTAssertNil(stalemate.bestMove)
+    }
+
+    func testContractResultCacheServesRepeatedSearchesAcrossEngines() async throws {
+        harness.stop()
+        let file = FileManager.default.temporaryDirectory.appendingPathComponent(UUID().uuidString + ".cache")
+        defer { try? FileManager.default.removeItem(at: file) }
+
+        let first = SFEngine()
+        first.start()
+        first.sendCommand("setoption name ResultCacheMB value 1")
+        first.sendCommand("setoption name ResultCacheFile value \(file.path)")
+        let before = SFEngine.resultCacheStatistics
+
+        let limits = SFSearchLimits(depth: 9)
+        let searched = try await first.searchFEN(nil, moves: ["e2e4"], limits: limits)
+        XCTAssertFalse(searched.isCached)
+        let repeated = try await first.searchFEN(nil, moves: ["e2e4"], limits: limits)
+        XCTAssertTrue(repeated.isCached)
+        XCTAssertEqual(repeated.bestMove, searched.bestMove)
+        XCTAssertEqual(repeated.info?.pv, searched.info?.pv)
+        XCTAssertEqual(repeated.info?.scoreValue, searched.info?.scoreValue)
+
+        // Other limits, or a different history into the position, search again.
+        let deeper = try await first.searchFEN(nil, moves: ["e2e4"], limits: SFSearchLimits(depth: 10))
+        XCTAssertFalse(deeper.isCached)
+
+        // Turning the cache off unmaps the file; the search orders after the setoption.
+        first.sendCommand("setoption name ResultCacheMB value 0")
+        _ = try await first.searchFEN(nil, moves: [], limits: SFSearchLimits(depth: 1))
+        XCTAssertEqual(SFEngine.resultCacheStatistics.capacity, 0)
+        first.stop()
+
+        // A new engine maps the same file and finds the stored result.
+        let second = SFEngine()
+        defer { second.stop() }
+        second.start()
+        second.sendCommand("setoption name ResultCacheMB value 1")
+        second.sendCommand("setoption name ResultCacheFile value \(file.path)")
+        let reopened = try await second.searchFEN(nil, moves: ["e2e4"], limits: limits)
+        XCTAssertTrue(reopened.isCached)
+        XCTAssertEqual(reopened.bestMove, searched.bestMove)
+
+        let after = SFEngine.resultCacheStatistics
+        XCTAssertEqual(after.hits - before.hits, 2)
+        XCTAssertEqual(after.stores - before.stores, 2)
+        XCTAssertEqual(after.capacity, 4096)
+        XCTAssertGreaterThan(after.hitRate, 0)
+
+        second.sendCommand("setoption name ResultCacheMB value 0")
+        _ = try await second.searchFEN(nil, moves: [], limits: SFSearchLimits(depth: 1))
+    }
+
+    func testContractAsyncSearchCancelsWithItsTask() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+        let holder = SFEngineHolder()
+        holder.store(engine)
+
+        // Without limits the search ends only when its task is cancelled; a
+        // search queued behind it is withdrawn without running.
+        let running = Task { try await holder.current()?.search(moves: ["e2e4"], limits: SFSearchLimits()) }
+        try await Task.sleep(nanoseconds: 300_000_000)
+        let queued = Task { try await holder.current()?.search(moves: ["d2d4"], limits: SFSearchLimits(depth: 30)) }
+        try await Task.sleep(nanoseconds: 50_000_000)
+        queued.cancel()
+        let cancelled = Date()
+        running.cancel()
+        for task in [queued, running] {
+            do {
+                _ = try await task.value
+                XCTFail("A cancelled search should throw CancellationError")
+            } catch {
+                XCTAssertTrue(error is CancellationError, "\(error)")
+            }
+        }
+        XCTAssertLessThan(Date().timeIntervalSince(cancelled), 1)
+
+        // The engine is idle again, and updates stream in order until bestmove.
+        var depths: [Int] = []
+        for try await info in engine.searchUpdates(moves: ["e2e4"], limits: SFSearchLimits(depth: 8)) {
+            depths.append(info.depth)
+        }
+        XCTAssertEqual(depths.last, 8)
+        XCTAssertEqual(depths, depths.sorted())
+
+        let result = try await engine.search(moves: ["e2e4"], limits: SFSearchLimits(depth: 4))
+        XCTAssertNotNil(result.bestMove)
+
+        do {
+            for try await _ in engine.searchUpdates(moves: ["e2e5"], limits: SFSearchLimits(depth: 4)) {}
+            XCTFail("An illegal move should fail the stream")
+        } catch let error as NSError {
+            XCTAssertEqual(error.domain, SFEngineErrorDomain)
+            XCTAssertEqual(error.code, SFEngineError.invalidPosition.rawValue)
+        }
+    }
+
+    func testContractQueuedNativeSearchesReportQueueAndSearchTime() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+
+        engine.start()
+        let limits = SFSearchLimits(depth: 10)
+        async let first = engine.searchFEN(nil, moves: ["e2e4"], limits: limits)
+        async let second = engine.searchFEN(nil, moves: ["d2d4"], limits: limits)
+        async let third = engine.searchFEN(nil, moves: ["c2c4"], limits: limits)
+        let results = try await [first, second, third]
+
+        for result in results {
+            XCTAssertNotNil(result.bestMove)
+            XCTAssertGreaterThan(result.searchMilliseconds, 0)
+        }
+        // Whichever job ran last waited in the queue for at least one other search.
+        let longestQueue = results.map(\.queueMilliseconds).max() ?? 0
+        let shortestSearch = results.map(\.searchMilliseconds).min() ?? 0
+        XCTAssertGreaterThanOrEqual(longestQueue, shortestSearch)
+    }
+
+    func testContractProvisionalBestMoveArrivesBeforeFinalResult() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+
+        let limits = SFSearchLimits(depth: 14)
+        limits.provisionalDepth = 4
+        let recorder = SearchInfoRecorder()
+        let result = try await engine.searchFEN(nil, moves: ["e2e4"], limits: limits, provisionalHandler: { bestMove, info in
+            recorder.appendLine(bestMove)
+            recorder.append(info)
+        })
+
+        XCTAssertEqual(recorder.textLines.count, 1)
+        let provisional = try XCTUnwrap(recorder.infos.first)
+        XCTAssertEqual(provisional.depth, 4)
+        XCTAssertEqual(recorder.textLines.first, provisional.pv.first)
+        XCTAssertEqual(result.info?.depth, 14)
+        XCTAssertNotNil(result.bestMove)
+
+        // A search that ends before the provisional depth reports only its result.
+        limits.depth = 2
+        _ = try await engine.searchFEN(nil, moves: [], limits: limits, provisionalHandler: { bestMove, _ in
+            recorder.appendLine(bestMove)
+        })
+        XCTAssertEqual(recorder.textLines.count, 1)
+    }
+
+    func testContractPonderingSharesTimeAcrossRepliesUntilStopped() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+
+        let replies = ["e7e5", "c7c5", "e1e2", "e7e6"]
+        async let pondered = engine.ponderFEN(nil, moves: ["e2e4"], replies: replies, sliceMilliseconds: 100)
+        try await Task.sleep(nanoseconds: 900_000_000)
+        engine.stopPondering()
+        let report = try await pondered
+
+        XCTAssertEqual(report.replies, replies)
+        XCTAssertGreaterThanOrEqual(report.slices, 3)
+        // An illegal reply is dropped after its first slice is rejected.
+        XCTAssertEqual(report.depths[2], 0)
+        XCTAssertEqual(report.nodes[2], 0)
+        for index in [0, 1, 3] where report.depths[index].intValue > 0 {
+            XCTAssertGreaterThanOrEqual(report.depths[index].intValue, report.firstDepths[index].intValue)
+            XCTAssertGreaterThan(report.nodes[index].uint64Value, 0)
+        }
+        XCTAssertGreaterThan(report.depths[0].intValue, 0)
+
+        // A foreground search also ends pondering, and is never cut short.
+        async let background = engine.ponderFEN(nil, moves: ["e2e4"], replies: ["e7e5"], sliceMilliseconds: 50)
+        try await Task.sleep(nanoseconds: 200_000_000)
+        let result = try await engine.searchFEN(nil, moves: ["e2e4", "e7e5"], limits: SFSearchLimits(depth: 10))
+        XCTAssertEqual(result.info?.depth, 10)
+        _ = try await background
+    }
+
+    func testContractSearchTelemetryReportsEachIterationAndTimeBudget() async throws {
+        harness.stop()
+        let recorder = SearchTelemetryRecorder()
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.searchTelemetryHandler = { telemetry in
+            recorder.append(telemetry)
+        }
+        engine.start()
+
+        _ = try await engine.searchFEN(nil, moves: [], limits: SFSearchLimits(depth: 8))
+        let iterations = recorder.removeAll()
+        XCTAssertEqual(iterations.map(\.depth), Array(1...8))
+        XCTAssertEqual(iterations.reduce(0) { $0 + $1.iterationNodes }, iterations.last?.nodes)
+        XCTAssertEqual(iterations.first?.effectiveBranchingFactor, 0)
+        XCTAssertEqual(iterations.filter(\.bestMoveChanged).count, iterations.last?.bestMoveChanges)
+        for iteration in iterations {
+            XCTAssertFalse(iteration.bestMove.isEmpty)
+            XCTAssertEqual(iteration.optimumTimeMilliseconds, 0)
+        }
+
+        let clock = SFSearchLimits()
+        clock.whiteTimeMilliseconds = 2000
+        clock.blackTimeMilliseconds = 2000
+        _ = try await engine.searchFEN(nil, moves: ["e2e4"], limits: clock)
+
+        let timed = try XCTUnwrap(recorder.removeAll().last)
+        XCTAssertGreaterThan(timed.optimumTimeMilliseconds, 0)
+        XCTAssertGreaterThanOrEqual(timed.maximumTimeMilliseconds, timed.optimumTimeMilliseconds)
+    }
+
+    func testContractThermalThreadAdaptationKeepsSearching() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+
+        XCTAssertFalse(engine.adaptsThreadsToThermalState)
+        engine.adaptsThreadsToThermalState = true
+        engine.start()
+        engine.sendCommand("setoption name Threads value 4")
+
+        let first = try await engine.searchFEN(nil, moves: [], limits: SFSearchLimits(depth: 8))
+        engine.adaptsThreadsToThermalState = false
+        let second = try await engine.searchFEN(nil, moves: ["e2e4"], limits: SFSearchLimits(depth: 8))
+
+        XCTAssertFalse(engine.adaptsThreadsToThermalState)
+        XCTAssertNotNil(first.bestMove)
+        XCTAssertNotNil(second.bestMove)
+    }
+
+    func testContractMoveOverheadCalibrationFollowsHandlerLatency() async {
+        harness.stop()
+        let bestMoves = expectation(description: "bestmove")
+        bestMoves.expectedFulfillmentCount = 3
+        // Every bestmove waits behind the last info line's 20 ms of handler work.
+        let engine = SFEngine(lineHandler: { line in
+            if line.hasPrefix("info depth") {
+                Thread.sleep(forTimeInterval: 0.02)
+            } else if line.hasPrefix("bestmove ") {
+                bestMoves.fulfill()
+            }
+        })
+        defer { engine.stop() }
+
+        XCTAssertFalse(engine.calibratesMoveOverhead)
+        engine.calibratesMoveOverhead = true
+        engine.start()
+        engine.sendCommand("position startpos")
+        for _ in 0..<3 {
+            engine.sendCommand("go depth 1")
+        }
+        await fulfillment(of: [bestMoves], timeout: 20.0)
+
+        XCTAssertGreaterThanOrEqual(engine.calibratedMoveOverheadMilliseconds, 10)
+        XCTAssertLessThanOrEqual(engine.calibratedMoveOverheadMilliseconds, 5000)
+    }
+
+    func testContractNativeSearchReportsInvalidPositionAndNotRunning() async {
+        harness.stop()
+        let engine = SFEngine()
+        engine.start()
+
+        do {
+            _ = try await engine.searchFEN(nil, moves: ["e2e5"], limits: SFSearchLimits(depth: 1))
+            XCTFail("Expected an illegal move to be rejected")
+        } catch let error as NSError {
+            XCTAssertEqual(error.domain, SFEngineErrorDomain)
+            XCTAssertEqual(error.code, SFEngineError.invalidPosition.rawValue)
+            XCTAssertEqual(error.localizedDescription, "Illegal move: e2e5")
+        }
+
+        engine.stop()
+
+        do {
+            _ = try await engine.searchFEN(nil, moves: [], limits: SFSearchLimits(depth: 1))
+            XCTFail("Expected a stopped engine to refuse the search")
+        } catch let error as NSError {
+            XCTAssertEqual(error.code, SFEngineError.notRunning.rawValue)
+        }
+    }
+
+    func testContractBatchSearchReportsEveryPositionOnce() async {
+        harness.stop()
+        let fens = [
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+            "not a fen",
+            "4k3/8/8/8/8/8/8/R3K3 w - - 0 1",
+        ]
+        let recorder = BatchSearchRecorder()
+
+        await SFEngine.searchFENs(fens, limits: SFSearchLimits(depth: 6), concurrency: 2) { index, result, error in
+            recorder.record(Int(index), result, error)
+        }
+
+        XCTAssertEqual(recorder.callCount, fens.count)
+        let results = recorder.results
+        XCTAssertEqual(Set(results.keys), Set(fens.indices))
+        for index in [0, 1, 3] {
+            XCTAssertNotNil(try? results[index]?.get().bestMove, "position \(index)")
+        }
+        if case .failure(let error as NSError)? = results[2] {
+            XCTAssertEqual(error.code, SFEngineError.invalidPosition.rawValue)
+        } else {
+            XCTFail("Expected the invalid FEN to be rejected")
+        }
+    }
+
+    func testContractDeterministicBatchIsReproducibleAcrossRunsAndConcurrency() async throws {
+        harness.stop()
+        let fens = [
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        ]
+        let limits = SFSearchLimits(nodes: 150_000)
+        limits.deterministic = true
+
+        func run(_ fens: [String], concurrency: Int) async -> [String: String] {
+            let recorder = BatchSearchRecorder()
+            await SFEngine.searchFENs(fens, limits: limits, concurrency: concurrency) { index, result, error in
+                recorder.record(Int(index), result, error)
+            }
+            var lines: [String: String] = [:]
+            for (index, outcome) in recorder.results {
+                let result = try? outcome.get()
+                lines[fens[index]] = "\(result?.info?.nodes ?? 0) \(result?.info?.scoreValue ?? 0) \(result?.info?.pv ?? [])"
+            }
+            return lines
+        }
+
+        let first = await run(fens, concurrency: 1)
+        XCTAssertEqual(first.count, fens.count)
+        let second = await run(fens.reversed(), concurrency: 2)
+        XCTAssertEqual(first, second)
+
+        // A clock makes the stopping node depend on timing, so it is refused.
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+        let timed = SFSearchLimits(moveTimeMilliseconds: 50)
+        timed.deterministic = true
+        do {
+            _ = try await engine.searchFEN(nil, moves: [], limits: timed)
+            XCTFail("Expected a deterministic search with a clock to be refused")
+        } catch let error as NSError {
+            XCTAssertEqual(error.code, SFEngineError.invalidLimits.rawValue)
+        }
+    }
+
+    func testContractRefusedSearchStillMovesTheEngineToItsPosition() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+        _ = try await engine.searchFEN(nil, moves: [], limits: SFSearchLimits(depth: 1))
+
+        let timed = SFSearchLimits(moveTimeMilliseconds: 50)
+        timed.deterministic = true
+        do {
+            _ = try await engine.searchFEN(nil, moves: ["e2e4"], limits: timed)
+            XCTFail("Expected a deterministic search with a clock to be refused")
+        } catch let error as NSError {
+            XCTAssertEqual(error.code, SFEngineError.invalidLimits.rawValue)
+        }
+
+        // The same moves again must search the reply, not the previous root.
+        let result = try await engine.searchFEN(nil, moves: ["e2e4"], limits: SFSearchLimits(depth: 6))
+        let bestMove = try XCTUnwrap(result.bestMove)
+        let fromRank = bestMove.dropFirst().first
+        XCTAssertTrue(fromRank == "7" || fromRank == "8", bestMove)
+    }
+
+    func testContractDeadlineSearchAccountsForTheSearchQueuedAhead() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+        _ = try await engine.searchFEN(nil, moves: [], limits: SFSearchLimits(depth: 1))  // Loads the network
+
+        // Most of the budget goes to the search still running ahead of it.
+        engine.searchFEN(nil, moves: [], limits: SFSearchLimits(moveTimeMilliseconds: 500)) { _, _ in }
+        let limits = SFSearchLimits()
+        limits.deadline = Date(timeIntervalSinceNow: 1.5)
+        let submitted = Date()
+        let result = try await engine.searchFEN(nil, moves: ["e2e4"], limits: limits)
+
+        XCTAssertNotNil(result.bestMove)
+        XCTAssertGreaterThan(Date().timeIntervalSince(submitted), 0.5)
+        XCTAssertFalse(result.missedDeadline)
+        XCTAssertEqual(engine.deadlineMissCount, 0)
+        XCTAssertGreaterThanOrEqual(result.queueMilliseconds, 400)
+        XCTAssertLessThan(result.queueMilliseconds + result.searchMilliseconds, 1500)
+
+        // A deadline already past still yields a move, and counts as missed.
+        limits.deadline = Date(timeIntervalSinceNow: -1)
+        let late = try await engine.searchFEN(nil, moves: [], limits: limits)
+        XCTAssertNotNil(late.bestMove)
+        XCTAssertTrue(late.missedDeadline)
+        XCTAssertEqual(engine.deadlineMissCount, 1)
+
+        limits.deadline = Date(timeIntervalSinceNow: 1)
+        limits.deterministic = true
+        do {
+            _ = try await engine.searchFEN(nil, moves: [], limits: limits)
+            XCTFail("Expected a deterministic search with a deadline to be refused")
+        } catch let error as NSError {
+            XCTAssertEqual(error.code, SFEngineError.invalidLimits.rawValue)
+        }
+    }
+
+    func testContractGameAnalysisStreamsEveryPlyInOrder() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+
+        let game = ["f2f3", "e7e5", "g2g4", "d8h4"]
+        let recorder = BatchSearchRecorder()
+        await engine.analyzeGame(fromFEN: nil, moves: game, limits: SFSearchLimits(depth: 8), backwards: true) { ply, result, error in
+            recorder.record(Int(ply), result, error)
+        }
+
+        XCTAssertEqual(recorder.order, [4, 3, 2, 1, 0])
+        let results = recorder.results
+        XCTAssertNil(try results[4]?.get().bestMove, "White is mated")
+        XCTAssertEqual(try results[3]?.get().bestMove, "d8h4")
+        XCTAssertEqual(try results[3]?.get().info?.scoreType, .mate)
+        for ply in 0...2 {
+            XCTAssertEqual(try results[ply]?.get().info?.depth, 8, "ply \(ply)")
+        }
+
+        // Plies from the illegal move on fail; the ones before it are analysed.
+        let broken = BatchSearchRecorder()
+        await engine.analyzeGame(fromFEN: nil, moves: ["e2e4", "e2e4", "e7e5"], limits: SFSearchLimits(depth: 4), backwards: false) { ply, result, error in
+            broken.record(Int(ply), result, error)
+        }
+        XCTAssertEqual(broken.order, [0, 1, 2, 3])
+        XCTAssertNotNil(try broken.results[1]?.get().bestMove)
+        for ply in [2, 3] {
+            if case .failure(let error as NSError)? = broken.results[ply] {
+                XCTAssertEqual(error.code, SFEngineError.invalidPosition.rawValue)
+            } else {
+                XCTFail("Expected ply \(ply) to be rejected")
+            }
+        }
+    }
+
+    func testContractBatchEvaluationScoresPositionsWithoutSearching() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+
+        engine.start()
+        let scores = try await engine.evaluateFENs([
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR b KQkq - 0 1",
+            "4k3/8/8/8/8/8/8/R3K3 w - - 0 1",
+            "4k3/8/8/8/8/8/4R3/4K3 b - - 0 1",
+            "not a fen",
+        ]).map(\.intValue)
+
+        XCTAssertEqual(scores.count, 5)
+        // Both sides see the symmetric start position alike, so White's view flips.
+        XCTAssertEqual(scores[0], -scores[1])
+        XCTAssertGreaterThan(scores[2], 300)
+        XCTAssertEqual(scores[3], SFEvaluationNoScore)
+        XCTAssertEqual(scores[4], SFEvaluationNoScore)
+
+        engine.stop()
+        do {
+            _ = try await engine.evaluateFENs(["8/8/8/8/8/8/8/K6k w - - 0 1"])
+            XCTFail("Expected a stopped engine to refuse the evaluation")
+        } catch let error as NSError {
+            XCTAssertEqual(error.code, SFEngineError.notRunning.rawValue)
+        }
+    }
+
+    func testContractConcurrentEnginesEvaluateWithSharedNetwork() async throws {
+        harness.stop()
+        let first = SFEngine()
+        let second = SFEngine()
+        defer {
+            first.stop()
+            second.stop()
+        }
+
+        first.start()
+        second.start()
+        let fens = [
+            "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+            "8/5pk1/6p1/8/3R4/6P1/5PK1/3r4 w - - 0 40",
+        ]
+        async let firstScores = first.evaluateFENs(fens)
+        async let secondScores = second.evaluateFENs(fens)
+        let expected = try await firstScores
+        XCTAssertEqual(try await secondScores, expected)
+
+        // The network outlives the engine that loaded it while another still uses it.
+        first.stop()
+        XCTAssertEqual(try await second.evaluateFENs(fens), expected)
+    }
+
+    func testContractConcurrentEvaluationDoesNotWaitForTheSearch() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+
+        let fens = [
+            "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+            "8/5pk1/6p1/8/3R4/6P1/5PK1/3r4 w - - 0 40",
+        ]
+        let expected = try await engine.evaluateFENs(fens)
+
+        engine.concurrentEvaluationThreads = 1
+        XCTAssertEqual(engine.concurrentEvaluationThreads, 1)
+        let searched = expectation(description: "search")
+        let searchFinished = CallbackCounter()
+        engine.searchFEN(nil, moves: [], limits: SFSearchLimits(moveTimeMilliseconds: 3000)) { result, _ in
+            XCTAssertNotNil(result?.bestMove)
+            _ = searchFinished.increment()
+            searched.fulfill()
+        }
+
+        XCTAssertEqual(try await engine.evaluateFENs(fens), expected)
+        XCTAssertEqual(searchFinished.value, 0, "The batch finished while the search ran")
+        await fulfillment(of: [searched], timeout: 10.0)
+    }
+
+    func testContractPackedPositionsRoundTripAndEvaluateLikeFENs() async throws {
+        harness.stop()
+        let fens = [
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+            "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+            "8/8/8/8/8/8/8/K6k b - - 57 300",
+        ]
+        var packed = Data()
+        for fen in fens {
+            let position = try SFEngine.packedPosition(fen: fen, chess960: false)
+            XCTAssertEqual(position.count, Int(SFPackedPositionLength))
+            XCTAssertEqual(try SFEngine.fen(packedPosition: position), fen)
+            packed.append(position)
+        }
+
+        let chess960 = "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9"
+        let chess960Position = try SFEngine.packedPosition(fen: chess960, chess960: true)
+        XCTAssertEqual(try SFEngine.fen(packedPosition: chess960Position), chess960)
+        XCTAssertThrowsError(try SFEngine.packedPosition(fen: "not a fen", chess960: false))
+
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+
+        let fromFENs = try await engine.evaluateFENs(fens)
+        let fromPacked = try await engine.evaluatePackedPositions(packed)
+        XCTAssertEqual(fromPacked, fromFENs)
+
+        do {
+            _ = try await engine.evaluatePackedPositions(packed.prefix(31))
+            XCTFail("Expected a truncated record to be rejected")
+        } catch let error as NSError {
+            XCTAssertEqual(error.code, SFEngineError.invalidPosition.rawValue)
+        }
+    }
+
+    func testContractPositionQueriesNeedNoEngine() throws {
+        harness.stop()
+        let start = try SFPosition(fen: nil, moves: [], chess960: false)
+        XCTAssertEqual(start.fen, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1")
+        XCTAssertEqual(start.legalMoves.count, 20)
+        XCTAssertEqual(start.status, .ongoing)
+        XCTAssertTrue(start.isLegalMove("g1f3"))
+        XCTAssertFalse(start.isLegalMove("e2e5"))
+
+        let foolsMate = try start.playing(["f2f3", "e7e5", "g2g4", "d8h4"])
+        XCTAssertEqual(foolsMate.status, .checkmate)
+        XCTAssertTrue(foolsMate.legalMoves.isEmpty)
+
+        let stalemate = try SFPosition(fen: "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1", moves: [], chess960: false)
+        XCTAssertEqual(stalemate.status, .stalemate)
+
+        let promoted = try SFPosition(fen: "4k3/P7/8/8/8/8/8/4K3 w - - 0 1", moves: ["a7a8Q"], chess960: false)
+        XCTAssertEqual(promoted.status, .check)
+        XCTAssertEqual(promoted.fen, "Q3k3/8/8/8/8/8/8/4K3 b - - 0 1")
+
+        // Transposed move orders share a key.
+        let viaKnights = try start.playing(["g1f3", "g8f6", "b1c3"])
+        let viaOtherOrder = try start.playing(["b1c3", "g8f6", "g1f3"])
+        XCTAssertEqual(viaKnights.zobristKey, viaOtherOrder.zobristKey)
+        XCTAssertNotEqual(viaKnights.zobristKey, start.zobristKey)
+
+        let chess960 = try SFPosition(
+            fen: "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+            moves: [],
+            chess960: true
+        )
+        XCTAssertEqual(chess960.legalMoves.count, 21)
+        XCTAssertTrue(chess960.isChess960)
+
+        XCTAssertThrowsError(try SFPosition(fen: "not a fen", moves: [], chess960: false))
+        XCTAssertThrowsError(try start.playing(["e2e5"])) { error in
+            XCTAssertEqual((error as NSError).code, SFEngineError.invalidPosition.rawValue)
+        }
+    }
+
+    func testContractPositionMovesDecodeEveryMoveType() throws {
+        harness.stop()
+        let castled = try SFPosition(
+            fen: "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", moves: ["E1G1", "e8c8"], chess960: false)
+        XCTAssertEqual(castled.fen, "2kr3r/8/8/8/8/8/8/R4RK1 w - - 2 2")
+        XCTAssertThrowsError(
+            try SFPosition(fen: "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", moves: ["e1h1"], chess960: false))
+
+        // En passant, then an underpromotion capturing a rook.
+        let promoted = try SFPosition(
+            fen: "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+            moves: ["e5f6", "g8h6", "f6g7", "e8f7", "g7h8n"],
+            chess960: false
+        )
+        XCTAssertEqual(promoted.fen, "rnbq1b1N/ppp1pk1p/7n/3p4/8/8/PPPP1PPP/RNBQKBNR b KQ - 0 5")
+
+        // Chess960 castling is the king taking its own rook.
+        let chess960FEN = "1r2k1r1/pppppppp/8/8/8/8/PPPPPPPP/1R2K1R1 w GBgb - 0 1"
+        let castled960 = try SFPosition(fen: chess960FEN, moves: ["e1g1", "e8b8"], chess960: true)
+        XCTAssertEqual(castled960.fen, "2kr2r1/pppppppp/8/8/8/8/PPPPPPPP/1R3RK1 w - - 2 2")
+        XCTAssertThrowsError(try SFPosition(fen: chess960FEN, moves: ["e1h1"], chess960: true))
+    }
+
+    func testContractBatchedDeliveryKeepsFinalInfoAndBestmove() async {
+        harness.stop()
+        let recorder = SearchInfoRecorder()
+        let batchCounter = CallbackCounter()
+        let bestmoveReceived = expectation(description: "batched_bestmove")
+
+        let engine = SFEngine(lineBatchHandler: { lines in
+            _ = batchCounter.increment()
+            // Simulate a slow consumer so later lines coalesce and get superseded.
+            Thread.sleep(forTimeInterval: 0.005)
+            for line in lines {
+                recorder.appendLine(line)
+                if line.hasPrefix("bestmove ") {
+                    bestmoveReceived.fulfill()
+                }
+            }
+        }, policy: .dropSupersededInfo)
+        defer { engine.stop() }
+
+        engine.start()
+        engine.sendCommand("setoption name Threads value 1")
+        engine.sendCommand("setoption name MultiPV value 3")
+        engine.sendCommand("position startpos")
+        engine.sendCommand("go depth 10")
+        await fulfillment(of: [bestmoveReceived], timeout: 10.0)
+
+        let lines = recorder.textLines
+        XCTAssertLessThan(batchCounter.value, lines.count, "Lines should be coalesced into batches")
+        for multiPV in 1...3 {
+            let last = lines.last { $0.hasPrefix("info depth ") && $0.contains(" multipv \(multiPV) ") }
+            XCTAssertNotNil(last, "Missing final info for multipv \(multiPV)")
+            XCTAssertTrue(last?.hasPrefix("info depth 10 ") ?? false, "Final multipv \(multiPV) line: \(last ?? "nil")")
+        }
+        XCTAssertEqual(lines.filter { $0.hasPrefix("bestmove ") }.count, 1)
+    }
+
+    func testContractInfoThrottleKeepsNewestUpdatePerMultiPV() async {
+        harness.stop()
+        let recorder = SearchInfoRecorder()
+        let bestmoveReceived = expectation(description: "throttled_bestmove")
+
+        let engine = SFEngine(lineHandler: { line in
+            recorder.appendLine(line)
+            if line.hasPrefix("bestmove ") {
+                bestmoveReceived.fulfill()
+            }
+        }, searchInfoHandler: { info in
+            recorder.append(info)
+        }, bestMoveHandler: nil)
+        defer { engine.stop() }
+
+        engine.start()
+        engine.sendCommand("setoption name InfoThrottleMs value 5000")
+        engine.sendCommand("setoption name MultiPV value 2")
+        engine.sendCommand("position startpos")
+        engine.sendCommand("go depth 12")
+        await fulfillment(of: [bestmoveReceived], timeout: 10.0)
+
+        // The first update goes out at once; the rest wait for the interval,
+        // which the search ends first, so only the final iteration follows.
+        let lines = recorder.textLines.filter { $0.hasPrefix("info depth ") }
+        XCTAssertLessThanOrEqual(lines.count, 2 * 2 + 1, "\(lines)")
+        XCTAssertEqual(recorder.infos.count, lines.count)
+        for multiPV in 1...2 {
+            let last = lines.last { $0.contains(" multipv \(multiPV) ") }
+            XCTAssertTrue(last?.hasPrefix("info depth 12 ") ?? false, "Final multipv \(multiPV) line: \(last ?? "nil")")
+        }
+        XCTAssertTrue(recorder.textLines.last?.hasPrefix("bestmove ") ?? false)
+    }
+
+    func testContractDebugCountersReportThrottledUpdates() async {
+        harness.send("debugcounters clear")
+        harness.send("setoption name InfoThrottleMs value 5000")
+        harness.send("position startpos")
+        harness.send("go depth 10")
+        _ = await harness.waitForLine(timeout: 10.0, matching: { $0.hasPrefix("bestmove ") })
+
+        harness.send("debugcounters")
+        let line = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("Hit Info updates held: ") })
+        XCTAssertNotNil(line)
+        guard let report = line, let held = report.split(separator: " ").dropFirst(7).first.flatMap({ Int($0) })
+        else { return }
+        // Every update but the first arrives inside the interval.
+        XCTAssertGreaterThan(held, 0, report)
+
+        // A cleared registry prints nothing until something records again.
+        harness.send("debugcounters clear")
+        harness.send("debugcounters")
+        harness.send("isready")
+        var afterClear: [String] = []
+        _ = await harness.waitForLine(timeout: 5.0, collecting: { afterClear.append($0) }, matching: { $0 == "readyok" })
+        XCTAssertEqual(afterClear, ["readyok"])
+    }
+
+    func testContractMultiPVDeltaReportsOnlyChangedLines() async {
+        harness.stop()
+        let recorder = SearchInfoRecorder()
+        let bestmoveReceived = expectation(description: "delta_bestmove")
+
+        let engine = SFEngine(lineHandler: { line in
+            if line.hasPrefix("bestmove ") {
+                bestmoveReceived.fulfill()
+            }
+        }, searchInfoHandler: { info in
+            recorder.append(info)
+        }, bestMoveHandler: nil)
+        defer { engine.stop() }
+
+        engine.start()
+        engine.sendCommand("setoption name MultiPVDelta value true")
+        engine.sendCommand("setoption name MultiPV value 5")
+        engine.sendCommand("position fen 8/8/8/8/8/5k2/8/4K1Q1 w - - 0 1")
+        engine.sendCommand("go depth 16")
+        await fulfillment(of: [bestmoveReceived], timeout: 20.0)
+
+        var idsByRootMove: [String: Int] = [:]
+        var lastByID: [Int: SFSearchInfo] = [:]
+        for info in recorder.infos where !info.pv.isEmpty {
+            XCTAssertGreaterThan(info.lineID, 0)
+            let id = idsByRootMove[info.pv[0], default: info.lineID]
+            XCTAssertEqual(info.lineID, id, "Line of \(info.pv[0]) changed its ID")
+            idsByRootMove[info.pv[0]] = id
+
+            if info.multiPV > 1, let last = lastByID[id] {
+                let unchanged = last.multiPV == info.multiPV && last.scoreType == info.scoreType
+                    && last.scoreValue == info.scoreValue && last.bound == info.bound && last.pv == info.pv
+                XCTAssertFalse(unchanged, "Unchanged line \(id) at depth \(info.depth) was reported again")
+            }
+            lastByID[id] = info
+        }
+        XCTAssertEqual(Set(idsByRootMove.values).count, idsByRootMove.count)
+
+        // The lead line still reports every iteration.
+        let leadDepths = recorder.infos.filter { $0.multiPV == 1 && $0.bound == .exact }.map(\.depth)
+        XCTAssertEqual(Set(leadDepths), Set(1...16))
+    }
+
+    func testContractSkillEarlyStopEndsAtSkillPickDepth() async {
+        harness.send("setoption name UCI_LimitStrength value true")
+        harness.send("setoption name UCI_Elo value 1600")
+        let start = Date()
+        guard let result = await harness.runSearch(
+            positionCommand: "position startpos",
+            goCommand: "go movetime 10000",
+            timeout: 15.0
+        ) else {
+            XCTFail("Expected search result")
+            return
+        }
+
+        // 1600 Elo is skill level 2, whose move is picked after depth 3.
+        let depths = result.transcript.filter { $0.contains(" pv ") }.compactMap { line -> Int? in
+            let fields = line.split(separator: " ")
+            return fields.count > 2 && fields[1] == "depth" ? Int(fields[2]) : nil
+        }
+        XCTAssertEqual(depths.max(), 3)
+        XCTAssertLessThan(Date().timeIntervalSince(start), 5.0)
+        XCTAssertTrue(Self.isValidBestmoveToken(result.bestmove))
+    }
+
+    func testContractKeepSearchStateCarriesLearnedStateAcrossNewGames() async throws {
+        harness.stop()
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+
+        let limits = SFSearchLimits(depth: 12)
+        let cold = try await engine.searchFEN(nil, moves: [], limits: limits).info?.nodes ?? 0
+        XCTAssertGreaterThan(cold, 0)
+
+        engine.sendCommand("setoption name KeepSearchState value true")
+        engine.sendCommand("ucinewgame")
+        let warm = try await engine.searchFEN(nil, moves: [], limits: limits).info?.nodes ?? 0
+        XCTAssertLessThan(warm, cold, "The kept hash answers most of the repeated search")
+
+        // Off, ucinewgame clears everything again, and one thread repeats the first search.
+        engine.sendCommand("setoption name KeepSearchState value false")
+        engine.sendCommand("ucinewgame")
+        let cleared = try await engine.searchFEN(nil, moves: [], limits: limits).info?.nodes ?? 0
+        XCTAssertEqual(cleared, cold)
+    }
+
+    func testContractRecentLineRingDeliversOnlyDiagnostics() async {
+        harness.stop()
+        let recorder = SearchInfoRecorder()
+        let bestmoveReceived = expectation(description: "ring_bestmove")
+        let errorReceived = expectation(description: "ring_error")
+
+        let engine = SFEngine(recentLineCapacity: 8, handler: { line in
+            recorder.appendLine(line)
+            if line.hasPrefix("bestmove ") {
+                bestmoveReceived.fulfill()
+            } else if line.hasPrefix("Unknown command") {
+                errorReceived.fulfill()
+            }
+        })
+        defer { engine.stop() }
+
+        engine.start()
+        engine.sendCommand("position startpos")
+        engine.sendCommand("go depth 12")
+        await fulfillment(of: [bestmoveReceived], timeout: 10.0)
+        engine.sendCommand("frobnicate")
+        await fulfillment(of: [errorReceived], timeout: 10.0)
+
+        // Search progress went only to the ring, which kept the latest lines.
+        XCTAssertEqual(recorder.textLines.count, 2, "\(recorder.textLines)")
+        let recent = engine.recentLines
+        XCTAssertEqual(recent.count, 8)
+        XCTAssertTrue(recent.last?.hasPrefix("Unknown command") ?? false, "\(recent)")
+        XCTAssertTrue(recent.contains { $0.hasPrefix("bestmove ") })
+        XCTAssertTrue(recent.contains { $0.hasPrefix("info depth 12 ") }, "\(recent)")
 
-        await fulfillment(
-            of: [multilineRejected, nulRejected, debugLogRejected, uciAccepted],
-            timeout: 5.0
-        )
         engine.stop()
+        XCTAssertEqual(engine.recentLines, recent)
+        XCTAssertEqual(SFEngine(lineHandler: { _ in }).recentLines, [])
     }
 
-    func testContractConcurrentStartAndStopCallsDoNotRaceLifecycle() {
+    func testContractFileDescriptorModeProxiesUCIThroughPipes() async throws {
         harness.stop()
-        let engine = SFEngine(lineHandler: { _ in })
-        let engineHolder = SFEngineHolder()
-        engineHolder.store(engine)
+        let commands = Pipe()
+        let output = Pipe()
+        let engine = SFEngine(outputFileDescriptor: output.fileHandleForWriting.fileDescriptor)
+        defer { engine.stop() }
 
-        DispatchQueue.concurrentPerform(iterations: 100) { index in
-            if index.isMultiple(of: 2) {
-                engineHolder.start()
-            } else {
-                engineHolder.stop()
+        engine.start()
+        engine.sendCommand("setoption name NoSuchOption value 1")
+        engine.readCommandsFromFileDescriptor(commands.fileHandleForReading.fileDescriptor)
+        commands.fileHandleForWriting.write(Data("uci\r\nposition startpos moves e2e4\ngo depth 6\n".utf8))
+
+        // Output, including the reply to sendCommand:, arrives as plain bytes.
+        let reader = output.fileHandleForReading
+        let text = try await Task.detached { () -> String in
+            var text = ""
+            while !text.contains("bestmove ") || !text.hasSuffix("\n") {
+                let chunk = reader.availableData
+                if chunk.isEmpty {
+                    break
+                }
+                text += String(decoding: chunk, as: UTF8.self)
             }
-        }
+            return text
+        }.value
+
+        let lines = text.split(separator: "\n").map(String.init)
+        XCTAssertTrue(lines.contains("uciok"), "\(lines.prefix(5))")
+        XCTAssertTrue(lines.contains { $0.hasPrefix("info depth 6 ") })
+        XCTAssertTrue(lines.contains("No such option: NoSuchOption"), "\(lines.prefix(5))")
+        XCTAssertFalse(text.contains("\r"))
+        XCTAssertTrue(lines.last?.hasPrefix("bestmove ") ?? false)
+
+        // End of file on the command descriptor quits the session.
+        try commands.fileHandleForWriting.close()
         engine.stop()
     }
 
@@ -398,7 +2156,22 @@ final class SFEngineTests: XCTestCase {
         localHarness.send("position startpos")
         localHarness.send("go depth 40")
 
-        // Give the search a brief head start, then stop.
+        // Give the search a brief head start. The queued setoption burst blocks
+        // the UCI loop until the search ends, so only the out-of-band stop lane
+        // can end it; stop-to-bestmove latency must not depend on the backlog.
+        try? await Task.sleep(nanoseconds: 100_000_000)
+        for _ in 0..<50 {
+            localHarness.send("setoption name MultiPV value 1")
+        }
+
+        let stopSent = Date()
+        localHarness.send("stop")
+        let bestmove = await localHarness.waitForLine(timeout: 3.0, matching: { $0.hasPrefix("bestmove ") })
+        let stopToBestmove = Date().timeIntervalSince(stopSent)
+        XCTAssertNotNil(bestmove, "Expected bestmove after stop behind a queued burst")
+        XCTAssertLessThan(stopToBestmove, 1.0, "Stop-to-bestmove latency: \(stopToBestmove)s")
+
+        localHarness.send("go depth 40")
         try? await Task.sleep(nanoseconds: 100_000_000)
         let start = Date()
         localHarness.stop()
@@ -566,325 +2339,433 @@ final class SFEngineTests: XCTestCase {
         }
     }
 
-    // Step 3: tactical tests (mate signal + allowed move set).
-
-    func testTacticalMateInOneRegressionSuite() async {
-        let cases: [TacticalCase] = [
-            TacticalCase(
-                name: "kqk_f6_h8_qa7",
-                positionCommand: "position fen 7k/Q7/5K2/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["a7g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qb7",
-                positionCommand: "position fen 7k/1Q6/5K2/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["b7g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qc7",
-                positionCommand: "position fen 7k/2Q5/5K2/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["c7g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qd7",
-                positionCommand: "position fen 7k/3Q4/5K2/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["d7g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qe7",
-                positionCommand: "position fen 7k/4Q3/5K2/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["e7g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qf7",
-                positionCommand: "position fen 7k/5Q2/5K2/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["f7g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qg1",
-                positionCommand: "position fen 7k/8/5K2/8/8/8/8/6Q1 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g1g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qg2",
-                positionCommand: "position fen 7k/8/5K2/8/8/8/6Q1/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g2g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qg3",
-                positionCommand: "position fen 7k/8/5K2/8/8/6Q1/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g3g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qg4",
-                positionCommand: "position fen 7k/8/5K2/8/6Q1/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g4g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qg5",
-                positionCommand: "position fen 7k/8/5K2/6Q1/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g5g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f6_h8_qg6",
-                positionCommand: "position fen 7k/8/5KQ1/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g6g7"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qa2",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/Q7/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["a2h2"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qa3",
-                positionCommand: "position fen 7k/5K2/8/8/8/Q7/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["a3h3"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qa4",
-                positionCommand: "position fen 7k/5K2/8/8/Q7/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["a4h4"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qa5",
-                positionCommand: "position fen 7k/5K2/8/Q7/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["a5h5"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qa6",
-                positionCommand: "position fen 7k/5K2/Q7/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["a6h6"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qb1",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/8/1Q6 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["b1h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qb3",
-                positionCommand: "position fen 7k/5K2/8/8/8/1Q6/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["b3h3"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qb4",
-                positionCommand: "position fen 7k/5K2/8/8/1Q6/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["b4h4"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qb5",
-                positionCommand: "position fen 7k/5K2/8/1Q6/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["b5h5"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qb6",
-                positionCommand: "position fen 7k/5K2/1Q6/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["b6h6"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qb7",
-                positionCommand: "position fen 7k/1Q3K2/8/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["b7h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qc1",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/8/2Q5 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["c1h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qc2",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/2Q5/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["c2h2"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qc4",
-                positionCommand: "position fen 7k/5K2/8/8/2Q5/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["c4h4"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qc5",
-                positionCommand: "position fen 7k/5K2/8/2Q5/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["c5h5"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qc6",
-                positionCommand: "position fen 7k/5K2/2Q5/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["c6h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qc7",
-                positionCommand: "position fen 7k/2Q2K2/8/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["c7h2"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qd1",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/8/3Q4 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["d1h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qd2",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/3Q4/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["d2h2"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qd3",
-                positionCommand: "position fen 7k/5K2/8/8/8/3Q4/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["d3h3"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qd5",
-                positionCommand: "position fen 7k/5K2/8/3Q4/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["d5h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qd6",
-                positionCommand: "position fen 7k/5K2/3Q4/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["d6h2"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qd7",
-                positionCommand: "position fen 7k/3Q1K2/8/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["d7h3"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qe1",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/8/4Q3 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["e1h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qe2",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/4Q3/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["e2h2"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qe3",
-                positionCommand: "position fen 7k/5K2/8/8/8/4Q3/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["e3h3"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qe4",
-                positionCommand: "position fen 7k/5K2/8/8/4Q3/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["e4h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qe6",
-                positionCommand: "position fen 7k/5K2/4Q3/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["e6h3"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qe7",
-                positionCommand: "position fen 7k/4QK2/8/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["e7h4"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qf1",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/8/5Q2 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["f1h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qf2",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/5Q2/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["f2h2"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qf3",
-                positionCommand: "position fen 7k/5K2/8/8/8/5Q2/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["f3h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qf4",
-                positionCommand: "position fen 7k/5K2/8/8/5Q2/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["f4h2"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qf5",
-                positionCommand: "position fen 7k/5K2/8/5Q2/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["f5h3"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qg1",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/8/6Q1 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g1h1"]
-            ),
-            TacticalCase(
-                name: "kqk_f7_h8_qg2",
-                positionCommand: "position fen 7k/5K2/8/8/8/8/6Q1/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g2h1"]
+    func testParallelAndCachedPerftMatchCanonicalCounts() async {
+        let cases: [PerftCase] = [
+            PerftCase(name: "startpos_d5", positionCommand: "position startpos", depth: 5, expectedNodes: 4865609),
+            PerftCase(
+                name: "kiwipete_d4",
+                positionCommand: "position fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+                depth: 4,
+                expectedNodes: 4085603
             ),
-            TacticalCase(
-                name: "kqk_f7_h8_qg3",
-                positionCommand: "position fen 7k/5K2/8/8/8/6Q1/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g3h2"]
+            PerftCase(
+                name: "position3_d5",
+                positionCommand: "position fen 8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+                depth: 5,
+                expectedNodes: 674624
+            )
+        ]
+
+        for options in ["threads 4", "hash 16", "threads 4 hash 16"] {
+            for testCase in cases {
+                let nodes = await harness.runPerft(
+                    positionCommand: testCase.positionCommand,
+                    depth: testCase.depth,
+                    options: options,
+                    timeout: 60.0
+                )
+                XCTAssertEqual(nodes, testCase.expectedNodes, "Perft mismatch for \(testCase.name) with \(options)")
+            }
+        }
+    }
+
+    func testContractPerftOptionsAreRejectedOutsidePerftAndOnFailedAllocation() async {
+        harness.send("position startpos")
+        harness.send("go depth 3 threads 4")
+        let misplaced = await harness.waitForLine(
+            timeout: 5.0,
+            matching: { $0.hasPrefix("info string StockfishEmbedded error: ") }
+        )
+        XCTAssertEqual(
+            misplaced,
+            "info string StockfishEmbedded error: command `go depth 3 threads 4` failed: "
+                + "'threads' only applies to 'go perft'"
+        )
+
+        // Accepted by the range check, but far beyond any device's memory.
+        harness.send("go perft 3 hash 33554432")
+        let oversized = await harness.waitForLine(
+            timeout: 5.0,
+            matching: { $0.hasPrefix("info string StockfishEmbedded error: ") }
+        )
+        XCTAssertEqual(
+            oversized,
+            "info string StockfishEmbedded error: command `go perft 3 hash 33554432` failed: "
+                + "Could not allocate 33554432 MB for the perft hash"
+        )
+
+        let nodes = await harness.runPerft(positionCommand: "position startpos", depth: 3, options: "hash 16", timeout: 10.0)
+        XCTAssertEqual(nodes, 8902)
+    }
+
+    func testBulkCountedPerftHandlesPinsEnPassantAndCastling() async {
+        let cases: [PerftCase] = [
+            PerftCase(
+                name: "en_passant_into_check_d4",
+                positionCommand: "position fen 8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+                depth: 4,
+                expectedNodes: 13931
             ),
-            TacticalCase(
-                name: "kqk_f7_h8_qg4",
-                positionCommand: "position fen 7k/5K2/8/8/6Q1/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g4h3"]
+            PerftCase(
+                name: "pinned_en_passant_d4",
+                positionCommand: "position fen 8/5bk1/8/2Pp4/8/1K6/8/8 w - d6 0 1",
+                depth: 4,
+                expectedNodes: 9287
             ),
-            TacticalCase(
-                name: "kqk_f7_h8_qg5",
-                positionCommand: "position fen 7k/5K2/8/6Q1/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g5h4"]
+            PerftCase(
+                name: "position5_d3",
+                positionCommand: "position fen rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+                depth: 3,
+                expectedNodes: 62379
+            )
+        ]
+        let chess960Cases: [PerftCase] = [
+            PerftCase(
+                name: "chess960_1_d3",
+                positionCommand: "position fen bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+                depth: 3,
+                expectedNodes: 12189
             ),
-            TacticalCase(
-                name: "kqk_f7_h8_qg6",
-                positionCommand: "position fen 7k/5K2/6Q1/8/8/8/8/8 w - - 0 1",
-                goCommand: "go depth 4",
-                expectedBestmoves: ["g6h5"]
+            PerftCase(
+                name: "chess960_2_d3",
+                positionCommand: "position fen 2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9",
+                depth: 3,
+                expectedNodes: 18002
             )
         ]
 
         for testCase in cases {
+            let nodes = await harness.runPerft(positionCommand: testCase.positionCommand, depth: testCase.depth, timeout: 60.0)
+            XCTAssertEqual(nodes, testCase.expectedNodes, "Perft mismatch for \(testCase.name)")
+        }
+
+        harness.send("setoption name UCI_Chess960 value true")
+        for testCase in chess960Cases {
+            let nodes = await harness.runPerft(positionCommand: testCase.positionCommand, depth: testCase.depth, timeout: 60.0)
+            XCTAssertEqual(nodes, testCase.expectedNodes, "Perft mismatch for \(testCase.name)")
+        }
+    }
+
+    // Step 3: tactical tests (mate signal + allowed move set).
+
+    // Mate in one for the side to move in each; the f7 kings have several mating moves.
+    private static let mateInOneCases: [TacticalCase] = [
+        TacticalCase(
+            name: "kqk_f6_h8_qa7",
+            positionCommand: "position fen 7k/Q7/5K2/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["a7g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qb7",
+            positionCommand: "position fen 7k/1Q6/5K2/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["b7g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qc7",
+            positionCommand: "position fen 7k/2Q5/5K2/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["c7g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qd7",
+            positionCommand: "position fen 7k/3Q4/5K2/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["d7g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qe7",
+            positionCommand: "position fen 7k/4Q3/5K2/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["e7g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qf7",
+            positionCommand: "position fen 7k/5Q2/5K2/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["f7g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qg1",
+            positionCommand: "position fen 7k/8/5K2/8/8/8/8/6Q1 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g1g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qg2",
+            positionCommand: "position fen 7k/8/5K2/8/8/8/6Q1/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g2g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qg3",
+            positionCommand: "position fen 7k/8/5K2/8/8/6Q1/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g3g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qg4",
+            positionCommand: "position fen 7k/8/5K2/8/6Q1/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g4g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qg5",
+            positionCommand: "position fen 7k/8/5K2/6Q1/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g5g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f6_h8_qg6",
+            positionCommand: "position fen 7k/8/5KQ1/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g6g7"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qa2",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/Q7/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["a2h2"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qa3",
+            positionCommand: "position fen 7k/5K2/8/8/8/Q7/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["a3h3"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qa4",
+            positionCommand: "position fen 7k/5K2/8/8/Q7/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["a4h4"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qa5",
+            positionCommand: "position fen 7k/5K2/8/Q7/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["a5h5"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qa6",
+            positionCommand: "position fen 7k/5K2/Q7/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["a6h6"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qb1",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/8/1Q6 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["b1h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qb3",
+            positionCommand: "position fen 7k/5K2/8/8/8/1Q6/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["b3h3"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qb4",
+            positionCommand: "position fen 7k/5K2/8/8/1Q6/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["b4h4"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qb5",
+            positionCommand: "position fen 7k/5K2/8/1Q6/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["b5h5"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qb6",
+            positionCommand: "position fen 7k/5K2/1Q6/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["b6h6"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qb7",
+            positionCommand: "position fen 7k/1Q3K2/8/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["b7h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qc1",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/8/2Q5 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["c1h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qc2",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/2Q5/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["c2h2"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qc4",
+            positionCommand: "position fen 7k/5K2/8/8/2Q5/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["c4h4"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qc5",
+            positionCommand: "position fen 7k/5K2/8/2Q5/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["c5h5"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qc6",
+            positionCommand: "position fen 7k/5K2/2Q5/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["c6h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qc7",
+            positionCommand: "position fen 7k/2Q2K2/8/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["c7h2"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qd1",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/8/3Q4 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["d1h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qd2",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/3Q4/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["d2h2"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qd3",
+            positionCommand: "position fen 7k/5K2/8/8/8/3Q4/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["d3h3"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qd5",
+            positionCommand: "position fen 7k/5K2/8/3Q4/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["d5h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qd6",
+            positionCommand: "position fen 7k/5K2/3Q4/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["d6h2"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qd7",
+            positionCommand: "position fen 7k/3Q1K2/8/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["d7h3"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qe1",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/8/4Q3 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["e1h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qe2",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/4Q3/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["e2h2"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qe3",
+            positionCommand: "position fen 7k/5K2/8/8/8/4Q3/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["e3h3"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qe4",
+            positionCommand: "position fen 7k/5K2/8/8/4Q3/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["e4h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qe6",
+            positionCommand: "position fen 7k/5K2/4Q3/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["e6h3"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qe7",
+            positionCommand: "position fen 7k/4QK2/8/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["e7h4"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qf1",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/8/5Q2 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["f1h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qf2",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/5Q2/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["f2h2"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qf3",
+            positionCommand: "position fen 7k/5K2/8/8/8/5Q2/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["f3h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qf4",
+            positionCommand: "position fen 7k/5K2/8/8/5Q2/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["f4h2"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qf5",
+            positionCommand: "position fen 7k/5K2/8/5Q2/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["f5h3"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qg1",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/8/6Q1 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g1h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qg2",
+            positionCommand: "position fen 7k/5K2/8/8/8/8/6Q1/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g2h1"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qg3",
+            positionCommand: "position fen 7k/5K2/8/8/8/6Q1/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g3h2"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qg4",
+            positionCommand: "position fen 7k/5K2/8/8/6Q1/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g4h3"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qg5",
+            positionCommand: "position fen 7k/5K2/8/6Q1/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g5h4"]
+        ),
+        TacticalCase(
+            name: "kqk_f7_h8_qg6",
+            positionCommand: "position fen 7k/5K2/6Q1/8/8/8/8/8 w - - 0 1",
+            goCommand: "go depth 4",
+            expectedBestmoves: ["g6h5"]
+        )
+    ]
+
+    func testTacticalMateInOneRegressionSuite() async {
+        for testCase in Self.mateInOneCases {
             guard let result = await harness.runSearch(
                 positionCommand: testCase.positionCommand,
                 goCommand: testCase.goCommand,
@@ -915,6 +2796,49 @@ final class SFEngineTests: XCTestCase {
         }
     }
 
+    // `go mate 1` over the same suite with the wrapper's MateFinder on and
+    // off. Both must report mate in one with a mating move; the printed times
+    // compare the proof with the full search.
+    func testMateFinderMateInOneSuiteBenchmark() async {
+        var elapsed: [Bool: TimeInterval] = [:]
+        for enabled in [false, true] {
+            harness.send("setoption name MateFinder value \(enabled)")
+            let start = Date()
+            for testCase in Self.mateInOneCases {
+                guard let result = await harness.runSearch(
+                    positionCommand: testCase.positionCommand,
+                    goCommand: "go mate 1",
+                    timeout: 10.0
+                ) else {
+                    XCTFail("Expected search result for \(testCase.name)")
+                    return
+                }
+
+                guard case .mate(1)? = result.latestScore else {
+                    XCTFail("Expected mate in one for \(testCase.name): \(result.transcript.joined(separator: " | "))")
+                    return
+                }
+                XCTAssertEqual(
+                    result.transcript.contains { $0.hasPrefix("info string Mate finder: mate in 1 ") },
+                    enabled,
+                    "Unexpected mate finder use for \(testCase.name)"
+                )
+                if testCase.name.hasPrefix("kqk_f6_h8_") {
+                    XCTAssertTrue(testCase.expectedBestmoves.contains(result.bestmove),
+                                  "Expected one of \(testCase.expectedBestmoves.sorted()) for \(testCase.name), got \(result.bestmove)")
+                }
+            }
+            elapsed[enabled] = Date().timeIntervalSince(start)
+        }
+
+        print(String(
+            format: "mate-in-one suite (%d positions): search %.1f ms, mate finder %.1f ms",
+            Self.mateInOneCases.count,
+            (elapsed[false] ?? 0) * 1000,
+            (elapsed[true] ?? 0) * 1000
+        ))
+    }
+
     func testTacticalHangingQueenMoveInAllowedSet() async {
         guard let result = await harness.runSearch(
             positionCommand: "position fen 4k3/8/8/8/4q3/8/4Q3/4K3 w - - 0 1",
@@ -1081,7 +3005,161 @@ private final class SoakEventRecorder: @unchecked Sendable {
     }
 }
 
+private final class SelfPlayGameRecorder: @unchecked Sendable {
+    private let lock = NSLock()
+    private var storage: [SFEngineSoakRunner.SelfPlayGame] = []
+
+    func append(_ game: SFEngineSoakRunner.SelfPlayGame) {
+        lock.lock()
+        storage.append(game)
+        lock.unlock()
+    }
+
+    var games: [SFEngineSoakRunner.SelfPlayGame] {
+        lock.lock()
+        defer { lock.unlock() }
+        return storage.sorted { $0.index < $1.index }
+    }
+}
+
 final class SFEngineSoakRunnerTests: XCTestCase {
+    func testRestartingRunSamplesMemoryOfEachEngine() async {
+        let recorder = SoakEventRecorder()
+        let runner = SFEngineSoakRunner(configuration: .init(
+            positions: [.startpos],
+            searchLimit: .depth(2),
+            maxIterations: 4,
+            engineOptions: ["setoption name Hash value 32"],
+            restartEngineEvery: 2,
+            memorySampleEvery: 2,
+            maxResidentGrowthBytes: 512 * 1_048_576
+        ))
+
+        let summary = await runner.run { recorder.append($0) }
+        let samples = recorder.events.compactMap { event -> SFEngineSoakRunner.MemorySample? in
+            guard case .memorySample(_, let sample) = event else { return nil }
+            return sample
+        }
+
+        XCTAssertEqual(summary.iterationsCompleted, 4)
+        XCTAssertEqual(summary.errors, 0)
+        // No restart follows the last iteration.
+        XCTAssertEqual(summary.engineRestarts, 1)
+        XCTAssertEqual(samples.count, 2)
+        XCTAssertEqual(summary.firstMemorySample, samples.first)
+        XCTAssertEqual(summary.lastMemorySample, samples.last)
+        for sample in samples {
+            XCTAssertGreaterThan(sample.residentBytes, 0)
+            XCTAssertEqual(sample.hashBytes, 32 * 1_048_576)
+            XCTAssertGreaterThan(sample.networkBytes, 0)
+            XCTAssertEqual(sample.threads, 1)
+            XCTAssertGreaterThan(sample.threadBytes, 0)
+            XCTAssertGreaterThan(sample.peakPendingCallbacks, 0)
+        }
+    }
+
+    func testThroughputRunSearchesEveryPositionAcrossEngines() async {
+        let summary = await SFEngineSoakRunner.runThroughput(.init(
+            positions: [
+                .startpos,
+                .fen("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1")
+            ],
+            searchLimit: .nodes(20_000),
+            totalPositions: 8,
+            engines: 2,
+            targetPositionsPerSecond: 40,
+            perMoveTimeout: .seconds(10)
+        ))
+
+        XCTAssertEqual(summary.positionsAttempted, 8)
+        XCTAssertEqual(summary.positionsCompleted, 8)
+        XCTAssertEqual(summary.errors, 0)
+        XCTAssertEqual(summary.timeoutRate, 0)
+        XCTAssertGreaterThan(summary.positionsPerSecond, 0)
+        // Eight slots at 40/s take at least 175 ms.
+        XCTAssertGreaterThanOrEqual(summary.elapsed, .milliseconds(175))
+        XCTAssertNotNil(summary.nps)
+        XCTAssertGreaterThan(summary.peakResidentBytes ?? 0, 0)
+
+        let invalid = await SFEngineSoakRunner.runThroughput(.init(positions: [.startpos], engines: 0))
+        XCTAssertEqual(invalid.errors, 1)
+        XCTAssertEqual(invalid.positionsAttempted, 0)
+    }
+
+    func testSelfPlayPlaysEachOpeningWithBothColours() async throws {
+        let recorder = SelfPlayGameRecorder()
+        let summary = await SFEngineSoakRunner.runSelfPlay(.init(
+            openings: [.fen("8/8/8/8/8/5k2/8/4K1Q1 w - - 0 1"), .fen("8/8/8/4k3/8/8/8/4K3 w - - 0 1")],
+            searchLimit: .nodes(20_000),
+            resignScore: 100_000,
+            perMoveTimeout: .seconds(10)
+        )) { recorder.append($0) }
+
+        XCTAssertEqual(summary.gamesPlayed, 4)
+        XCTAssertEqual(summary.firstEngineWins + summary.secondEngineWins, 2)
+        XCTAssertEqual(summary.draws, 2)
+        XCTAssertEqual(summary.errors, 0)
+        XCTAssertGreaterThan(summary.gamesPerHour, 0)
+
+        let games = recorder.games
+        XCTAssertEqual(games.map(\.index), [0, 1, 2, 3])
+        XCTAssertEqual(games.map(\.firstEngineIsWhite), [true, false, true, false])
+        for game in games.prefix(2) {
+            XCTAssertEqual(game.result, "1-0")
+            XCTAssertEqual(game.termination, .checkmate)
+            XCTAssertTrue(game.pgn.contains("[Result \"1-0\"]"))
+            XCTAssertTrue(game.pgn.hasSuffix("# 1-0\n\n"), game.pgn)
+            let records = try XCTUnwrap(game.packedRecords)
+            XCTAssertEqual(records.count, game.positions.count * (Int(SFPackedPositionLength) + 4))
+            // The final move was White's, and White won.
+            XCTAssertEqual(Int8(bitPattern: records[records.count - 2]), 1)
+        }
+        for game in games.suffix(2) {
+            XCTAssertEqual(game.result, "1/2-1/2")
+            XCTAssertEqual(game.termination, .insufficientMaterial)
+            XCTAssertTrue(game.positions.isEmpty)
+        }
+
+        let invalid = await SFEngineSoakRunner.runSelfPlay(.init(openings: [])) { _ in }
+        XCTAssertEqual(invalid.errors, 1)
+        XCTAssertEqual(invalid.gamesPlayed, 0)
+    }
+
+    func testLatencyMeasurementReportsOrderedPercentilesPerHandlerLoad() async throws {
+        let loads: [Duration] = [.zero, .microseconds(100)]
+        let reports = try XCTUnwrap(await SFEngineSoakRunner.measureLatency(.init(
+            samples: 50,
+            handlerLoads: loads,
+            timeout: .seconds(10)
+        )))
+
+        XCTAssertEqual(reports.map(\.handlerLoad), loads)
+        for report in reports {
+            for percentiles in [report.ready, report.depthOne] {
+                XCTAssertGreaterThan(percentiles.p50, .zero)
+                XCTAssertLessThanOrEqual(percentiles.p50, percentiles.p99)
+                XCTAssertLessThanOrEqual(percentiles.p99, percentiles.p999)
+                XCTAssertLessThanOrEqual(percentiles.p999, percentiles.max)
+            }
+        }
+        let invalid = await SFEngineSoakRunner.measureLatency(.init(samples: 0))
+        XCTAssertNil(invalid)
+    }
+
+    func testLatencyMeasurementRunsWithTheGivenThreadCount() async throws {
+        let reports = try XCTUnwrap(await SFEngineSoakRunner.measureLatency(.init(
+            samples: 20,
+            handlerLoads: [.zero],
+            timeout: .seconds(10),
+            threads: 2
+        )))
+        XCTAssertEqual(reports.count, 1)
+        XCTAssertGreaterThan(reports[0].depthOne.p50, .zero)
+
+        let invalid = await SFEngineSoakRunner.measureLatency(.init(samples: 10, threads: 0))
+        XCTAssertNil(invalid)
+    }
+
     func testInvalidConfigurationFailsBeforeStartingEngine() async {
         let recorder = SoakEventRecorder()
         let runner = SFEngineSoakRunner(configuration: .init(
@@ -1172,6 +3250,294 @@ final class SFEngineSoakRunnerTests: XCTestCase {
     }
 }
 
+private final class BridgeThroughputRecorder: @unchecked Sendable {
+    private let lock = NSLock()
+    private var bytes = 0
+    private var uciokCount = 0
+
+    /// Records one delivered line and returns how many `uciok` lines arrived so far.
+    func record(_ line: String) -> Int {
+        lock.lock()
+        defer { lock.unlock() }
+        bytes += line.utf8.count + 1
+        if line == "uciok" {
+            uciokCount += 1
+        }
+        return uciokCount
+    }
+
+    var byteCount: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return bytes
+    }
+}
+
+final class SFEngineBridgeBenchmarkTests: XCTestCase {
+    // Micro-benchmark for the output path (line stream buffer -> serial callback
+    // queue -> handler). Compare the printed bytes/second before and after
+    // bridge changes; `uci` is used because it emits ~2 KB without searching.
+    func testBridgeOutputThroughput() async {
+        let rounds = 200
+        let recorder = BridgeThroughputRecorder()
+        let finished = expectation(description: "bridge_throughput_rounds")
+        let engine = SFEngine(lineHandler: { line in
+            if recorder.record(line) == rounds {
+                finished.fulfill()
+            }
+        })
+        defer { engine.stop() }
+
+        engine.start()
+        let start = Date()
+        for _ in 0..<rounds {
+            engine.sendCommand("uci")
+        }
+        await fulfillment(of: [finished], timeout: 30.0)
+
+        let elapsed = max(Date().timeIntervalSince(start), 0.000_001)
+        let bytes = recorder.byteCount
+        print(String(
+            format: "bridge throughput: %d bytes in %.3f s (%.0f bytes/s)",
+            bytes,
+            elapsed,
+            Double(bytes) / elapsed
+        ))
+        XCTAssertGreaterThan(bytes, rounds * 1_000)
+    }
+
+    // Static evaluations per second through `evaluateFENs:completion:`, with
+    // one worker and with four. The first batch loads the network and is not timed.
+    func testBatchEvaluationThroughput() async throws {
+        let engine = SFEngine()
+        defer { engine.stop() }
+        engine.start()
+
+        let openings = [
+            "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+            "rnbqkb1r/pp2pppp/3p1n2/8/3NP3/8/PPP2PPP/RNBQKB1R w KQkq - 1 5",
+            "r2q1rk1/pp2bppp/2n1pn2/3p4/3P4/2NBPN2/PP3PPP/R2Q1RK1 w - - 4 10",
+            "8/5pk1/6p1/8/3R4/6P1/5PK1/3r4 w - - 0 40",
+        ]
+        let fens = (0..<100_000).map { openings[$0 % openings.count] }
+        _ = try await engine.evaluateFENs(openings)
+
+        for threads in [1, 4] {
+            engine.sendCommand("setoption name Threads value \(threads)")
+            let start = Date()
+            let scores = try await engine.evaluateFENs(fens)
+            let elapsed = max(Date().timeIntervalSince(start), 0.000_001)
+            print(String(
+                format: "batch evaluation: %d threads, %.0f positions/s",
+                threads,
+                Double(scores.count) / elapsed
+            ))
+            XCTAssertEqual(scores.count, fens.count)
+        }
+    }
+
+    // Per-stage NNUE timings from `nnuebench` on the embedded network. Compare
+    // the printed table before and after a vendored Stockfish update.
+    func testNNUEStageTimings() async throws {
+        let harness = SFEngineHarness()
+        defer { harness.stop() }
+        try await harness.startAndBootstrap()
+
+        var stages: [String] = []
+        harness.send("nnuebench 200")
+        let last = await harness.waitForLine(
+            timeout: 120.0,
+            collecting: { line in
+                if line.contains(":"), line.range(of: #"[0-9.]+$"#, options: .regularExpression) != nil {
+                    stages.append(line)
+                }
+            },
+            matching: { $0.hasPrefix("NetworkArchitecture::propagate") }
+        )
+
+        print("NNUE stages:\n" + stages.joined(separator: "\n"))
+        XCTAssertNotNil(last)
+        XCTAssertEqual(stages.count, 9)
+    }
+
+    // Upstream's bench positions at fixed nodes, one thread, and 16 MB of hash,
+    // reported as JSON for release checks on devices. The report is attached to
+    // the test result and, when SF_BENCH_JSON names a path, written there too.
+    func testBenchReportAsJSON() async throws {
+        struct Position: Encodable {
+            let fen: String
+            var depth = 0
+            var nodes = 0
+            var milliseconds = 0
+            var nps = 0
+        }
+
+        struct Report: Encodable {
+            let deviceModel: String
+            let isa: String
+            let threads: Int
+            let hashMB: Int
+            let nodesPerPosition: Int
+            let thermalStateBefore: String
+            var thermalStateAfter = ""
+            var nodes = 0
+            var milliseconds = 0
+            var nps = 0
+            var positions: [Position] = []
+        }
+
+        func thermalState() -> String {
+            switch ProcessInfo.processInfo.thermalState {
+            case .nominal: return "nominal"
+            case .fair: return "fair"
+            case .serious: return "serious"
+            case .critical: return "critical"
+            @unknown default: return "unknown"
+            }
+        }
+
+        var system = utsname()
+        uname(&system)
+        let machine = withUnsafeBytes(of: &system.machine) { bytes in
+            String(decoding: bytes.prefix { $0 != 0 }, as: UTF8.self)
+        }
+
+        let harness = SFEngineHarness()
+        defer { harness.stop() }
+        try await harness.startAndBootstrap()
+
+        harness.send("compiler")
+        let settings = await harness.waitForLine(timeout: 5.0, matching: { $0.hasPrefix("Compilation settings") })
+        let isa = settings?.split(separator: ":", maxSplits: 1).last?.trimmingCharacters(in: .whitespaces)
+
+        var report = Report(
+            deviceModel: ProcessInfo.processInfo.environment["SIMULATOR_MODEL_IDENTIFIER"] ?? machine,
+            isa: isa ?? "unknown",
+            threads: 1,
+            hashMB: 16,
+            nodesPerPosition: 200_000,
+            thermalStateBefore: thermalState()
+        )
+
+        harness.send("bench \(report.hashMB) \(report.threads) \(report.nodesPerPosition) default nodes")
+        let last = await harness.waitForLine(
+            timeout: 600.0,
+            collecting: { line in
+                let fields = line.split(separator: " ").map(String.init)
+                func value(_ key: String) -> Int? {
+                    fields.firstIndex(of: key).flatMap { $0 + 1 < fields.count ? Int(fields[$0 + 1]) : nil }
+                }
+
+                if line.hasPrefix("Position: "), let open = line.firstIndex(of: "(") {
+                    let fen = line[line.index(after: open)...].dropLast()
+                    report.positions.append(Position(fen: String(fen)))
+                } else if line.hasPrefix("info depth "), !report.positions.isEmpty {
+                    let index = report.positions.count - 1
+                    report.positions[index].depth = value("depth") ?? report.positions[index].depth
+                    report.positions[index].nodes = value("nodes") ?? report.positions[index].nodes
+                    report.positions[index].milliseconds = value("time") ?? report.positions[index].milliseconds
+                    report.positions[index].nps = value("nps") ?? report.positions[index].nps
+                } else if let total = fields.last.flatMap({ Int($0) }) {
+                    if line.hasPrefix("Total time (ms)") {
+                        report.milliseconds = total
+                    } else if line.hasPrefix("Nodes searched") {
+                        report.nodes = total
+                    } else if line.hasPrefix("Nodes/second") {
+                        report.nps = total
+                    }
+                }
+            },
+            matching: { $0.hasPrefix("Nodes/second") }
+        )
+        report.thermalStateAfter = thermalState()
+
+        let encoder = JSONEncoder()
+        encoder.outputFormatting = [.prettyPrinted, .sortedKeys]
+        let json = try encoder.encode(report)
+        print("bench report:\n" + String(decoding: json, as: UTF8.self))
+
+        let attachment = XCTAttachment(data: json, uniformTypeIdentifier: "public.json")
+        attachment.name = "bench.json"
+        attachment.lifetime = .keepAlways
+        add(attachment)
+        if let path = ProcessInfo.processInfo.environment["SF_BENCH_JSON"] {
+            try json.write(to: URL(fileURLWithPath: path))
+        }
+
+        XCTAssertNotNil(last)
+        XCTAssertFalse(report.positions.isEmpty)
+        XCTAssertGreaterThan(report.nps, 0)
+        XCTAssertEqual(report.positions.reduce(0) { $0 + $1.nodes }, report.nodes)
+    }
+
+    // Lazy SMP scaling on this device: upstream's bench positions to a fixed
+    // depth at 1, 2, 4, ... threads, up to the performance cores and then all
+    // cores. Time to depth is what extra threads buy; NPS alone overstates it,
+    // since helpers also search nodes the main thread never needed.
+    func testThreadScalingReport() async throws {
+        let harness = SFEngineHarness()
+        defer { harness.stop() }
+        try await harness.startAndBootstrap()
+
+        let cores = ProcessInfo.processInfo.activeProcessorCount
+        var threadCounts = Set(sequence(first: 1, next: { $0 * 2 }).prefix { $0 <= cores })
+        threadCounts.insert(max(1, SFEngine.performanceCoreCount))
+        threadCounts.insert(cores)
+
+        var rows: [String] = []
+        var baselineMs = 0
+        for threads in threadCounts.sorted() {
+            var milliseconds = 0
+            var nodes = 0
+            var nps = 0
+            harness.send("bench 64 \(threads) 13 default depth")
+            let last = await harness.waitForLine(
+                timeout: 900.0,
+                collecting: { line in
+                    guard let total = line.split(separator: " ").last.flatMap({ Int($0) }) else { return }
+                    if line.hasPrefix("Total time (ms)") {
+                        milliseconds = total
+                    } else if line.hasPrefix("Nodes searched") {
+                        nodes = total
+                    } else if line.hasPrefix("Nodes/second") {
+                        nps = total
+                    }
+                },
+                matching: { $0.hasPrefix("Nodes/second") }
+            )
+            XCTAssertNotNil(last)
+            XCTAssertGreaterThan(milliseconds, 0)
+
+            if threads == 1 {
+                baselineMs = milliseconds
+            }
+            let speedup = Double(baselineMs) / Double(max(milliseconds, 1))
+            rows.append(
+                "\(threads) threads: \(milliseconds) ms, \(nodes) nodes, \(nps) nps, "
+                    + "time-to-depth speedup \(String(format: "%.2f", speedup)), "
+                    + "efficiency \(String(format: "%.2f", speedup / Double(threads)))"
+            )
+        }
+
+        print(
+            "Thread scaling (\(SFEngine.performanceCoreCount)P + \(SFEngine.efficiencyCoreCount)E):\n"
+                + rows.joined(separator: "\n")
+        )
+    }
+
+    // Compares ThreadSafeQueue and SPSCQueue behind CommandStreambuf without an engine.
+    func testCommandQueueThroughputComparison() {
+        let result = SFRunCommandQueueBenchmark(200_000)
+        print(String(
+            format: "command queue throughput: ThreadSafeQueue %.0f commands/s, SPSCQueue %.0f commands/s",
+            result.threadSafeQueueCommandsPerSecond,
+            result.spscQueueCommandsPerSecond
+        ))
+        XCTAssertGreaterThan(result.threadSafeQueueCommandsPerSecond, 0)
+        XCTAssertGreaterThan(result.spscQueueCommandsPerSecond, 0)
+    }
+}
+
 final class EmbeddedUCIParityTests: XCTestCase {
     func testEmbeddedUCIStartupLifecycleMatchesVendoredMain() throws {
         let repositoryRoot = try Self.repositoryRoot()
@@ -1196,6 +3562,20 @@ final class EmbeddedUCIParityTests: XCTestCase {
         )
     }
 
+    func testPackedSoakPositionsMatchTextFile() throws {
+        let soak = try Self.repositoryRoot().appendingPathComponent("Resources/Soak")
+        let packed = try Data(contentsOf: soak.appendingPathComponent("positions.bin"))
+        let lines = try String(contentsOf: soak.appendingPathComponent("positions.txt"), encoding: .utf8)
+            .components(separatedBy: .newlines)
+            .filter { !$0.isEmpty && !$0.hasPrefix("#") }
+
+        let length = Int(SFPackedPositionLength)
+        XCTAssertEqual(packed.count, lines.count * length)
+        for offset in stride(from: 0, to: packed.count, by: length) {
+            XCTAssertNoThrow(try SFEngine.fen(packedPosition: packed.subdata(in: offset..<offset + length)))
+        }
+    }
+
     private static func repositoryRoot(filePath: String = #filePath) throws -> URL {
         var url = URL(fileURLWithPath: filePath)
         for _ in 0..<3 {
@@ -1209,6 +3589,17 @@ final class EmbeddedUCIParityTests: XCTestCase {
         return url
     }
 
+    private static let shimOnlyStartupMarkers = [
+        "std::once_flag",
+        "std::call_once",
+        "});",
+        "std::lock_guard",
+        "std::unique_ptr<EmbeddedUCIEngine> uci;",
+        "optionsListing(",
+        "steady_clock",
+        "startup",
+    ]
+
     private static func extractStartupLifecycle(from source: String) -> [String] {
         var lifecycle: [String] = []
         var isCapturing = false
@@ -1219,7 +3610,7 @@ final class EmbeddedUCIParityTests: XCTestCase {
                 continue
             }
 
-            if line.contains("std::cout << engine_info()") {
+            if line.contains("std::cout << engine_info()") || line.contains("banner.write(engine_info())") {
                 isCapturing = true
                 lifecycle.append("engine_info banner")
                 continue
@@ -1233,7 +3624,7 @@ final class EmbeddedUCIParityTests: XCTestCase {
                 lifecycle.append("Bitboards::init")
             } else if line.contains("Position::init()") {
                 lifecycle.append("Position::init")
-            } else if line.contains("std::make_unique<UCIEngine>") {
+            } else if line.range(of: #"std::make_unique<(Embedded)?UCIEngine>"#, options: .regularExpression) != nil {
                 lifecycle.append("UCIEngine heap construction")
             } else if line.range(of: #"^UCIEngine\s+\w+\("#, options: .regularExpression) != nil {
                 lifecycle.append("UCIEngine stack construction")
@@ -1248,6 +3639,9 @@ final class EmbeddedUCIParityTests: XCTestCase {
                         || line == "}"
                         || line.contains("argv") {
                 continue
+            } else if Self.shimOnlyStartupMarkers.contains(where: { line.contains($0) }) {
+                // One-time table setup, serialized engine construction, and startup timing are shim plumbing.
+                continue
             } else {
                 // Preserve unknown setup statements so upstream additions fail until mirrored here.
                 lifecycle.append(line)